@@ -0,0 +1,147 @@
+// 声明映射基准：比较原先的 if/else contains() 链与 ClaimMapper
+// 构建：cmake -DBUILD_BENCHMARKS=ON，运行 ./claimmapper_benchmark [迭代次数]
+#include "claimmapper.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QVariantMap>
+
+namespace {
+
+QJsonObject sampleUserInfo()
+{
+    QJsonObject claims;
+    claims["http://schemas.xmlsoap.org/ws/2005/05/identity/claims/nameidentifier"] = "10086";
+    claims["http://schemas.xmlsoap.org/ws/2005/05/identity/claims/name"] = "zhangsan";
+    claims["http://schemas.xmlsoap.org/ws/2005/05/identity/claims/emailaddress"] = "zhangsan@example.com";
+    claims["http://schemas.microsoft.com/ws/2008/06/identity/claims/role"] = "admin";
+    claims["portrait"] = "/uploads/avatar/10086.png";
+    claims["iss"] = "http://192.168.1.12:9007";
+    claims["aud"] = "10001";
+    claims["iat"] = 1700000000;
+    claims["exp"] = 1700003600;
+    claims["nbf"] = 1700000000;
+    claims["amr"] = QJsonArray{ "pwd" };
+    claims["auth_time"] = 1700000000;
+    return claims;
+}
+
+// 原先 onUserInfoRequestFinished 中的提取方式
+QVariantMap legacyExtract(const QJsonObject &userObj)
+{
+    QVariantMap authData;
+    QString userId, username, email, role, portrait;
+
+    if (userObj.contains("sub")) {
+        userId = userObj["sub"].toString();
+    } else if (userObj.contains("http://schemas.xmlsoap.org/ws/2005/05/identity/claims/nameidentifier")) {
+        userId = userObj["http://schemas.xmlsoap.org/ws/2005/05/identity/claims/nameidentifier"].toString();
+    } else if (userObj.contains("id")) {
+        userId = userObj["id"].toString();
+    } else if (userObj.contains("user_id")) {
+        userId = userObj["user_id"].toString();
+    }
+
+    if (userObj.contains("http://schemas.xmlsoap.org/ws/2005/05/identity/claims/name")) {
+        username = userObj["http://schemas.xmlsoap.org/ws/2005/05/identity/claims/name"].toString();
+    } else if (userObj.contains("name")) {
+        username = userObj["name"].toString();
+    } else if (userObj.contains("username")) {
+        username = userObj["username"].toString();
+    } else if (userObj.contains("login")) {
+        username = userObj["login"].toString();
+    } else if (userObj.contains("preferred_username")) {
+        username = userObj["preferred_username"].toString();
+    }
+
+    if (userObj.contains("email")) {
+        email = userObj["email"].toString();
+    } else if (userObj.contains("http://schemas.xmlsoap.org/ws/2005/05/identity/claims/emailaddress")) {
+        email = userObj["http://schemas.xmlsoap.org/ws/2005/05/identity/claims/emailaddress"].toString();
+    } else if (userObj.contains("mail")) {
+        email = userObj["mail"].toString();
+    }
+
+    if (userObj.contains("http://schemas.microsoft.com/ws/2008/06/identity/claims/role")) {
+        role = userObj["http://schemas.microsoft.com/ws/2008/06/identity/claims/role"].toString();
+    } else if (userObj.contains("role")) {
+        role = userObj["role"].toString();
+    } else if (userObj.contains("roles")) {
+        role = userObj["roles"].toString();
+    }
+
+    if (userObj.contains("portrait")) {
+        portrait = userObj["portrait"].toString();
+    } else if (userObj.contains("picture")) {
+        portrait = userObj["picture"].toString();
+    } else if (userObj.contains("avatar")) {
+        portrait = userObj["avatar"].toString();
+    }
+
+    authData["user_id"] = userId;
+    authData["username"] = username;
+    authData["email"] = email;
+    authData["role"] = role;
+    authData["portrait"] = portrait;
+
+    QStringList jwtFields = {"iss", "aud", "iat", "exp", "nbf"};
+    for (const QString &field : jwtFields) {
+        if (userObj.contains(field)) {
+            authData[field] = userObj[field].toVariant();
+        }
+    }
+    return authData;
+}
+
+template <typename Function>
+double nanosecondsPerCall(int iterations, Function function)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; ++i) {
+        function();
+    }
+    return double(timer.nsecsElapsed()) / iterations;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    int iterations = argc > 1 ? QByteArray(argv[1]).toInt() : 200000;
+    if (iterations <= 0) {
+        iterations = 200000;
+    }
+
+    const QJsonObject claims = sampleUserInfo();
+    const ClaimMapper mapper;
+    QTextStream out(stdout);
+
+    // 结果一致性检查
+    QVariantMap legacy = legacyExtract(claims);
+    QVariantMap mapped = mapper.map(claims);
+    for (const QString &field : mapper.fields()) {
+        if (legacy.value(field).toString() != mapped.value(field).toString()) {
+            out << "mismatch for " << field << ": " << legacy.value(field).toString()
+                << " vs " << mapped.value(field).toString() << "\n";
+            return 1;
+        }
+    }
+
+    int sink = 0;
+    double legacyNs = nanosecondsPerCall(iterations, [&]() { sink += legacyExtract(claims).size(); });
+    double mapperNs = nanosecondsPerCall(iterations, [&]() { sink += mapper.map(claims).size(); });
+    double compileNs = nanosecondsPerCall(iterations / 100 + 1, [&]() {
+        sink += ClaimMapper(ClaimMapper::mappingsFromSettings({})).fields().size();
+    });
+
+    out << "iterations:        " << iterations << "\n";
+    out << "if/else chains:    " << legacyNs << " ns/call\n";
+    out << "ClaimMapper::map:  " << mapperNs << " ns/call\n";
+    out << "table compile:     " << compileNs << " ns (once per configuration load)\n";
+    out << "(sink " << sink << ")\n";
+    return 0;
+}
@@ -99,6 +99,9 @@ mkdir -p "${PACKAGE_DIR}/usr/share/accounts/providers/kde"
 mkdir -p "${PACKAGE_DIR}/usr/share/accounts/services/kde"
 mkdir -p "${PACKAGE_DIR}/usr/share/doc/${PROJECT_NAME}"
 mkdir -p "${PACKAGE_DIR}/usr/bin"
+mkdir -p "${PACKAGE_DIR}/usr/lib/systemd/user"
+mkdir -p "${PACKAGE_DIR}/usr/share/dbus-1/services"
+mkdir -p "${PACKAGE_DIR}/usr/include"
 
 # 读取当前control文件内容（如果存在）
 echo -e "${YELLOW}📝 创建control文件...${NC}"
@@ -114,7 +117,7 @@ Version: ${VERSION}
 Section: kde
 Priority: optional
 Architecture: ${ARCHITECTURE}
-Depends: libqt5core5t64, libqt5network5t64, libqt5widgets5t64, libqt5gui5t64, libkaccounts2, libkf5i18n5
+Depends: libqt5core5t64, libqt5concurrent5t64, libqt5network5t64, libqt5dbus5t64, libqt5widgets5t64, libqt5gui5t64, libkaccounts2, libkf5i18n5, libsqlite3-0
 Maintainer: KDE OAuth2 Plugin Developer <connwap135@vip.qq.com>
 Description: KDE Online Accounts OAuth2 Plugin
  A custom OAuth2 authentication plugin for KDE Online Accounts system.
@@ -140,6 +143,9 @@ cat > "${PACKAGE_DIR}/DEBIAN/postinst" << 'EOF'
 
 echo "Configuring kde-oauth2-plugin..."
 
+# 注册 libkdeoauth2-client
+ldconfig || true
+
 # 重启KDE相关服务
 if pgrep -x "kded5" > /dev/null; then
     echo "Restarting kded5 service..."
@@ -194,15 +200,27 @@ echo "复制插件文件..."
 cp "$BUILD_DIR/gzweibo_oauth2_plugin.so" "${PACKAGE_DIR}/usr/lib/x86_64-linux-gnu/qt5/plugins/kaccounts/ui/"
 cp "src/kdeoauth2plugin.json" "${PACKAGE_DIR}/usr/lib/x86_64-linux-gnu/qt5/plugins/kaccounts/ui/gzweibo_oauth2_plugin.so.json"
 
+# 复制令牌代理
+echo "复制令牌代理..."
+cp "$BUILD_DIR/kde-oauth2-broker" "${PACKAGE_DIR}/usr/bin/"
+cp "kde-oauth2-broker.service" "${PACKAGE_DIR}/usr/lib/systemd/user/"
+cp "org.kde.kaccounts.OAuth2Broker.service" "${PACKAGE_DIR}/usr/share/dbus-1/services/"
+
+# 复制命令行工具
+echo "复制命令行工具..."
+cp "$BUILD_DIR/kde-oauth2-cli" "${PACKAGE_DIR}/usr/bin/"
+cp "$BUILD_DIR/kde-oauth2-token" "${PACKAGE_DIR}/usr/bin/"
+
+# 复制客户端库
+echo "复制客户端库..."
+cp -P "$BUILD_DIR"/libkdeoauth2-client.so* "${PACKAGE_DIR}/usr/lib/x86_64-linux-gnu/"
+cp "src/client/kdeoauth2client.h" "${PACKAGE_DIR}/usr/include/"
+
 # 复制配置文件
 echo "复制配置文件..."
 cp "gzweibo-oauth2.provider" "${PACKAGE_DIR}/usr/share/accounts/providers/kde/"
 cp gzweibo-oauth2*.service "${PACKAGE_DIR}/usr/share/accounts/services/kde/"
 
-# 复制工具脚本
-echo "复制工具脚本..."
-cp "get_oauth_token.sh" "${PACKAGE_DIR}/usr/bin/kde-oauth2-token"
-
 # 复制文档
 echo "复制文档..."
 cp readme.md "${PACKAGE_DIR}/usr/share/doc/${PROJECT_NAME}/"
@@ -276,6 +294,8 @@ find "${PACKAGE_DIR}" -type d -exec chmod 755 {} \;
 # 可执行文件权限
 chmod 755 "${PACKAGE_DIR}/usr/lib/x86_64-linux-gnu/qt5/plugins/kaccounts/ui/gzweibo_oauth2_plugin.so"
 chmod 755 "${PACKAGE_DIR}/usr/bin/kde-oauth2-token"
+chmod 755 "${PACKAGE_DIR}/usr/bin/kde-oauth2-broker"
+chmod 755 "${PACKAGE_DIR}/usr/bin/kde-oauth2-cli"
 chmod 755 "${PACKAGE_DIR}/DEBIAN/postinst"
 chmod 755 "${PACKAGE_DIR}/DEBIAN/prerm"
 
@@ -0,0 +1,156 @@
+#include "accountdatabase.h"
+#include <QDir>
+#include <QStandardPaths>
+#include <sqlite3.h>
+
+namespace {
+
+// 一次查询读出账户 ID 和令牌相关设置；LEFT JOIN 保证账户存在但没有设置时也能返回账户 ID
+const char *const LatestAccountQuery =
+    "SELECT a.id, s.key, s.value FROM Accounts a "
+    "LEFT JOIN Settings s ON s.account = a.id "
+    "AND s.key IN ('access_token', 'refresh_token', 'expires_at', 'server', 'username') "
+    "WHERE a.id = (SELECT id FROM Accounts WHERE provider = ?1 AND enabled = 1 ORDER BY id DESC LIMIT 1)";
+
+const char *const AccountQuery =
+    "SELECT a.id, s.key, s.value FROM Accounts a "
+    "LEFT JOIN Settings s ON s.account = a.id "
+    "AND s.key IN ('access_token', 'refresh_token', 'expires_at', 'server', 'username') "
+    "WHERE a.id = ?2 AND a.provider = ?1";
+
+QByteArray columnBytes(sqlite3_stmt *statement, int column)
+{
+    const void *data = sqlite3_column_blob(statement, column);
+    int size = sqlite3_column_bytes(statement, column);
+    return data ? QByteArray(static_cast<const char *>(data), size) : QByteArray();
+}
+
+} // namespace
+
+QString AccountDatabase::defaultPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation)
+        + QStringLiteral("/libaccounts-glib/accounts.db");
+}
+
+bool AccountDatabase::readToken(const QString &path, const QString &providerId, quint32 accountId,
+                                TokenRecord *record, QString *error)
+{
+    sqlite3 *db = nullptr;
+    // 只读打开，不创建数据库，也不会触发 WAL 检查点之类的写操作
+    if (sqlite3_open_v2(QDir::toNativeSeparators(path).toUtf8().constData(), &db,
+                        SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+        *error = QString("无法打开账户数据库 %1：%2").arg(path, QString::fromUtf8(sqlite3_errmsg(db)));
+        sqlite3_close(db);
+        return false;
+    }
+    sqlite3_busy_timeout(db, BusyTimeoutMs);
+
+    sqlite3_stmt *statement = nullptr;
+    const char *sql = accountId > 0 ? AccountQuery : LatestAccountQuery;
+    if (sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) != SQLITE_OK) {
+        *error = QString("账户数据库查询失败：%1").arg(QString::fromUtf8(sqlite3_errmsg(db)));
+        sqlite3_close(db);
+        return false;
+    }
+    QByteArray provider = providerId.toUtf8();
+    sqlite3_bind_text(statement, 1, provider.constData(), provider.size(), SQLITE_TRANSIENT);
+    if (accountId > 0) {
+        sqlite3_bind_int64(statement, 2, accountId);
+    }
+
+    *record = TokenRecord();
+    int rc;
+    while ((rc = sqlite3_step(statement)) == SQLITE_ROW) {
+        record->accountId = quint32(sqlite3_column_int64(statement, 0));
+        if (sqlite3_column_type(statement, 1) == SQLITE_NULL) {
+            continue;
+        }
+        QByteArray key = columnBytes(statement, 1);
+        QByteArray value = columnBytes(statement, 2);
+        if (key == "access_token") {
+            record->accessToken = decodeString(value);
+        } else if (key == "refresh_token") {
+            record->refreshToken = decodeString(value);
+        } else if (key == "expires_at") {
+            record->expiresAt = decodeInteger(value);
+        } else if (key == "server") {
+            record->server = decodeString(value);
+        } else if (key == "username") {
+            record->username = decodeString(value);
+        }
+    }
+    if (rc != SQLITE_DONE) {
+        *error = QString("读取账户数据库失败：%1").arg(QString::fromUtf8(sqlite3_errmsg(db)));
+    }
+    sqlite3_finalize(statement);
+    sqlite3_close(db);
+
+    if (rc != SQLITE_DONE) {
+        return false;
+    }
+    if (record->accountId == 0) {
+        *error = accountId > 0 ? QString("账户 %1 不存在或不属于 %2").arg(accountId).arg(providerId)
+                               : QString("未找到启用的 %1 账户").arg(providerId);
+        return false;
+    }
+    return true;
+}
+
+QString AccountDatabase::decodeString(const QByteArray &text)
+{
+    QByteArray value = text.trimmed();
+    if (value.size() < 2 || (value.at(0) != '\'' && value.at(0) != '"') || value.at(value.size() - 1) != value.at(0)) {
+        return QString::fromUtf8(value);
+    }
+
+    QString result;
+    QByteArray pending;   // 尚未转换的 UTF-8 字节
+    for (int i = 1; i < value.size() - 1; ++i) {
+        char c = value.at(i);
+        if (c != '\\' || i + 1 >= value.size() - 1) {
+            pending.append(c);
+            continue;
+        }
+        char escaped = value.at(++i);
+        switch (escaped) {
+        case 'n': pending.append('\n'); break;
+        case 't': pending.append('\t'); break;
+        case 'r': pending.append('\r'); break;
+        case 'b': pending.append('\b'); break;
+        case 'f': pending.append('\f'); break;
+        case 'v': pending.append('\v'); break;
+        case 'u':
+        case 'U': {
+            int digits = escaped == 'u' ? 4 : 8;
+            bool ok = false;
+            uint codePoint = value.mid(i + 1, digits).toUInt(&ok, 16);
+            if (!ok) {
+                pending.append(escaped);
+                break;
+            }
+            result += QString::fromUtf8(pending);
+            pending.clear();
+            result += QString::fromUcs4(&codePoint, 1);
+            i += digits;
+            break;
+        }
+        default:
+            pending.append(escaped);   // \' \" \\
+            break;
+        }
+    }
+    result += QString::fromUtf8(pending);
+    return result;
+}
+
+qint64 AccountDatabase::decodeInteger(const QByteArray &text)
+{
+    // 可能带类型注解，例如 "int64 1700000000"
+    QByteArray value = text.trimmed();
+    int space = value.lastIndexOf(' ');
+    if (space >= 0) {
+        value = value.mid(space + 1);
+    }
+    return value.toLongLong();
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <QByteArray>
+#include <QString>
+
+// libaccounts-glib 账户数据库的只读访问
+// 给命令行工具取令牌用的快速路径：不经过 Accounts::Manager、DBus 和网络，
+// 一条查询读出账户的令牌相关设置。写入仍然只能通过 Accounts-Qt 进行。
+class AccountDatabase
+{
+public:
+    static constexpr int BusyTimeoutMs = 200;   // 插件或代理正在写入时的等待上限
+
+    struct TokenRecord {
+        quint32 accountId = 0;
+        QString accessToken;
+        QString refreshToken;
+        QString server;
+        QString username;
+        qint64 expiresAt = 0;   // 秒，0 表示未知
+    };
+
+    // $XDG_CONFIG_HOME/libaccounts-glib/accounts.db
+    static QString defaultPath();
+
+    // accountId 为 0 时取该 provider 最新的已启用账户。
+    // 找不到账户或数据库无法读取时返回 false 并设置 error
+    static bool readToken(const QString &path, const QString &providerId, quint32 accountId,
+                          TokenRecord *record, QString *error);
+
+    // 设置值以 GVariant 文本格式保存，例如 'abc'、int64 1700000000
+    static QString decodeString(const QByteArray &text);
+    static qint64 decodeInteger(const QByteArray &text);
+};
@@ -0,0 +1,128 @@
+#include "accountstore.h"
+#include <QElapsedTimer>
+#include <QMetaObject>
+#include <QPointer>
+#include <Accounts/Account>
+#include <Accounts/Manager>
+#include <memory>
+
+// 工作线程中的执行者，Manager 在首次查询时于工作线程内创建，也在工作线程内销毁
+class AccountStore::Executor : public QObject
+{
+public:
+    Accounts::Manager *manager()
+    {
+        if (!m_manager) {
+            m_manager.reset(new Accounts::Manager);
+        }
+        return m_manager.get();
+    }
+
+private:
+    std::unique_ptr<Accounts::Manager> m_manager;
+};
+
+AccountStore::AccountStore(QObject *parent)
+    : QObject(parent)
+    , m_executor(new Executor)
+{
+    m_thread.setObjectName("AccountStore");
+    m_executor->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_executor, &QObject::deleteLater);
+    m_thread.start();
+}
+
+AccountStore::~AccountStore()
+{
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void AccountStore::listAccounts(const QString &providerId, QObject *context, const AccountsCallback &callback)
+{
+    post([providerId](Accounts::Manager *manager) {
+        QVariantList accounts;
+        const Accounts::AccountIdList ids = manager->accountList();
+        for (Accounts::AccountId id : ids) {
+            std::unique_ptr<Accounts::Account> account(manager->account(id));
+            if (!account || account->providerName() != providerId) {
+                continue;
+            }
+            QVariantMap entry;
+            entry["id"] = quint32(id);
+            entry["displayName"] = account->displayName();
+            entry["enabled"] = account->enabled();
+            accounts.append(entry);
+        }
+        return QVariant(accounts);
+    }, context, [callback](const QVariant &result) {
+        callback(result.toList());
+    });
+}
+
+void AccountStore::findAccount(const QString &providerId, const QString &key, const QVariant &value,
+                               QObject *context, const AccountIdCallback &callback)
+{
+    post([providerId, key, value](Accounts::Manager *manager) {
+        const Accounts::AccountIdList ids = manager->accountList();
+        for (Accounts::AccountId id : ids) {
+            std::unique_ptr<Accounts::Account> account(manager->account(id));
+            if (account && account->providerName() == providerId && account->value(key) == value) {
+                return QVariant(quint32(id));
+            }
+        }
+        return QVariant(quint32(0));
+    }, context, [callback](const QVariant &result) {
+        callback(result.toUInt());
+    });
+}
+
+int AccountStore::enabledCount(const QVariantList &accounts)
+{
+    int count = 0;
+    for (const QVariant &account : accounts) {
+        if (account.toMap().value("enabled").toBool()) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+QVariantMap AccountStore::statistics() const
+{
+    quint64 posted = m_posted.load();
+    quint64 completed = m_completed.load();
+
+    QVariantMap stats;
+    stats["posted"] = posted;
+    stats["completed"] = completed;
+    stats["pending"] = posted - completed;
+    stats["maxLatencyMs"] = m_maxLatencyMs.load();
+    return stats;
+}
+
+void AccountStore::post(const Query &query, QObject *context, const std::function<void(const QVariant &)> &callback)
+{
+    ++m_posted;
+    QElapsedTimer timer;
+    timer.start();
+
+    // 回调经由本对象回到所属线程，再检查 context 是否仍然存在
+    QPointer<QObject> guard(context);
+    Executor *executor = m_executor;
+    QMetaObject::invokeMethod(executor, [this, executor, query, guard, callback, timer]() {
+        QVariant result = query(executor->manager());
+
+        qint64 latency = timer.elapsed();
+        qint64 previous = m_maxLatencyMs.load();
+        while (latency > previous && !m_maxLatencyMs.compare_exchange_weak(previous, latency)) {
+        }
+        ++m_completed;
+
+        QMetaObject::invokeMethod(this, [guard, callback, result]() {
+            if (guard) {
+                callback(result);
+            }
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
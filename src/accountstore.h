@@ -0,0 +1,53 @@
+#pragma once
+#include <QObject>
+#include <QThread>
+#include <QVariant>
+#include <QVariantList>
+#include <QVariantMap>
+#include <atomic>
+#include <functional>
+
+namespace Accounts {
+class Manager;
+}
+
+// 账户存储查询线程
+// Accounts-Qt 的全量扫描需要逐个加载账户，账户较多时会阻塞对话框和 DBus 分发。
+// 只读查询在专用线程中执行，该线程持有自己的 Accounts::Manager，
+// 结果以排队调用的方式回到本对象所在线程（context 应与本对象同线程），context 已销毁时结果被丢弃。
+// 写入（setValue/sync）仍由调用者在自己的线程完成。
+class AccountStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    // 账户摘要列表，每项为 QVariantMap：id、displayName、enabled
+    using AccountsCallback = std::function<void(const QVariantList &accounts)>;
+    // 0 表示未找到
+    using AccountIdCallback = std::function<void(quint32 accountId)>;
+
+    explicit AccountStore(QObject *parent = nullptr);
+    ~AccountStore() override;
+
+    void listAccounts(const QString &providerId, QObject *context, const AccountsCallback &callback);
+    // 查找 provider 下设置 key 等于 value 的账户
+    void findAccount(const QString &providerId, const QString &key, const QVariant &value,
+                     QObject *context, const AccountIdCallback &callback);
+
+    static int enabledCount(const QVariantList &accounts);
+
+    QVariantMap statistics() const;
+
+private:
+    class Executor;
+    using Query = std::function<QVariant(Accounts::Manager *manager)>;
+
+    void post(const Query &query, QObject *context, const std::function<void(const QVariant &)> &callback);
+
+    QThread m_thread;
+    Executor *m_executor;
+
+    std::atomic<quint64> m_posted{0};
+    std::atomic<quint64> m_completed{0};
+    std::atomic<qint64> m_maxLatencyMs{0};
+};
@@ -0,0 +1,57 @@
+#include "accountwriter.h"
+#include <Accounts/Account>
+
+QVariantMap AccountWriter::changedValues(Accounts::Account *account, const QVariantMap &values)
+{
+    QVariantMap changed;
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        bool stored = account->contains(it.key());
+        if (!it.value().isValid()) {
+            if (stored) {
+                changed.insert(it.key(), QVariant());
+            }
+            continue;
+        }
+        if (!stored || !sameValue(account->value(it.key()), it.value())) {
+            changed.insert(it.key(), it.value());
+        }
+    }
+    return changed;
+}
+
+QStringList AccountWriter::stage(Accounts::Account *account, const QVariantMap &values, const QString &displayName)
+{
+    const QVariantMap changed = changedValues(account, values);
+    QStringList written;
+    for (auto it = changed.constBegin(); it != changed.constEnd(); ++it) {
+        if (it.value().isValid()) {
+            account->setValue(it.key(), it.value());
+        } else {
+            account->remove(it.key());
+        }
+        written.append(it.key());
+    }
+    if (!displayName.isEmpty() && account->displayName() != displayName) {
+        account->setDisplayName(displayName);
+        written.append("displayName");
+    }
+    return written;
+}
+
+QStringList AccountWriter::write(Accounts::Account *account, const QVariantMap &values, const QString &displayName)
+{
+    const QStringList written = stage(account, values, displayName);
+    if (!written.isEmpty()) {
+        account->sync();
+    }
+    return written;
+}
+
+bool AccountWriter::sameValue(const QVariant &stored, const QVariant &value)
+{
+    // 数据库中的值读回后类型可能不同（例如整数读回为 qint64 或字符串），按文本比较
+    if (stored.type() == QVariant::StringList || value.type() == QVariant::StringList) {
+        return stored.toStringList() == value.toStringList();
+    }
+    return stored.toString() == value.toString();
+}
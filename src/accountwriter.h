@@ -0,0 +1,29 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+namespace Accounts {
+class Account;
+}
+
+// 账户设置的差量写入
+// 定期刷新令牌和用户信息时，大部分设置与已保存的值相同。先与账户中的值逐个比较，
+// 只写入变化的键并只调用一次 sync()：没有变化时不写数据库，也不会通知 libaccounts 的监听者；
+// 只有 access_token 和 expires_at 变化的刷新只改动两行。
+class AccountWriter
+{
+public:
+    // values 中与账户当前值不同的键；无效的 QVariant 表示删除该键（账户中存在时才算变化）
+    static QVariantMap changedValues(Accounts::Account *account, const QVariantMap &values);
+    // 只设置变化的键，不 sync（调用者还要修改其他属性时使用）；displayName 为空时不修改显示名称。
+    // 返回设置的键（显示名称记为 "displayName"），为空表示没有变化
+    static QStringList stage(Accounts::Account *account, const QVariantMap &values,
+                             const QString &displayName = QString());
+    // stage() 后有变化时 sync 一次
+    static QStringList write(Accounts::Account *account, const QVariantMap &values,
+                             const QString &displayName = QString());
+
+private:
+    static bool sameValue(const QVariant &stored, const QVariant &value);
+};
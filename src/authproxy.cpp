@@ -0,0 +1,587 @@
+#include "authproxy.h"
+#include "oauth2config.h"
+#include "providerregistry.h"
+#include "tokenbroker.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+
+constexpr char kContinueResponse[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+bool headerIs(const QByteArray &name, const char *expected)
+{
+    return name.size() == int(qstrlen(expected)) && qstrnicmp(name.constData(), expected, uint(name.size())) == 0;
+}
+
+// 逐跳头和代理自己处理的头不转发
+bool isHopByHop(const QByteArray &name)
+{
+    static const char *const names[] = {
+        "Connection", "Keep-Alive", "Proxy-Connection", "Proxy-Authorization", "Proxy-Authenticate",
+        "TE", "Trailer", "Transfer-Encoding", "Upgrade", "Host", "Content-Length", "Expect",
+    };
+    for (const char *hopByHop : names) {
+        if (headerIs(name, hopByHop)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 长度相同时逐字节比较全部内容，耗时与密钥内容无关
+bool keyMatches(const QByteArray &given, const QByteArray &key)
+{
+    if (given.size() != key.size()) {
+        return false;
+    }
+    unsigned char difference = 0;
+    for (int i = 0; i < key.size(); ++i) {
+        difference |= static_cast<unsigned char>(given[i] ^ key[i]);
+    }
+    return difference == 0;
+}
+
+// 请求缓冲区在下一个请求时复用，保留的内容需要深拷贝
+QByteArray copyOf(const QByteArray &view)
+{
+    return QByteArray(view.constData(), view.size());
+}
+
+QByteArray simpleResponse(int status, const QByteArray &reason, const QByteArray &body, bool keepAlive)
+{
+    QByteArray response;
+    response.reserve(160 + body.size());
+    response.append("HTTP/1.1 ").append(QByteArray::number(status)).append(' ').append(reason);
+    response.append("\r\nContent-Type: text/plain; charset=utf-8\r\nContent-Length: ");
+    response.append(QByteArray::number(body.size()));
+    response.append(keepAlive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n");
+    response.append(body);
+    return response;
+}
+
+} // namespace
+
+AuthProxy::AuthProxy(TokenBroker *broker, QObject *parent)
+    : LoopbackHttpServer(parent)
+    , m_broker(broker)
+{
+    setMaxConnections(MaxConnections);
+    setIdleTimeout(KeepAliveIdleMs);
+
+    // 每次启动生成新的密钥，只写入仅当前用户可读的端点文件
+    quint32 random[8];
+    QRandomGenerator::system()->fillRange(random);
+    m_key = QByteArray(reinterpret_cast<const char *>(random), sizeof(random)).toHex();
+}
+
+AuthProxy::~AuthProxy()
+{
+    for (Exchange *exchange : qAsConst(m_exchanges)) {
+        deleteExchange(exchange);
+    }
+    m_exchanges.clear();
+    if (isListening()) {
+        QFile::remove(endpointFile());
+    }
+}
+
+bool AuthProxy::start(quint16 port)
+{
+    if (!listenLoopback({port})) {
+        qWarning() << "AuthProxy: cannot listen on loopback port" << port;
+        return false;
+    }
+    if (!writeEndpointFile()) {
+        qWarning() << "AuthProxy: cannot write endpoint file" << endpointFile();
+        stopListening();
+        return false;
+    }
+    qDebug() << "AuthProxy: forwarding API requests on port" << serverPort();
+    return true;
+}
+
+QString AuthProxy::endpointFile()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + "/kde-oauth2-proxy.json";
+}
+
+bool AuthProxy::writeEndpointFile() const
+{
+    QSaveFile file(endpointFile());
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+
+    QJsonObject endpoint;
+    endpoint["url"] = QString("http://127.0.0.1:%1").arg(serverPort());
+    endpoint["key"] = QString::fromLatin1(m_key);
+    endpoint["pid"] = QCoreApplication::applicationPid();
+    file.write(QJsonDocument(endpoint).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+QVariantMap AuthProxy::statistics() const
+{
+    QVariantMap stats = LoopbackHttpServer::statistics();
+    stats["endpointFile"] = endpointFile();
+    stats["activeExchanges"] = m_exchanges.size();
+    stats["bufferedBodySize"] = m_bufferedBodySize;
+    stats["forwarded"] = m_forwarded;
+    stats["replayed"] = m_replayed;
+    stats["rejected"] = m_rejected;
+    stats["upstreamErrors"] = m_upstreamErrors;
+    return stats;
+}
+
+AuthProxy::RequestResult AuthProxy::handleRequest(QTcpSocket *socket, const HttpRequestParser &parser)
+{
+    QByteArray key;
+    QByteArray accountValue;
+    QByteArray providerValue;
+    bool expectContinue = false;
+
+    auto *exchange = new Exchange;
+    int cursor = 0;
+    HttpRequestParser::Span name;
+    HttpRequestParser::Span value;
+    while (parser.nextHeader(&cursor, &name, &value)) {
+        QByteArray headerName = parser.view(name);
+        if (headerIs(headerName, KeyHeader)) {
+            key = parser.view(value);
+        } else if (headerIs(headerName, AccountHeader)) {
+            accountValue = parser.view(value);
+        } else if (headerIs(headerName, ProviderHeader)) {
+            providerValue = parser.view(value);
+        } else if (headerIs(headerName, "Authorization")) {
+            // 应用不需要也不应该自己携带令牌
+        } else if (headerIs(headerName, "Expect")) {
+            expectContinue = headerIs(parser.view(value), "100-continue");
+        } else if (!isHopByHop(headerName)) {
+            exchange->headers.append(qMakePair(copyOf(headerName), copyOf(parser.view(value))));
+        }
+    }
+
+    // 请求体尚未读取时出错只能关闭连接
+    qint64 contentLength = 0;
+    bool lengthValid = true;
+    if (!parser.contentLengthHeader().isEmpty()) {
+        contentLength = parser.view(parser.contentLengthHeader()).toLongLong(&lengthValid);
+    }
+    bool keepAlive = parser.keepAlive() && contentLength == 0;
+
+    int status = 0;
+    QByteArray reason;
+    QString message;
+    quint32 accountId = 0;
+    QString providerId = QString::fromUtf8(providerValue);
+    if (!keyMatches(key, m_key)) {
+        ++m_rejected;
+        status = 403;
+        reason = "Forbidden";
+        message = QString("缺少或错误的 %1 请求头").arg(KeyHeader);
+    } else if (!parser.transferEncodingHeader().isEmpty()) {
+        status = 411;
+        reason = "Length Required";
+        message = "不支持分块传输的请求体，请使用 Content-Length";
+        keepAlive = false;
+    } else if (!lengthValid || contentLength < 0) {
+        status = 400;
+        reason = "Bad Request";
+        message = "无效的 Content-Length";
+        keepAlive = false;
+    } else if (contentLength > MaxBodySize) {
+        status = 413;
+        reason = "Payload Too Large";
+        message = QString("请求体超过 %1 字节").arg(MaxBodySize);
+    } else if (m_bufferedBodySize + contentLength > MaxBufferedBodySize) {
+        status = 503;
+        reason = "Service Unavailable";
+        message = "代理缓冲的请求体过多，请稍后重试";
+    } else {
+        bool ok = true;
+        accountId = accountValue.isEmpty() ? 0 : accountValue.toUInt(&ok);
+        if (!ok) {
+            status = 400;
+            reason = "Bad Request";
+            message = QString("无效的 %1 请求头").arg(AccountHeader);
+        } else if (accountId == 0) {
+            if (providerId.isEmpty()) {
+                providerId = QString::fromLatin1(ProviderRegistry::DefaultProviderId);
+            }
+            accountId = m_broker->defaultAccount(providerId);
+            if (accountId == 0) {
+                status = 404;
+                reason = "Not Found";
+                message = QString("provider %1 没有启用的账户").arg(providerId);
+            }
+        }
+    }
+
+    if (status != 0) {
+        delete exchange;
+        socket->write(simpleResponse(status, reason, message.toUtf8(), keepAlive));
+        return keepAlive ? KeepAlive : CloseConnection;
+    }
+
+    QByteArray version = parser.view(parser.version());
+    exchange->method = copyOf(parser.view(parser.method()));
+    exchange->target = copyOf(parser.view(parser.target()));
+    exchange->http11 = version.endsWith('1');
+    exchange->keepAlive = parser.keepAlive();
+    exchange->accountId = accountId;
+    exchange->providerId = providerId;
+    exchange->body = copyOf(parser.bufferedBody().left(int(qMin<qint64>(contentLength, parser.bufferedBody().size()))));
+    exchange->bodyRemaining = contentLength - exchange->body.size();
+    exchange->bodyReserved = contentLength;
+    m_bufferedBodySize += contentLength;
+    m_exchanges.insert(socket, exchange);
+
+    if (exchange->bodyRemaining > 0) {
+        if (expectContinue) {
+            socket->write(kContinueResponse, sizeof(kContinueResponse) - 1);
+        }
+        startDeadline(socket, BodyDeadlineMs);
+        // 解析器只读取了请求头上限大小的数据，已到达的其余部分不会再触发 readyRead
+        if (socket->bytesAvailable() > 0) {
+            requestDataAvailable(socket);
+        }
+        return Pending;
+    }
+    acquireToken(socket, false);
+    return Pending;
+}
+
+void AuthProxy::requestDataAvailable(QTcpSocket *socket)
+{
+    Exchange *exchange = m_exchanges.value(socket);
+    if (!exchange) {
+        LoopbackHttpServer::requestDataAvailable(socket);
+        return;
+    }
+    if (exchange->bodyRemaining == 0) {
+        // 下一个请求留在套接字中，当前响应结束后再处理
+        return;
+    }
+
+    QByteArray data = socket->read(qMin(socket->bytesAvailable(), exchange->bodyRemaining));
+    exchange->body.append(data);
+    exchange->bodyRemaining -= data.size();
+    if (exchange->bodyRemaining == 0) {
+        stopDeadline(socket);
+        acquireToken(socket, false);
+    }
+}
+
+void AuthProxy::connectionClosing(QTcpSocket *socket)
+{
+    // 客户端断开时放弃上游请求
+    if (Exchange *exchange = m_exchanges.take(socket)) {
+        deleteExchange(exchange);
+    }
+}
+
+void AuthProxy::acquireToken(QTcpSocket *socket, bool forceRefresh)
+{
+    Exchange *exchange = m_exchanges.value(socket);
+    QPointer<QTcpSocket> guard(socket);
+    m_broker->requestToken(exchange->accountId, forceRefresh, [this, guard, exchange](const QVariantMap &token, const QString &error) {
+        if (!guard || m_exchanges.value(guard) != exchange) {
+            return;   // 客户端已断开
+        }
+        if (token.isEmpty()) {
+            // 重放前刷新失败时保留 401 语义，应用可以提示重新认证
+            if (exchange->replayed) {
+                respondError(guard, 401, "Unauthorized", error);
+            } else {
+                respondError(guard, 503, "Service Unavailable", error);
+            }
+            return;
+        }
+        sendUpstream(guard, token);
+    });
+}
+
+void AuthProxy::sendUpstream(QTcpSocket *socket, const QVariantMap &token)
+{
+    Exchange *exchange = m_exchanges.value(socket);
+    exchange->providerId = token.value("provider").toString();
+    exchange->accessToken = token.value("access_token").toString();
+
+    ProviderContext *provider = m_broker->registry()->provider(exchange->providerId);
+    if (!provider) {
+        respondError(socket, 502, "Bad Gateway", QString("provider %1 不存在").arg(exchange->providerId));
+        return;
+    }
+
+    // API 服务器默认与认证服务器相同，可以在 provider 文件的 proxy 组中单独配置
+    OAuth2Config::SnapshotPtr config = provider->config()->snapshot();
+    QString upstream = config->value("proxy/upstream");
+    if (upstream.isEmpty()) {
+        upstream = config->serverUrl;
+    }
+    while (upstream.endsWith('/')) {
+        upstream.chop(1);
+    }
+    QUrl url = QUrl::fromEncoded(upstream.toUtf8() + exchange->target, QUrl::StrictMode);
+    if (!url.isValid() || url.scheme().isEmpty()) {
+        respondError(socket, 502, "Bad Gateway", QString("无效的上游地址：%1").arg(upstream));
+        return;
+    }
+
+    QNetworkRequest request(url);
+    bool hasAcceptEncoding = false;
+    for (const auto &header : qAsConst(exchange->headers)) {
+        QByteArray value = header.second;
+        if (request.hasRawHeader(header.first)) {
+            // 同名请求头合并为一行
+            value = request.rawHeader(header.first) + (headerIs(header.first, "Cookie") ? "; " : ", ") + value;
+        }
+        request.setRawHeader(header.first, value);
+        hasAcceptEncoding = hasAcceptEncoding || headerIs(header.first, "Accept-Encoding");
+    }
+    if (!hasAcceptEncoding) {
+        // 否则 QNetworkAccessManager 会自动请求 gzip 并解压，与转发的响应头不一致
+        request.setRawHeader("Accept-Encoding", "identity");
+    }
+    request.setRawHeader("Authorization", "Bearer " + exchange->accessToken.toUtf8());
+
+    QNetworkAccessManager *manager = provider->networkManager();
+    QNetworkReply *reply;
+    if (exchange->method == "HEAD") {
+        reply = manager->head(request);
+    } else if (exchange->body.isEmpty()) {
+        reply = manager->sendCustomRequest(request, exchange->method);
+    } else {
+        reply = manager->sendCustomRequest(request, exchange->method, exchange->body);
+    }
+    // 读缓冲区满后 QNetworkReply 停止从上游连接接收，背压经 TCP 传到上游
+    reply->setReadBufferSize(MaxPendingWrite);
+    exchange->reply = reply;
+    ++m_forwarded;
+
+    QPointer<QTcpSocket> guard(socket);
+    // 应用取走数据后继续转发；以 reply 为上下文，回复释放后连接随之断开
+    connect(socket, &QTcpSocket::bytesWritten, reply, [this, guard]() {
+        if (guard) {
+            onUpstreamData(guard);
+        }
+    });
+    connect(reply, &QNetworkReply::metaDataChanged, this, [this, guard]() {
+        if (guard) {
+            onUpstreamMetaData(guard);
+        }
+    });
+    connect(reply, &QNetworkReply::readyRead, this, [this, guard]() {
+        if (guard) {
+            onUpstreamData(guard);
+        }
+    });
+    connect(reply, &QNetworkReply::finished, this, [this, guard]() {
+        if (guard) {
+            onUpstreamFinished(guard);
+        }
+    });
+}
+
+void AuthProxy::onUpstreamMetaData(QTcpSocket *socket)
+{
+    Exchange *exchange = m_exchanges.value(socket);
+    if (!exchange || !exchange->reply || exchange->headersSent) {
+        return;
+    }
+    QNetworkReply *reply = exchange->reply;
+    QVariant statusAttribute = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+    if (!statusAttribute.isValid()) {
+        return;   // 尚未收到状态行
+    }
+    int status = statusAttribute.toInt();
+    if (status == 401 && !exchange->replayed) {
+        retryUnauthorized(socket);
+        return;
+    }
+
+    bool bodyless = exchange->method == "HEAD" || status == 204 || status == 304 || status < 200;
+    exchange->chunked = !bodyless && exchange->http11;
+    if (!bodyless && !exchange->http11) {
+        // HTTP/1.0 客户端不支持分块编码，以关闭连接结束响应体
+        exchange->keepAlive = false;
+    }
+
+    QByteArray head;
+    head.reserve(1024);
+    head.append("HTTP/1.1 ").append(QByteArray::number(status)).append(' ');
+    head.append(reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute).toByteArray()).append("\r\n");
+    for (const auto &header : reply->rawHeaderPairs()) {
+        // HEAD 响应的 Content-Length 描述的是 GET 响应体，原样转发
+        bool headLength = exchange->method == "HEAD" && headerIs(header.first, "Content-Length");
+        if (isHopByHop(header.first) && !headLength) {
+            continue;
+        }
+        // QNetworkReply 把多个同名响应头（例如 Set-Cookie）用换行合并
+        for (const QByteArray &value : header.second.split('\n')) {
+            head.append(header.first).append(": ").append(value).append("\r\n");
+        }
+    }
+    if (exchange->chunked) {
+        head.append("Transfer-Encoding: chunked\r\n");
+    }
+    head.append(exchange->keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+    socket->write(head);
+    exchange->headersSent = true;
+}
+
+void AuthProxy::onUpstreamData(QTcpSocket *socket)
+{
+    Exchange *exchange = m_exchanges.value(socket);
+    if (!exchange || !exchange->reply) {
+        return;
+    }
+    if (!exchange->headersSent) {
+        onUpstreamMetaData(socket);
+        if (!exchange->reply || !exchange->headersSent) {
+            return;
+        }
+    }
+
+    // 应用读取得慢时套接字的写缓冲区不再增长，剩余数据留在上游回复中，bytesWritten 后继续
+    QNetworkReply *reply = exchange->reply;
+    while (reply->bytesAvailable() > 0 && socket->bytesToWrite() < MaxPendingWrite) {
+        QByteArray data = reply->read(MaxPendingWrite - socket->bytesToWrite());
+        if (data.isEmpty()) {
+            break;
+        }
+        if (exchange->chunked) {
+            socket->write(QByteArray::number(data.size(), 16).append("\r\n"));
+            socket->write(data);
+            socket->write("\r\n", 2);
+        } else {
+            socket->write(data);
+        }
+    }
+    if (exchange->upstreamFinished && reply->bytesAvailable() == 0) {
+        completeExchange(socket);
+    }
+}
+
+void AuthProxy::onUpstreamFinished(QTcpSocket *socket)
+{
+    Exchange *exchange = m_exchanges.value(socket);
+    if (!exchange || !exchange->reply) {
+        return;
+    }
+    QNetworkReply *reply = exchange->reply;
+    if (!exchange->headersSent) {
+        onUpstreamMetaData(socket);
+        if (!exchange->reply) {
+            return;   // 401，正在刷新令牌后重放
+        }
+        if (!exchange->headersSent) {
+            // 没有收到HTTP响应：连接失败、TLS 错误等
+            ++m_upstreamErrors;
+            QString error = reply->errorString();
+            releaseReply(exchange);
+            respondError(socket, 502, "Bad Gateway", error);
+            return;
+        }
+    }
+
+    // HTTP 错误状态码也是完整的响应；网络层错误（< ContentAccessDenied）表示响应体被截断
+    QNetworkReply::NetworkError error = reply->error();
+    exchange->truncated = error != QNetworkReply::NoError && error < QNetworkReply::ContentAccessDenied;
+    if (exchange->truncated) {
+        qDebug() << "AuthProxy: upstream response truncated:" << error;
+    }
+    // 读缓冲区中剩余的数据转发完后才结束响应
+    exchange->upstreamFinished = true;
+    onUpstreamData(socket);
+}
+
+void AuthProxy::completeExchange(QTcpSocket *socket)
+{
+    Exchange *exchange = m_exchanges.value(socket);
+    releaseReply(exchange);
+    if (exchange->truncated) {
+        ++m_upstreamErrors;
+        finishExchange(socket, false);
+        return;
+    }
+    if (exchange->chunked) {
+        socket->write("0\r\n\r\n", 5);
+    }
+    finishExchange(socket, exchange->keepAlive);
+}
+
+void AuthProxy::retryUnauthorized(QTcpSocket *socket)
+{
+    Exchange *exchange = m_exchanges.value(socket);
+    exchange->replayed = true;
+    ++m_replayed;
+    releaseReply(exchange);
+
+    // 并发请求同时收到 401 时只需刷新一次：缓存中已是新令牌则直接重放
+    QString usedToken = exchange->accessToken;
+    QPointer<QTcpSocket> guard(socket);
+    m_broker->requestToken(exchange->accountId, false, [this, guard, exchange, usedToken](const QVariantMap &token, const QString &) {
+        if (!guard || m_exchanges.value(guard) != exchange) {
+            return;
+        }
+        if (!token.isEmpty() && token.value("access_token").toString() != usedToken) {
+            sendUpstream(guard, token);
+            return;
+        }
+        acquireToken(guard, true);
+    });
+}
+
+void AuthProxy::respondError(QTcpSocket *socket, int status, const QByteArray &reason, const QString &message)
+{
+    Exchange *exchange = m_exchanges.value(socket);
+    if (exchange && exchange->headersSent) {
+        // 响应已经开始，只能关闭连接
+        finishExchange(socket, false);
+        return;
+    }
+    qDebug() << "AuthProxy:" << status << message;
+    bool keepAlive = exchange && exchange->keepAlive && exchange->bodyRemaining == 0;
+    socket->write(simpleResponse(status, reason, message.toUtf8(), keepAlive));
+    finishExchange(socket, keepAlive);
+}
+
+void AuthProxy::finishExchange(QTcpSocket *socket, bool keepAlive)
+{
+    if (Exchange *exchange = m_exchanges.take(socket)) {
+        deleteExchange(exchange);
+    }
+    finishRequest(socket, keepAlive);
+}
+
+void AuthProxy::deleteExchange(Exchange *exchange)
+{
+    releaseReply(exchange);
+    m_bufferedBodySize -= exchange->bodyReserved;
+    delete exchange;
+}
+
+void AuthProxy::releaseReply(Exchange *exchange)
+{
+    QNetworkReply *reply = exchange->reply;
+    if (!reply) {
+        return;
+    }
+    exchange->reply = nullptr;
+    // 先断开信号：abort() 会同步发出 finished
+    reply->disconnect(this);
+    reply->abort();
+    reply->deleteLater();
+}
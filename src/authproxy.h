@@ -0,0 +1,96 @@
+#pragma once
+#include "loopbackhttpserver.h"
+#include <QList>
+#include <QPair>
+#include <QPointer>
+
+class QNetworkReply;
+class TokenBroker;
+
+// 本地认证反向代理（kde-oauth2-broker --proxy-port）
+// 应用把 API 请求发到回环地址上的代理，代理从令牌代理的缓存中取令牌并加上
+// Authorization 头，转发到 provider 的 API 服务器；上游返回 401 时刷新一次令牌并重放请求。
+// 上游连接由 provider 的 QNetworkAccessManager 复用（keep-alive 连接池），
+// 所有应用共享同一组连接，应用自身不接触令牌。
+//
+// 请求头：
+//   X-OAuth2-Proxy-Key  必需，与端点文件中的 key 一致（同一台机器上的其他用户也能连接回环地址）
+//   X-OAuth2-Account    可选，账户ID；缺省时使用该 provider 最近添加的账户
+//   X-OAuth2-Provider   可选，provider ID；缺省时使用默认 provider
+// 端点信息（url、key）写入 $XDG_RUNTIME_DIR/kde-oauth2-proxy.json，权限 0600。
+class AuthProxy : public LoopbackHttpServer
+{
+    Q_OBJECT
+
+public:
+    static constexpr int MaxConnections = 64;
+    static constexpr int KeepAliveIdleMs = 60000;      // 应用连接池中的空闲连接保留时间
+    static constexpr int BodyDeadlineMs = 30000;       // 接收请求体的截止时间
+    // 请求体要保留到响应结束（401 后重放），因此单个请求和所有连接缓冲的总量都有上限
+    static constexpr qint64 MaxBodySize = 8 * 1024 * 1024;
+    static constexpr qint64 MaxBufferedBodySize = 64 * 1024 * 1024;
+    static constexpr qint64 MaxPendingWrite = 256 * 1024;   // 写往应用的数据超过此值时暂停读取上游响应
+    static constexpr const char *KeyHeader = "X-OAuth2-Proxy-Key";
+    static constexpr const char *AccountHeader = "X-OAuth2-Account";
+    static constexpr const char *ProviderHeader = "X-OAuth2-Provider";
+
+    explicit AuthProxy(TokenBroker *broker, QObject *parent = nullptr);
+    ~AuthProxy() override;
+
+    // 监听回环端口（0 表示系统分配）并写入端点文件
+    bool start(quint16 port);
+    static QString endpointFile();
+
+    QVariantMap statistics() const override;
+
+protected:
+    RequestResult handleRequest(QTcpSocket *socket, const HttpRequestParser &parser) override;
+    void requestDataAvailable(QTcpSocket *socket) override;
+    void connectionClosing(QTcpSocket *socket) override;
+
+private:
+    // 一个进行中的请求：请求内容保留到响应结束，以便 401 后重放
+    struct Exchange {
+        QByteArray method;
+        QByteArray target;
+        QList<QPair<QByteArray, QByteArray>> headers;   // 转发给上游的请求头
+        QByteArray body;
+        qint64 bodyRemaining = 0;
+        qint64 bodyReserved = 0;   // 计入 m_bufferedBodySize 的大小
+        bool keepAlive = true;
+        bool http11 = true;
+
+        quint32 accountId = 0;
+        QString providerId;
+        QString accessToken;
+        bool replayed = false;
+        bool headersSent = false;
+        bool chunked = false;
+        bool upstreamFinished = false;   // 上游响应已结束，读缓冲区中可能还有数据
+        bool truncated = false;
+        QPointer<QNetworkReply> reply;
+    };
+
+    void acquireToken(QTcpSocket *socket, bool forceRefresh);
+    void sendUpstream(QTcpSocket *socket, const QVariantMap &token);
+    void onUpstreamMetaData(QTcpSocket *socket);
+    void onUpstreamData(QTcpSocket *socket);
+    void onUpstreamFinished(QTcpSocket *socket);
+    void completeExchange(QTcpSocket *socket);
+    void retryUnauthorized(QTcpSocket *socket);
+    void respondError(QTcpSocket *socket, int status, const QByteArray &reason, const QString &message);
+    void finishExchange(QTcpSocket *socket, bool keepAlive);
+    void releaseReply(Exchange *exchange);
+    void deleteExchange(Exchange *exchange);
+    bool writeEndpointFile() const;
+
+    TokenBroker *m_broker;
+    QByteArray m_key;
+    QHash<QTcpSocket *, Exchange *> m_exchanges;
+    qint64 m_bufferedBodySize = 0;
+
+    quint64 m_forwarded = 0;
+    quint64 m_replayed = 0;
+    quint64 m_rejected = 0;
+    quint64 m_upstreamErrors = 0;
+};
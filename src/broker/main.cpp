@@ -0,0 +1,39 @@
+#include "tokenbroker.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+
+// kde-oauth2-broker：常驻的令牌代理
+// 由 systemd 用户服务启动，或在首次调用 org.kde.kaccounts.OAuth2Broker 时由 DBus 激活。
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("kde-oauth2-broker");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("KDE OAuth2 token broker");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption proxyOption("proxy-port", "在回环端口上启动认证反向代理（0 表示由系统分配）", "port");
+    parser.addOption(proxyOption);
+    parser.process(app);
+
+    TokenBroker broker;
+    if (!broker.registerOnBus()) {
+        // 通常是已有实例在运行
+        qWarning() << "kde-oauth2-broker: another instance owns the bus name, exiting";
+        return 1;
+    }
+
+    if (parser.isSet(proxyOption)) {
+        bool ok = false;
+        uint port = parser.value(proxyOption).toUInt(&ok);
+        if (!ok || port > 65535 || !broker.startAuthProxy(quint16(port))) {
+            // 代理不可用时令牌代理照常提供 DBus 服务
+            qWarning() << "kde-oauth2-broker: authentication proxy not started";
+        }
+    }
+
+    return app.exec();
+}
@@ -0,0 +1,94 @@
+#include "brokerclient.h"
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusUnixFileDescriptor>
+#include <QDebug>
+#include <fcntl.h>
+
+template <typename T>
+void BrokerClient::call(const QString &method, const QVariantList &arguments, QObject *context,
+                        const T &fallback, const std::function<void(const T &)> &callback)
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(ServiceName, ObjectPath, InterfaceName, method);
+    message.setArguments(arguments);
+
+    // 监视器挂在 context 上，context 先销毁时回调随之取消
+    QDBusPendingCall pending = QDBusConnection::sessionBus().asyncCall(message, CallTimeoutMs);
+    auto *watcher = new QDBusPendingCallWatcher(pending, context);
+    QObject::connect(watcher, &QDBusPendingCallWatcher::finished, watcher, [watcher, method, fallback, callback]() {
+        QDBusPendingReply<T> reply = *watcher;
+        watcher->deleteLater();
+        if (reply.isError()) {
+            qDebug() << "BrokerClient:" << method << "failed:" << reply.error().name() << reply.error().message();
+            callback(fallback);
+            return;
+        }
+        callback(reply.value());
+    });
+}
+
+void BrokerClient::refreshToken(quint32 accountId, QObject *context, const std::function<void(bool ok)> &callback)
+{
+    call<bool>("refreshToken", {accountId}, context, false, callback);
+}
+
+void BrokerClient::hasRole(quint32 accountId, const QString &role, QObject *context,
+                           const std::function<void(bool hasRole)> &callback)
+{
+    call<bool>("hasRole", {accountId, role}, context, false, callback);
+}
+
+void BrokerClient::accountsWithRole(const QString &role, const QString &providerId, QObject *context,
+                                    const std::function<void(const QList<quint32> &accountIds)> &callback)
+{
+    call<QList<quint32>>("accountsWithRole", {role, providerId}, context, QList<quint32>(), callback);
+}
+
+void BrokerClient::queueRevocation(const QString &providerId, const QString &accessToken, const QString &refreshToken,
+                                   QObject *context, const std::function<void(bool queued)> &callback)
+{
+    call<bool>("queueRevocation", {providerId, accessToken, refreshToken}, context, false, callback);
+}
+
+QVariantMap BrokerClient::getTokenBlocking(quint32 accountId, QString *error)
+{
+    return callTokenBlocking("getToken", {accountId}, error);
+}
+
+QVariantMap BrokerClient::getServiceTokenBlocking(quint32 accountId, const QString &serviceId, QString *error)
+{
+    return callTokenBlocking("getServiceToken", {accountId, serviceId}, error);
+}
+
+QVariantMap BrokerClient::callTokenBlocking(const QString &method, const QVariantList &arguments, QString *error)
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(ServiceName, ObjectPath, InterfaceName, method);
+    message.setArguments(arguments);
+
+    QDBusMessage reply = QDBusConnection::sessionBus().call(message, QDBus::Block, CallTimeoutMs);
+    if (reply.type() != QDBusMessage::ReplyMessage || reply.arguments().isEmpty()) {
+        *error = reply.errorMessage().isEmpty() ? reply.errorName() : reply.errorMessage();
+        return QVariantMap();
+    }
+    return qdbus_cast<QVariantMap>(reply.arguments().first());
+}
+
+int BrokerClient::tokenSnapshotBlocking(QString *error)
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(ServiceName, ObjectPath, InterfaceName, "tokenSnapshot");
+    QDBusMessage reply = QDBusConnection::sessionBus().call(message, QDBus::Block, CallTimeoutMs);
+    if (reply.type() != QDBusMessage::ReplyMessage || reply.arguments().isEmpty()) {
+        *error = reply.errorMessage().isEmpty() ? reply.errorName() : reply.errorMessage();
+        return -1;
+    }
+    QDBusUnixFileDescriptor descriptor = qdbus_cast<QDBusUnixFileDescriptor>(reply.arguments().first());
+    if (!descriptor.isValid()) {
+        *error = "令牌代理返回了无效的描述符";
+        return -1;
+    }
+    // descriptor 析构时关闭自己的副本
+    return fcntl(descriptor.fileDescriptor(), F_DUPFD_CLOEXEC, 0);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <QList>
+#include <QString>
+#include <QVariantList>
+#include <QVariantMap>
+#include <functional>
+
+class QObject;
+
+// 令牌代理（kde-oauth2-broker）的 DBus 客户端
+// 令牌刷新和角色查询由常驻的代理进程负责，插件只做转发。所有调用都是异步的，
+// 代理未运行时由 DBus 激活启动；回调在 context 所在线程执行，context 销毁后不再回调。
+class BrokerClient
+{
+public:
+    static constexpr const char *ServiceName = "org.kde.kaccounts.OAuth2Broker";
+    static constexpr const char *ObjectPath = "/Broker";
+    static constexpr const char *InterfaceName = "org.kde.kaccounts.OAuth2Broker";
+    static constexpr int CallTimeoutMs = 30000;   // 刷新需要访问令牌端点，超时比默认值长
+
+    static void refreshToken(quint32 accountId, QObject *context, const std::function<void(bool ok)> &callback);
+    static void hasRole(quint32 accountId, const QString &role, QObject *context,
+                        const std::function<void(bool hasRole)> &callback);
+    static void accountsWithRole(const QString &role, const QString &providerId, QObject *context,
+                                 const std::function<void(const QList<quint32> &accountIds)> &callback);
+    // 把令牌交给代理的吊销发件箱；queued 为 false 表示代理不可用或未能写入发件箱
+    static void queueRevocation(const QString &providerId, const QString &accessToken, const QString &refreshToken,
+                                QObject *context, const std::function<void(bool queued)> &callback);
+
+    // 同步获取有效令牌（必要时由代理先刷新），只用于没有事件循环的命令行工具。
+    // 失败时返回空表并设置 error
+    static QVariantMap getTokenBlocking(quint32 accountId, QString *error);
+    // 同步获取只含服务 scope 的令牌（见 provider 文件的 scopes 组）
+    static QVariantMap getServiceTokenBlocking(quint32 accountId, const QString &serviceId, QString *error);
+    // 同步获取共享内存令牌快照的只读描述符（调用方负责关闭），失败时返回 -1
+    static int tokenSnapshotBlocking(QString *error);
+
+private:
+    // 调用失败（代理无法启动、超时、返回错误）时以 fallback 回调
+    template <typename T>
+    static void call(const QString &method, const QVariantList &arguments, QObject *context,
+                     const T &fallback, const std::function<void(const T &)> &callback);
+    static QVariantMap callTokenBlocking(const QString &method, const QVariantList &arguments, QString *error);
+};
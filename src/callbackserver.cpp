@@ -0,0 +1,192 @@
+#include "callbackserver.h"
+#include <QDebug>
+
+namespace {
+
+// 回调响应页面的静态部分在编译期确定，运行时只拼接转义后的动态字段
+constexpr char kHtmlResponseHead[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/html; charset=utf-8\r\n"
+    "Connection: close\r\n"
+    "Content-Length: ";
+
+constexpr char kNotFoundKeepAliveResponse[] =
+    "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n";
+
+constexpr char kNotFoundCloseResponse[] =
+    "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+constexpr char kSuccessPageHead[] =
+    "<!DOCTYPE html>\n"
+    "<html><head><title>认证成功</title></head>\n"
+    "<body style='font-family: Arial, sans-serif; text-align: center; padding: 50px; background: #f0f8ff;'>\n"
+    "<h2 style='color: #28a745;'>✅ OAuth2 认证成功！</h2>\n"
+    "<p>授权码已自动获取</p>\n"
+    "<p style='font-size: 12px; color: #666;'>授权码: <code style='background: #f8f9fa; padding: 2px 4px; border-radius: 3px;'>";
+
+constexpr char kSuccessPageTail[] =
+    "...</code></p>\n"
+    "<p>您可以关闭此页面，账户将自动创建。</p>\n"
+    "<script>setTimeout(function(){window.close();}, 3000);</script>\n"
+    "</body></html>";
+
+constexpr char kErrorPageHead[] =
+    "<!DOCTYPE html>\n"
+    "<html><head><title>认证失败</title></head>\n"
+    "<body style='font-family: Arial, sans-serif; text-align: center; padding: 50px; background: #fff5f5;'>\n"
+    "<h2 style='color: #dc3545;'>❌ OAuth2 认证失败</h2>\n"
+    "<p>错误: ";
+
+constexpr char kErrorPageMiddle[] =
+    "</p>\n"
+    "<p>描述: ";
+
+constexpr char kErrorPageTail[] =
+    "</p>\n"
+    "<p>您可以关闭此页面重试。</p>\n"
+    "</body></html>";
+
+#define RESPONSE_CHUNK(literal) { literal, int(sizeof(literal) - 1) }
+
+constexpr CallbackServer::ResponseChunk kSuccessPage[] = {
+    RESPONSE_CHUNK(kSuccessPageHead),
+    RESPONSE_CHUNK(kSuccessPageTail),
+};
+
+constexpr CallbackServer::ResponseChunk kErrorPage[] = {
+    RESPONSE_CHUNK(kErrorPageHead),
+    RESPONSE_CHUNK(kErrorPageMiddle),
+    RESPONSE_CHUNK(kErrorPageTail),
+};
+
+#undef RESPONSE_CHUNK
+
+const char *htmlEntity(char c)
+{
+    switch (c) {
+    case '&': return "&amp;";
+    case '<': return "&lt;";
+    case '>': return "&gt;";
+    case '"': return "&quot;";
+    case '\'': return "&#39;";
+    default: return nullptr;
+    }
+}
+
+int htmlEscapedLength(const QByteArray &value)
+{
+    int length = 0;
+    for (char c : value) {
+        const char *entity = htmlEntity(c);
+        length += entity ? int(qstrlen(entity)) : 1;
+    }
+    return length;
+}
+
+void appendHtmlEscaped(QByteArray &out, const QByteArray &value)
+{
+    const char *data = value.constData();
+    const int size = value.size();
+    int runStart = 0;
+    for (int i = 0; i < size; ++i) {
+        const char *entity = htmlEntity(data[i]);
+        if (entity) {
+            out.append(data + runStart, i - runStart);
+            out.append(entity);
+            runStart = i + 1;
+        }
+    }
+    out.append(data + runStart, size - runStart);
+}
+
+} // namespace
+
+// CallbackServer 实现
+CallbackServer::CallbackServer(QObject *parent)
+    : LoopbackHttpServer(parent)
+    , m_callbackPath("/callback")
+{
+    setMaxConnections(MaxConnections);
+}
+
+void CallbackServer::setCallbackPath(const QByteArray &path)
+{
+    m_callbackPath = path;
+}
+
+CallbackServer::RequestResult CallbackServer::handleRequest(QTcpSocket *socket, const HttpRequestParser &parser)
+{
+    qDebug() << "CallbackServer: received request:" << parser.view(parser.method()) << parser.view(parser.target());
+
+    // 非回调路径（例如 /favicon.ico）返回404，并按客户端意愿保持连接
+    if (!m_callbackPath.isEmpty() && parser.path() != m_callbackPath) {
+        if (parser.keepAlive()) {
+            socket->write(kNotFoundKeepAliveResponse, sizeof(kNotFoundKeepAliveResponse) - 1);
+            return KeepAlive;
+        }
+        socket->write(kNotFoundCloseResponse, sizeof(kNotFoundCloseResponse) - 1);
+        return CloseConnection;
+    }
+
+    QByteArray response;
+    if (parser.hasQueryItem("code")) {
+        QByteArray code = parser.queryItemValue("code");
+        response = createSuccessResponse(code);
+        emit authorizationCodeReceived(QString::fromUtf8(code));
+    } else if (parser.hasQueryItem("error")) {
+        QByteArray error = parser.queryItemValue("error");
+        QByteArray errorDesc = parser.queryItemValue("error_description");
+        response = createErrorResponse(error, errorDesc);
+        emit authorizationError(QString::fromUtf8(error), QString::fromUtf8(errorDesc));
+    } else {
+        response = createErrorResponse(QByteArrayLiteral("invalid_request"),
+                                       QByteArrayLiteral("No authorization code or error received"));
+    }
+
+    // 回调页面总是以 Connection: close 结束
+    socket->write(response);
+    socket->flush();
+    return CloseConnection;
+}
+
+QByteArray CallbackServer::createSuccessResponse(const QByteArray &code)
+{
+    // 页面中只显示授权码前20个字符
+    const QByteArray shownCode = QByteArray::fromRawData(code.constData(), qMin(code.size(), 20));
+    const QByteArray fields[] = { shownCode };
+    return buildResponse(kSuccessPage, 2, fields);
+}
+
+QByteArray CallbackServer::createErrorResponse(const QByteArray &error, const QByteArray &description)
+{
+    const QByteArray fields[] = { error, description };
+    return buildResponse(kErrorPage, 3, fields);
+}
+
+QByteArray CallbackServer::buildResponse(const ResponseChunk *chunks, int chunkCount, const QByteArray *fields)
+{
+    // 先计算总长度，保证整个响应只分配一次
+    int bodyLength = 0;
+    for (int i = 0; i < chunkCount; ++i) {
+        bodyLength += chunks[i].length;
+        if (i + 1 < chunkCount) {
+            bodyLength += htmlEscapedLength(fields[i]);
+        }
+    }
+
+    char lengthDigits[16];
+    int digitsLength = qsnprintf(lengthDigits, sizeof(lengthDigits), "%d", bodyLength);
+
+    QByteArray response;
+    response.reserve(int(sizeof(kHtmlResponseHead) - 1) + digitsLength + 4 + bodyLength);
+    response.append(kHtmlResponseHead, int(sizeof(kHtmlResponseHead) - 1));
+    response.append(lengthDigits, digitsLength);
+    response.append("\r\n\r\n", 4);
+    for (int i = 0; i < chunkCount; ++i) {
+        response.append(chunks[i].data, chunks[i].length);
+        if (i + 1 < chunkCount) {
+            appendHtmlEscaped(response, fields[i]);
+        }
+    }
+    return response;
+}
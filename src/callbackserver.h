@@ -0,0 +1,37 @@
+#pragma once
+#include "loopbackhttpserver.h"
+
+// 本地HTTP服务器类，用于捕获OAuth2回调
+class CallbackServer : public LoopbackHttpServer
+{
+    Q_OBJECT
+
+public:
+    static constexpr int MaxConnections = 16;
+
+    // 编译期确定的响应片段
+    struct ResponseChunk {
+        const char *data;
+        int length;
+    };
+
+    explicit CallbackServer(QObject *parent = nullptr);
+
+    // 回调路径，其他路径返回404；为空时接受任意路径
+    void setCallbackPath(const QByteArray &path);
+
+signals:
+    void authorizationCodeReceived(const QString &code);
+    void authorizationError(const QString &error, const QString &description);
+
+protected:
+    RequestResult handleRequest(QTcpSocket *socket, const HttpRequestParser &parser) override;
+
+private:
+    QByteArray createSuccessResponse(const QByteArray &code);
+    QByteArray createErrorResponse(const QByteArray &error, const QByteArray &description);
+    // 按“静态片段 / 转义字段 / 静态片段 ...”顺序拼接完整响应，只分配一次
+    static QByteArray buildResponse(const ResponseChunk *chunks, int chunkCount, const QByteArray *fields);
+
+    QByteArray m_callbackPath;
+};
@@ -0,0 +1,223 @@
+#include "claimmapper.h"
+#include "stringpool.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+const char kClaimsGroupPrefix[] = "claims/";
+const char kMultiValuedSuffix[] = "[]";
+
+} // namespace
+
+ClaimMapper::ClaimMapper(const QVector<Mapping> &mappings)
+{
+    for (const Mapping &mapping : mappings) {
+        int field = m_fields.size();
+        m_fields.append(StringPool::intern(mapping.field));
+        m_flags.append(mapping.flags);
+
+        int priority = 0;
+        for (const QString &claim : mapping.claims) {
+            Candidate candidate;
+            candidate.field = field;
+            candidate.priority = priority++;
+
+            QString key = claim;
+            if (claim.startsWith('/')) {
+                QStringList segments = parsePointer(claim);
+                if (segments.isEmpty()) {
+                    continue;
+                }
+                key = segments.takeFirst();
+                candidate.path = segments;
+            }
+            key = StringPool::intern(key);
+            m_index[key].append(candidate);
+            m_claimKeys.insert(key);
+        }
+    }
+}
+
+QVector<ClaimMapper::Mapping> ClaimMapper::defaultMappings()
+{
+    return {
+        { "user_id", { "sub",
+                       "http://schemas.xmlsoap.org/ws/2005/05/identity/claims/nameidentifier",
+                       "id",
+                       "user_id" } },
+        { "username", { "http://schemas.xmlsoap.org/ws/2005/05/identity/claims/name",
+                        "name",
+                        "username",
+                        "login",
+                        "preferred_username" } },
+        { "email", { "email",
+                     "http://schemas.xmlsoap.org/ws/2005/05/identity/claims/emailaddress",
+                     "mail" } },
+        // role 保留为逗号连接的字符串以兼容旧的读取方，roles/groups 为完整列表
+        { "role", { "http://schemas.microsoft.com/ws/2008/06/identity/claims/role",
+                    "role",
+                    "roles" }, Interned },
+        { "roles", { "http://schemas.microsoft.com/ws/2008/06/identity/claims/role",
+                     "roles",
+                     "role" }, MultiValued | Interned },
+        { "groups", { "groups",
+                      "http://schemas.xmlsoap.org/claims/Group" }, MultiValued | Interned },
+        { "portrait", { "portrait", "picture", "avatar" } },
+        // 标准 JWT 字段
+        { "iss", { "iss" }, Interned },
+        { "aud", { "aud" }, Interned },
+        { "iat", { "iat" } },
+        { "exp", { "exp" } },
+        { "nbf", { "nbf" } },
+    };
+}
+
+QVector<ClaimMapper::Mapping> ClaimMapper::mappingsFromSettings(const QHash<QString, QString> &settings)
+{
+    QVector<Mapping> mappings = defaultMappings();
+    const QLatin1String prefix(kClaimsGroupPrefix);
+
+    for (auto it = settings.constBegin(); it != settings.constEnd(); ++it) {
+        if (!it.key().startsWith(prefix)) {
+            continue;
+        }
+        QString field = it.key().mid(prefix.size());
+        Flags flags = NoFlags;
+        if (field.endsWith(QLatin1String(kMultiValuedSuffix))) {
+            field.chop(int(sizeof(kMultiValuedSuffix)) - 1);
+            flags = MultiValued | Interned;
+        }
+        if (field.isEmpty() || field.contains('/')) {
+            continue;
+        }
+
+        QStringList claims;
+        const QStringList parts = it.value().split(',', Qt::SkipEmptyParts);
+        for (const QString &part : parts) {
+            QString claim = part.trimmed();
+            if (!claim.isEmpty()) {
+                claims.append(claim);
+            }
+        }
+
+        auto existing = std::find_if(mappings.begin(), mappings.end(),
+                                     [&field](const Mapping &mapping) { return mapping.field == field; });
+        if (existing != mappings.end()) {
+            existing->claims = claims;
+            existing->flags |= flags;
+        } else {
+            mappings.append({ field, claims, flags });
+        }
+    }
+    return mappings;
+}
+
+QVariantMap ClaimMapper::map(const QJsonObject &claims) const
+{
+    QVector<int> best(m_fields.size(), INT_MAX);
+    QVector<QJsonValue> found(m_fields.size());
+
+    for (auto it = claims.constBegin(); it != claims.constEnd(); ++it) {
+        auto entry = m_index.constFind(it.key());
+        if (entry == m_index.constEnd()) {
+            continue;
+        }
+        for (const Candidate &candidate : entry.value()) {
+            if (candidate.priority >= best[candidate.field]) {
+                continue;
+            }
+            QJsonValue value = candidate.path.isEmpty() ? it.value() : resolvePath(it.value(), candidate.path);
+            if (value.isUndefined() || value.isNull()) {
+                continue;
+            }
+            best[candidate.field] = candidate.priority;
+            found[candidate.field] = value;
+        }
+    }
+
+    QVariantMap result;
+    for (int field = 0; field < m_fields.size(); ++field) {
+        if (best[field] != INT_MAX) {
+            result.insert(m_fields[field], toVariant(found[field], m_flags[field]));
+        }
+    }
+    return result;
+}
+
+QJsonObject ClaimMapper::decodeJwtPayload(const QString &jwt)
+{
+    // header.payload.signature，载荷为 base64url 编码（无填充）的 JSON 对象
+    QStringList parts = jwt.split(QLatin1Char('.'));
+    if (parts.size() != 3 || parts[1].isEmpty()) {
+        return QJsonObject();
+    }
+
+    QByteArray payload = QByteArray::fromBase64(parts[1].toLatin1(),
+                                                QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals);
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(payload, &error);
+    if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+        return QJsonObject();
+    }
+    return doc.object();
+}
+
+QStringList ClaimMapper::parsePointer(const QString &pointer)
+{
+    QStringList segments = pointer.mid(1).split('/');
+    for (QString &segment : segments) {
+        segment.replace(QLatin1String("~1"), QLatin1String("/"));
+        segment.replace(QLatin1String("~0"), QLatin1String("~"));
+    }
+    return segments;
+}
+
+QJsonValue ClaimMapper::resolvePath(QJsonValue value, const QStringList &path)
+{
+    for (const QString &segment : path) {
+        if (value.isObject()) {
+            value = value.toObject().value(segment);
+        } else if (value.isArray()) {
+            bool ok = false;
+            int index = segment.toInt(&ok);
+            QJsonArray array = value.toArray();
+            if (!ok || index < 0 || index >= array.size()) {
+                return QJsonValue(QJsonValue::Undefined);
+            }
+            value = array.at(index);
+        } else {
+            return QJsonValue(QJsonValue::Undefined);
+        }
+    }
+    return value;
+}
+
+QVariant ClaimMapper::toVariant(const QJsonValue &value, Flags flags)
+{
+    if (value.isArray() || (flags & MultiValued)) {
+        QStringList items;
+        const QJsonArray array = value.isArray() ? value.toArray() : QJsonArray{ value };
+        items.reserve(array.size());
+        for (const QJsonValue &item : array) {
+            QString text = item.isString() ? item.toString() : item.toVariant().toString();
+            if (text.isEmpty()) {
+                continue;
+            }
+            items.append((flags & Interned) ? StringPool::intern(text) : text);
+        }
+        if (flags & MultiValued) {
+            return items;
+        }
+        return items.join(',');
+    }
+    if (value.isString() && (flags & Interned)) {
+        return StringPool::intern(value.toString());
+    }
+    if (value.isObject()) {
+        return QString::fromUtf8(QJsonDocument(value.toObject()).toJson(QJsonDocument::Compact));
+    }
+    return value.toVariant();
+}
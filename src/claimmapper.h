@@ -0,0 +1,72 @@
+#pragma once
+#include <QFlags>
+#include <QHash>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+#include <QVector>
+
+// 表驱动的声明映射器
+// 映射表把账户字段（user_id、username、email ...）映射到按优先级排列的候选声明，
+// 在加载配置时编译为“声明名 -> 候选”索引，之后每次映射只遍历一次 JSON 对象。
+//
+// 候选声明有两种写法：
+//   - 顶层键，原样匹配（可以是 .NET 的长 URI，例如 http://schemas.xmlsoap.org/...）
+//   - 以 '/' 开头的 JSON Pointer（RFC 6901），用于嵌套对象和数组，例如 /realm_access/roles、/emails/0
+// 单值字段的数组值以逗号连接为字符串；多值字段（roles、groups）保留为 QStringList。
+class ClaimMapper
+{
+public:
+    enum Flag {
+        NoFlags = 0,
+        MultiValued = 0x1,      // 结果为 QStringList（数组逐项、单个字符串为单元素列表）
+        Interned = 0x2          // 字符串值通过 StringPool 驻留（角色名、签发者等重复出现的值）
+    };
+    Q_DECLARE_FLAGS(Flags, Flag)
+
+    struct Mapping {
+        QString field;          // 账户字段名
+        QStringList claims;     // 候选声明，靠前的优先
+        Flags flags = NoFlags;
+    };
+
+    explicit ClaimMapper(const QVector<Mapping> &mappings = defaultMappings());
+
+    // 内置映射表（与原先硬编码的提取顺序一致）
+    static QVector<Mapping> defaultMappings();
+    // 在内置映射表上叠加 provider 模板中 claims 组的设置（键为 "claims/<字段>"，值为逗号分隔的候选声明，
+    // 值为空表示禁用该字段；字段名以 "[]" 结尾表示多值字段）
+    static QVector<Mapping> mappingsFromSettings(const QHash<QString, QString> &settings);
+
+    // 单次遍历 claims，返回 字段 -> 值；未找到的字段不出现在结果中
+    QVariantMap map(const QJsonObject &claims) const;
+
+    // 解码 JWT（例如 id_token）的载荷部分。不校验签名，结果只能用作账户的初始显示信息，
+    // 随后由 userinfo 响应覆盖。格式错误时返回空对象。
+    static QJsonObject decodeJwtPayload(const QString &jwt);
+
+    QStringList fields() const { return m_fields; }
+    // 映射表引用到的所有顶层声明名（流式解析时只需保留这些成员）
+    QSet<QString> claimKeys() const { return m_claimKeys; }
+
+private:
+    struct Candidate {
+        int field = 0;          // m_fields 中的下标
+        int priority = 0;       // 越小越优先
+        QStringList path;       // JSON Pointer 第一段之后的路径，顶层键为空
+    };
+
+    static QStringList parsePointer(const QString &pointer);
+    static QJsonValue resolvePath(QJsonValue value, const QStringList &path);
+    static QVariant toVariant(const QJsonValue &value, Flags flags);
+
+    QStringList m_fields;
+    QVector<Flags> m_flags;
+    QHash<QString, QVector<Candidate>> m_index;   // 顶层键 -> 候选
+    QSet<QString> m_claimKeys;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(ClaimMapper::Flags)
@@ -0,0 +1,194 @@
+#include "callbackserver.h"
+#include "oauth2config.h"
+#include "oauth2flow.h"
+#include "providerregistry.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QUrl>
+#include <algorithm>
+
+// kde-oauth2-cli：不依赖界面的 OAuth2 调试工具
+// 只链接 oauth2core，用于在无图形环境中检查 provider 配置、生成认证URL和走通授权码流程。
+// login 只打印令牌和映射后的声明，不创建 KAccounts 账户。
+
+namespace {
+
+QTextStream &out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+QTextStream &err()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+QJsonObject claimsToJson(const QVariantMap &claims)
+{
+    return QJsonObject::fromVariantMap(claims);
+}
+
+// 授权码交换和用户信息获取；完成后退出事件循环
+class LoginSession : public QObject
+{
+public:
+    LoginSession(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config)
+        : m_provider(provider)
+        , m_config(config)
+    {
+    }
+
+    void exchange(const QString &code, const QString &redirectUri)
+    {
+        // 授权码只能使用一次，忽略重复的回调
+        if (m_started) {
+            return;
+        }
+        m_started = true;
+        OAuth2Flow::exchangeCode(m_provider, m_config, code, redirectUri, this,
+                                 [this](const QJsonObject &response, const QString &error) {
+            if (!error.isEmpty() || !response.contains("access_token")) {
+                err() << "Token请求失败：" << (error.isEmpty() ? QString("响应中未包含访问令牌") : error) << Qt::endl;
+                QCoreApplication::exit(1);
+                return;
+            }
+            m_result["token"] = response;
+            m_result["claims"] = claimsToJson(OAuth2Flow::mapClaims(*m_config, response, true));
+
+            OAuth2Flow::fetchUserInfo(m_provider, m_config, response.value("access_token").toString(), this,
+                                      [this](const QJsonObject &userInfo, const QString &error) {
+                if (error.isEmpty()) {
+                    QString displayName;
+                    QVariantMap data = OAuth2Flow::accountDataFromClaims(
+                        *m_config, OAuth2Flow::mapClaims(*m_config, userInfo, false), &displayName);
+                    m_result["displayName"] = displayName;
+                    m_result["userInfo"] = claimsToJson(data);
+                } else {
+                    // 与插件一致：用户信息失败不影响令牌
+                    err() << "获取用户信息失败：" << error << Qt::endl;
+                }
+                out() << QJsonDocument(m_result).toJson(QJsonDocument::Indented);
+                out().flush();
+                QCoreApplication::exit(0);
+            });
+        });
+    }
+
+private:
+    ProviderContext *m_provider;
+    OAuth2Config::SnapshotPtr m_config;
+    QJsonObject m_result;
+    bool m_started = false;
+};
+
+int listProviders(ProviderRegistry *registry)
+{
+    const QList<ProviderContext *> providers = registry->providers();
+    for (ProviderContext *provider : providers) {
+        out() << provider->providerId() << '\t' << provider->displayName() << '\t' << provider->providerFile() << Qt::endl;
+    }
+    return 0;
+}
+
+int printConfig(ProviderContext *provider)
+{
+    OAuth2Config::SnapshotPtr config = provider->config()->snapshot();
+    QStringList keys = config->values.keys();
+    std::sort(keys.begin(), keys.end());
+    for (const QString &key : keys) {
+        out() << key << " = " << config->values.value(key)
+              << "  [" << OAuth2Config::layerName(config->sources.value(key)) << "]" << Qt::endl;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("kde-oauth2-cli");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("KDE OAuth2 command line tool");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("command", "providers | config | auth-url | login");
+    QCommandLineOption providerOption("provider", "Provider id (default: gzweibo-oauth2).", "id");
+    QCommandLineOption redirectOption("redirect-uri", "Override the configured redirect URI.", "uri");
+    QCommandLineOption codeOption("code", "Exchange this authorization code instead of waiting for the callback.", "code");
+    parser.addOption(providerOption);
+    parser.addOption(redirectOption);
+    parser.addOption(codeOption);
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 1) {
+        parser.showHelp(1);
+    }
+    const QString command = args.first();
+
+    ProviderRegistry registry;
+    registry.scan();
+
+    if (command == "providers") {
+        return listProviders(&registry);
+    }
+
+    ProviderContext *provider = parser.isSet(providerOption) ? registry.provider(parser.value(providerOption))
+                                                             : registry.defaultProvider();
+    if (!provider) {
+        err() << "未找到 provider：" << parser.value(providerOption) << Qt::endl;
+        return 1;
+    }
+    OAuth2Config::SnapshotPtr config = provider->config()->snapshot();
+    QString redirectUri = parser.isSet(redirectOption) ? parser.value(redirectOption) : config->redirectUri;
+
+    if (command == "config") {
+        return printConfig(provider);
+    }
+    if (command == "auth-url") {
+        out() << OAuth2Flow::authorizationUrl(*config, redirectUri) << Qt::endl;
+        return 0;
+    }
+    if (command != "login") {
+        err() << "未知命令：" << command << Qt::endl;
+        parser.showHelp(1);
+    }
+
+    LoginSession session(provider, config);
+    if (parser.isSet(codeOption)) {
+        session.exchange(parser.value(codeOption), redirectUri);
+        return app.exec();
+    }
+
+    // 与插件对话框相同：在回环地址上监听，redirect_uri 使用实际监听的端口
+    CallbackServer server;
+    server.setCallbackPath(QUrl(redirectUri).path().toUtf8());
+    if (!server.listenLoopback(OAuth2Flow::callbackPorts(*config))) {
+        err() << "无法启动回调服务器，请使用 --code" << Qt::endl;
+        return 1;
+    }
+    QUrl redirectUrl(redirectUri);
+    redirectUrl.setPort(server.serverPort());
+    redirectUri = redirectUrl.toString();
+
+    QObject::connect(&server, &CallbackServer::authorizationCodeReceived, &session, [&](const QString &code) {
+        server.stopListening();
+        session.exchange(code, redirectUri);
+    });
+    QObject::connect(&server, &CallbackServer::authorizationError, &app, [](const QString &error, const QString &description) {
+        err() << "授权失败：" << error << ' ' << description << Qt::endl;
+        QCoreApplication::exit(1);
+    });
+
+    err() << "请在浏览器中打开以下地址完成认证：" << Qt::endl;
+    out() << OAuth2Flow::authorizationUrl(*config, redirectUri) << Qt::endl;
+    return app.exec();
+}
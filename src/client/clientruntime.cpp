@@ -0,0 +1,203 @@
+#include "clientruntime.h"
+#include "brokerclient.h"
+#include "kdeoauth2client.h"
+#include "tokensnapshot.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDBusConnection>
+#include <QDebug>
+#include <QMutexLocker>
+#include <QThread>
+#include <future>
+#include <thread>
+#include <unistd.h>
+
+ClientRuntime *ClientRuntime::instance()
+{
+    // 局部静态变量的初始化是线程安全的，并发的首次调用只会启动一个运行时
+    static ClientRuntime *runtime = start();
+    return runtime;
+}
+
+ClientRuntime *ClientRuntime::start()
+{
+    if (QCoreApplication::instance()) {
+        // 宿主是 Qt 程序：运行时使用自己的线程，不依赖宿主是否运行事件循环
+        auto *thread = new QThread;
+        thread->setObjectName("kdeoauth2-client");
+        auto *runtime = new ClientRuntime;
+        runtime->moveToThread(thread);
+        thread->start();
+        QMetaObject::invokeMethod(runtime, [runtime]() { runtime->connectToBroker(); }, Qt::BlockingQueuedConnection);
+        return runtime;
+    }
+
+    // 非 Qt 宿主（C#、Python 等）：在内部线程中创建 QCoreApplication 并运行事件循环
+    std::promise<ClientRuntime *> ready;
+    std::future<ClientRuntime *> result = ready.get_future();
+    std::thread([&ready]() {
+        static int argc = 1;
+        static char name[] = "kdeoauth2-client";
+        static char *argv[] = {name, nullptr};
+        QCoreApplication app(argc, argv);
+        auto *runtime = new ClientRuntime;
+        runtime->connectToBroker();
+        ready.set_value(runtime);
+        app.exec();
+    }).detach();
+    return result.get();
+}
+
+void ClientRuntime::connectToBroker()
+{
+    // 指定服务名：代理稍后启动或重启时 QtDBus 会跟随新的连接
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    bool connected = bus.connect(BrokerClient::ServiceName, BrokerClient::ObjectPath, BrokerClient::InterfaceName,
+                                 "tokenRefreshed", this, SLOT(onTokenRefreshed(quint32,qlonglong)))
+                  && bus.connect(BrokerClient::ServiceName, BrokerClient::ObjectPath, BrokerClient::InterfaceName,
+                                 "tokenRefreshFailed", this, SLOT(onTokenRefreshFailed(quint32,QString)))
+                  && bus.connect(BrokerClient::ServiceName, BrokerClient::ObjectPath, BrokerClient::InterfaceName,
+                                 "accountUpdated", this, SLOT(onAccountUpdated(quint32)))
+                  && bus.connect(BrokerClient::ServiceName, BrokerClient::ObjectPath, BrokerClient::InterfaceName,
+                                 "accountRemoved", this, SLOT(onAccountRemoved(quint32)));
+    if (!connected) {
+        // 收不到失效通知时缓存仍然按过期时间失效
+        qWarning() << "kdeoauth2-client: cannot subscribe to broker signals:" << bus.lastError().message();
+    }
+}
+
+bool ClientRuntime::lookup(quint32 accountId, int minValidity, CachedToken *token) const
+{
+    QReadLocker locker(&m_cacheLock);
+    auto it = m_cache.constFind(accountId);
+    if (it == m_cache.constEnd() || it->expiresAt - QDateTime::currentSecsSinceEpoch() < minValidity) {
+        return false;
+    }
+    *token = *it;
+    return true;
+}
+
+void ClientRuntime::store(quint32 accountId, const CachedToken &token)
+{
+    if (token.expiresAt <= 0 || token.accessToken.isEmpty()) {
+        return;
+    }
+    QWriteLocker locker(&m_cacheLock);
+    m_cache.insert(accountId, token);
+}
+
+void ClientRuntime::invalidate(quint32 accountId)
+{
+    QWriteLocker locker(&m_cacheLock);
+    m_cache.remove(accountId);
+}
+
+bool ClientRuntime::lookupSnapshot(quint32 accountId, int minValidity, CachedToken *token)
+{
+    std::shared_ptr<const TokenSnapshotReader> reader = snapshot(nullptr);
+    for (int attempt = 0; reader && attempt < 2; ++attempt) {
+        qint64 expiresAt = 0;
+        switch (reader->lookup(accountId, &token->accessToken, &expiresAt)) {
+        case TokenSnapshotReader::Found:
+            token->expiresAt = expiresAt;
+            return expiresAt - QDateTime::currentSecsSinceEpoch() >= minValidity;
+        case TokenSnapshotReader::Retired:
+            // 代理扩容后发布了新的快照
+            reader = snapshot(reader);
+            break;
+        case TokenSnapshotReader::NotFound:
+        case TokenSnapshotReader::Unavailable:
+            return false;
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<const TokenSnapshotReader> ClientRuntime::snapshot(const std::shared_ptr<const TokenSnapshotReader> &retired)
+{
+    {
+        QMutexLocker locker(&m_snapshotLock);
+        if (m_snapshot && m_snapshot != retired) {
+            return m_snapshot;
+        }
+        m_snapshot.reset();   // 其他线程仍持有的旧映射在最后一个引用释放时解除
+
+        // 同时只发出一个请求；代理无响应时调用最长阻塞到 DBus 超时
+        if (m_snapshotFetching || QDateTime::currentMSecsSinceEpoch() < m_snapshotRetryAt) {
+            return nullptr;
+        }
+        m_snapshotFetching = true;
+    }
+
+    QString error;
+    int fd = BrokerClient::tokenSnapshotBlocking(&error);
+    auto reader = std::make_shared<TokenSnapshotReader>();
+    bool attached = fd >= 0 && reader->attach(fd);
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    QMutexLocker locker(&m_snapshotLock);
+    m_snapshotFetching = false;
+    if (!attached) {
+        qDebug() << "kdeoauth2-client: token snapshot unavailable:" << error;
+        m_snapshotRetryAt = QDateTime::currentMSecsSinceEpoch() + SnapshotRetryMs;
+        return nullptr;
+    }
+    m_snapshot = reader;
+    return m_snapshot;
+}
+
+int ClientRuntime::subscribe(const EventCallback &callback)
+{
+    QMutexLocker locker(&m_subscribersLock);
+    int subscription = m_nextSubscription++;
+    m_subscribers.insert(subscription, callback);
+    return subscription;
+}
+
+void ClientRuntime::unsubscribe(int subscription)
+{
+    QMutexLocker locker(&m_subscribersLock);
+    m_subscribers.remove(subscription);
+}
+
+void ClientRuntime::onTokenRefreshed(quint32 accountId, qlonglong expiresAt)
+{
+    // 新令牌已写入账户数据库，下次查询时重新读取
+    invalidate(accountId);
+    notify(accountId, KDEOAUTH2_EVENT_TOKEN_REFRESHED, expiresAt);
+}
+
+void ClientRuntime::onTokenRefreshFailed(quint32 accountId, const QString &error)
+{
+    qDebug() << "kdeoauth2-client: account" << accountId << "refresh failed:" << error;
+    invalidate(accountId);
+    notify(accountId, KDEOAUTH2_EVENT_REFRESH_FAILED, 0);
+}
+
+void ClientRuntime::onAccountUpdated(quint32 accountId)
+{
+    // 账户可能已重新认证或被停用，缓存的令牌不再可信
+    invalidate(accountId);
+    notify(accountId, KDEOAUTH2_EVENT_ACCOUNT_UPDATED, 0);
+}
+
+void ClientRuntime::onAccountRemoved(quint32 accountId)
+{
+    invalidate(accountId);
+    notify(accountId, KDEOAUTH2_EVENT_ACCOUNT_REMOVED, 0);
+}
+
+void ClientRuntime::notify(quint32 accountId, int event, qint64 expiresAt)
+{
+    // 复制后在锁外回调，回调中可以取消订阅
+    QList<EventCallback> callbacks;
+    {
+        QMutexLocker locker(&m_subscribersLock);
+        callbacks = m_subscribers.values();
+    }
+    for (const EventCallback &callback : callbacks) {
+        callback(accountId, event, expiresAt);
+    }
+}
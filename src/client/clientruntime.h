@@ -0,0 +1,70 @@
+#pragma once
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <functional>
+#include <memory>
+
+class TokenSnapshotReader;
+
+// libkdeoauth2-client 的进程级运行时
+// 持有进程内令牌缓存，并在内部线程的事件循环中监听令牌代理的 DBus 信号：
+// 令牌刷新、刷新失败或账户被修改、删除时失效缓存并通知订阅者。宿主进程没有 QCoreApplication 时
+// 由运行时在内部线程中创建。运行时在首次使用时启动，随进程结束。
+// 进程内缓存未命中时先查令牌代理发布的共享内存快照，不需要 DBus 往返和数据库查询。
+class ClientRuntime : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct CachedToken {
+        QByteArray accessToken;   // UTF-8，直接复制到调用方缓冲区
+        qint64 expiresAt = 0;     // 秒
+    };
+
+    using EventCallback = std::function<void(quint32 accountId, int event, qint64 expiresAt)>;
+
+    static constexpr int SnapshotRetryMs = 5000;   // 获取快照失败后，多久之内不再向代理请求
+
+    static ClientRuntime *instance();
+
+    // 只返回距过期至少还有 minValidity 秒的缓存令牌
+    bool lookup(quint32 accountId, int minValidity, CachedToken *token) const;
+    // 过期时间未知的令牌不缓存（无法判断何时失效）
+    void store(quint32 accountId, const CachedToken &token);
+    void invalidate(quint32 accountId);
+    // 从共享内存快照读取距过期至少还有 minValidity 秒的令牌
+    bool lookupSnapshot(quint32 accountId, int minValidity, CachedToken *token);
+
+    int subscribe(const EventCallback &callback);
+    void unsubscribe(int subscription);
+
+private slots:
+    void onTokenRefreshed(quint32 accountId, qlonglong expiresAt);
+    void onTokenRefreshFailed(quint32 accountId, const QString &error);
+    void onAccountUpdated(quint32 accountId);
+    void onAccountRemoved(quint32 accountId);
+
+private:
+    ClientRuntime() = default;
+    static ClientRuntime *start();
+    void connectToBroker();
+    void notify(quint32 accountId, int event, qint64 expiresAt);
+    // 首次使用或旧快照被取代时向代理获取描述符；DBus 调用期间不持有锁，
+    // 其他线程此时得到 nullptr，改走令牌代理的 getToken
+    std::shared_ptr<const TokenSnapshotReader> snapshot(const std::shared_ptr<const TokenSnapshotReader> &retired);
+
+    mutable QReadWriteLock m_cacheLock;
+    QHash<quint32, CachedToken> m_cache;
+
+    QMutex m_snapshotLock;
+    std::shared_ptr<const TokenSnapshotReader> m_snapshot;
+    qint64 m_snapshotRetryAt = 0;
+    bool m_snapshotFetching = false;
+
+    QMutex m_subscribersLock;
+    QHash<int, EventCallback> m_subscribers;
+    int m_nextSubscription = 1;
+};
@@ -0,0 +1,169 @@
+#include "kdeoauth2client.h"
+#include "accountdatabase.h"
+#include "brokerclient.h"
+#include "clientruntime.h"
+#include "providerregistry.h"
+#include <QDateTime>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <cstring>
+
+struct kdeoauth2_client {
+    QString providerId;
+    QString databasePath;
+    ClientRuntime *runtime = nullptr;
+
+    QMutex lock;                // 保护 subscriptions 和 lastError
+    QSet<int> subscriptions;    // 释放句柄时一并取消
+    QByteArray lastError;
+};
+
+namespace {
+
+int fail(kdeoauth2_client *client, int status, const QString &error)
+{
+    QMutexLocker locker(&client->lock);
+    client->lastError = error.toUtf8();
+    return status;
+}
+
+int copyToken(const ClientRuntime::CachedToken &token, char *buffer, size_t bufferSize,
+              size_t *tokenLength, int64_t *expiresAt)
+{
+    size_t length = size_t(token.accessToken.size());
+    if (tokenLength) {
+        *tokenLength = length;
+    }
+    if (expiresAt) {
+        *expiresAt = token.expiresAt;
+    }
+    if (!buffer || bufferSize < length + 1) {
+        if (tokenLength) {
+            *tokenLength = length + 1;
+        }
+        return KDEOAUTH2_ERROR_BUFFER_TOO_SMALL;
+    }
+    memcpy(buffer, token.accessToken.constData(), length);
+    buffer[length] = '\0';
+    return KDEOAUTH2_OK;
+}
+
+} // namespace
+
+kdeoauth2_client *kdeoauth2_client_new(const char *provider_id)
+{
+    auto *client = new kdeoauth2_client;
+    client->providerId = provider_id ? QString::fromUtf8(provider_id) : QString(ProviderRegistry::DefaultProviderId);
+    client->databasePath = AccountDatabase::defaultPath();
+    client->runtime = ClientRuntime::instance();
+    return client;
+}
+
+void kdeoauth2_client_free(kdeoauth2_client *client)
+{
+    if (!client) {
+        return;
+    }
+    for (int subscription : qAsConst(client->subscriptions)) {
+        client->runtime->unsubscribe(subscription);
+    }
+    delete client;
+}
+
+int kdeoauth2_client_get_token(kdeoauth2_client *client, uint32_t account_id, int min_validity_secs,
+                               char *buffer, size_t buffer_size, size_t *token_length, int64_t *expires_at)
+{
+    if (!client || min_validity_secs < 0) {
+        return KDEOAUTH2_ERROR_INVALID_ARGUMENT;
+    }
+
+    // 快速路径：进程内缓存，只有一次读锁和一次哈希查找
+    ClientRuntime::CachedToken cached;
+    if (account_id > 0 && client->runtime->lookup(account_id, min_validity_secs, &cached)) {
+        return copyToken(cached, buffer, buffer_size, token_length, expires_at);
+    }
+
+    // 共享内存快照：与缓存一样没有系统调用
+    if (account_id > 0 && client->runtime->lookupSnapshot(account_id, min_validity_secs, &cached)) {
+        client->runtime->store(account_id, cached);
+        return copyToken(cached, buffer, buffer_size, token_length, expires_at);
+    }
+
+    // 未命中：只读一次账户数据库
+    AccountDatabase::TokenRecord record;
+    QString error;
+    if (!AccountDatabase::readToken(client->databasePath, client->providerId, account_id, &record, &error)) {
+        return fail(client, KDEOAUTH2_ERROR_NOT_FOUND, error);
+    }
+    account_id = record.accountId;
+    qint64 now = QDateTime::currentSecsSinceEpoch();
+    cached.accessToken = record.accessToken.toUtf8();
+    cached.expiresAt = record.expiresAt;
+    if (!cached.accessToken.isEmpty() && cached.expiresAt - now >= min_validity_secs) {
+        client->runtime->store(account_id, cached);
+        return copyToken(cached, buffer, buffer_size, token_length, expires_at);
+    }
+
+    // 即将过期或过期时间未知：由令牌代理刷新
+    QString brokerError;
+    QVariantMap token = BrokerClient::getTokenBlocking(account_id, &brokerError);
+    QByteArray accessToken = token.value("access_token").toString().toUtf8();
+    if (!accessToken.isEmpty()) {
+        cached.accessToken = accessToken;
+        cached.expiresAt = token.value("expires_at").toLongLong();
+        client->runtime->store(account_id, cached);
+        return copyToken(cached, buffer, buffer_size, token_length, expires_at);
+    }
+
+    // 代理不可用：已保存的令牌尚未过期（或过期时间未知）时仍然返回，不缓存
+    if (!cached.accessToken.isEmpty() && (cached.expiresAt == 0 || cached.expiresAt > now)) {
+        return copyToken(cached, buffer, buffer_size, token_length, expires_at);
+    }
+    if (cached.accessToken.isEmpty()) {
+        return fail(client, KDEOAUTH2_ERROR_NOT_FOUND, QString("账户 %1 没有访问令牌").arg(account_id));
+    }
+    return fail(client, KDEOAUTH2_ERROR_UNAVAILABLE, QString("令牌已过期，令牌代理无法刷新：%1").arg(brokerError));
+}
+
+uint32_t kdeoauth2_client_default_account(kdeoauth2_client *client)
+{
+    if (!client) {
+        return 0;
+    }
+    AccountDatabase::TokenRecord record;
+    QString error;
+    if (!AccountDatabase::readToken(client->databasePath, client->providerId, 0, &record, &error)) {
+        fail(client, KDEOAUTH2_ERROR_NOT_FOUND, error);
+        return 0;
+    }
+    return record.accountId;
+}
+
+int kdeoauth2_client_subscribe(kdeoauth2_client *client, kdeoauth2_event_callback callback, void *user_data)
+{
+    if (!client || !callback) {
+        return 0;
+    }
+    int subscription = client->runtime->subscribe([callback, user_data](quint32 accountId, int event, qint64 expiresAt) {
+        callback(accountId, event, expiresAt, user_data);
+    });
+    QMutexLocker locker(&client->lock);
+    client->subscriptions.insert(subscription);
+    return subscription;
+}
+
+void kdeoauth2_client_unsubscribe(kdeoauth2_client *client, int subscription)
+{
+    if (!client) {
+        return;
+    }
+    client->runtime->unsubscribe(subscription);
+    QMutexLocker locker(&client->lock);
+    client->subscriptions.remove(subscription);
+}
+
+const char *kdeoauth2_client_last_error(const kdeoauth2_client *client)
+{
+    return client ? client->lastError.constData() : "";
+}
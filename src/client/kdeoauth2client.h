@@ -0,0 +1,74 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * libkdeoauth2-client：进程内取令牌的 C 接口
+ *
+ * 令牌缓存在进程内（所有句柄共享），令牌代理的 tokenRefreshed / tokenRefreshFailed /
+ * accountUpdated / accountRemoved 信号到达时失效对应账户；未命中时只读一次账户数据库，
+ * 令牌即将过期时才向令牌代理请求。
+ * C#（P/Invoke）、Python（ctypes）和原生服务都可以直接使用，不必各自读取 accounts.db。
+ *
+ * 除 kdeoauth2_client_last_error 外，所有函数都是线程安全的。
+ * 本接口只会追加函数，不会修改已有函数的签名。
+ */
+
+#if defined(__GNUC__)
+#define KDEOAUTH2_EXPORT __attribute__((visibility("default")))
+#else
+#define KDEOAUTH2_EXPORT
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct kdeoauth2_client kdeoauth2_client;
+
+enum kdeoauth2_status {
+    KDEOAUTH2_OK = 0,
+    KDEOAUTH2_ERROR_INVALID_ARGUMENT = 1,
+    KDEOAUTH2_ERROR_NOT_FOUND = 2,         /* 账户不存在或没有令牌 */
+    KDEOAUTH2_ERROR_UNAVAILABLE = 3,       /* 令牌已过期，且令牌代理无法刷新 */
+    KDEOAUTH2_ERROR_BUFFER_TOO_SMALL = 4   /* token_length 中返回所需大小（含结尾的 0） */
+};
+
+enum kdeoauth2_event {
+    KDEOAUTH2_EVENT_TOKEN_REFRESHED = 1,
+    KDEOAUTH2_EVENT_REFRESH_FAILED = 2,
+    KDEOAUTH2_EVENT_ACCOUNT_UPDATED = 3,   /* 账户被修改（例如重新认证、停用） */
+    KDEOAUTH2_EVENT_ACCOUNT_REMOVED = 4
+};
+
+/* 回调在库的内部线程中执行，不应阻塞；expires_at 为秒时间戳，其他事件为 0 */
+typedef void (*kdeoauth2_event_callback)(uint32_t account_id, int event, int64_t expires_at, void *user_data);
+
+/* provider_id 为 NULL 时使用 gzweibo-oauth2 */
+KDEOAUTH2_EXPORT kdeoauth2_client *kdeoauth2_client_new(const char *provider_id);
+KDEOAUTH2_EXPORT void kdeoauth2_client_free(kdeoauth2_client *client);
+
+/*
+ * 获取距过期至少还有 min_validity_secs 秒的访问令牌，以 0 结尾写入 buffer。
+ * account_id 为 0 时使用该 provider 最新的已启用账户（需要读取账户数据库，
+ * 高频调用请传入明确的账户 ID）。token_length（可为 NULL）返回不含结尾 0 的长度，
+ * expires_at（可为 NULL）返回过期时间（秒，0 表示未知）。
+ */
+KDEOAUTH2_EXPORT int kdeoauth2_client_get_token(kdeoauth2_client *client, uint32_t account_id, int min_validity_secs,
+                                                char *buffer, size_t buffer_size,
+                                                size_t *token_length, int64_t *expires_at);
+
+/* 该 provider 最新的已启用账户，没有时返回 0 */
+KDEOAUTH2_EXPORT uint32_t kdeoauth2_client_default_account(kdeoauth2_client *client);
+
+/* 订阅令牌变化，返回订阅 ID（大于 0），失败时返回 0 */
+KDEOAUTH2_EXPORT int kdeoauth2_client_subscribe(kdeoauth2_client *client, kdeoauth2_event_callback callback,
+                                                void *user_data);
+KDEOAUTH2_EXPORT void kdeoauth2_client_unsubscribe(kdeoauth2_client *client, int subscription);
+
+/* 最近一次失败的原因（UTF-8），在同一句柄的下一次调用前有效 */
+KDEOAUTH2_EXPORT const char *kdeoauth2_client_last_error(const kdeoauth2_client *client);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,306 @@
+#include "flowjournal.h"
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSet>
+#include <QStandardPaths>
+#include <QUuid>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+bool writeAll(int fd, const QByteArray &data)
+{
+    const char *p = data.constData();
+    qint64 remaining = data.size();
+    while (remaining > 0) {
+        ssize_t n = write(fd, p, size_t(remaining));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        remaining -= n;
+    }
+    return true;
+}
+
+} // namespace
+
+FlowJournal::FlowJournal(const QString &name, QObject *parent)
+    : QObject(parent)
+    , m_fileName(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+                 + QStringLiteral("/kde-oauth2-plugin/") + name + QStringLiteral("-journal.jsonl"))
+{
+    QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+    openFile();
+
+    m_syncTimer.setSingleShot(true);
+    connect(&m_syncTimer, &QTimer::timeout, this, &FlowJournal::syncNow);
+}
+
+FlowJournal::~FlowJournal()
+{
+    if (m_fd >= 0) {
+        syncNow();
+        close(m_fd);
+    }
+}
+
+QString FlowJournal::begin(const QString &type, const QVariantMap &data)
+{
+    QString flowId = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    QJsonObject record;
+    record["op"] = "begin";
+    record["flow"] = flowId;
+    record["type"] = type;
+    record["pid"] = qint64(QCoreApplication::applicationPid());
+    record["at"] = QDateTime::currentSecsSinceEpoch();
+    record["data"] = QJsonObject::fromVariantMap(data);
+    if (!append(record, true)) {
+        return QString();
+    }
+    ++m_begun;
+    return flowId;
+}
+
+void FlowJournal::commit(const QString &flowId)
+{
+    if (flowId.isEmpty()) {
+        return;
+    }
+    QJsonObject record;
+    record["op"] = "commit";
+    record["flow"] = flowId;
+    if (append(record, false)) {
+        ++m_committed;
+    }
+}
+
+bool FlowJournal::openFile()
+{
+    // 日志中是有效的令牌
+    m_fd = open(QFile::encodeName(m_fileName).constData(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (m_fd < 0) {
+        qWarning() << "FlowJournal: cannot open" << m_fileName << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool FlowJournal::lock()
+{
+    const QByteArray path = QFile::encodeName(m_fileName);
+    for (;;) {
+        if (m_fd < 0 && !openFile()) {
+            return false;
+        }
+        while (flock(m_fd, LOCK_EX) != 0) {
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+        struct stat locked;
+        struct stat current;
+        if (fstat(m_fd, &locked) == 0 && stat(path.constData(), &current) == 0
+            && locked.st_dev == current.st_dev && locked.st_ino == current.st_ino) {
+            return true;
+        }
+        // 旧文件上已写入的记录都已被压缩进新文件
+        flock(m_fd, LOCK_UN);
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void FlowJournal::unlock()
+{
+    flock(m_fd, LOCK_UN);
+}
+
+bool FlowJournal::append(const QJsonObject &record, bool durable)
+{
+    QByteArray line = QJsonDocument(record).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    if (!lock()) {
+        return false;
+    }
+    bool written = writeAll(m_fd, line);
+    unlock();
+    if (!written) {
+        qWarning() << "FlowJournal: write to" << m_fileName << "failed:" << strerror(errno);
+        return false;
+    }
+
+    if (durable) {
+        // 同时落盘之前合并等待的提交记录
+        m_syncTimer.stop();
+        m_syncPending = true;
+        syncNow();
+    } else if (!m_syncPending) {
+        m_syncPending = true;
+        m_syncTimer.start(SyncDelayMs);
+    }
+    return true;
+}
+
+void FlowJournal::syncNow()
+{
+    if (!m_syncPending || m_fd < 0) {
+        return;
+    }
+    m_syncPending = false;
+    fdatasync(m_fd);
+    ++m_syncs;
+}
+
+QList<FlowJournal::Record> FlowJournal::readRecords(QList<QString> *committed)
+{
+    QList<Record> records;
+    QByteArray content;
+    if (lseek(m_fd, 0, SEEK_SET) < 0) {
+        return records;
+    }
+    char buffer[16384];
+    for (;;) {
+        ssize_t n = read(m_fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        content.append(buffer, int(n));
+    }
+
+    // 最后一行可能在写入时被截断，解析失败的行直接跳过
+    const QList<QByteArray> lines = content.split('\n');
+    for (const QByteArray &line : lines) {
+        QJsonObject obj = QJsonDocument::fromJson(line).object();
+        QString flowId = obj.value("flow").toString();
+        if (flowId.isEmpty()) {
+            continue;
+        }
+        if (obj.value("op").toString() == QLatin1String("commit")) {
+            committed->append(flowId);
+            continue;
+        }
+        Record record;
+        record.flowId = flowId;
+        record.type = obj.value("type").toString();
+        record.pid = qint64(obj.value("pid").toDouble());
+        record.at = qint64(obj.value("at").toDouble());
+        record.data = obj.value("data").toObject().toVariantMap();
+        records.append(record);
+    }
+    return records;
+}
+
+QList<FlowJournal::Record> FlowJournal::pending()
+{
+    QList<Record> result;
+    if (m_fd < 0) {
+        return result;
+    }
+    QList<QString> committedList;
+    if (!lock()) {
+        return result;
+    }
+    QList<Record> records = readRecords(&committedList);
+    unlock();
+    const QSet<QString> committed(committedList.begin(), committedList.end());
+    qint64 self = QCoreApplication::applicationPid();
+    for (const Record &record : qAsConst(records)) {
+        if (committed.contains(record.flowId)) {
+            continue;
+        }
+        if (record.pid != self && record.pid > 0 && kill(pid_t(record.pid), 0) == 0) {
+            continue;
+        }
+        result.append(record);
+    }
+    return result;
+}
+
+void FlowJournal::compact()
+{
+    if (m_fd < 0 || !lock()) {
+        return;
+    }
+    QList<QString> committedList;
+    const QList<Record> records = readRecords(&committedList);
+    const QSet<QString> committed(committedList.begin(), committedList.end());
+
+    QByteArray content;
+    for (const Record &record : records) {
+        if (committed.contains(record.flowId)) {
+            continue;
+        }
+        QJsonObject obj;
+        obj["op"] = "begin";
+        obj["flow"] = record.flowId;
+        obj["type"] = record.type;
+        obj["pid"] = record.pid;
+        obj["at"] = record.at;
+        obj["data"] = QJsonObject::fromVariantMap(record.data);
+        content.append(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+        content.append('\n');
+    }
+    // 新内容落盘后才替换日志：写入中途崩溃或磁盘已满时原日志保持不变
+    const QByteArray path = QFile::encodeName(m_fileName);
+    const QByteArray tempPath = path + ".compact";
+    int tempFd = open(tempPath.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    bool written = tempFd >= 0 && writeAll(tempFd, content) && fsync(tempFd) == 0;
+    if (tempFd >= 0) {
+        close(tempFd);
+    }
+    if (!written || rename(tempPath.constData(), path.constData()) != 0) {
+        qWarning() << "FlowJournal: compacting" << m_fileName << "failed:" << strerror(errno);
+        unlink(tempPath.constData());
+        unlock();
+        return;
+    }
+    // rename 本身也要落盘
+    int dirFd = open(QFile::encodeName(QFileInfo(m_fileName).absolutePath()).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    ++m_syncs;
+
+    // 等待锁的其他进程发现文件已被替换后重新打开；本进程改用新文件
+    unlock();
+    close(m_fd);
+    m_syncPending = false;
+    openFile();
+}
+
+QString FlowJournal::tokenDigest(const QString &token)
+{
+    return QString::fromLatin1(QCryptographicHash::hash(token.toUtf8(), QCryptographicHash::Sha256).toHex());
+}
+
+QVariantMap FlowJournal::statistics() const
+{
+    QVariantMap stats;
+    stats["file"] = m_fileName;
+    stats["available"] = m_fd >= 0;
+    stats["begun"] = m_begun;
+    stats["committed"] = m_committed;
+    stats["syncs"] = m_syncs;
+    return stats;
+}
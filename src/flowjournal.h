@@ -0,0 +1,70 @@
+#pragma once
+#include <QObject>
+#include <QList>
+#include <QString>
+#include <QTimer>
+#include <QVariantMap>
+
+class QJsonObject;
+
+// 进行中流程的预写日志（JSONL，权限 0600）
+// 令牌端点签发的令牌在写入账户之前先追加到日志：插件在 success() 之前记录新账户的令牌，
+// 令牌代理在写回账户之前记录轮换后的 refresh_token。写入账户后追加提交记录。
+// 进程在两者之间退出时，下次启动重放未提交的记录，已签发的令牌不会丢失。
+//
+// 签发记录立即 fdatasync；提交记录只 write，在 SyncDelayMs 内合并为一次 fdatasync
+// （提交记录丢失只会导致重放时发现账户已是最新并再次提交）。
+// 多个进程可能追加同一日志，追加和压缩都持有 flock。压缩把保留的记录写入临时文件、落盘后
+// rename 覆盖日志，任何时刻磁盘上都有完整的日志；其他进程加锁后发现文件已被替换时重新打开。
+class FlowJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int SyncDelayMs = 200;
+
+    struct Record {
+        QString flowId;
+        QString type;        // 插件：account；令牌代理：rotation
+        qint64 pid = 0;      // 写入记录的进程
+        qint64 at = 0;       // 秒
+        QVariantMap data;
+    };
+
+    // 日志文件为 <数据目录>/kde-oauth2-plugin/<name>-journal.jsonl
+    explicit FlowJournal(const QString &name, QObject *parent = nullptr);
+    ~FlowJournal() override;
+
+    // 追加签发记录并立即落盘，返回流程ID；日志不可用时返回空字符串
+    QString begin(const QString &type, const QVariantMap &data);
+    // 追加提交记录（批量落盘）
+    void commit(const QString &flowId);
+
+    // 未提交的记录；仍在运行的其他进程写入的记录不返回（它们可能正要提交）
+    QList<Record> pending();
+    // 重写日志，只保留未提交的记录
+    void compact();
+
+    QString fileName() const { return m_fileName; }
+    // 令牌的摘要（SHA-256，十六进制），用于在记录中标识被替换的令牌而不保存它
+    static QString tokenDigest(const QString &token);
+    QVariantMap statistics() const;
+
+private:
+    bool openFile();
+    // 加锁后确认描述符仍指向当前的日志文件（压缩可能已替换它），否则重新打开
+    bool lock();
+    void unlock();
+    bool append(const QJsonObject &record, bool durable);
+    QList<Record> readRecords(QList<QString> *committed);
+    void syncNow();
+
+    QString m_fileName;
+    int m_fd = -1;
+    QTimer m_syncTimer;
+    bool m_syncPending = false;
+
+    quint64 m_begun = 0;
+    quint64 m_committed = 0;
+    quint64 m_syncs = 0;
+};
@@ -0,0 +1,303 @@
+#include "jsonresponsereader.h"
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+
+namespace {
+
+inline bool isJsonSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+} // namespace
+
+JsonMemberScanner::JsonMemberScanner(const QSet<QString> &wantedKeys)
+    : m_wanted(wantedKeys)
+{
+}
+
+JsonMemberScanner::Status JsonMemberScanner::feed(const char *data, qint64 size)
+{
+    for (qint64 i = 0; i < size && (m_status == NeedMoreData || m_status == Complete); ++i) {
+        const char c = data[i];
+
+        switch (m_state) {
+        case BeforeObject:
+            if (isJsonSpace(c)) {
+                break;
+            }
+            if (c != '{') {
+                m_status = Malformed;
+                break;
+            }
+            m_state = BeforeKey;
+            break;
+
+        case BeforeKey:
+            if (isJsonSpace(c)) {
+                break;
+            }
+            if (c == '"') {
+                m_key.clear();
+                m_keyEscape = false;
+                m_state = InKey;
+            } else if (c == '}' && !m_expectKey) {
+                m_state = Done;
+                m_status = Complete;
+            } else {
+                m_status = Malformed;
+            }
+            break;
+
+        case InKey:
+            if (m_keyEscape) {
+                m_keyEscape = false;
+            } else if (c == '\\') {
+                m_keyEscape = true;
+            } else if (c == '"') {
+                m_state = AfterKey;
+                break;
+            }
+            m_key.append(c);
+            if (m_key.size() > MaxKeyLength) {
+                m_status = Malformed;
+            }
+            break;
+
+        case AfterKey:
+            if (isJsonSpace(c)) {
+                break;
+            }
+            if (c != ':') {
+                m_status = Malformed;
+                break;
+            }
+            m_capture = m_wanted.contains(decodeKey());
+            m_value.clear();
+            m_depth = 0;
+            m_inString = false;
+            m_escape = false;
+            m_state = BeforeValue;
+            break;
+
+        case BeforeValue:
+            if (isJsonSpace(c)) {
+                break;
+            }
+            m_state = InValue;
+            Q_FALLTHROUGH();
+
+        case InValue:
+            if (m_inString) {
+                if (m_capture) {
+                    m_value.append(c);
+                }
+                if (m_escape) {
+                    m_escape = false;
+                } else if (c == '\\') {
+                    m_escape = true;
+                } else if (c == '"') {
+                    m_inString = false;
+                    if (m_depth == 0 && !endValue()) {
+                        m_status = Malformed;
+                    }
+                }
+                break;
+            }
+
+            if (m_depth == 0 && (c == ',' || c == '}')) {
+                // 标量值在顶层对象的分隔符处结束
+                if (!endValue()) {
+                    m_status = Malformed;
+                    break;
+                }
+                if (c == ',') {
+                    m_expectKey = true;
+                    m_state = BeforeKey;
+                } else {
+                    m_state = Done;
+                    m_status = Complete;
+                }
+                break;
+            }
+
+            if (m_capture) {
+                m_value.append(c);
+            }
+            if (c == '"') {
+                m_inString = true;
+            } else if (c == '{' || c == '[') {
+                if (++m_depth > MaxDepth) {
+                    m_status = TooDeep;
+                }
+            } else if (c == '}' || c == ']') {
+                if (--m_depth < 0 || (m_depth == 0 && !endValue())) {
+                    m_status = Malformed;
+                }
+            }
+            break;
+
+        case AfterValue:
+            if (isJsonSpace(c)) {
+                break;
+            }
+            if (c == ',') {
+                m_expectKey = true;
+                m_state = BeforeKey;
+            } else if (c == '}') {
+                m_state = Done;
+                m_status = Complete;
+            } else {
+                m_status = Malformed;
+            }
+            break;
+
+        case Done:
+            if (!isJsonSpace(c)) {
+                m_status = Malformed;
+            }
+            break;
+        }
+    }
+    return m_status;
+}
+
+JsonMemberScanner::Status JsonMemberScanner::finish()
+{
+    if (m_status == NeedMoreData) {
+        m_status = Malformed;
+    }
+    return m_status;
+}
+
+bool JsonMemberScanner::endValue()
+{
+    m_expectKey = false;
+    m_state = AfterValue;
+
+    if (!m_capture) {
+        ++m_skipped;
+        return true;
+    }
+
+    // 只解析需要的成员
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson('[' + m_value + ']', &error);
+    m_value.clear();
+    if (error.error != QJsonParseError::NoError || doc.array().size() != 1) {
+        return false;
+    }
+    m_members.insert(decodeKey(), doc.array().at(0));
+    return true;
+}
+
+QString JsonMemberScanner::decodeKey() const
+{
+    if (!m_key.contains('\\')) {
+        return QString::fromUtf8(m_key);
+    }
+    QJsonDocument doc = QJsonDocument::fromJson("[\"" + m_key + "\"]");
+    return doc.array().at(0).toString();
+}
+
+JsonResponseReader::JsonResponseReader(QNetworkReply *reply, qint64 maxBodySize, const QSet<QString> &wantedKeys)
+    : QObject(reply)
+    , m_reply(reply)
+    , m_maxBodySize(maxBodySize)
+    , m_scanner(wantedKeys)
+{
+    // 限制 QNetworkReply 的内部缓冲，使网络读取跟随本读取器的消费速度
+    reply->setReadBufferSize(ReadChunkSize * 4);
+    connect(reply, &QNetworkReply::metaDataChanged, this, &JsonResponseReader::onMetaDataChanged);
+    connect(reply, &QIODevice::readyRead, this, &JsonResponseReader::onReadyRead);
+}
+
+JsonResponseReader *JsonResponseReader::attach(QNetworkReply *reply, qint64 maxBodySize, const QSet<QString> &wantedKeys)
+{
+    return new JsonResponseReader(reply, maxBodySize, wantedKeys);
+}
+
+JsonResponseReader *JsonResponseReader::forReply(QNetworkReply *reply)
+{
+    return reply ? reply->findChild<JsonResponseReader *>(QString(), Qt::FindDirectChildrenOnly) : nullptr;
+}
+
+JsonResponseReader::Result JsonResponseReader::finish()
+{
+    if (m_finished) {
+        return m_result;
+    }
+    m_finished = true;
+
+    if (m_result == Ok && consume() && m_scanner.finish() != JsonMemberScanner::Complete) {
+        m_result = Malformed;
+    }
+    qDebug() << "JsonResponseReader: read" << m_bytesRead << "bytes, kept" << m_scanner.members().size()
+             << "members, skipped" << m_scanner.skippedMembers();
+    return m_result;
+}
+
+QString JsonResponseReader::errorString() const
+{
+    switch (m_result) {
+    case Ok:
+        return QString();
+    case TooLarge:
+        return QString("响应超过大小上限（%1 字节）").arg(m_maxBodySize);
+    case Malformed:
+        return QString("响应不是有效的 JSON 对象");
+    }
+    return QString();
+}
+
+void JsonResponseReader::onMetaDataChanged()
+{
+    // 声明的长度已超过上限时，不等数据到达就中止
+    bool ok = false;
+    qint64 length = m_reply->header(QNetworkRequest::ContentLengthHeader).toLongLong(&ok);
+    if (ok && m_maxBodySize > 0 && length > m_maxBodySize) {
+        qDebug() << "JsonResponseReader: Content-Length" << length << "exceeds limit" << m_maxBodySize;
+        reject(TooLarge);
+    }
+}
+
+void JsonResponseReader::onReadyRead()
+{
+    if (m_result == Ok) {
+        consume();
+    }
+}
+
+bool JsonResponseReader::consume()
+{
+    char chunk[ReadChunkSize];
+    while (m_reply->bytesAvailable() > 0) {
+        qint64 read = m_reply->read(chunk, sizeof(chunk));
+        if (read <= 0) {
+            break;
+        }
+        m_bytesRead += read;
+        if (m_maxBodySize > 0 && m_bytesRead > m_maxBodySize) {
+            reject(TooLarge);
+            return false;
+        }
+
+        JsonMemberScanner::Status status = m_scanner.feed(chunk, read);
+        if (status == JsonMemberScanner::Malformed || status == JsonMemberScanner::TooDeep) {
+            reject(Malformed);
+            return false;
+        }
+    }
+    return true;
+}
+
+void JsonResponseReader::reject(Result result)
+{
+    m_result = result;
+    if (m_reply->isRunning()) {
+        m_reply->abort();
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <QObject>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QSet>
+#include <QString>
+
+class QNetworkReply;
+
+// 流式 JSON 成员扫描器
+// 逐字节扫描顶层 JSON 对象，只把需要的成员解析为 QJsonValue，其余成员直接跳过，
+// 不构建整个文档。可以分多次输入数据，已处理的数据不会保留。
+class JsonMemberScanner
+{
+public:
+    enum Status {
+        NeedMoreData,   // 顶层对象尚未结束
+        Complete,       // 顶层对象已完整
+        Malformed,      // 非法 JSON 或不是对象
+        TooDeep         // 嵌套层数超过上限
+    };
+
+    static constexpr int MaxDepth = 64;
+    static constexpr int MaxKeyLength = 4096;
+
+    explicit JsonMemberScanner(const QSet<QString> &wantedKeys = QSet<QString>());
+
+    Status feed(const char *data, qint64 size);
+    // 输入结束；顶层对象未结束时返回 Malformed
+    Status finish();
+    Status status() const { return m_status; }
+
+    QJsonObject members() const { return m_members; }
+    int skippedMembers() const { return m_skipped; }
+
+private:
+    enum State {
+        BeforeObject,
+        BeforeKey,
+        InKey,
+        AfterKey,
+        BeforeValue,
+        InValue,
+        AfterValue,
+        Done
+    };
+
+    bool endValue();
+    QString decodeKey() const;
+
+    QSet<QString> m_wanted;
+    Status m_status = NeedMoreData;
+    State m_state = BeforeObject;
+    bool m_expectKey = false;   // 逗号之后必须出现键
+
+    QByteArray m_key;
+    bool m_keyEscape = false;
+
+    bool m_capture = false;     // 当前值是否需要解析
+    QByteArray m_value;
+    int m_depth = 0;
+    bool m_inString = false;
+    bool m_escape = false;
+
+    QJsonObject m_members;
+    int m_skipped = 0;
+};
+
+// 带大小上限的 JSON 响应读取器
+// 挂在 QNetworkReply 上，随 readyRead 分块读取并交给 JsonMemberScanner，
+// Content-Length 或已读字节超过上限、或 JSON 非法时立即中止请求。
+class JsonResponseReader : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Result {
+        Ok,
+        TooLarge,
+        Malformed
+    };
+
+    static constexpr int ReadChunkSize = 16384;
+
+    // 读取器以 reply 为父对象，随 reply 一起释放
+    static JsonResponseReader *attach(QNetworkReply *reply, qint64 maxBodySize, const QSet<QString> &wantedKeys);
+    static JsonResponseReader *forReply(QNetworkReply *reply);
+
+    // 在 reply finished 之后调用：读取剩余数据并返回结果
+    Result finish();
+    QJsonObject members() const { return m_scanner.members(); }
+    qint64 bytesRead() const { return m_bytesRead; }
+    QString errorString() const;
+
+private slots:
+    void onMetaDataChanged();
+    void onReadyRead();
+
+private:
+    JsonResponseReader(QNetworkReply *reply, qint64 maxBodySize, const QSet<QString> &wantedKeys);
+    bool consume();
+    void reject(Result result);
+
+    QNetworkReply *m_reply;
+    qint64 m_maxBodySize;
+    qint64 m_bytesRead = 0;
+    JsonMemberScanner m_scanner;
+    Result m_result = Ok;
+    bool m_finished = false;
+};
@@ -1,140 +1,44 @@
 #include "kdeoauth2plugin.h"
+#include "accountstore.h"
+#include "accountwriter.h"
+#include "brokerclient.h"
+#include "callbackserver.h"
+#include "flowjournal.h"
+#include "oauth2config.h"
+#include "oauth2flow.h"
+#include "providerregistry.h"
+#include "stringpool.h"
+#include "tokenratelimiter.h"
 #include <QDebug>
 #include <QMessageBox>
 #include <QTimer>
 #include <QJsonDocument>
 #include <QJsonObject>
-#include <QNetworkRequest>
 #include <QNetworkReply>
-#include <QUrlQuery>
-#include <QUuid>
 #include <QApplication>
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <QHostAddress>
 #include <QFile>
-#include <QXmlStreamReader>
+#include <QDBusMetaType>
+#include <QDateTime>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
 // Accounts-Qt
 #include <Accounts/Manager>
 #include <Accounts/Account>
 
-// 本地HTTP服务器类，用于捕获OAuth2回调
-class CallbackServer : public QTcpServer
-{
-    Q_OBJECT
-    
-public:
-    explicit CallbackServer(QObject *parent = nullptr)
-        : QTcpServer(parent)
-    {
-    }
-    
-signals:
-    void authorizationCodeReceived(const QString &code);
-    void authorizationError(const QString &error, const QString &description);
-    
-protected:
-    void incomingConnection(qintptr socketDescriptor) override
-    {
-        QTcpSocket *socket = new QTcpSocket(this);
-        socket->setSocketDescriptor(socketDescriptor);
-        
-        connect(socket, &QTcpSocket::readyRead, [this, socket]() {
-            QByteArray data = socket->readAll();
-            QString request = QString::fromUtf8(data);
-            
-            qDebug() << "CallbackServer: received request:" << request;
-            
-            // 解析HTTP请求获取URL
-            QStringList lines = request.split("\r\n");
-            if (!lines.isEmpty()) {
-                QString firstLine = lines.first();
-                QStringList parts = firstLine.split(" ");
-                if (parts.size() >= 2) {
-                    QString path = parts[1];
-                    
-                    // 创建完整URL用于解析
-                    QUrl url("http://localhost:8080" + path);
-                    QUrlQuery query(url);
-                    
-                    QString response;
-                    if (query.hasQueryItem("code")) {
-                        QString code = query.queryItemValue("code");
-                        response = createSuccessResponse(code);
-                        emit authorizationCodeReceived(code);
-                    } else if (query.hasQueryItem("error")) {
-                        QString error = query.queryItemValue("error");
-                        QString errorDesc = query.queryItemValue("error_description");
-                        response = createErrorResponse(error, errorDesc);
-                        emit authorizationError(error, errorDesc);
-                    } else {
-                        response = createErrorResponse("invalid_request", "No authorization code or error received");
-                    }
-                    
-                    socket->write(response.toUtf8());
-                    socket->flush();
-                    socket->disconnectFromHost();
-                }
-            }
-        });
-        
-        connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
-    }
-    
-private:
-    QString createSuccessResponse(const QString &code)
-    {
-        QString html = QString(
-            "<!DOCTYPE html>\n"
-            "<html><head><title>认证成功</title></head>\n"
-            "<body style='font-family: Arial, sans-serif; text-align: center; padding: 50px; background: #f0f8ff;'>\n"
-            "<h2 style='color: #28a745;'>✅ OAuth2 认证成功！</h2>\n"
-            "<p>授权码已自动获取</p>\n"
-            "<p style='font-size: 12px; color: #666;'>授权码: <code style='background: #f8f9fa; padding: 2px 4px; border-radius: 3px;'>%1</code></p>\n"
-            "<p>您可以关闭此页面，账户将自动创建。</p>\n"
-            "<script>setTimeout(function(){window.close();}, 3000);</script>\n"
-            "</body></html>"
-        ).arg(code.left(20) + "...");
-        
-        return QString(
-            "HTTP/1.1 200 OK\r\n"
-            "Content-Type: text/html; charset=utf-8\r\n"
-            "Content-Length: %1\r\n"
-            "Connection: close\r\n"
-            "\r\n%2"
-        ).arg(html.toUtf8().size()).arg(html);
-    }
-    
-    QString createErrorResponse(const QString &error, const QString &description)
-    {
-        QString html = QString(
-            "<!DOCTYPE html>\n"
-            "<html><head><title>认证失败</title></head>\n"
-            "<body style='font-family: Arial, sans-serif; text-align: center; padding: 50px; background: #fff5f5;'>\n"
-            "<h2 style='color: #dc3545;'>❌ OAuth2 认证失败</h2>\n"
-            "<p>错误: %1</p>\n"
-            "<p>描述: %2</p>\n"
-            "<p>您可以关闭此页面重试。</p>\n"
-            "</body></html>"
-        ).arg(error, description);
-        
-        return QString(
-            "HTTP/1.1 200 OK\r\n"
-            "Content-Type: text/html; charset=utf-8\r\n"
-            "Content-Length: %1\r\n"
-            "Connection: close\r\n"
-            "\r\n%2"
-        ).arg(html.toUtf8().size()).arg(html);
-    }
-};
-
 // OAuth2Dialog 实现
-OAuth2Dialog::OAuth2Dialog(const QString &authUrl, const QString &redirectUri, QWidget *parent)
+OAuth2Dialog::OAuth2Dialog(const QString &redirectUri, const QList<quint16> &callbackPorts,
+                           const AuthUrlBuilder &authUrlBuilder, QWidget *parent)
     : QDialog(parent)
-    , m_authUrl(authUrl)
-    , m_redirectUri(redirectUri)
     , m_callbackServer(nullptr)
     , m_useWebView(false) // false = 自动模式, true = 手动模式
+    , m_authUrl(authUrlBuilder(redirectUri))
+    , m_redirectUri(redirectUri)
+    , m_configuredRedirectUri(redirectUri)
+    , m_callbackPorts(callbackPorts)
+    , m_authUrlBuilder(authUrlBuilder)
 {
     setWindowTitle("OAuth2 认证");
     setModal(true);
@@ -179,7 +83,7 @@ OAuth2Dialog::OAuth2Dialog(const QString &authUrl, const QString &redirectUri, Q
     
     // 手动输入区域（默认隐藏）
     m_urlDisplay = new QTextEdit();
-    m_urlDisplay->setPlainText(authUrl);
+    m_urlDisplay->setPlainText(m_authUrl);
     m_urlDisplay->setMaximumHeight(80);
     m_urlDisplay->setReadOnly(true);
     m_urlDisplay->hide();
@@ -228,23 +132,39 @@ OAuth2Dialog::OAuth2Dialog(const QString &authUrl, const QString &redirectUri, Q
 OAuth2Dialog::~OAuth2Dialog()
 {
     if (m_callbackServer) {
-        m_callbackServer->close();
+        m_callbackServer->stopListening();
         m_callbackServer->deleteLater();
     }
 }
 
+void OAuth2Dialog::applyRedirectUri(const QString &redirectUri)
+{
+    m_redirectUri = redirectUri;
+    m_authUrl = m_authUrlBuilder(redirectUri);
+    m_urlDisplay->setPlainText(m_authUrl);
+}
+
 void OAuth2Dialog::startCallbackServer()
 {
-    m_callbackServer = new CallbackServer(this);
+    if (!m_callbackServer) {
+        m_callbackServer = new CallbackServer(this);
+        
+        connect(m_callbackServer, &CallbackServer::authorizationCodeReceived, 
+                this, &OAuth2Dialog::onAuthorizationCodeReceived);
+        connect(m_callbackServer, &CallbackServer::authorizationError,
+                this, &OAuth2Dialog::onAuthorizationError);
+    }
     
-    connect(m_callbackServer, &CallbackServer::authorizationCodeReceived, 
-            this, &OAuth2Dialog::onAuthorizationCodeReceived);
-    connect(m_callbackServer, &CallbackServer::authorizationError,
-            this, &OAuth2Dialog::onAuthorizationError);
+    m_callbackServer->setCallbackPath(QUrl(m_configuredRedirectUri).path().toUtf8());
     
-    if (m_callbackServer->listen(QHostAddress::LocalHost, 8080)) {
-        qDebug() << "OAuth2Dialog: callback server started on port 8080";
-        m_statusLabel->setText("✅ 回调服务器已启动，准备接收认证结果...");
+    if (m_callbackServer->listenLoopback(m_callbackPorts)) {
+        // redirect_uri 使用实际监听的端口
+        QUrl redirectUrl(m_configuredRedirectUri);
+        redirectUrl.setPort(m_callbackServer->serverPort());
+        applyRedirectUri(redirectUrl.toString());
+        
+        qDebug() << "OAuth2Dialog: callback server started, redirect URI:" << m_redirectUri;
+        m_statusLabel->setText(QString("✅ 回调服务器已启动（端口 %1），准备接收认证结果...").arg(m_callbackServer->serverPort()));
         m_statusLabel->setStyleSheet("padding: 10px; background: #d4edda; color: #155724; border-radius: 5px;");
     } else {
         qDebug() << "OAuth2Dialog: failed to start callback server";
@@ -254,6 +174,14 @@ void OAuth2Dialog::startCallbackServer()
     }
 }
 
+QVariantMap OAuth2Dialog::callbackServerStatistics() const
+{
+    if (!m_callbackServer) {
+        return QVariantMap();
+    }
+    return m_callbackServer->statistics();
+}
+
 void OAuth2Dialog::onAuthorizationCodeReceived(const QString &code)
 {
     qDebug() << "OAuth2Dialog: received authorization code via callback:" << code;
@@ -306,10 +234,11 @@ void OAuth2Dialog::onWebViewModeToggle()
         m_statusLabel->setText("📋 请手动复制授权码并粘贴到下面的输入框中");
         m_statusLabel->setStyleSheet("padding: 10px; background: #e2e3e5; color: #383d41; border-radius: 5px;");
         
-        // 停止回调服务器
+        // 停止回调服务器，手动模式使用配置的 redirect_uri
         if (m_callbackServer) {
-            m_callbackServer->close();
+            m_callbackServer->stopListening();
         }
+        applyRedirectUri(m_configuredRedirectUri);
         
         m_codeEdit->setFocus();
     } else {
@@ -357,39 +286,201 @@ void OAuth2Dialog::onCancel()
 
 KDEOAuth2Plugin::KDEOAuth2Plugin(QObject *parent)
     : KAccountsUiPlugin(parent)
-    , m_networkManager(nullptr)
-    , m_serverUrl("http://192.168.1.12:9007")  // 默认值，可被环境变量覆盖
-    , m_clientId("10001")                       // 默认值，可被环境变量覆盖
-    , m_authPath("/connect/authorize")          // 默认值，可被环境变量覆盖
-    , m_tokenPath("/connect/token")             // 默认值，可被环境变量覆盖
-    , m_userInfoPath("/connect/userinfo")       // 默认值，可被环境变量覆盖
-    , m_redirectUri("http://localhost:8080/callback")  // 默认值，可被环境变量覆盖
-    , m_scope("openid profile")                 // 默认值，可被环境变量覆盖
+    , m_registry(nullptr)
+    , m_provider(nullptr)
     , m_dbusAdapter(nullptr)
 {
     qDebug() << "KDEOAuth2Plugin: Constructor called";
-    m_networkManager = new QNetworkAccessManager(this);
+    
+    // KAccounts 仅列出 provider 时也会加载插件，因此构造函数不做任何实际工作：
+    // 网络、DBus注册和配置解析都推迟到首次使用时（见 ensureInitialized）
+}
+
+void KDEOAuth2Plugin::ensureInitialized()
+{
+    if (m_initialized) {
+        return;
+    }
+    m_initialized = true;
+    
+    qDebug() << "KDEOAuth2Plugin: initializing plugin core on first use";
+    
+    // 索引所有使用本插件的 provider 文件；每个 provider 的配置分层加载：
+    // 默认值 < provider文件 < 环境变量 < 运行时覆盖
+    m_registry = new ProviderRegistry(this);
+    connect(m_registry, &ProviderRegistry::providerAdded, this, &KDEOAuth2Plugin::onProviderAdded);
+    connect(m_registry, &ProviderRegistry::providerRemoved, this, &KDEOAuth2Plugin::onProviderRemoved);
+    m_registry->scan();
+    
+    m_provider = m_registry->defaultProvider();
+    m_providerName = m_provider->providerId();
+    
+    m_journal = new FlowJournal("plugin", this);
+    replayJournal();
     
     // 创建DBus适配器
+    qDBusRegisterMetaType<QList<quint32>>();
     m_dbusAdapter = new KDEOAuth2PluginDBusAdapter(this);
     
     // 注册DBus服务
     QDBusConnection sessionBus = QDBusConnection::sessionBus();
     if (sessionBus.registerService("org.kde.kaccounts.OAuth2Plugin")) {
         if (sessionBus.registerObject("/OAuth2Plugin", this)) {
+            m_dbusRegistered = true;
             qDebug() << "KDEOAuth2Plugin: DBus service registered successfully";
             qDebug() << "KDEOAuth2Plugin: DBus adapter created and attached to object";
+            
+            // 每个 provider 在 /OAuth2Plugin/<provider> 下有独立的对象
+            const QList<ProviderContext *> providers = m_registry->providers();
+            for (ProviderContext *provider : providers) {
+                registerProviderObject(provider);
+            }
         } else {
             qDebug() << "KDEOAuth2Plugin: Failed to register DBus object:" << sessionBus.lastError().message();
+            sessionBus.unregisterService("org.kde.kaccounts.OAuth2Plugin");
         }
     } else {
         qDebug() << "KDEOAuth2Plugin: Failed to register DBus service:" << sessionBus.lastError().message();
     }
+}
+
+bool KDEOAuth2Plugin::selectProvider(const QString &providerId)
+{
+    ensureInitialized();
+    ProviderContext *provider = m_registry->provider(providerId);
+    if (!provider) {
+        qDebug() << "KDEOAuth2Plugin::selectProvider: unknown provider" << providerId;
+        return false;
+    }
+    // 按上下文比较：同一 ID 的 provider 可能已被移除并重新添加（例如文件移到了其他数据目录）
+    if (provider == m_provider) {
+        return true;
+    }
+    
+    // 认证流程进行中时不切换，避免授权码被交换到其他 provider
+    if (m_currentDialogState != "none") {
+        if (m_provider && m_provider->providerId() == providerId) {
+            // 重新添加的同一 provider：流程继续使用旧上下文，结束后由 switchToLiveProvider 换成新的
+            return true;
+        }
+        qWarning() << "KDEOAuth2Plugin::selectProvider: flow in progress for" << m_providerName
+                   << ", cannot switch to" << providerId;
+        return false;
+    }
+    
+    qDebug() << "KDEOAuth2Plugin: switching provider from" << m_providerName << "to" << providerId;
+    ProviderContext *previous = m_provider;
+    m_provider = provider;
+    m_providerName = providerId;
+    if (previous && m_registry->provider(previous->providerId()) != previous) {
+        // 已被移除的 provider 一直作为当前 provider 使用到流程结束，见 onProviderRemoved
+        previous->deleteLater();
+    }
+    return true;
+}
+
+QString KDEOAuth2Plugin::activeProviderId() const
+{
+    return m_provider ? m_provider->providerId() : QString();
+}
+
+bool KDEOAuth2Plugin::isProviderSelected(const QString &providerId) const
+{
+    return m_registry && m_provider && m_provider == m_registry->provider(providerId);
+}
+
+void KDEOAuth2Plugin::registerProviderObject(ProviderContext *provider)
+{
+    // 适配器以 provider 上下文为父对象，随上下文一起释放
+    if (!provider->findChild<KDEOAuth2PluginDBusAdapter *>(QString(), Qt::FindDirectChildrenOnly)) {
+        new KDEOAuth2PluginDBusAdapter(this, provider, provider->providerId());
+    }
+    QDBusConnection sessionBus = QDBusConnection::sessionBus();
+    if (sessionBus.registerObject(provider->dbusObjectPath(), provider)) {
+        qDebug() << "KDEOAuth2Plugin: provider" << provider->providerId() << "registered at" << provider->dbusObjectPath();
+    } else {
+        qDebug() << "KDEOAuth2Plugin: Failed to register provider object" << provider->dbusObjectPath()
+                 << sessionBus.lastError().message();
+    }
+}
+
+void KDEOAuth2Plugin::onProviderAdded(ProviderContext *provider)
+{
+    // 首次扫描时 DBus 尚未注册，对象注册在 ensureInitialized 中统一进行
+    if (m_dbusRegistered) {
+        registerProviderObject(provider);
+    }
+}
+
+void KDEOAuth2Plugin::onProviderRemoved(ProviderContext *provider)
+{
+    if (m_dbusRegistered) {
+        QDBusConnection::sessionBus().unregisterObject(provider->dbusObjectPath());
+    }
+    m_configOverrides.remove(provider->providerId());
     
-    // 优先从provider文件加载配置
-    loadProviderConfiguration();
-    // 再从环境变量加载配置（可覆盖provider配置）
-    loadConfigurationFromEnvironment();
+    // 上下文和挂在它上面的适配器一起释放。当前 provider 被移除时等这次扫描结束再切换：
+    // 同一 ID 可能随后重新添加（selectProvider 释放旧上下文）；进行中的流程继续使用旧上下文
+    if (provider == m_provider) {
+        QTimer::singleShot(0, this, &KDEOAuth2Plugin::switchToLiveProvider);
+        return;
+    }
+    provider->deleteLater();
+}
+
+void KDEOAuth2Plugin::switchToLiveProvider()
+{
+    if (!m_provider || m_currentDialogState != "none") {
+        return;
+    }
+    ProviderContext *live = m_registry->provider(m_provider->providerId());
+    if (live == m_provider) {
+        return;
+    }
+    // 优先使用以同一 ID 重新添加的上下文，否则回退到默认 provider
+    if (!live) {
+        live = m_registry->defaultProvider();
+    }
+    if (live) {
+        selectProvider(live->providerId());
+    }
+}
+
+AccountStore *KDEOAuth2Plugin::accountStore()
+{
+    if (!m_accountStore) {
+        m_accountStore = new AccountStore(this);
+    }
+    return m_accountStore;
+}
+
+void KDEOAuth2Plugin::dbusHasRole(quint32 accountId, const QString &role, QObject *context,
+                                  const std::function<void(bool)> &callback)
+{
+    // 角色索引由令牌代理维护
+    BrokerClient::hasRole(accountId, role, context, callback);
+}
+
+void KDEOAuth2Plugin::dbusAccountsWithRole(const QString &role, QObject *context,
+                                           const std::function<void(const QList<quint32> &)> &callback)
+{
+    // 与其他账户查询一致，只返回当前 provider 的账户
+    BrokerClient::accountsWithRole(role, m_providerName, context, callback);
+}
+
+QVariantMap KDEOAuth2Plugin::dbusGetProviders() const
+{
+    QVariantMap result;
+    if (!m_registry) {
+        return result;
+    }
+    const QList<ProviderContext *> providers = m_registry->providers();
+    for (ProviderContext *provider : providers) {
+        QVariantMap info = provider->statistics();
+        info["active"] = (provider == m_provider);
+        result.insert(provider->providerId(), info);
+    }
+    return result;
 }
 
 KDEOAuth2Plugin::~KDEOAuth2Plugin()
@@ -397,9 +488,15 @@ KDEOAuth2Plugin::~KDEOAuth2Plugin()
     qDebug() << "KDEOAuth2Plugin: Destructor called";
     
     // 注销DBus服务
-    QDBusConnection sessionBus = QDBusConnection::sessionBus();
-    sessionBus.unregisterObject("/OAuth2Plugin");
-    sessionBus.unregisterService("org.kde.kaccounts.OAuth2Plugin");
+    if (m_dbusRegistered) {
+        QDBusConnection sessionBus = QDBusConnection::sessionBus();
+        const QList<ProviderContext *> providers = m_registry->providers();
+        for (ProviderContext *provider : providers) {
+            sessionBus.unregisterObject(provider->dbusObjectPath());
+        }
+        sessionBus.unregisterObject("/OAuth2Plugin");
+        sessionBus.unregisterService("org.kde.kaccounts.OAuth2Plugin");
+    }
     
     // 清理DBus适配器
     if (m_dbusAdapter) {
@@ -411,6 +508,7 @@ KDEOAuth2Plugin::~KDEOAuth2Plugin()
 void KDEOAuth2Plugin::init(KAccountsUiPlugin::UiType type)
 {
     qDebug() << "KDEOAuth2Plugin: init called with type" << type;
+    ensureInitialized();
     qDebug() << "KDEOAuth2Plugin: NewAccountDialog =" << KAccountsUiPlugin::NewAccountDialog;
     qDebug() << "KDEOAuth2Plugin: ConfigureAccountDialog =" << KAccountsUiPlugin::ConfigureAccountDialog;
     
@@ -428,13 +526,24 @@ void KDEOAuth2Plugin::init(KAccountsUiPlugin::UiType type)
 
 void KDEOAuth2Plugin::setProviderName(const QString &providerName)
 {
-    m_providerName = providerName;
+    ensureInitialized();
+    // KAccounts 传入的 provider 名称即 provider 文件名，切换到对应的配置
+    if (!selectProvider(providerName)) {
+        m_providerName = providerName;
+    }
     qDebug() << "KDEOAuth2Plugin: provider name set to" << providerName;
 }
 
 void KDEOAuth2Plugin::showNewAccountDialog()
+{
+    startNewAccount(QHash<QString, QString>());
+}
+
+void KDEOAuth2Plugin::startNewAccount(const QHash<QString, QString> &flowOverrides)
 {
     qDebug() << "KDEOAuth2Plugin: showing new account dialog";
+    ensureInitialized();
+    switchToLiveProvider();
     
     // 更新状态
     m_currentDialogState = "creating";
@@ -447,12 +556,23 @@ void KDEOAuth2Plugin::showNewAccountDialog()
         emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, m_dialogInfo);
     }
     
-    // 检查是否已存在账户（单账户限制）
-    if (!m_providerName.isEmpty()) {
-        int accountCount = getAccountCountForProvider(m_providerName);
-        qDebug() << "KDEOAuth2Plugin: existing account count for provider" << m_providerName << ":" << accountCount;
+    if (m_providerName.isEmpty()) {
+        startOAuth2Flow(flowOverrides);
+        return;
+    }
+    
+    // 检查是否已存在账户（单账户限制），账户扫描在账户存储线程中进行
+    QString providerName = m_providerName;
+    accountStore()->listAccounts(providerName, this, [this, providerName, flowOverrides](const QVariantList &accounts) {
+        if (m_currentDialogState != "creating" || m_providerName != providerName) {
+            qDebug() << "KDEOAuth2Plugin: new account dialog canceled while counting accounts";
+            return;
+        }
+        
+        int accountCount = AccountStore::enabledCount(accounts);
+        qDebug() << "KDEOAuth2Plugin: existing account count for provider" << providerName << ":" << accountCount;
         if (accountCount > 0) {
-            QString errorMsg = QString("Provider '%1' 已存在账户，无法重复添加。\n如需更换请先删除原账户。").arg(m_providerName);
+            QString errorMsg = QString("Provider '%1' 已存在账户，无法重复添加。\n如需更换请先删除原账户。").arg(providerName);
             QMessageBox::warning(nullptr, "账户限制", errorMsg);
             
             // 发送错误信号
@@ -465,96 +585,35 @@ void KDEOAuth2Plugin::showNewAccountDialog()
             emit canceled();
             return;
         }
-    }
-    startOAuth2Flow();
-}
-
-int KDEOAuth2Plugin::getAccountCountForProvider(const QString &providerId) const
-{
-    qDebug() << "KDEOAuth2Plugin::getAccountCountForProvider: checking provider" << providerId;
-    
-    // 使用 Accounts-Qt 查询指定 provider 下的账户数
-    // 注意：KAccountsUiPlugin 运行于进程内，直接构造 Manager 即可
-    Accounts::Manager manager;
-    
-    // 输出所有可用的 provider
-    Accounts::ProviderList allProviders = manager.providerList();
-    qDebug() << "KDEOAuth2Plugin::getAccountCountForProvider: total providers available:" << allProviders.size();
-    for (const Accounts::Provider &provider : allProviders) {
-        qDebug() << "  - Available provider:" << provider.name();
-    }
-    
-    // 修复：使用通用的 accountList() 方法，然后手动过滤
-    // 因为 accountList(providerId) 依赖于 provider 注册，可能不可靠
-    Accounts::AccountIdList allIds = manager.accountList();
-    qDebug() << "KDEOAuth2Plugin::getAccountCountForProvider: total accounts found:" << allIds.size();
-    
-    int count = 0;
-    for (Accounts::AccountId id : allIds) {
-        qDebug() << "KDEOAuth2Plugin::getAccountCountForProvider: checking account ID" << id;
-        std::unique_ptr<Accounts::Account> account(manager.account(id));
-        if (account) {
-            QString accountProvider = account->providerName();
-            bool enabled = account->enabled();
-            qDebug() << "KDEOAuth2Plugin::getAccountCountForProvider: account" << id 
-                     << "provider:" << accountProvider << "enabled:" << enabled 
-                     << "target provider:" << providerId;
-            
-            // 手动比较 provider 名称
-            if (accountProvider == providerId && enabled) {
-                ++count;
-                qDebug() << "KDEOAuth2Plugin::getAccountCountForProvider: account" << id << "matches and is enabled, count now:" << count;
-            } else if (accountProvider == providerId) {
-                qDebug() << "KDEOAuth2Plugin::getAccountCountForProvider: account" << id << "matches but is disabled, skipping";
-            } else {
-                qDebug() << "KDEOAuth2Plugin::getAccountCountForProvider: account" << id << "provider mismatch, skipping";
-            }
-        } else {
-            qDebug() << "KDEOAuth2Plugin::getAccountCountForProvider: failed to load account" << id;
+        if (resumeJournaledAccount(providerName)) {
+            return;
         }
-    }
-    
-    qDebug() << "KDEOAuth2Plugin::getAccountCountForProvider: final enabled account count for provider" << providerId << ":" << count;
-    return count;
+        startOAuth2Flow(flowOverrides);
+    });
 }
 
-QStringList KDEOAuth2Plugin::dbusGetAccountsList() const
+void KDEOAuth2Plugin::dbusGetAccountsList(QObject *context, const std::function<void(const QStringList &)> &callback)
 {
     qDebug() << "KDEOAuth2Plugin::dbusGetAccountsList: getting accounts list";
     
-    QStringList result;
-    
-    // 使用 Accounts-Qt 查询所有账户
-    Accounts::Manager manager;
-    Accounts::AccountIdList allIds = manager.accountList();
-    
-    qDebug() << "KDEOAuth2Plugin::dbusGetAccountsList: total accounts found:" << allIds.size();
-    
-    for (Accounts::AccountId id : allIds) {
-        std::unique_ptr<Accounts::Account> account(manager.account(id));
-        if (account) {
-            QString accountProvider = account->providerName();
-            bool enabled = account->enabled();
-            QString displayName = account->displayName();
-            
-            // 只返回当前provider的账户
-            if (accountProvider == m_providerName) {
-                QString accountInfo = QString("ID:%1|Name:%2|Enabled:%3")
-                    .arg(id)
-                    .arg(displayName.isEmpty() ? QString("Account %1").arg(id) : displayName)
-                    .arg(enabled ? "Yes" : "No");
-                
-                result.append(accountInfo);
-                qDebug() << "KDEOAuth2Plugin::dbusGetAccountsList: found account:" << accountInfo;
-            }
+    // 只返回当前provider的账户
+    accountStore()->listAccounts(m_providerName, context, [callback](const QVariantList &accounts) {
+        QStringList result;
+        for (const QVariant &entry : accounts) {
+            QVariantMap account = entry.toMap();
+            quint32 id = account.value("id").toUInt();
+            QString displayName = account.value("displayName").toString();
+            result.append(QString("ID:%1|Name:%2|Enabled:%3")
+                .arg(id)
+                .arg(displayName.isEmpty() ? QString("Account %1").arg(id) : displayName)
+                .arg(account.value("enabled").toBool() ? "Yes" : "No"));
         }
-    }
-    
-    qDebug() << "KDEOAuth2Plugin::dbusGetAccountsList: returning" << result.size() << "accounts";
-    return result;
+        qDebug() << "KDEOAuth2Plugin::dbusGetAccountsList: returning" << result.size() << "accounts";
+        callback(result);
+    });
 }
 
-bool KDEOAuth2Plugin::dbusDeleteAccount(quint32 accountId)
+void KDEOAuth2Plugin::dbusDeleteAccount(quint32 accountId, QObject *context, const std::function<void(bool)> &callback)
 {
     qDebug() << "KDEOAuth2Plugin::dbusDeleteAccount: deleting account" << accountId;
     
@@ -564,23 +623,39 @@ bool KDEOAuth2Plugin::dbusDeleteAccount(quint32 accountId)
     
     if (!account) {
         qDebug() << "KDEOAuth2Plugin::dbusDeleteAccount: account not found" << accountId;
-        return false;
+        callback(false);
+        return;
     }
     
     // 检查是否是当前provider的账户
     if (account->providerName() != m_providerName) {
         qDebug() << "KDEOAuth2Plugin::dbusDeleteAccount: account provider mismatch" << account->providerName() << "vs" << m_providerName;
-        return false;
+        callback(false);
+        return;
     }
     
-    // 删除账户
-    account->remove();
-    qDebug() << "KDEOAuth2Plugin::dbusDeleteAccount: delete request sent for account" << accountId;
-    
-    return true;
+    // 令牌在服务器上仍然有效：令牌代理确认写入吊销发件箱后才删除账户，否则令牌再也无法吊销
+    queueRevocation(account.get(), context, [accountId, callback](bool queued) {
+        if (!queued) {
+            qWarning() << "KDEOAuth2Plugin::dbusDeleteAccount: tokens could not be queued for revocation, account"
+                       << accountId << "kept";
+            callback(false);
+            return;
+        }
+        Accounts::Manager manager;
+        std::unique_ptr<Accounts::Account> account(manager.account(accountId));
+        if (account) {
+            // 删除账户（令牌代理收到 accountRemoved 后丢弃缓存和刷新计划）
+            account->remove();
+            account->sync();
+        }
+        qDebug() << "KDEOAuth2Plugin::dbusDeleteAccount: account" << accountId << "deleted";
+        callback(true);
+    });
 }
 
-bool KDEOAuth2Plugin::dbusEnableAccount(quint32 accountId, bool enabled)
+void KDEOAuth2Plugin::dbusEnableAccount(quint32 accountId, bool enabled, QObject *context,
+                                        const std::function<void(bool)> &callback)
 {
     qDebug() << "KDEOAuth2Plugin::dbusEnableAccount: setting account" << accountId << "enabled:" << enabled;
     
@@ -590,21 +665,70 @@ bool KDEOAuth2Plugin::dbusEnableAccount(quint32 accountId, bool enabled)
     
     if (!account) {
         qDebug() << "KDEOAuth2Plugin::dbusEnableAccount: account not found" << accountId;
-        return false;
+        callback(false);
+        return;
     }
     
     // 检查是否是当前provider的账户
     if (account->providerName() != m_providerName) {
         qDebug() << "KDEOAuth2Plugin::dbusEnableAccount: account provider mismatch" << account->providerName() << "vs" << m_providerName;
-        return false;
+        callback(false);
+        return;
     }
     
-    // 设置启用状态
-    account->setEnabled(enabled);
-    account->sync();
-    qDebug() << "KDEOAuth2Plugin::dbusEnableAccount: account" << accountId << "enabled set to" << enabled;
+    if (enabled) {
+        if (!account->enabled()) {
+            account->setEnabled(true);
+            account->sync();
+        }
+        qDebug() << "KDEOAuth2Plugin::dbusEnableAccount: account" << accountId << "enabled";
+        callback(true);
+        return;
+    }
     
-    return true;
+    // 停用的账户不再使用令牌：吊销并从账户中清除，重新启用后需要重新认证。
+    // 令牌代理确认写入吊销发件箱后才清除，否则账户保持原状
+    queueRevocation(account.get(), context, [accountId, callback](bool queued) {
+        if (!queued) {
+            qWarning() << "KDEOAuth2Plugin::dbusEnableAccount: tokens could not be queued for revocation, account"
+                       << accountId << "left enabled";
+            callback(false);
+            return;
+        }
+        Accounts::Manager manager;
+        std::unique_ptr<Accounts::Account> account(manager.account(accountId));
+        if (!account) {
+            callback(false);
+            return;
+        }
+        QVariantMap cleared;
+        cleared["access_token"] = QString();
+        cleared["refresh_token"] = QString();
+        cleared["expires_at"] = 0;
+        // 状态和令牌都未变化时不写数据库
+        bool changed = !AccountWriter::stage(account.get(), cleared).isEmpty();
+        if (account->enabled()) {
+            account->setEnabled(false);
+            changed = true;
+        }
+        if (changed) {
+            account->sync();
+        }
+        qDebug() << "KDEOAuth2Plugin::dbusEnableAccount: account" << accountId << "disabled";
+        callback(true);
+    });
+}
+
+void KDEOAuth2Plugin::queueRevocation(Accounts::Account *account, QObject *context,
+                                      const std::function<void(bool queued)> &callback)
+{
+    QString accessToken = account->value("access_token").toString();
+    QString refreshToken = account->value("refresh_token").toString();
+    if (accessToken.isEmpty() && refreshToken.isEmpty()) {
+        callback(true);
+        return;
+    }
+    BrokerClient::queueRevocation(account->providerName(), accessToken, refreshToken, context, callback);
 }
 
 QVariantMap KDEOAuth2Plugin::dbusGetAccountDetails(quint32 accountId)
@@ -639,14 +763,15 @@ QVariantMap KDEOAuth2Plugin::dbusGetAccountDetails(quint32 accountId)
     // 获取账户设置（如果可用）
     // 注意：Accounts-Qt的设置访问方式可能因版本而异
     // 这里我们只返回基本信息，避免API兼容性问题
-    result["server"] = m_serverUrl;
-    result["client_id"] = m_clientId;
+    OAuth2Config::SnapshotPtr snapshot = currentConfig();
+    result["server"] = snapshot->serverUrl;
+    result["client_id"] = snapshot->clientId;
     
     qDebug() << "KDEOAuth2Plugin::dbusGetAccountDetails: returning basic details";
     return result;
 }
 
-bool KDEOAuth2Plugin::dbusRefreshToken(quint32 accountId)
+void KDEOAuth2Plugin::dbusRefreshToken(quint32 accountId, QObject *context, const std::function<void(bool)> &callback)
 {
     qDebug() << "KDEOAuth2Plugin::dbusRefreshToken: refreshing token for account" << accountId;
     
@@ -656,74 +781,51 @@ bool KDEOAuth2Plugin::dbusRefreshToken(quint32 accountId)
     
     if (!account) {
         qDebug() << "KDEOAuth2Plugin::dbusRefreshToken: account not found" << accountId;
-        return false;
+        callback(false);
+        return;
     }
     
     // 检查是否是当前provider的账户
     if (account->providerName() != m_providerName) {
         qDebug() << "KDEOAuth2Plugin::dbusRefreshToken: account provider mismatch" << account->providerName() << "vs" << m_providerName;
-        return false;
-    }
-    
-    // 获取当前的refresh token
-    // 注意：Accounts-Qt的设置访问方式可能因版本而异
-    // 这里我们使用value()方法，如果不可用则返回false
-    QString refreshToken;
-    try {
-        refreshToken = account->value("refresh_token").toString();
-    } catch (...) {
-        qDebug() << "KDEOAuth2Plugin::dbusRefreshToken: cannot access refresh token";
-        return false;
-    }
-    
-    if (refreshToken.isEmpty()) {
-        qDebug() << "KDEOAuth2Plugin::dbusRefreshToken: no refresh token available";
-        return false;
+        callback(false);
+        return;
     }
     
-    // 这里应该实现token刷新逻辑
-    // 由于这需要网络请求，我们暂时返回false并记录日志
-    qDebug() << "KDEOAuth2Plugin::dbusRefreshToken: token refresh not implemented yet";
-    return false;
+    // 令牌缓存和刷新由令牌代理负责，刷新后的令牌由代理写回账户
+    BrokerClient::refreshToken(accountId, context, callback);
 }
 
-QVariantMap KDEOAuth2Plugin::dbusGetPluginStatus()
+void KDEOAuth2Plugin::dbusGetPluginStatus(QObject *context, const std::function<void(const QVariantMap &)> &callback)
 {
     qDebug() << "KDEOAuth2Plugin::dbusGetPluginStatus: getting plugin status";
     
+    OAuth2Config::SnapshotPtr snapshot = currentConfig();
     QVariantMap status;
     status["providerName"] = m_providerName;
-    status["serverUrl"] = m_serverUrl;
-    status["clientId"] = m_clientId;
-    status["authPath"] = m_authPath;
-    status["tokenPath"] = m_tokenPath;
-    status["userInfoPath"] = m_userInfoPath;
-    status["redirectUri"] = m_redirectUri;
-    status["scope"] = m_scope;
-    
-    // 获取账户统计
-    Accounts::Manager manager;
-    Accounts::AccountIdList allIds = manager.accountList();
-    int totalAccounts = 0;
-    int enabledAccounts = 0;
-    
-    for (Accounts::AccountId id : allIds) {
-        std::unique_ptr<Accounts::Account> account(manager.account(id));
-        if (account && account->providerName() == m_providerName) {
-            totalAccounts++;
-            if (account->enabled()) {
-                enabledAccounts++;
-            }
-        }
-    }
-    
-    status["totalAccounts"] = totalAccounts;
-    status["enabledAccounts"] = enabledAccounts;
+    status["serverUrl"] = snapshot->serverUrl;
+    status["clientId"] = snapshot->clientId;
+    status["authPath"] = snapshot->authPath;
+    status["tokenPath"] = snapshot->tokenPath;
+    status["userInfoPath"] = snapshot->userInfoPath;
+    status["redirectUri"] = snapshot->redirectUri;
+    status["redirectPorts"] = snapshot->redirectPorts;
+    status["scope"] = snapshot->scope;
+    status["tokenRateLimiter"] = m_provider->tokenRateLimiter()->statistics();
+    status["providers"] = m_registry->providerIds();
+    status["stringPool"] = StringPool::statistics();
+    
+    status["accountStore"] = accountStore()->statistics();
     status["currentDialogState"] = m_currentDialogState;
     status["authMethod"] = m_authMethod;
     
-    qDebug() << "KDEOAuth2Plugin::dbusGetPluginStatus: returning status";
-    return status;
+    // 账户统计在账户存储线程中完成后再返回
+    accountStore()->listAccounts(m_providerName, context, [status, callback](const QVariantList &accounts) mutable {
+        status["totalAccounts"] = accounts.size();
+        status["enabledAccounts"] = AccountStore::enabledCount(accounts);
+        qDebug() << "KDEOAuth2Plugin::dbusGetPluginStatus: returning status";
+        callback(status);
+    });
 }
 
 // 扩展的DBus接口方法实现
@@ -743,22 +845,37 @@ void KDEOAuth2Plugin::dbusInitNewAccountWithConfig(const QVariantMap &config)
         emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, data);
     }
     
-    // 应用配置
-    if (config.contains("serverUrl")) {
-        m_serverUrl = config["serverUrl"].toString();
-    }
-    if (config.contains("clientId")) {
-        m_clientId = config["clientId"].toString();
-    }
-    if (config.contains("redirectUri")) {
-        m_redirectUri = config["redirectUri"].toString();
+    // 配置只用于这一次流程：叠加到流程的配置快照中，不修改也不保存 provider 的配置
+    static const QPair<const char *, const char *> keys[] = {
+        { "serverUrl", "Host" },
+        { "clientId", "ClientId" },
+        { "authPath", "AuthPath" },
+        { "tokenPath", "TokenPath" },
+        { "redirectUri", "RedirectUri" },
+        { "scope", "Scope" },
+    };
+    QHash<QString, QString> flowOverrides;
+    for (const auto &key : keys) {
+        QString value = config.value(key.first).toString();
+        if (!value.isEmpty()) {
+            flowOverrides.insert(key.second, value);
+        }
     }
-    if (config.contains("scope")) {
-        m_scope = config["scope"].toString();
+    if (flowOverrides.contains("Host")) {
+        QUrl serverUrl(flowOverrides.value("Host"));
+        if (!serverUrl.isValid() || serverUrl.scheme().isEmpty()) {
+            qWarning() << "Invalid server URL:" << flowOverrides.value("Host");
+            m_currentDialogState = "none";
+            m_dialogInfo.clear();
+            if (m_dbusAdapter) {
+                emit m_dbusAdapter->accountCreationError("invalid_config", QString("服务器地址无效：%1").arg(flowOverrides.value("Host")));
+            }
+            return;
+        }
     }
     
     // 启动标准流程
-    showNewAccountDialog();
+    startNewAccount(flowOverrides);
 }
 
 void KDEOAuth2Plugin::dbusCancelCurrentDialog()
@@ -803,47 +920,50 @@ QVariantMap KDEOAuth2Plugin::dbusGetDialogInfo() const
 void KDEOAuth2Plugin::dbusSetOAuth2ServerUrl(const QString &serverUrl)
 {
     qDebug() << "KDEOAuth2Plugin::dbusSetOAuth2ServerUrl:" << serverUrl;
-    m_serverUrl = serverUrl;
+    m_configOverrides[m_provider->providerId()].insert("Host", serverUrl);
 }
 
 void KDEOAuth2Plugin::dbusSetOAuth2ClientId(const QString &clientId)
 {
     qDebug() << "KDEOAuth2Plugin::dbusSetOAuth2ClientId:" << clientId;
-    m_clientId = clientId;
+    m_configOverrides[m_provider->providerId()].insert("ClientId", clientId);
 }
 
 void KDEOAuth2Plugin::dbusSetOAuth2RedirectUri(const QString &redirectUri)
 {
     qDebug() << "KDEOAuth2Plugin::dbusSetOAuth2RedirectUri:" << redirectUri;
-    m_redirectUri = redirectUri;
+    m_configOverrides[m_provider->providerId()].insert("RedirectUri", redirectUri);
 }
 
 void KDEOAuth2Plugin::dbusSetOAuth2Scope(const QString &scope)
 {
     qDebug() << "KDEOAuth2Plugin::dbusSetOAuth2Scope:" << scope;
-    m_scope = scope;
+    m_configOverrides[m_provider->providerId()].insert("Scope", scope);
 }
 
 QVariantMap KDEOAuth2Plugin::dbusGetOAuth2Configuration() const
 {
+    OAuth2Config::SnapshotPtr snapshot = currentConfig();
     QVariantMap config;
-    config["serverUrl"] = m_serverUrl;
-    config["clientId"] = m_clientId;
-    config["authPath"] = m_authPath;
-    config["tokenPath"] = m_tokenPath;
-    config["userInfoPath"] = m_userInfoPath;
-    config["redirectUri"] = m_redirectUri;
-    config["scope"] = m_scope;
+    config["serverUrl"] = snapshot->serverUrl;
+    config["clientId"] = snapshot->clientId;
+    config["authPath"] = snapshot->authPath;
+    config["tokenPath"] = snapshot->tokenPath;
+    config["userInfoPath"] = snapshot->userInfoPath;
+    config["redirectUri"] = snapshot->redirectUri;
+    config["redirectPorts"] = snapshot->redirectPorts;
+    config["scope"] = snapshot->scope;
     config["authMethod"] = m_authMethod;
     return config;
 }
 
 bool KDEOAuth2Plugin::dbusTestConnection()
 {
-    qDebug() << "KDEOAuth2Plugin::dbusTestConnection: testing connection to" << m_serverUrl;
+    OAuth2Config::SnapshotPtr snapshot = currentConfig();
+    qDebug() << "KDEOAuth2Plugin::dbusTestConnection: testing connection to" << snapshot->serverUrl;
     
     // 简单的连接测试 - 尝试访问服务器
-    QUrl testUrl(m_serverUrl);
+    QUrl testUrl(snapshot->serverUrl);
     if (!testUrl.isValid() || testUrl.scheme().isEmpty() || testUrl.host().isEmpty()) {
         qDebug() << "KDEOAuth2Plugin::dbusTestConnection: invalid server URL";
         return false;
@@ -877,11 +997,6 @@ bool KDEOAuth2Plugin::dbusSetOAuth2Config(const QString &server, const QString &
     qDebug() << "KDEOAuth2Plugin::dbusSetOAuth2Config:" << server << clientId << authPath << tokenPath;
     
     try {
-        // 设置各个配置参数
-        dbusSetOAuth2ServerUrl(server);
-        dbusSetOAuth2ClientId(clientId);
-        // 注意：当前实现中没有直接设置path的方法，这里需要扩展
-        
         // 验证URL有效性
         QUrl serverUrl(server);
         if (!serverUrl.isValid() || serverUrl.scheme().isEmpty()) {
@@ -889,6 +1004,17 @@ bool KDEOAuth2Plugin::dbusSetOAuth2Config(const QString &server, const QString &
             return false;
         }
         
+        // 设置各个配置参数（只在本进程内生效，dbusSaveOAuth2Config 才写入用户配置文件）
+        QHash<QString, QString> &overrides = m_configOverrides[m_provider->providerId()];
+        overrides.insert("Host", server);
+        overrides.insert("ClientId", clientId);
+        if (!authPath.isEmpty()) {
+            overrides.insert("AuthPath", authPath);
+        }
+        if (!tokenPath.isEmpty()) {
+            overrides.insert("TokenPath", tokenPath);
+        }
+        
         // 发送配置变化信号
         if (m_dbusAdapter) {
             emit m_dbusAdapter->oauth2ConfigChanged(server, clientId, authPath, tokenPath);
@@ -906,14 +1032,17 @@ QString KDEOAuth2Plugin::dbusGetAuthMethod() const
     return m_authMethod;
 }
 
-int KDEOAuth2Plugin::dbusGetAccountCount() const
+void KDEOAuth2Plugin::dbusGetAccountCount(QObject *context, const std::function<void(int)> &callback)
 {
     qDebug() << "KDEOAuth2Plugin::dbusGetAccountCount";
     
-    if (!m_providerName.isEmpty()) {
-        return getAccountCountForProvider(m_providerName);
+    if (m_providerName.isEmpty()) {
+        callback(0);
+        return;
     }
-    return 0;
+    accountStore()->listAccounts(m_providerName, context, [callback](const QVariantList &accounts) {
+        callback(AccountStore::enabledCount(accounts));
+    });
 }
 
 QString KDEOAuth2Plugin::dbusGetPluginVersion() const
@@ -943,14 +1072,36 @@ QVariantMap KDEOAuth2Plugin::dbusGetCurrentDialogInfo() const
     return m_dialogInfo;
 }
 
-void KDEOAuth2Plugin::startOAuth2Flow()
+QVariantMap KDEOAuth2Plugin::dbusGetTokenRateLimiterStats() const
+{
+    return m_provider->tokenRateLimiter()->statistics();
+}
+
+QVariantMap KDEOAuth2Plugin::dbusGetCallbackServerStats() const
+{
+    // 对话框打开时返回当前监听器的实时计数，否则返回上一次的计数
+    if (m_activeDialog) {
+        return m_activeDialog->callbackServerStatistics();
+    }
+    return m_lastCallbackStats;
+}
+
+void KDEOAuth2Plugin::startOAuth2Flow(const QHash<QString, QString> &flowOverrides)
 {
     qDebug() << "KDEOAuth2Plugin: starting OAuth2 authentication flow";
     
     // 更新状态
     m_currentDialogState = "oauth_in_progress";
     
-    QString authUrl = generateAuthUrl();
+    // 捕获配置快照：整个流程（授权、令牌交换、用户信息）都使用同一份配置，
+    // 流程进行中通过 DBus 修改配置只影响之后的流程；flowOverrides 只进入这份快照
+    QHash<QString, QString> overrides = m_configOverrides.value(m_provider->providerId());
+    for (auto it = flowOverrides.constBegin(); it != flowOverrides.constEnd(); ++it) {
+        overrides.insert(it.key(), it.value());
+    }
+    m_flowConfig = m_provider->config()->withOverrides(overrides);
+    
+    QString authUrl = OAuth2Flow::authorizationUrl(*m_flowConfig, m_flowConfig->redirectUri);
     QUrl urlCheck(authUrl);
     if (!urlCheck.isValid() || urlCheck.scheme().isEmpty() || urlCheck.host().isEmpty()) {
         QString errorMsg = QString("生成的认证URL无效：%1\n请联系开发人员检查OAuth2配置。").arg(authUrl);
@@ -972,17 +1123,24 @@ void KDEOAuth2Plugin::startOAuth2Flow()
     
     // 更新对话框信息
     m_dialogInfo["auth_url"] = authUrl;
-    m_dialogInfo["redirect_uri"] = m_redirectUri;
+    m_dialogInfo["redirect_uri"] = m_flowConfig->redirectUri;
     
     // 发送状态变化信号
     if (m_dbusAdapter) {
         emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, m_dialogInfo);
     }
     
-    // 创建OAuth2认证对话框，传递重定向URI
-    OAuth2Dialog *dialog = new OAuth2Dialog(authUrl, m_redirectUri);
+    // 创建OAuth2认证对话框，实际的 redirect_uri 由回调服务器监听的端口决定
+    OAuth2Config::SnapshotPtr flowConfig = m_flowConfig;
+    OAuth2Dialog *dialog = new OAuth2Dialog(flowConfig->redirectUri, OAuth2Flow::callbackPorts(*flowConfig),
+        [flowConfig](const QString &redirectUri) { return OAuth2Flow::authorizationUrl(*flowConfig, redirectUri); });
+    m_activeDialog = dialog;
     
     int result = dialog->exec();
+    m_lastCallbackStats = dialog->callbackServerStatistics();
+    m_activeDialog = nullptr;
+    m_flowRedirectUri = dialog->redirectUri();
+    m_dialogInfo["redirect_uri"] = m_flowRedirectUri;
     
     if (result == QDialog::Accepted) {
         QString authCode = dialog->getAuthorizationCode();
@@ -1024,21 +1182,6 @@ void KDEOAuth2Plugin::startOAuth2Flow()
     dialog->deleteLater();
 }
 
-QString KDEOAuth2Plugin::generateAuthUrl() const
-{
-    QUrl url(m_serverUrl + m_authPath);
-    QUrlQuery query;
-    
-    query.addQueryItem("response_type", "code");
-    query.addQueryItem("client_id", m_clientId);
-    query.addQueryItem("redirect_uri", m_redirectUri);
-    query.addQueryItem("scope", "openid");
-    query.addQueryItem("state", QUuid::createUuid().toString(QUuid::WithoutBraces));
-    
-    url.setQuery(query);
-    return url.toString();
-}
-
 void KDEOAuth2Plugin::exchangeCodeForToken(const QString &authCode)
 {
     qDebug() << "KDEOAuth2Plugin: exchanging authorization code for access token";
@@ -1051,39 +1194,18 @@ void KDEOAuth2Plugin::exchangeCodeForToken(const QString &authCode)
         emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, m_dialogInfo);
     }
     
-    QUrl url(m_serverUrl + m_tokenPath);
-    QNetworkRequest request(url);
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
-    
-    QUrlQuery postData;
-    postData.addQueryItem("grant_type", "authorization_code");
-    postData.addQueryItem("client_id", m_clientId);
-    postData.addQueryItem("code", authCode);
-    postData.addQueryItem("redirect_uri", m_redirectUri);
-    
-    QNetworkReply *reply = m_networkManager->post(request, postData.toString(QUrl::FullyEncoded).toUtf8());
-    connect(reply, &QNetworkReply::finished, this, &KDEOAuth2Plugin::onTokenRequestFinished);
+    QString redirectUri = m_flowRedirectUri.isEmpty() ? m_flowConfig->redirectUri : m_flowRedirectUri;
+    OAuth2Flow::exchangeCode(m_provider, m_flowConfig, authCode, redirectUri, this,
+                             [this](const QJsonObject &response, const QString &error) {
+        onTokenResponse(response, error);
+    });
 }
 
-void KDEOAuth2Plugin::onTokenRequestFinished()
+void KDEOAuth2Plugin::onTokenResponse(const QJsonObject &response, const QString &error)
 {
-    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
-    if (!reply) {
-        qDebug() << "KDEOAuth2Plugin: invalid reply object";
-        
-        if (m_dbusAdapter) {
-            emit m_dbusAdapter->accountCreationError("invalid_reply", "无效的网络响应对象");
-        }
-        
-        m_currentDialogState = "none";
-        m_dialogInfo.clear();
-        emit canceled();
-        return;
-    }
-    
-    if (reply->error() != QNetworkReply::NoError) {
-        QString errorMsg = QString("Token请求失败：%1").arg(reply->errorString());
-        qDebug() << "KDEOAuth2Plugin: token request failed:" << reply->errorString();
+    if (!error.isEmpty()) {
+        QString errorMsg = QString("Token请求失败：%1").arg(error);
+        qDebug() << "KDEOAuth2Plugin: token request failed:" << error;
         
         if (m_dbusAdapter) {
             emit m_dbusAdapter->accountCreationError("token_request_failed", errorMsg);
@@ -1092,13 +1214,9 @@ void KDEOAuth2Plugin::onTokenRequestFinished()
         m_currentDialogState = "none";
         m_dialogInfo.clear();
         emit canceled();
-        reply->deleteLater();
         return;
     }
     
-    QByteArray data = reply->readAll();
-    qDebug() << "KDEOAuth2Plugin: token response:" << data;
-    
     // 更新状态
     m_currentDialogState = "processing_token";
     m_dialogInfo["status"] = "parsing_token_response";
@@ -1107,8 +1225,7 @@ void KDEOAuth2Plugin::onTokenRequestFinished()
         emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, m_dialogInfo);
     }
     
-    QJsonDocument doc = QJsonDocument::fromJson(data);
-    QJsonObject obj = doc.object();
+    const QJsonObject &obj = response;
     if (obj.contains("access_token")) {
         m_currentAccessToken = obj["access_token"].toString();
         if (obj.contains("refresh_token")) {
@@ -1118,6 +1235,24 @@ void KDEOAuth2Plugin::onTokenRequestFinished()
             m_currentExpiresIn = obj["expires_in"].toInt();
             qDebug() << "KDEOAuth2Plugin: expires_in received:" << m_currentExpiresIn;
         }
+        // 响应未包含 scope 时，授予的就是申请的 scope（RFC 6749 5.1）
+        m_currentGrantedScope = OAuth2Config::parseScopes(
+            obj.contains("scope") ? obj["scope"].toString() : m_flowConfig->consentScope).join(' ');
+        
+        // 令牌只在本进程内存中，账户保存之前先落盘，进程退出后下次启动可以恢复账户
+        QVariantMap journalData;
+        journalData["provider"] = m_providerName;
+        journalData["server"] = m_flowConfig->serverUrl;
+        journalData["client_id"] = m_flowConfig->clientId;
+        journalData["access_token"] = m_currentAccessToken;
+        journalData["refresh_token"] = m_currentRefreshToken;
+        journalData["granted_scope"] = m_currentGrantedScope;
+        journalData["id_token"] = obj.value("id_token").toString();
+        if (m_currentExpiresIn > 0) {
+            journalData["expires_in"] = m_currentExpiresIn;
+            journalData["expires_at"] = QDateTime::currentSecsSinceEpoch() + m_currentExpiresIn;
+        }
+        m_flowJournalId = m_journal->begin("account", journalData);
         
         // 更新对话框信息
         m_dialogInfo["access_token_received"] = true;
@@ -1128,15 +1263,33 @@ void KDEOAuth2Plugin::onTokenRequestFinished()
         
         qDebug() << "KDEOAuth2Plugin: successfully obtained access token";
         
-        // 更新状态到获取用户信息阶段
-        m_currentDialogState = "fetching_user_info";
-        m_dialogInfo["status"] = "requesting_user_info";
-        
-        if (m_dbusAdapter) {
-            emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, m_dialogInfo);
-        }
-        
+        // 用户信息在后台获取，账户不再等待它，拿到令牌后立即创建
         fetchUserInfo(m_currentAccessToken);
+        
+        // 声明映射和 id_token 解码在线程池中进行
+        OAuth2Config::SnapshotPtr config = m_flowConfig;
+        QString accessToken = m_currentAccessToken;
+        QString refreshToken = m_currentRefreshToken;
+        QString providerId = m_providerName;
+        mapClaimsAsync(config, obj, true, [this, config, providerId, accessToken, refreshToken](const QVariantMap &claims) {
+            if (config != m_flowConfig || m_currentDialogState != "processing_token") {
+                // 流程被取消，新签发的令牌不会再使用：先交给令牌代理吊销，确认入队后才提交日志记录；
+                // 无法入队时保留记录，令牌不会在服务器上被遗忘
+                qDebug() << "KDEOAuth2Plugin: flow ended before token claims were mapped, revoking issued tokens";
+                QString flowId = m_flowJournalId;
+                m_flowJournalId.clear();
+                BrokerClient::queueRevocation(providerId, accessToken, refreshToken, this,
+                                              [this, flowId](bool queued) {
+                    if (queued) {
+                        m_journal->commit(flowId);
+                    } else {
+                        qWarning() << "KDEOAuth2Plugin: cannot queue revocation, journal record" << flowId << "kept";
+                    }
+                });
+                return;
+            }
+            createAccountFromToken(claims);
+        });
     } else {
         qDebug() << "KDEOAuth2Plugin: no access token in response";
         
@@ -1148,253 +1301,99 @@ void KDEOAuth2Plugin::onTokenRequestFinished()
         m_dialogInfo.clear();
         emit canceled();
     }
-    
-    reply->deleteLater();
 }
 
 void KDEOAuth2Plugin::fetchUserInfo(const QString &accessToken)
 {
-    qDebug() << "KDEOAuth2Plugin: fetching user information";
-    
-    QUrl url(m_serverUrl + m_userInfoPath);
-    QNetworkRequest request(url);
-    request.setRawHeader("Authorization", QString("Bearer %1").arg(accessToken).toUtf8());
+    qDebug() << "KDEOAuth2Plugin: fetching user information in background";
     
-    QNetworkReply *reply = m_networkManager->get(request);
-    connect(reply, &QNetworkReply::finished, this, &KDEOAuth2Plugin::onUserInfoRequestFinished);
+    // 响应到达时对话框流程早已结束（甚至可能开始了新的流程），所需状态全部随请求捕获
+    OAuth2Config::SnapshotPtr config = m_flowConfig;
+    QString providerId = m_providerName;
+    OAuth2Flow::fetchUserInfo(m_provider, config, accessToken, this,
+                              [this, config, providerId, accessToken](const QJsonObject &response, const QString &error) {
+        onUserInfoReceived(response, error, config, providerId, accessToken);
+    });
 }
 
-void KDEOAuth2Plugin::onUserInfoRequestFinished()
+void KDEOAuth2Plugin::onUserInfoReceived(const QJsonObject &response, const QString &error,
+                                         const OAuth2Config::SnapshotPtr &config,
+                                         const QString &providerId, const QString &accessToken)
 {
-    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
-    if (!reply) {
-        qDebug() << "KDEOAuth2Plugin: invalid reply object";
-        
-        if (m_dbusAdapter) {
-            emit m_dbusAdapter->accountCreationError("invalid_reply", "无效的网络响应对象");
-        }
-        
-        m_currentDialogState = "none";
-        m_dialogInfo.clear();
-        emit canceled();
+    // 账户已用令牌中的信息创建，失败时保留这些信息即可
+    if (!error.isEmpty()) {
+        qDebug() << "KDEOAuth2Plugin: user info request failed, keeping token claims:" << error;
         return;
     }
     
-    qDebug() << "KDEOAuth2Plugin: user info request status code:" << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-    qDebug() << "KDEOAuth2Plugin: user info request error:" << reply->error();
-    qDebug() << "KDEOAuth2Plugin: user info request error string:" << reply->errorString();
-    
-    if (reply->error() != QNetworkReply::NoError) {
-        qDebug() << "KDEOAuth2Plugin: user info request failed:" << reply->errorString();
-        
-        // 更新状态 - 用户信息获取失败，但仍可尝试创建基本账户
-        m_currentDialogState = "creating_account";
-        m_dialogInfo["status"] = "user_info_failed_creating_basic";
-        m_dialogInfo["warning"] = "用户信息获取失败，将创建基本账户";
-        
-        if (m_dbusAdapter) {
-            emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, m_dialogInfo);
+    // 按 provider 配置的声明映射表提取用户信息（在线程池中单次遍历 JSON 对象）
+    mapClaimsAsync(config, response, false, [this, config, providerId, accessToken](const QVariantMap &claims) {
+        if (claims.isEmpty()) {
+            qDebug() << "KDEOAuth2Plugin: user info contains no mapped claims";
+            return;
         }
         
-        // 即使获取用户信息失败，我们仍然可以创建账户
-        createAccountWithBasicInfo();
-        reply->deleteLater();
-        return;
-    }
-    
-    QByteArray data = reply->readAll();
-    qDebug() << "KDEOAuth2Plugin: raw user info response data:" << data;
-    qDebug() << "KDEOAuth2Plugin: user info response size:" << data.size() << "bytes";
-    
-    // 更新状态
-    m_currentDialogState = "processing_user_info";
-    m_dialogInfo["status"] = "parsing_user_info";
-    
-    if (m_dbusAdapter) {
-        emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, m_dialogInfo);
-    }
-    
-    // 尝试解析JSON
-    QJsonParseError parseError;
-    QJsonDocument doc = QJsonDocument::fromJson(data, &parseError);
-    
-    if (parseError.error != QJsonParseError::NoError) {
-        qDebug() << "KDEOAuth2Plugin: JSON parse error:" << parseError.errorString();
-        qDebug() << "KDEOAuth2Plugin: JSON parse error at offset:" << parseError.offset;
-        
-        // 更新状态并创建基本账户
-        m_currentDialogState = "creating_account";
-        m_dialogInfo["status"] = "json_parse_failed_creating_basic";
-        m_dialogInfo["warning"] = "用户信息解析失败，将创建基本账户";
+        QString displayName;
+        QVariantMap userInfo = OAuth2Flow::accountDataFromClaims(*config, claims, &displayName);
+        qDebug() << "KDEOAuth2Plugin: user info received, display name:" << displayName << "keys:" << userInfo.keys();
         
-        if (m_dbusAdapter) {
-            emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, m_dialogInfo);
+        applyUserInfo(providerId, accessToken, displayName, userInfo, 1);
+    });
+}
+
+void KDEOAuth2Plugin::mapClaimsAsync(const OAuth2Config::SnapshotPtr &config, const QJsonObject &source, bool includeIdToken,
+                                     const std::function<void(const QVariantMap &claims)> &callback)
+{
+    // 快照和映射器不可变，StringPool 自带锁，可以在工作线程中直接使用
+    auto *watcher = new QFutureWatcher<QVariantMap>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [watcher, callback]() {
+        callback(watcher->result());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::run([config, source, includeIdToken]() {
+        return OAuth2Flow::mapClaims(*config, source, includeIdToken);
+    }));
+}
+
+void KDEOAuth2Plugin::applyUserInfo(const QString &providerId, const QString &accessToken,
+                                    const QString &displayName, const QVariantMap &userInfo, int attempt)
+{
+    // 按 access_token 查找账户需要扫描全部账户，放在账户存储线程中进行
+    accountStore()->findAccount(providerId, "access_token", accessToken, this,
+                                [this, providerId, accessToken, displayName, userInfo, attempt](quint32 accountId) {
+        if (accountId == 0) {
+            // success() 之后 KAccounts 异步保存账户，用户信息可能先到
+            if (attempt >= UserInfoBackfillMaxAttempts) {
+                qDebug() << "KDEOAuth2Plugin: account for user info not found, giving up after" << attempt << "attempts";
+                return;
+            }
+            QTimer::singleShot(UserInfoBackfillRetryMs, this, [this, providerId, accessToken, displayName, userInfo, attempt]() {
+                applyUserInfo(providerId, accessToken, displayName, userInfo, attempt + 1);
+            });
+            return;
         }
         
-        // 即使解析失败，也创建基本账户
-        createAccountWithBasicInfo();
-        reply->deleteLater();
-        return;
-    }
-    
-    QJsonObject userObj = doc.object();
-    qDebug() << "KDEOAuth2Plugin: parsed JSON object keys:" << userObj.keys();
-    
-    // 详细打印每个字段
-    for (auto it = userObj.begin(); it != userObj.end(); ++it) {
-        qDebug() << "KDEOAuth2Plugin: user info field" << it.key() << "=" << it.value();
-    }
-    
-    // 更新状态为创建账户
-    m_currentDialogState = "creating_account";
-    m_dialogInfo["status"] = "creating_account_with_user_info";
-    m_dialogInfo["user_fields_count"] = userObj.keys().size();
-    
-    if (m_dbusAdapter) {
-        emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, m_dialogInfo);
-    }
-    
-    // 准备账户数据
-    QVariantMap authData;
-    authData["server"] = m_serverUrl;
-    authData["client_id"] = m_clientId;
-    authData["access_token"] = m_currentAccessToken;
-    if (!m_currentRefreshToken.isEmpty()) {
-        authData["refresh_token"] = m_currentRefreshToken;
-    }
-    if (m_currentExpiresIn > 0) {
-        authData["expires_in"] = m_currentExpiresIn;
-    }
-    
-    // 智能提取用户信息 - 支持多种常见字段名和.NET Claims格式
-    QString userId, username, email, displayName, role, portrait;
-    
-    // 尝试获取用户ID (支持多种字段名)
-    if (userObj.contains("sub")) {
-        userId = userObj["sub"].toString();
-    } else if (userObj.contains("http://schemas.xmlsoap.org/ws/2005/05/identity/claims/nameidentifier")) {
-        userId = userObj["http://schemas.xmlsoap.org/ws/2005/05/identity/claims/nameidentifier"].toString();
-    } else if (userObj.contains("id")) {
-        userId = userObj["id"].toString();
-    } else if (userObj.contains("user_id")) {
-        userId = userObj["user_id"].toString();
-    }
-    
-    // 尝试获取用户名/显示名 (支持多种字段名)
-    if (userObj.contains("http://schemas.xmlsoap.org/ws/2005/05/identity/claims/name")) {
-        username = userObj["http://schemas.xmlsoap.org/ws/2005/05/identity/claims/name"].toString();
-    } else if (userObj.contains("name")) {
-        username = userObj["name"].toString();
-    } else if (userObj.contains("username")) {
-        username = userObj["username"].toString();
-    } else if (userObj.contains("login")) {
-        username = userObj["login"].toString();
-    } else if (userObj.contains("preferred_username")) {
-        username = userObj["preferred_username"].toString();
-    }
-    
-    // 尝试获取邮箱
-    if (userObj.contains("email")) {
-        email = userObj["email"].toString();
-    } else if (userObj.contains("http://schemas.xmlsoap.org/ws/2005/05/identity/claims/emailaddress")) {
-        email = userObj["http://schemas.xmlsoap.org/ws/2005/05/identity/claims/emailaddress"].toString();
-    } else if (userObj.contains("mail")) {
-        email = userObj["mail"].toString();
-    }
-    
-    // 尝试获取角色
-    if (userObj.contains("http://schemas.microsoft.com/ws/2008/06/identity/claims/role")) {
-        role = userObj["http://schemas.microsoft.com/ws/2008/06/identity/claims/role"].toString();
-    } else if (userObj.contains("role")) {
-        role = userObj["role"].toString();
-    } else if (userObj.contains("roles")) {
-        role = userObj["roles"].toString();
-    }
-    
-    // 尝试获取头像
-    if (userObj.contains("portrait")) {
-        portrait = userObj["portrait"].toString();
-    } else if (userObj.contains("picture")) {
-        portrait = userObj["picture"].toString();
-    } else if (userObj.contains("avatar")) {
-        portrait = userObj["avatar"].toString();
-    }
-    
-    // 确定显示名称的优先级
-    if (!username.isEmpty()) {
-        displayName = username;
-    } else if (!email.isEmpty()) {
-        displayName = email;
-    } else if (!userId.isEmpty()) {
-        displayName = "User " + userId;
-    } else {
-        displayName = "OAuth2 User";
-    }
-    
-    // 添加提取到的用户信息
-    if (!userId.isEmpty()) {
-        authData["user_id"] = userId;
-        qDebug() << "KDEOAuth2Plugin: extracted user_id:" << userId;
-    }
-    if (!username.isEmpty()) {
-        authData["username"] = username;
-        qDebug() << "KDEOAuth2Plugin: extracted username:" << username;
-    }
-    if (!email.isEmpty()) {
-        authData["email"] = email;
-        qDebug() << "KDEOAuth2Plugin: extracted email:" << email;
-    }
-    if (!role.isEmpty()) {
-        authData["role"] = role;
-        qDebug() << "KDEOAuth2Plugin: extracted role:" << role;
-    }
-    if (!portrait.isEmpty()) {
-        authData["portrait"] = portrait;
-        // 如果是相对路径，转换为完整URL
-        if (portrait.startsWith("/")) {
-            authData["portrait_url"] = m_serverUrl + portrait;
-        } else {
-            authData["portrait_url"] = portrait;
+        Accounts::Manager manager;
+        std::unique_ptr<Accounts::Account> account(manager.account(accountId));
+        if (!account) {
+            qDebug() << "KDEOAuth2Plugin: account" << accountId << "disappeared before user info was written";
+            return;
         }
-        qDebug() << "KDEOAuth2Plugin: extracted portrait:" << portrait;
-    }
-    
-    // 添加其他标准JWT字段
-    QStringList jwtFields = {"iss", "aud", "iat", "exp", "nbf"};
-    for (const QString &field : jwtFields) {
-        if (userObj.contains(field)) {
-            authData[field] = userObj[field].toVariant();
-            qDebug() << "KDEOAuth2Plugin: extracted JWT field" << field << ":" << userObj[field];
+        // 用户信息通常与创建账户时 id_token 中的声明相同，只写入变化的键
+        const QStringList written = AccountWriter::write(account.get(), userInfo, displayName);
+        qDebug() << "KDEOAuth2Plugin: user info applied to account" << accountId << "changed keys:" << written;
+        
+        if (m_dbusAdapter) {
+            emit m_dbusAdapter->accountUserInfoUpdated(accountId, displayName, userInfo);
         }
-    }
-    
-    qDebug() << "KDEOAuth2Plugin: final display name:" << displayName;
-    qDebug() << "KDEOAuth2Plugin: final auth data keys:" << authData.keys();
-    qDebug() << "KDEOAuth2Plugin: authentication successful, creating account";
-    
-    // 更新最终状态
-    m_currentDialogState = "completed";
-    m_dialogInfo["status"] = "account_created_successfully";
-    m_dialogInfo["display_name"] = displayName;
-    m_dialogInfo["account_data_keys"] = QVariant::fromValue(authData.keys());
-    
-    if (m_dbusAdapter) {
-        emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, m_dialogInfo);
-        emit m_dbusAdapter->accountCreated(0, displayName, authData); // 使用0作为临时账户ID
-    }
-    
-    // 重置状态
-    m_currentDialogState = "none";
-    m_dialogInfo.clear();
-    
-    emit success(displayName, "", authData);
-    
-    reply->deleteLater();
+    });
 }
 
 void KDEOAuth2Plugin::showConfigureAccountDialog(const quint32 accountId)
 {
     qDebug() << "KDEOAuth2Plugin: showing configuration dialog for account" << accountId;
+    ensureInitialized();
+    switchToLiveProvider();
     
     QMessageBox msgBox;
     msgBox.setWindowTitle("Account Configuration");
@@ -1412,42 +1411,52 @@ void KDEOAuth2Plugin::showConfigureAccountDialog(const quint32 accountId)
 
 QStringList KDEOAuth2Plugin::supportedServicesForConfig() const
 {
-    return QStringList() << "oauth2-service";
+    // provider 文件 scopes 组中定义了 scope 的服务
+    QStringList services = m_provider ? m_provider->config()->snapshot()->serviceScopes.keys() : QStringList();
+    if (services.isEmpty()) {
+        return QStringList() << "oauth2-service";
+    }
+    services.sort();
+    return services;
 }
 
-void KDEOAuth2Plugin::createAccountWithBasicInfo()
+void KDEOAuth2Plugin::createAccountFromToken(const QVariantMap &claims)
 {
-    qDebug() << "KDEOAuth2Plugin: creating account with basic info (no user data available)";
-    
     // 更新状态
     m_currentDialogState = "creating_account";
-    m_dialogInfo["status"] = "creating_basic_account";
-    m_dialogInfo["warning"] = "使用基本信息创建账户";
+    m_dialogInfo["status"] = "creating_account_from_token";
     
     if (m_dbusAdapter) {
         emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, m_dialogInfo);
     }
     
-    // 准备基本账户数据
-    QVariantMap authData;
-    authData["server"] = m_serverUrl;
-    authData["client_id"] = m_clientId;
+    QString displayName;
+    QVariantMap authData = OAuth2Flow::accountDataFromClaims(*m_flowConfig, claims, &displayName);
+    authData["server"] = m_flowConfig->serverUrl;
+    authData["client_id"] = m_flowConfig->clientId;
     authData["access_token"] = m_currentAccessToken;
     if (!m_currentRefreshToken.isEmpty()) {
         authData["refresh_token"] = m_currentRefreshToken;
     }
     if (m_currentExpiresIn > 0) {
         authData["expires_in"] = m_currentExpiresIn;
+        // 令牌代理据此安排过期前的刷新（秒）
+        authData["expires_at"] = QDateTime::currentSecsSinceEpoch() + m_currentExpiresIn;
+    }
+    if (!m_currentGrantedScope.isEmpty()) {
+        // 增量授权据此计算缺少的 scope
+        authData["granted_scope"] = m_currentGrantedScope;
     }
     
-    // 使用默认显示名称
-    QString displayName = "OAuth2 User";
+    qDebug() << "KDEOAuth2Plugin: creating account from token, display name:" << displayName
+             << "keys:" << authData.keys();
     
     // 更新最终状态
     m_currentDialogState = "completed";
-    m_dialogInfo["status"] = "basic_account_created_successfully";
+    m_dialogInfo["status"] = "account_created_successfully";
     m_dialogInfo["display_name"] = displayName;
     m_dialogInfo["account_data_keys"] = QVariant::fromValue(authData.keys());
+    m_dialogInfo["user_info_pending"] = true;
     
     if (m_dbusAdapter) {
         emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, m_dialogInfo);
@@ -1458,180 +1467,387 @@ void KDEOAuth2Plugin::createAccountWithBasicInfo()
     m_currentDialogState = "none";
     m_dialogInfo.clear();
     
-    qDebug() << "KDEOAuth2Plugin: creating basic account with display name:" << displayName;
+    QString flowId = m_flowJournalId;
+    m_flowJournalId.clear();
     emit success(displayName, "", authData);
+    commitWhenSaved(flowId, m_providerName, m_currentAccessToken, m_currentRefreshToken, 1);
 }
 
-void KDEOAuth2Plugin::loadConfigurationFromEnvironment()
-{
-    qDebug() << "KDEOAuth2Plugin: loading configuration from environment variables...";
-    
-    QString configServer = qEnvironmentVariable("OAUTH2_SERVER_URL");
-    QString configClientId = qEnvironmentVariable("OAUTH2_CLIENT_ID");
-    QString configAuthPath = qEnvironmentVariable("OAUTH2_AUTH_PATH");
-    QString configTokenPath = qEnvironmentVariable("OAUTH2_TOKEN_PATH");
-    QString configUserInfoPath = qEnvironmentVariable("OAUTH2_USERINFO_PATH");
-    QString configRedirectUri = qEnvironmentVariable("OAUTH2_REDIRECT_URI");
-    QString configScope = qEnvironmentVariable("OAUTH2_SCOPE");
-    
-    if (!configServer.isEmpty()) {
-        m_serverUrl = configServer;
-        qDebug() << "KDEOAuth2Plugin: loaded server URL from config:" << m_serverUrl;
-    }
-    
-    if (!configClientId.isEmpty()) {
-        m_clientId = configClientId;
-        qDebug() << "KDEOAuth2Plugin: loaded client ID from config:" << m_clientId;
-    }
-    
-    if (!configAuthPath.isEmpty()) {
-        m_authPath = configAuthPath;
-        qDebug() << "KDEOAuth2Plugin: loaded auth path from config:" << m_authPath;
-    }
-    
-    if (!configTokenPath.isEmpty()) {
-        m_tokenPath = configTokenPath;
-        qDebug() << "KDEOAuth2Plugin: loaded token path from config:" << m_tokenPath;
-    }
-    
-    if (!configUserInfoPath.isEmpty()) {
-        m_userInfoPath = configUserInfoPath;
-        qDebug() << "KDEOAuth2Plugin: loaded userinfo path from config:" << m_userInfoPath;
-    }
-    
-    if (!configRedirectUri.isEmpty()) {
-        m_redirectUri = configRedirectUri;
-        qDebug() << "KDEOAuth2Plugin: loaded redirect URI from config:" << m_redirectUri;
-    }
-    
-    if (!configScope.isEmpty()) {
-        m_scope = configScope;
-        qDebug() << "KDEOAuth2Plugin: loaded scope from config:" << m_scope;
-    }
-    
-    qDebug() << "KDEOAuth2Plugin: final configuration - Server:" << m_serverUrl 
-             << "Client ID:" << m_clientId << "Redirect URI:" << m_redirectUri;
-}
-
-void KDEOAuth2Plugin::loadProviderConfiguration()
-{
-    qDebug() << "KDEOAuth2Plugin: loading provider configuration...";
-
-    // 优先查找系统 provider 路径
-    QString providerFile = "/usr/share/accounts/providers/kde/gzweibo-oauth2.provider";
-    QFile file(providerFile);
-    if (!file.exists()) {
-        // 回退到本地工作目录
-        providerFile = "gzweibo-oauth2.provider";
-        file.setFileName(providerFile);
-    }
-    if (file.exists() && file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QXmlStreamReader xml(&file);
-        // 递归进入 group: auth → oauth2 → user_agent
-        while (!xml.atEnd()) {
-            xml.readNext();
-            if (xml.isStartElement() && xml.name() == "group" && xml.attributes().value("name") == "auth") {
-                // 进入 auth 层
-                while (!xml.atEnd()) {
-                    xml.readNext();
-                    if (xml.isStartElement() && xml.name() == "group" && xml.attributes().value("name") == "oauth2") {
-                        // 进入 oauth2 层
-                        while (!xml.atEnd()) {
-                            xml.readNext();
-                            if (xml.isStartElement() && xml.name() == "group" && xml.attributes().value("name") == "user_agent") {
-                                // 进入 user_agent 层
-                                while (!xml.atEnd()) {
-                                    xml.readNext();
-                                    if (xml.isStartElement() && xml.name() == "setting") {
-                                        QString name = xml.attributes().value("name").toString();
-                                        QString value = xml.readElementText();
-                                        if (name == "Host") {
-                                            m_serverUrl = value;
-                                            qDebug() << "KDEOAuth2Plugin: loaded Host from provider:" << m_serverUrl;
-                                        } else if (name == "AuthPath") {
-                                            m_authPath = value;
-                                            qDebug() << "KDEOAuth2Plugin: loaded AuthPath from provider:" << m_authPath;
-                                        } else if (name == "TokenPath") {
-                                            m_tokenPath = value;
-                                            qDebug() << "KDEOAuth2Plugin: loaded TokenPath from provider:" << m_tokenPath;
-                                        } else if (name == "UserInfoPath") {
-                                            m_userInfoPath = value;
-                                            qDebug() << "KDEOAuth2Plugin: loaded UserInfoPath from provider:" << m_userInfoPath;
-                                        } else if (name == "ClientId") {
-                                            m_clientId = value;
-                                            qDebug() << "KDEOAuth2Plugin: loaded ClientId from provider:" << m_clientId;
-                                        } else if (name == "RedirectUri") {
-                                            m_redirectUri = value;
-                                            qDebug() << "KDEOAuth2Plugin: loaded RedirectUri from provider:" << m_redirectUri;
-                                        } else if (name == "Scope") {
-                                            m_scope = value;
-                                            qDebug() << "KDEOAuth2Plugin: loaded Scope from provider:" << m_scope;
-                                        }
-                                    } else if (xml.isEndElement() && xml.name() == "group") {
-                                        break; // 退出 user_agent 层
-                                    }
-                                }
-                            } else if (xml.isEndElement() && xml.name() == "group") {
-                                break; // 退出 oauth2 层
-                            }
-                        }
-                    } else if (xml.isEndElement() && xml.name() == "group") {
-                        break; // 退出 auth 层
-                    }
-                }
+void KDEOAuth2Plugin::commitWhenSaved(const QString &flowId, const QString &providerId,
+                                      const QString &accessToken, const QString &refreshToken, int attempt)
+{
+    if (flowId.isEmpty()) {
+        return;
+    }
+    findAccountWithTokens(providerId, accessToken, refreshToken,
+                          [this, flowId, providerId, accessToken, refreshToken, attempt](quint32 accountId) {
+        if (accountId != 0) {
+            m_journal->commit(flowId);
+            return;
+        }
+        if (attempt >= UserInfoBackfillMaxAttempts) {
+            qDebug() << "KDEOAuth2Plugin: account not saved yet, journal record kept for replay";
+            return;
+        }
+        QTimer::singleShot(UserInfoBackfillRetryMs, this, [this, flowId, providerId, accessToken, refreshToken, attempt]() {
+            commitWhenSaved(flowId, providerId, accessToken, refreshToken, attempt + 1);
+        });
+    });
+}
+
+void KDEOAuth2Plugin::findAccountWithTokens(const QString &providerId, const QString &accessToken,
+                                            const QString &refreshToken,
+                                            const std::function<void(quint32 accountId)> &callback)
+{
+    accountStore()->findAccount(providerId, "access_token", accessToken, this,
+                                [this, providerId, refreshToken, callback](quint32 accountId) {
+        if (accountId != 0 || refreshToken.isEmpty()) {
+            callback(accountId);
+            return;
+        }
+        accountStore()->findAccount(providerId, "refresh_token", refreshToken, this, callback);
+    });
+}
+
+void KDEOAuth2Plugin::replayJournal()
+{
+    m_journal->compact();
+    const QList<FlowJournal::Record> records = m_journal->pending();
+    for (const FlowJournal::Record &record : records) {
+        if (record.type != QLatin1String("account")) {
+            continue;
+        }
+        QString flowId = record.flowId;
+        QVariantMap data = record.data;
+        // KAccounts 可能在进程退出前已经保存了账户
+        findAccountWithTokens(data.value("provider").toString(), data.value("access_token").toString(),
+                              data.value("refresh_token").toString(), [this, flowId, data](quint32 accountId) {
+            if (accountId != 0) {
+                m_journal->commit(flowId);
+                return;
             }
+            restoreAccountFromJournal(flowId, data);
+        });
+    }
+}
+
+void KDEOAuth2Plugin::restoreAccountFromJournal(const QString &flowId, const QVariantMap &data)
+{
+    QString providerId = data.value("provider").toString();
+    accountStore()->listAccounts(providerId, this, [this, flowId, data, providerId](const QVariantList &accounts) {
+        // 上下文在查询期间可能已随 provider 文件删除而释放，回调中再查找
+        ProviderContext *provider = m_registry->provider(providerId);
+        if (!provider) {
+            // provider 文件恢复后再重放
+            qDebug() << "KDEOAuth2Plugin: journal record for unknown provider" << providerId << "kept";
+            return;
         }
-        if (xml.hasError()) {
-            qDebug() << "KDEOAuth2Plugin: XML parse error in provider file:" << xml.errorString();
+        if (AccountStore::enabledCount(accounts) > 0) {
+            // 用户已重新登录（每个 provider 只允许一个账户）。replayJournal 已确认这些令牌不在任何账户中，
+            // 吊销不会影响现有账户
+            qDebug() << "KDEOAuth2Plugin: provider" << providerId << "already has an account, revoking journaled tokens";
+            BrokerClient::queueRevocation(providerId, data.value("access_token").toString(),
+                                          data.value("refresh_token").toString(), this, [](bool) {});
+            m_journal->commit(flowId);
+            return;
         }
-        file.close();
-    } else {
-        qDebug() << "KDEOAuth2Plugin: provider file not found, fallback to env vars.";
+        
+        // 与 createAccountFromToken 相同：账户信息来自 id_token 中的声明
+        OAuth2Config::SnapshotPtr config = provider->config()->snapshot();
+        QJsonObject source;
+        source["id_token"] = data.value("id_token").toString();
+        PendingRestore restore;
+        restore.flowId = flowId;
+        restore.providerId = providerId;
+        restore.authData = OAuth2Flow::accountDataFromClaims(*config, OAuth2Flow::mapClaims(*config, source, true),
+                                                             &restore.displayName);
+        const char *keys[] = { "server", "client_id", "access_token", "refresh_token",
+                               "expires_in", "expires_at", "granted_scope" };
+        for (const char *key : keys) {
+            QVariant value = data.value(key);
+            if (!value.toString().isEmpty()) {
+                restore.authData[key] = value;
+            }
+        }
+        
+        // 账户只能经 KAccounts 的 success() 创建：signon 身份（CredentialsId）和账户创建通知都由它完成。
+        // 插件进程不知道何时有 KAccounts 在等待结果，等它下次为该 provider 打开新建账户流程时再交出
+        for (const PendingRestore &pending : qAsConst(m_pendingRestores)) {
+            if (pending.flowId == flowId) {
+                return;
+            }
+        }
+        m_pendingRestores.append(restore);
+        qDebug() << "KDEOAuth2Plugin: account" << restore.displayName << "for provider" << providerId
+                 << "will be completed from the journal on the next new account flow";
+    });
+}
+
+bool KDEOAuth2Plugin::resumeJournaledAccount(const QString &providerId)
+{
+    for (int i = 0; i < m_pendingRestores.size(); ++i) {
+        if (m_pendingRestores.at(i).providerId != providerId) {
+            continue;
+        }
+        PendingRestore restore = m_pendingRestores.takeAt(i);
+        qDebug() << "KDEOAuth2Plugin: completing account" << restore.displayName << "from journal";
+        
+        // 与 createAccountFromToken 的结尾相同
+        m_currentDialogState = "completed";
+        m_dialogInfo["status"] = "account_restored_from_journal";
+        m_dialogInfo["display_name"] = restore.displayName;
+        m_dialogInfo["account_data_keys"] = QVariant::fromValue(restore.authData.keys());
+        if (m_dbusAdapter) {
+            emit m_dbusAdapter->dialogStateChanged("new_account", m_currentDialogState, m_dialogInfo);
+            emit m_dbusAdapter->accountCreated(0, restore.displayName, restore.authData);
+        }
+        m_currentDialogState = "none";
+        m_dialogInfo.clear();
+        
+        emit success(restore.displayName, "", restore.authData);
+        commitWhenSaved(restore.flowId, providerId, restore.authData.value("access_token").toString(),
+                        restore.authData.value("refresh_token").toString(), 1);
+        return true;
+    }
+    return false;
+}
+
+void KDEOAuth2Plugin::upgradeScopes(quint32 accountId, const QStringList &scopes)
+{
+    qDebug() << "KDEOAuth2Plugin: upgrading scopes of account" << accountId << "to include" << scopes;
+    ensureInitialized();
+    
+    if (m_currentDialogState != "none") {
+        // 不能复位进行中的流程，直接报告错误
+        if (m_dbusAdapter) {
+            emit m_dbusAdapter->accountConfigurationError(accountId, "flow_in_progress", "另一个认证流程正在进行");
+        }
+        return;
+    }
+    
+    Accounts::Manager manager;
+    std::unique_ptr<Accounts::Account> account(manager.account(accountId));
+    if (!account || !selectProvider(account->providerName())) {
+        if (m_dbusAdapter) {
+            emit m_dbusAdapter->accountConfigurationError(accountId, "account_not_found",
+                                                          "账户不存在或不属于本插件管理的 provider");
+        }
+        return;
+    }
+    
+    m_flowConfig = currentConfig();
+    // 旧账户没有记录 granted_scope，按创建时的 Scope 配置计算
+    QString storedScope = account->value("granted_scope").toString();
+    QStringList granted = OAuth2Config::parseScopes(storedScope.isEmpty() ? m_flowConfig->scope : storedScope);
+    QStringList missing;
+    const QStringList requested = OAuth2Config::parseScopes(scopes.join(' '));
+    for (const QString &scope : requested) {
+        if (!granted.contains(scope)) {
+            missing.append(scope);
+        }
+    }
+    if (missing.isEmpty()) {
+        qDebug() << "KDEOAuth2Plugin: account" << accountId << "already has all requested scopes";
+        if (m_dbusAdapter) {
+            QVariantMap data;
+            data["granted_scope"] = granted.join(' ');
+            emit m_dbusAdapter->accountConfigured(accountId, data);
+        }
+        return;
+    }
+    
+    // 预填账户，用户只需确认新增的授权
+    QString loginHint = account->value("email").toString();
+    if (loginHint.isEmpty()) {
+        loginHint = account->value("username").toString();
+    }
+    
+    m_currentDialogState = "upgrading_scopes";
+    m_dialogInfo.clear();
+    m_dialogInfo["type"] = "upgrade_scopes";
+    m_dialogInfo["provider"] = m_providerName;
+    m_dialogInfo["account_id"] = accountId;
+    m_dialogInfo["missing_scopes"] = missing;
+    if (m_dbusAdapter) {
+        emit m_dbusAdapter->dialogStateChanged("upgrade_scopes", m_currentDialogState, m_dialogInfo);
+    }
+    
+    OAuth2Config::SnapshotPtr flowConfig = m_flowConfig;
+    OAuth2Dialog *dialog = new OAuth2Dialog(flowConfig->redirectUri, OAuth2Flow::callbackPorts(*flowConfig),
+        [flowConfig, missing, loginHint](const QString &redirectUri) {
+            return OAuth2Flow::incrementalAuthorizationUrl(*flowConfig, redirectUri, missing, loginHint);
+        });
+    m_activeDialog = dialog;
+    
+    int result = dialog->exec();
+    m_lastCallbackStats = dialog->callbackServerStatistics();
+    m_activeDialog = nullptr;
+    m_flowRedirectUri = dialog->redirectUri();
+    QString authCode = result == QDialog::Accepted ? dialog->getAuthorizationCode() : QString();
+    dialog->deleteLater();
+    
+    if (authCode.isEmpty()) {
+        qDebug() << "KDEOAuth2Plugin: scope upgrade canceled for account" << accountId;
+        if (m_dbusAdapter) {
+            emit m_dbusAdapter->accountConfigurationCanceled(accountId, "用户取消了授权");
+        }
+        m_currentDialogState = "none";
+        m_dialogInfo.clear();
+        return;
+    }
+    
+    m_currentDialogState = "token_exchange";
+    m_dialogInfo["redirect_uri"] = m_flowRedirectUri;
+    if (m_dbusAdapter) {
+        emit m_dbusAdapter->dialogStateChanged("upgrade_scopes", m_currentDialogState, m_dialogInfo);
     }
+    
+    // 服务器未在响应中返回 scope 时，授予的是原有 scope 与新增 scope 的并集
+    QStringList expected = OAuth2Config::parseScopes((granted + missing).join(' '));
+    OAuth2Flow::exchangeCode(m_provider, m_flowConfig, authCode, m_flowRedirectUri, this,
+                             [this, accountId, expected](const QJsonObject &response, const QString &error) {
+        onUpgradeTokenResponse(accountId, expected, response, error);
+    });
+}
 
-    // 环境变量作为兜底
-    QString configServer = qEnvironmentVariable("OAUTH2_SERVER_URL");
-    QString configClientId = qEnvironmentVariable("OAUTH2_CLIENT_ID");
-    QString configAuthPath = qEnvironmentVariable("OAUTH2_AUTH_PATH");
-    QString configTokenPath = qEnvironmentVariable("OAUTH2_TOKEN_PATH");
-    QString configUserInfoPath = qEnvironmentVariable("OAUTH2_USERINFO_PATH");
-    QString configRedirectUri = qEnvironmentVariable("OAUTH2_REDIRECT_URI");
-    QString configScope = qEnvironmentVariable("OAUTH2_SCOPE");
+void KDEOAuth2Plugin::onUpgradeTokenResponse(quint32 accountId, const QStringList &grantedScopes,
+                                             const QJsonObject &response, const QString &error)
+{
+    if (!error.isEmpty() || response.value("access_token").toString().isEmpty()) {
+        failScopeUpgrade(accountId, "token_request_failed",
+                         QString("Token请求失败：%1").arg(error.isEmpty() ? QString("响应中未包含访问令牌") : error));
+        return;
+    }
+    
+    // 登录提示只是预填，用户仍可能以其他身份授权；用 id_token 中的声明核对后再写入
+    OAuth2Config::SnapshotPtr config = m_flowConfig;
+    mapClaimsAsync(config, response, true, [this, config, accountId, grantedScopes, response](const QVariantMap &claims) {
+        if (config != m_flowConfig || m_currentDialogState != "token_exchange") {
+            qDebug() << "KDEOAuth2Plugin: flow ended before upgraded token claims were mapped";
+            return;
+        }
+        if (!claims.value("user_id").toString().isEmpty()) {
+            mergeUpgradedTokens(accountId, grantedScopes, response, claims);
+            return;
+        }
+        // 响应中没有 id_token（或其中没有 sub）：用新令牌请求用户信息核对身份
+        OAuth2Flow::fetchUserInfo(m_provider, config, response.value("access_token").toString(), this,
+                                  [this, config, accountId, grantedScopes, response](const QJsonObject &userInfo,
+                                                                                     const QString &error) {
+            if (config != m_flowConfig || m_currentDialogState != "token_exchange") {
+                return;
+            }
+            if (!error.isEmpty()) {
+                mergeUpgradedTokens(accountId, grantedScopes, response, QVariantMap());
+                return;
+            }
+            mapClaimsAsync(config, userInfo, false, [this, config, accountId, grantedScopes, response](const QVariantMap &claims) {
+                if (config != m_flowConfig || m_currentDialogState != "token_exchange") {
+                    return;
+                }
+                mergeUpgradedTokens(accountId, grantedScopes, response, claims);
+            });
+        });
+    });
+}
 
-    if (!configServer.isEmpty()) {
-        m_serverUrl = configServer;
-        qDebug() << "KDEOAuth2Plugin: loaded server URL from env:" << m_serverUrl;
+void KDEOAuth2Plugin::mergeUpgradedTokens(quint32 accountId, const QStringList &grantedScopes,
+                                          const QJsonObject &response, const QVariantMap &claims)
+{
+    Accounts::Manager manager;
+    std::unique_ptr<Accounts::Account> account(manager.account(accountId));
+    if (!account) {
+        failScopeUpgrade(accountId, "account_not_found", "授权期间账户已被删除");
+        return;
     }
-    if (!configClientId.isEmpty()) {
-        m_clientId = configClientId;
-        qDebug() << "KDEOAuth2Plugin: loaded client ID from env:" << m_clientId;
+    
+    // 两边都必须有用户ID且相同；无法核对时同样拒绝，不能把其他身份的令牌写入账户
+    QString storedUserId = account->value("user_id").toString();
+    QString userId = claims.value("user_id").toString();
+    if (storedUserId.isEmpty() || userId.isEmpty() || storedUserId != userId) {
+        // 新令牌不会再使用
+        BrokerClient::queueRevocation(account->providerName(), response.value("access_token").toString(),
+                                      response.value("refresh_token").toString(), this, [](bool) {});
+        if (storedUserId.isEmpty() || userId.isEmpty()) {
+            failScopeUpgrade(accountId, "identity_unverified", "无法确认授权的用户就是账户的用户，令牌未写入");
+        } else {
+            failScopeUpgrade(accountId, "account_mismatch", "授权的用户与账户不一致，令牌未写入");
+        }
+        return;
     }
-    if (!configAuthPath.isEmpty()) {
-        m_authPath = configAuthPath;
-        qDebug() << "KDEOAuth2Plugin: loaded auth path from env:" << m_authPath;
+    
+    QVariantMap data;
+    data["access_token"] = response.value("access_token").toString();
+    // 未返回新的 refresh_token 时保留原有的
+    if (response.contains("refresh_token")) {
+        data["refresh_token"] = response.value("refresh_token").toString();
     }
-    if (!configTokenPath.isEmpty()) {
-        m_tokenPath = configTokenPath;
-        qDebug() << "KDEOAuth2Plugin: loaded token path from env:" << m_tokenPath;
+    int expiresIn = response.value("expires_in").toInt();
+    if (expiresIn > 0) {
+        data["expires_in"] = expiresIn;
+        data["expires_at"] = QDateTime::currentSecsSinceEpoch() + expiresIn;
     }
-    if (!configUserInfoPath.isEmpty()) {
-        m_userInfoPath = configUserInfoPath;
-        qDebug() << "KDEOAuth2Plugin: loaded userinfo path from env:" << m_userInfoPath;
+    data["granted_scope"] = response.contains("scope")
+        ? OAuth2Config::parseScopes(response.value("scope").toString()).join(' ')
+        : grantedScopes.join(' ');
+    
+    // 令牌代理收到 accountUpdated 后发现令牌变化，丢弃旧的缓存和服务令牌
+    AccountWriter::write(account.get(), data);
+    
+    qDebug() << "KDEOAuth2Plugin: account" << accountId << "now has scopes" << data["granted_scope"];
+    
+    data.remove("access_token");
+    data.remove("refresh_token");
+    m_currentDialogState = "none";
+    m_dialogInfo.clear();
+    if (m_dbusAdapter) {
+        emit m_dbusAdapter->accountConfigured(accountId, data);
     }
-    if (!configRedirectUri.isEmpty()) {
-        m_redirectUri = configRedirectUri;
-        qDebug() << "KDEOAuth2Plugin: loaded redirect URI from env:" << m_redirectUri;
+}
+
+void KDEOAuth2Plugin::failScopeUpgrade(quint32 accountId, const QString &errorCode, const QString &errorMessage)
+{
+    qDebug() << "KDEOAuth2Plugin: scope upgrade for account" << accountId << "failed:" << errorMessage;
+    m_lastError = errorMessage;
+    m_currentDialogState = "none";
+    m_dialogInfo.clear();
+    if (m_dbusAdapter) {
+        emit m_dbusAdapter->accountConfigurationError(accountId, errorCode, errorMessage);
     }
-    if (!configScope.isEmpty()) {
-        m_scope = configScope;
-        qDebug() << "KDEOAuth2Plugin: loaded scope from env:" << m_scope;
+}
+
+OAuth2Config::SnapshotPtr KDEOAuth2Plugin::currentConfig() const
+{
+    return m_provider->config()->withOverrides(m_configOverrides.value(m_provider->providerId()));
+}
+
+QVariantMap KDEOAuth2Plugin::dbusGetConfigurationSources() const
+{
+    OAuth2Config::SnapshotPtr snapshot = currentConfig();
+    QVariantMap result;
+    for (auto it = snapshot->sources.constBegin(); it != snapshot->sources.constEnd(); ++it) {
+        result.insert(it.key(), OAuth2Config::layerName(it.value()));
     }
+    return result;
+}
 
-    qDebug() << "KDEOAuth2Plugin: final configuration - Server:" << m_serverUrl 
-             << "Client ID:" << m_clientId << "Redirect URI:" << m_redirectUri;
+bool KDEOAuth2Plugin::dbusSaveOAuth2Config()
+{
+    const QHash<QString, QString> overrides = m_configOverrides.take(m_provider->providerId());
+    qDebug() << "KDEOAuth2Plugin::dbusSaveOAuth2Config: persisting" << overrides.keys();
+    for (auto it = overrides.constBegin(); it != overrides.constEnd(); ++it) {
+        m_provider->config()->setRuntimeOverride(it.key(), it.value());
+    }
+    return true;
 }
 
-#include "kdeoauth2plugin.moc"
+bool KDEOAuth2Plugin::dbusClearRuntimeConfiguration()
+{
+    qDebug() << "KDEOAuth2Plugin::dbusClearRuntimeConfiguration";
+    m_configOverrides.remove(m_provider->providerId());
+    m_provider->config()->clearRuntimeOverrides();
+    return true;
+}
 
 // DBus适配器实现
 KDEOAuth2PluginDBusAdapter::KDEOAuth2PluginDBusAdapter(KDEOAuth2Plugin *parent)
@@ -1640,10 +1856,69 @@ KDEOAuth2PluginDBusAdapter::KDEOAuth2PluginDBusAdapter(KDEOAuth2Plugin *parent)
 {
 }
 
-void KDEOAuth2PluginDBusAdapter::initNewAccount()
+KDEOAuth2PluginDBusAdapter::KDEOAuth2PluginDBusAdapter(KDEOAuth2Plugin *plugin, QObject *parent, const QString &providerId)
+    : QDBusAbstractAdaptor(parent)
+    , m_plugin(plugin)
+    , m_providerId(providerId)
+{
+    // 插件通过 /OAuth2Plugin 上的适配器发出信号，属于本 provider 的信号同时在本对象上转发
+    KDEOAuth2PluginDBusAdapter *source = plugin->getDBusAdapter();
+    forwardSignal(source, &KDEOAuth2PluginDBusAdapter::accountCreated);
+    forwardSignal(source, &KDEOAuth2PluginDBusAdapter::accountCreationCanceled);
+    forwardSignal(source, &KDEOAuth2PluginDBusAdapter::accountCreationError);
+    forwardSignal(source, &KDEOAuth2PluginDBusAdapter::accountConfigured);
+    forwardSignal(source, &KDEOAuth2PluginDBusAdapter::accountConfigurationCanceled);
+    forwardSignal(source, &KDEOAuth2PluginDBusAdapter::accountConfigurationError);
+    forwardSignal(source, &KDEOAuth2PluginDBusAdapter::accountUserInfoUpdated);
+    forwardSignal(source, &KDEOAuth2PluginDBusAdapter::dialogStateChanged);
+    forwardSignal(source, &KDEOAuth2PluginDBusAdapter::oauth2ConfigChanged);
+}
+
+KDEOAuth2PluginDBusAdapter::ProviderScope::ProviderScope(KDEOAuth2PluginDBusAdapter *adapter,
+                                                          const QDBusMessage &message, Mode mode)
+    : m_plugin(adapter->m_plugin)
+{
+    const QString &providerId = adapter->m_providerId;
+    if (providerId.isEmpty() || m_plugin->isProviderSelected(providerId)) {
+        return;
+    }
+    QString previous = m_plugin->activeProviderId();
+    if (!m_plugin->selectProvider(providerId)) {
+        // 不能让调用静默作用于当前 provider 的配置和账户
+        QString error = QString("无法切换到 provider %1：provider 不存在，或 %2 的认证流程正在进行")
+                            .arg(providerId, previous);
+        if (message.isReplyRequired()) {
+            message.setDelayedReply(true);
+            QDBusConnection::sessionBus().send(
+                message.createErrorReply("org.kde.kaccounts.OAuth2Plugin.Error.ProviderBusy", error));
+        }
+        if (mode == KeepSelected) {
+            emit adapter->accountCreationError("provider_busy", error);
+        }
+        m_plugin = nullptr;
+        return;
+    }
+    if (mode == Temporary) {
+        m_previous = previous;
+    }
+}
+
+KDEOAuth2PluginDBusAdapter::ProviderScope::~ProviderScope()
+{
+    // 调用开始了流程时保持选中，流程结束后由下一次切换恢复
+    if (m_plugin && !m_previous.isEmpty() && m_plugin->dbusGetCurrentDialogState() == "none") {
+        m_plugin->selectProvider(m_previous);
+    }
+}
+
+void KDEOAuth2PluginDBusAdapter::initNewAccount(const QDBusMessage &message)
 {
     qDebug() << "=== KDEOAuth2PluginDBusAdapter: initNewAccount called via DBus ===";
     qDebug() << "KDEOAuth2PluginDBusAdapter: Checking GUI environment...";
+    ProviderScope scope(this, message, ProviderScope::KeepSelected);
+    if (!scope) {
+        return;
+    }
 
     // 检查是否有GUI环境
     if (!qApp || !qApp->desktop()) {
@@ -1667,7 +1942,7 @@ void KDEOAuth2PluginDBusAdapter::initNewAccount()
         // 再次检查GUI环境
         if (qApp && qApp->desktop()) {
             qDebug() << "KDEOAuth2PluginDBusAdapter: GUI environment now available after DISPLAY fix";
-            m_plugin->init(KAccountsUiPlugin::NewAccountDialog);
+            scope->init(KAccountsUiPlugin::NewAccountDialog);
             return;
         }
 
@@ -1677,12 +1952,16 @@ void KDEOAuth2PluginDBusAdapter::initNewAccount()
     }
 
     qDebug() << "KDEOAuth2PluginDBusAdapter: GUI environment available, proceeding with dialog";
-    m_plugin->init(KAccountsUiPlugin::NewAccountDialog);
+    scope->init(KAccountsUiPlugin::NewAccountDialog);
 }
 
-void KDEOAuth2PluginDBusAdapter::initConfigureAccount(quint32 accountId)
+void KDEOAuth2PluginDBusAdapter::initConfigureAccount(quint32 accountId, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: initConfigureAccount called via DBus for account" << accountId;
+    ProviderScope scope(this, message, ProviderScope::KeepSelected);
+    if (!scope) {
+        return;
+    }
 
     // 检查是否有GUI环境
     if (!qApp || !qApp->desktop()) {
@@ -1706,7 +1985,7 @@ void KDEOAuth2PluginDBusAdapter::initConfigureAccount(quint32 accountId)
         // 再次检查GUI环境
         if (qApp && qApp->desktop()) {
             qDebug() << "KDEOAuth2PluginDBusAdapter: GUI environment now available after DISPLAY fix";
-            m_plugin->init(KAccountsUiPlugin::ConfigureAccountDialog);
+            scope->init(KAccountsUiPlugin::ConfigureAccountDialog);
             return;
         }
 
@@ -1715,54 +1994,101 @@ void KDEOAuth2PluginDBusAdapter::initConfigureAccount(quint32 accountId)
         return;
     }
 
-    m_plugin->init(KAccountsUiPlugin::ConfigureAccountDialog);
+    scope->init(KAccountsUiPlugin::ConfigureAccountDialog);
     // 注意：这里我们忽略accountId，因为原始的init方法不支持传递accountId
     // 如果需要，可以修改为直接调用showConfigureAccountDialog
 }
 
-QString KDEOAuth2PluginDBusAdapter::getProviderName()
+QString KDEOAuth2PluginDBusAdapter::getProviderName(const QDBusMessage &message)
 {
-    return m_plugin->dbusGetProviderName();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QString();
+    }
+    return scope->dbusGetProviderName();
 }
 
-void KDEOAuth2PluginDBusAdapter::setProviderName(const QString &providerName)
+void KDEOAuth2PluginDBusAdapter::setProviderName(const QString &providerName, const QDBusMessage &message)
 {
-    m_plugin->dbusSetProviderName(providerName);
+    ProviderScope scope(this, message, ProviderScope::KeepSelected);
+    if (!scope) {
+        return;
+    }
+    scope->dbusSetProviderName(providerName);
 }
 
-QStringList KDEOAuth2PluginDBusAdapter::getAccountsList()
+QStringList KDEOAuth2PluginDBusAdapter::getAccountsList(const QDBusMessage &message)
 {
-    return m_plugin->dbusGetAccountsList();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QStringList();
+    }
+    scope->dbusGetAccountsList(this, delayedReply<QStringList>(message));
+    return QStringList();
 }
 
-bool KDEOAuth2PluginDBusAdapter::deleteAccount(quint32 accountId)
+bool KDEOAuth2PluginDBusAdapter::deleteAccount(quint32 accountId, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: deleteAccount called via DBus for account" << accountId;
-    return m_plugin->dbusDeleteAccount(accountId);
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return false;
+    }
+    scope->dbusDeleteAccount(accountId, this, delayedReply<bool>(message));
+    return false;
 }
 
-bool KDEOAuth2PluginDBusAdapter::enableAccount(quint32 accountId, bool enabled)
+bool KDEOAuth2PluginDBusAdapter::enableAccount(quint32 accountId, bool enabled, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: enableAccount called via DBus for account" << accountId << "enabled:" << enabled;
-    return m_plugin->dbusEnableAccount(accountId, enabled);
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return false;
+    }
+    scope->dbusEnableAccount(accountId, enabled, this, delayedReply<bool>(message));
+    return false;
 }
 
-QVariantMap KDEOAuth2PluginDBusAdapter::getAccountDetails(quint32 accountId)
+QVariantMap KDEOAuth2PluginDBusAdapter::getAccountDetails(quint32 accountId, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: getAccountDetails called via DBus for account" << accountId;
-    return m_plugin->dbusGetAccountDetails(accountId);
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QVariantMap();
+    }
+    return scope->dbusGetAccountDetails(accountId);
 }
 
-bool KDEOAuth2PluginDBusAdapter::refreshToken(quint32 accountId)
+bool KDEOAuth2PluginDBusAdapter::refreshToken(quint32 accountId, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: refreshToken called via DBus for account" << accountId;
-    return m_plugin->dbusRefreshToken(accountId);
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return false;
+    }
+    scope->dbusRefreshToken(accountId, this, delayedReply<bool>(message));
+    return false;
 }
 
-QVariantMap KDEOAuth2PluginDBusAdapter::getPluginStatus()
+void KDEOAuth2PluginDBusAdapter::upgradeScopes(quint32 accountId, const QStringList &scopes, const QDBusMessage &message)
+{
+    qDebug() << "KDEOAuth2PluginDBusAdapter: upgradeScopes called via DBus for account" << accountId << scopes;
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return;
+    }
+    scope->upgradeScopes(accountId, scopes);
+}
+
+QVariantMap KDEOAuth2PluginDBusAdapter::getPluginStatus(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: getPluginStatus called via DBus";
-    return m_plugin->dbusGetPluginStatus();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QVariantMap();
+    }
+    scope->dbusGetPluginStatus(this, delayedReply<QVariantMap>(message));
+    return QVariantMap();
 }
 
 bool KDEOAuth2PluginDBusAdapter::isHeadlessEnvironment()
@@ -1774,183 +2100,371 @@ bool KDEOAuth2PluginDBusAdapter::isHeadlessEnvironment()
 
 // 扩展的DBus接口实现
 
-void KDEOAuth2PluginDBusAdapter::initNewAccountWithConfig(const QVariantMap &config)
+void KDEOAuth2PluginDBusAdapter::initNewAccountWithConfig(const QVariantMap &config, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: initNewAccountWithConfig called via DBus with config:" << config;
-    m_plugin->dbusInitNewAccountWithConfig(config);
+    ProviderScope scope(this, message, ProviderScope::KeepSelected);
+    if (!scope) {
+        return;
+    }
+    scope->dbusInitNewAccountWithConfig(config);
 }
 
-void KDEOAuth2PluginDBusAdapter::cancelCurrentDialog()
+void KDEOAuth2PluginDBusAdapter::cancelCurrentDialog(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: cancelCurrentDialog called via DBus";
-    m_plugin->dbusCancelCurrentDialog();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return;
+    }
+    scope->dbusCancelCurrentDialog();
 }
 
-QString KDEOAuth2PluginDBusAdapter::getCurrentDialogState()
+QString KDEOAuth2PluginDBusAdapter::getCurrentDialogState(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: getCurrentDialogState called via DBus";
-    return m_plugin->dbusGetCurrentDialogState();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QString();
+    }
+    return scope->dbusGetCurrentDialogState();
 }
 
-QVariantMap KDEOAuth2PluginDBusAdapter::getDialogInfo()
+QVariantMap KDEOAuth2PluginDBusAdapter::getDialogInfo(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: getDialogInfo called via DBus";
-    return m_plugin->dbusGetDialogInfo();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QVariantMap();
+    }
+    return scope->dbusGetDialogInfo();
 }
 
-void KDEOAuth2PluginDBusAdapter::setOAuth2ServerUrl(const QString &serverUrl)
+void KDEOAuth2PluginDBusAdapter::setOAuth2ServerUrl(const QString &serverUrl, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: setOAuth2ServerUrl called via DBus:" << serverUrl;
-    m_plugin->dbusSetOAuth2ServerUrl(serverUrl);
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return;
+    }
+    scope->dbusSetOAuth2ServerUrl(serverUrl);
 }
 
-void KDEOAuth2PluginDBusAdapter::setOAuth2ClientId(const QString &clientId)
+void KDEOAuth2PluginDBusAdapter::setOAuth2ClientId(const QString &clientId, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: setOAuth2ClientId called via DBus:" << clientId;
-    m_plugin->dbusSetOAuth2ClientId(clientId);
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return;
+    }
+    scope->dbusSetOAuth2ClientId(clientId);
 }
 
-void KDEOAuth2PluginDBusAdapter::setOAuth2RedirectUri(const QString &redirectUri)
+void KDEOAuth2PluginDBusAdapter::setOAuth2RedirectUri(const QString &redirectUri, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: setOAuth2RedirectUri called via DBus:" << redirectUri;
-    m_plugin->dbusSetOAuth2RedirectUri(redirectUri);
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return;
+    }
+    scope->dbusSetOAuth2RedirectUri(redirectUri);
 }
 
-void KDEOAuth2PluginDBusAdapter::setOAuth2Scope(const QString &scope)
+void KDEOAuth2PluginDBusAdapter::setOAuth2Scope(const QString &scope, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: setOAuth2Scope called via DBus:" << scope;
-    m_plugin->dbusSetOAuth2Scope(scope);
+    // 局部变量不能与参数 scope 同名
+    ProviderScope provider(this, message);
+    if (!provider) {
+        return;
+    }
+    provider->dbusSetOAuth2Scope(scope);
 }
 
-QVariantMap KDEOAuth2PluginDBusAdapter::getOAuth2Configuration()
+QVariantMap KDEOAuth2PluginDBusAdapter::getOAuth2Configuration(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: getOAuth2Configuration called via DBus";
-    return m_plugin->dbusGetOAuth2Configuration();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QVariantMap();
+    }
+    return scope->dbusGetOAuth2Configuration();
 }
 
-bool KDEOAuth2PluginDBusAdapter::testConnection()
+bool KDEOAuth2PluginDBusAdapter::testConnection(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: testConnection called via DBus";
-    return m_plugin->dbusTestConnection();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return false;
+    }
+    return scope->dbusTestConnection();
 }
 
-QStringList KDEOAuth2PluginDBusAdapter::getSupportedAuthMethods()
+QStringList KDEOAuth2PluginDBusAdapter::getSupportedAuthMethods(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: getSupportedAuthMethods called via DBus";
-    return m_plugin->dbusGetSupportedAuthMethods();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QStringList();
+    }
+    return scope->dbusGetSupportedAuthMethods();
 }
 
-void KDEOAuth2PluginDBusAdapter::setAuthMethod(const QString &method)
+void KDEOAuth2PluginDBusAdapter::setAuthMethod(const QString &method, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: setAuthMethod called via DBus:" << method;
-    m_plugin->dbusSetAuthMethod(method);
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return;
+    }
+    scope->dbusSetAuthMethod(method);
 }
 
 // 新的DBus方法实现
-void KDEOAuth2PluginDBusAdapter::dbusInitNewAccount()
+void KDEOAuth2PluginDBusAdapter::dbusInitNewAccount(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusInitNewAccount called via DBus";
-    m_plugin->showNewAccountDialog();
+    ProviderScope scope(this, message, ProviderScope::KeepSelected);
+    if (!scope) {
+        return;
+    }
+    scope->showNewAccountDialog();
 }
 
-void KDEOAuth2PluginDBusAdapter::dbusInitNewAccountWithConfig(const QString &server, const QString &clientId, const QString &authPath, const QString &tokenPath)
+void KDEOAuth2PluginDBusAdapter::dbusInitNewAccountWithConfig(const QString &server, const QString &clientId, const QString &authPath, const QString &tokenPath, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusInitNewAccountWithConfig called via DBus";
     qDebug() << "  server:" << server << "clientId:" << clientId;
     qDebug() << "  authPath:" << authPath << "tokenPath:" << tokenPath;
-    
-    // 设置配置并创建账户
-    bool configResult = m_plugin->dbusSetOAuth2Config(server, clientId, authPath, tokenPath);
-    if (configResult) {
-        m_plugin->showNewAccountDialog();
-    } else {
-        qWarning() << "Failed to set OAuth2 config, cannot create account";
+    ProviderScope scope(this, message, ProviderScope::KeepSelected);
+    if (!scope) {
+        return;
     }
+    
+    // 配置只用于这次创建账户的流程
+    QVariantMap config;
+    config["serverUrl"] = server;
+    config["clientId"] = clientId;
+    config["authPath"] = authPath;
+    config["tokenPath"] = tokenPath;
+    scope->dbusInitNewAccountWithConfig(config);
 }
 
-void KDEOAuth2PluginDBusAdapter::dbusCancelCurrentDialog()
+void KDEOAuth2PluginDBusAdapter::dbusCancelCurrentDialog(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusCancelCurrentDialog called via DBus";
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return;
+    }
     // 触发取消信号并重置状态
-    m_plugin->m_currentDialogState = "none";
-    m_plugin->m_dialogInfo.clear();
+    scope->m_currentDialogState = "none";
+    scope->m_dialogInfo.clear();
     
     emit accountCreationCanceled("用户通过DBus请求取消");
-    emit dialogStateChanged("new_account", "canceled", m_plugin->m_dialogInfo);
+    emit dialogStateChanged("new_account", "canceled", scope->m_dialogInfo);
     
     // 触发插件的canceled信号
-    emit m_plugin->canceled();
+    emit scope->canceled();
 }
 
-QString KDEOAuth2PluginDBusAdapter::dbusGetCurrentDialogState()
+QString KDEOAuth2PluginDBusAdapter::dbusGetCurrentDialogState(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusGetCurrentDialogState called via DBus";
-    return m_plugin->m_currentDialogState;
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QString();
+    }
+    return scope->m_currentDialogState;
 }
 
-QVariantMap KDEOAuth2PluginDBusAdapter::dbusGetCurrentDialogInfo()
+QVariantMap KDEOAuth2PluginDBusAdapter::dbusGetCurrentDialogInfo(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusGetCurrentDialogInfo called via DBus";
-    return m_plugin->m_dialogInfo;
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QVariantMap();
+    }
+    return scope->m_dialogInfo;
 }
 
-bool KDEOAuth2PluginDBusAdapter::dbusSetOAuth2Config(const QString &server, const QString &clientId, const QString &authPath, const QString &tokenPath)
+bool KDEOAuth2PluginDBusAdapter::dbusSetOAuth2Config(const QString &server, const QString &clientId, const QString &authPath, const QString &tokenPath, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusSetOAuth2Config called via DBus";
-    return m_plugin->dbusSetOAuth2Config(server, clientId, authPath, tokenPath);
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return false;
+    }
+    return scope->dbusSetOAuth2Config(server, clientId, authPath, tokenPath);
 }
 
-QVariantMap KDEOAuth2PluginDBusAdapter::dbusGetOAuth2Config()
+QVariantMap KDEOAuth2PluginDBusAdapter::dbusGetOAuth2Config(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusGetOAuth2Config called via DBus";
-    return m_plugin->dbusGetOAuth2Configuration();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QVariantMap();
+    }
+    return scope->dbusGetOAuth2Configuration();
 }
 
-bool KDEOAuth2PluginDBusAdapter::dbusSetAuthMethod(const QString &method)
+bool KDEOAuth2PluginDBusAdapter::dbusSetAuthMethod(const QString &method, const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusSetAuthMethod called via DBus:" << method;
-    m_plugin->dbusSetAuthMethod(method);
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return false;
+    }
+    scope->dbusSetAuthMethod(method);
     return true;
 }
 
-QString KDEOAuth2PluginDBusAdapter::dbusGetAuthMethod()
+QString KDEOAuth2PluginDBusAdapter::dbusGetAuthMethod(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusGetAuthMethod called via DBus";
-    return m_plugin->m_authMethod;
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QString();
+    }
+    return scope->m_authMethod;
 }
 
-int KDEOAuth2PluginDBusAdapter::dbusGetAccountCount()
+int KDEOAuth2PluginDBusAdapter::dbusGetAccountCount(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusGetAccountCount called via DBus";
-    return m_plugin->dbusGetAccountCount();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return 0;
+    }
+    scope->dbusGetAccountCount(this, delayedReply<int>(message));
+    return 0;
 }
 
-QString KDEOAuth2PluginDBusAdapter::dbusGetPluginVersion()
+QString KDEOAuth2PluginDBusAdapter::dbusGetPluginVersion(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusGetPluginVersion called via DBus";
-    return m_plugin->dbusGetPluginVersion();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QString();
+    }
+    return scope->dbusGetPluginVersion();
 }
 
-QString KDEOAuth2PluginDBusAdapter::dbusGetPluginInfo()
+QString KDEOAuth2PluginDBusAdapter::dbusGetPluginInfo(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusGetPluginInfo called via DBus";
-    return m_plugin->dbusGetPluginInfo();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QString();
+    }
+    return scope->dbusGetPluginInfo();
 }
 
-bool KDEOAuth2PluginDBusAdapter::dbusTestConnection()
+bool KDEOAuth2PluginDBusAdapter::dbusTestConnection(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusTestConnection called via DBus";
-    return m_plugin->dbusTestConnection();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return false;
+    }
+    return scope->dbusTestConnection();
 }
 
-QString KDEOAuth2PluginDBusAdapter::dbusGetLastError()
+QString KDEOAuth2PluginDBusAdapter::dbusGetLastError(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusGetLastError called via DBus";
-    return m_plugin->dbusGetLastError();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QString();
+    }
+    return scope->dbusGetLastError();
 }
 
-bool KDEOAuth2PluginDBusAdapter::dbusClearError()
+bool KDEOAuth2PluginDBusAdapter::dbusClearError(const QDBusMessage &message)
 {
     qDebug() << "KDEOAuth2PluginDBusAdapter: dbusClearError called via DBus";
-    return m_plugin->dbusClearError();
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return false;
+    }
+    return scope->dbusClearError();
+}
+
+QVariantMap KDEOAuth2PluginDBusAdapter::dbusGetTokenRateLimiterStats(const QDBusMessage &message)
+{
+    qDebug() << "KDEOAuth2PluginDBusAdapter: dbusGetTokenRateLimiterStats called via DBus";
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QVariantMap();
+    }
+    return scope->dbusGetTokenRateLimiterStats();
+}
+
+QVariantMap KDEOAuth2PluginDBusAdapter::dbusGetCallbackServerStats(const QDBusMessage &message)
+{
+    qDebug() << "KDEOAuth2PluginDBusAdapter: dbusGetCallbackServerStats called via DBus";
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QVariantMap();
+    }
+    return scope->dbusGetCallbackServerStats();
+}
+
+bool KDEOAuth2PluginDBusAdapter::hasRole(quint32 accountId, const QString &role, const QDBusMessage &message)
+{
+    qDebug() << "KDEOAuth2PluginDBusAdapter: hasRole called via DBus for account" << accountId << "role:" << role;
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return false;
+    }
+    scope->dbusHasRole(accountId, role, this, delayedReply<bool>(message));
+    return false;
+}
+
+QList<quint32> KDEOAuth2PluginDBusAdapter::accountsWithRole(const QString &role, const QDBusMessage &message)
+{
+    qDebug() << "KDEOAuth2PluginDBusAdapter: accountsWithRole called via DBus for role" << role;
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QList<quint32>();
+    }
+    scope->dbusAccountsWithRole(role, this, delayedReply<QList<quint32>>(message));
+    return QList<quint32>();
+}
+
+QVariantMap KDEOAuth2PluginDBusAdapter::dbusGetProviders()
+{
+    qDebug() << "KDEOAuth2PluginDBusAdapter: dbusGetProviders called via DBus";
+    return m_plugin->dbusGetProviders();
+}
+
+QVariantMap KDEOAuth2PluginDBusAdapter::dbusGetConfigurationSources(const QDBusMessage &message)
+{
+    qDebug() << "KDEOAuth2PluginDBusAdapter: dbusGetConfigurationSources called via DBus";
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return QVariantMap();
+    }
+    return scope->dbusGetConfigurationSources();
+}
+
+bool KDEOAuth2PluginDBusAdapter::dbusSaveOAuth2Config(const QDBusMessage &message)
+{
+    qDebug() << "KDEOAuth2PluginDBusAdapter: dbusSaveOAuth2Config called via DBus";
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return false;
+    }
+    return scope->dbusSaveOAuth2Config();
+}
+
+bool KDEOAuth2PluginDBusAdapter::dbusClearRuntimeConfiguration(const QDBusMessage &message)
+{
+    qDebug() << "KDEOAuth2PluginDBusAdapter: dbusClearRuntimeConfiguration called via DBus";
+    ProviderScope scope(this, message);
+    if (!scope) {
+        return false;
+    }
+    return scope->dbusClearRuntimeConfiguration();
 }
\ No newline at end of file
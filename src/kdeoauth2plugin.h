@@ -15,17 +15,29 @@
 #include <QTcpSocket>
 #include <QUrl>
 #include <QUrlQuery>
+#include <QJsonObject>
 #include <QDBusAbstractAdaptor>
 #include <QDBusConnection>
 #include <QDBusMessage>
 #include <QDesktopServices>
 #include <QTimer>
+#include <QPointer>
+#include <QSet>
+#include <functional>
+#include "oauth2config.h"
 
 // 前置声明
 class KDEOAuth2PluginDBusAdapter;
 
 // 前置声明
+namespace Accounts {
+class Account;
+}
+class AccountStore;
 class CallbackServer;
+class FlowJournal;
+class ProviderRegistry;
+class ProviderContext;
 
 // OAuth2认证对话框
 class OAuth2Dialog : public QDialog
@@ -33,10 +45,17 @@ class OAuth2Dialog : public QDialog
     Q_OBJECT
     
 public:
-    explicit OAuth2Dialog(const QString &authUrl, const QString &redirectUri, QWidget *parent = nullptr);
+    // 根据实际使用的 redirect_uri 生成认证URL
+    using AuthUrlBuilder = std::function<QString(const QString &redirectUri)>;
+    
+    explicit OAuth2Dialog(const QString &redirectUri, const QList<quint16> &callbackPorts,
+                          const AuthUrlBuilder &authUrlBuilder, QWidget *parent = nullptr);
     ~OAuth2Dialog();
     
     QString getAuthorizationCode() const { return m_authCode; }
+    // 本次认证实际使用的 redirect_uri（令牌交换时必须与之一致）
+    QString redirectUri() const { return m_redirectUri; }
+    QVariantMap callbackServerStatistics() const;
     
 private slots:
     void onOpenBrowser();
@@ -48,6 +67,7 @@ private slots:
     
 private:
     void startCallbackServer();
+    void applyRedirectUri(const QString &redirectUri);
     
     QVBoxLayout *m_layout;
     QLabel *m_instructionLabel;
@@ -68,6 +88,9 @@ private:
     QString m_authUrl;
     QString m_authCode;
     QString m_redirectUri;
+    QString m_configuredRedirectUri;   // 配置的 redirect_uri（手动模式使用）
+    QList<quint16> m_callbackPorts;    // 回调监听端口，0 表示临时端口
+    AuthUrlBuilder m_authUrlBuilder;
 };
 
 class KDEOAuth2Plugin : public KAccountsUiPlugin
@@ -85,16 +108,22 @@ public:
     void showNewAccountDialog() override;
     void showConfigureAccountDialog(const quint32 accountId) override;
     QStringList supportedServicesForConfig() const override;
+    // 为已有账户追加 scope：只申请缺少的授权（一次浏览器跳转），新令牌合并到原账户，
+    // 账户和其他设置保持不变；结果通过 accountConfigured / accountConfigurationError 信号通知
+    void upgradeScopes(quint32 accountId, const QStringList &scopes);
     
     // DBus API 辅助方法
     QString dbusGetProviderName() const { return m_providerName; }
-    void dbusSetProviderName(const QString &providerName) { m_providerName = providerName; }
-    QStringList dbusGetAccountsList() const;
-    bool dbusDeleteAccount(quint32 accountId);
-    bool dbusEnableAccount(quint32 accountId, bool enabled);
+    void dbusSetProviderName(const QString &providerName) { setProviderName(providerName); }
+    // 账户查询在账户存储线程中执行，完成后在插件线程回调
+    void dbusGetAccountsList(QObject *context, const std::function<void(const QStringList &)> &callback);
+    // 停用或删除前先确认令牌已进入令牌代理的吊销发件箱，确认失败时账户保持原状并返回 false
+    void dbusDeleteAccount(quint32 accountId, QObject *context, const std::function<void(bool)> &callback);
+    void dbusEnableAccount(quint32 accountId, bool enabled, QObject *context, const std::function<void(bool)> &callback);
     QVariantMap dbusGetAccountDetails(quint32 accountId);
-    bool dbusRefreshToken(quint32 accountId);
-    QVariantMap dbusGetPluginStatus();
+    // 令牌刷新和角色查询转发给令牌代理（kde-oauth2-broker）
+    void dbusRefreshToken(quint32 accountId, QObject *context, const std::function<void(bool)> &callback);
+    void dbusGetPluginStatus(QObject *context, const std::function<void(const QVariantMap &)> &callback);
     
     // 扩展的DBus接口方法
     void dbusInitNewAccountWithConfig(const QVariantMap &config);
@@ -113,48 +142,115 @@ public:
     // 新增的DBus方法
     bool dbusSetOAuth2Config(const QString &server, const QString &clientId, const QString &authPath, const QString &tokenPath);
     QString dbusGetAuthMethod() const;
-    int dbusGetAccountCount() const;
+    void dbusGetAccountCount(QObject *context, const std::function<void(int)> &callback);
     QString dbusGetPluginVersion() const;
     QString dbusGetPluginInfo() const;
     QString dbusGetLastError() const;
     bool dbusClearError();
     QVariantMap dbusGetCurrentDialogInfo() const;
+    QVariantMap dbusGetTokenRateLimiterStats() const;
+    QVariantMap dbusGetCallbackServerStats() const;
+    QVariantMap dbusGetConfigurationSources() const;
+    // dbusSetOAuth2* 的设置只在本进程内生效，调用此方法后才写入用户配置文件
+    bool dbusSaveOAuth2Config();
+    bool dbusClearRuntimeConfiguration();
+    QVariantMap dbusGetProviders() const;
+    void dbusHasRole(quint32 accountId, const QString &role, QObject *context, const std::function<void(bool)> &callback);
+    void dbusAccountsWithRole(const QString &role, QObject *context,
+                              const std::function<void(const QList<quint32> &)> &callback);
+    
+    // 切换当前 provider（认证流程进行中时拒绝切换）
+    bool selectProvider(const QString &providerId);
+    QString activeProviderId() const;
+    // 当前上下文就是注册表中该 ID 的上下文（而不是已被移除的同 ID 旧上下文）
+    bool isProviderSelected(const QString &providerId) const;
     
     // 获取DBus适配器实例（用于发送信号）
     KDEOAuth2PluginDBusAdapter* getDBusAdapter() const { return m_dbusAdapter; }
 
 private slots:
-    void onTokenRequestFinished();
-    void onUserInfoRequestFinished();
+    void onProviderAdded(ProviderContext *provider);
+    void onProviderRemoved(ProviderContext *provider);
+    // 当前 provider 已被移除或以同一 ID 重新添加时，在没有进行中的流程时换成注册表中的上下文
+    void switchToLiveProvider();
 
 private:
-    void startOAuth2Flow();
+    // 首次使用时初始化配置、DBus服务等（插件仅被加载时不做任何工作）
+    void ensureInitialized();
+    void registerProviderObject(ProviderContext *provider);
+    AccountStore *accountStore();  // 延迟创建（首次查询时才启动线程）
+    // 把账户的令牌交给令牌代理的吊销发件箱，令牌代理写入磁盘后回调；账户没有令牌时立即回调 true
+    void queueRevocation(Accounts::Account *account, QObject *context, const std::function<void(bool queued)> &callback);
+    // flowOverrides 只叠加到这次流程的配置快照中（例如 InitNewAccountWithConfig 传入的配置）
+    void startNewAccount(const QHash<QString, QString> &flowOverrides);
+    void startOAuth2Flow(const QHash<QString, QString> &flowOverrides);
     void exchangeCodeForToken(const QString &authCode);
+    void onTokenResponse(const QJsonObject &response, const QString &error);
+    // 后台获取用户信息，完成后补全已创建的账户（与当前对话框状态无关）
     void fetchUserInfo(const QString &accessToken);
-    QString generateAuthUrl() const;
-    void createAccountWithBasicInfo();
-    void loadProviderConfiguration();  // 从provider文件加载配置
-    void loadConfigurationFromEnvironment();  // 从环境变量加载配置
-    void loadFallbackConfiguration();  // 使用默认配置
-    // 查询指定 provider 已存在的账户数量（用于限制单账户）
-    int getAccountCountForProvider(const QString &providerId) const;
+    void onUserInfoReceived(const QJsonObject &response, const QString &error, const OAuth2Config::SnapshotPtr &config,
+                            const QString &providerId, const QString &accessToken);
+    // 找到由 access_token 创建的账户并写入用户信息；KAccounts 尚未保存账户时稍后重试
+    void applyUserInfo(const QString &providerId, const QString &accessToken,
+                       const QString &displayName, const QVariantMap &userInfo, int attempt);
+    OAuth2Config::SnapshotPtr currentConfig() const;  // 当前 provider 的最新配置快照
+    // 拿到令牌后立即创建账户，初始信息来自令牌响应和 id_token 中的声明
+    void createAccountFromToken(const QVariantMap &claims);
+    // KAccounts 保存账户后提交日志记录；超过重试次数仍未找到时保留记录，下次启动时重放
+    void commitWhenSaved(const QString &flowId, const QString &providerId, const QString &accessToken,
+                         const QString &refreshToken, int attempt);
+    // 查找保存了这些令牌的账户：access_token 可能已被令牌代理刷新，不轮换的 refresh_token 仍然相同
+    void findAccountWithTokens(const QString &providerId, const QString &accessToken, const QString &refreshToken,
+                               const std::function<void(quint32 accountId)> &callback);
+    // 重放上次在 success() 前后中断的账户创建
+    void replayJournal();
+    void restoreAccountFromJournal(const QString &flowId, const QVariantMap &data);
+    // KAccounts 为 provider 打开新建账户流程时，把中断的账户交给 success()，不再重新登录
+    bool resumeJournaledAccount(const QString &providerId);
+    // 增量授权的令牌响应：核对用户身份后把令牌和已授予的 scope 写回账户
+    void onUpgradeTokenResponse(quint32 accountId, const QStringList &grantedScopes,
+                                const QJsonObject &response, const QString &error);
+    void mergeUpgradedTokens(quint32 accountId, const QStringList &grantedScopes,
+                             const QJsonObject &response, const QVariantMap &claims);
+    void failScopeUpgrade(quint32 accountId, const QString &errorCode, const QString &errorMessage);
+    // 在线程池中执行声明映射（includeIdToken 时先解码 id_token 载荷并合并），完成后在插件线程回调
+    void mapClaimsAsync(const OAuth2Config::SnapshotPtr &config, const QJsonObject &source, bool includeIdToken,
+                        const std::function<void(const QVariantMap &claims)> &callback);
     
     QString m_providerName;
-    QNetworkAccessManager *m_networkManager;
-    
-    // OAuth2 配置
-    QString m_serverUrl;
-    QString m_clientId;
-    QString m_authPath;
-    QString m_tokenPath;
-    QString m_userInfoPath;
-    QString m_redirectUri;
-    QString m_scope;  // 添加scope字段
+    bool m_initialized = false;
+    bool m_dbusRegistered = false;
+    
+    // provider 注册表和当前 provider（配置、连接池、限流器均按 provider 隔离；令牌缓存由令牌代理持有）
+    ProviderRegistry *m_registry;
+    ProviderContext *m_provider;
+    AccountStore *m_accountStore = nullptr; // 账户存储查询线程
+    FlowJournal *m_journal = nullptr;       // 已签发但尚未保存到账户的令牌
+    
+    // 当前流程开始时捕获的配置快照（流程中的所有请求都使用它）
+    OAuth2Config::SnapshotPtr m_flowConfig;
+    // provider ID -> DBus 设置的配置（不持久化，叠加在 provider 配置之上）
+    QHash<QString, QHash<QString, QString>> m_configOverrides;
+    QString m_flowRedirectUri;      // 当前流程实际使用的 redirect_uri
+    
+    static constexpr int UserInfoBackfillRetryMs = 500;
+    static constexpr int UserInfoBackfillMaxAttempts = 20;
     
     // 当前认证状态
     QString m_currentAccessToken;
     QString m_currentRefreshToken;
     int m_currentExpiresIn = 0;
+    QString m_currentGrantedScope;  // 令牌响应中的 scope，未返回时为申请的 scope
+    QString m_flowJournalId;        // 当前流程在日志中的记录
+    
+    // 日志中尚未由 KAccounts 保存的账户
+    struct PendingRestore {
+        QString flowId;
+        QString providerId;
+        QString displayName;
+        QVariantMap authData;
+    };
+    QList<PendingRestore> m_pendingRestores;
     QVariantMap m_currentUserInfo;
     
     // 状态跟踪
@@ -166,11 +262,15 @@ private:
     QVariantMap m_dialogInfo;                 // 当前对话框的信息
     QString m_authMethod = "auto";            // 当前认证方法: "auto", "manual", "callback"
     QString m_lastError;                      // 最后的错误信息
+    QPointer<OAuth2Dialog> m_activeDialog;    // 当前认证对话框（用于查询回调监听器状态）
+    QVariantMap m_lastCallbackStats;          // 上一次回调监听器的计数
     
     // DBus适配器
     class KDEOAuth2PluginDBusAdapter *m_dbusAdapter;
 };
 
+// 延迟回复的方法带有末尾的 QDBusMessage 参数（不属于 DBus 签名）：
+// QtDBus 只为注册的对象设置 QDBusContext，适配器自己的 calledFromDBus() 总是 false
 class KDEOAuth2PluginDBusAdapter : public QDBusAbstractAdaptor
 {
     Q_OBJECT
@@ -178,6 +278,8 @@ class KDEOAuth2PluginDBusAdapter : public QDBusAbstractAdaptor
     
 public:
     explicit KDEOAuth2PluginDBusAdapter(KDEOAuth2Plugin *parent);
+    // provider 专属适配器，挂在 /OAuth2Plugin/<provider> 对象上
+    KDEOAuth2PluginDBusAdapter(KDEOAuth2Plugin *plugin, QObject *parent, const QString &providerId);
     
 signals:
     // 账户操作结果信号
@@ -187,6 +289,8 @@ signals:
     void accountConfigured(quint32 accountId, const QVariantMap &accountData);
     void accountConfigurationCanceled(quint32 accountId, const QString &reason);
     void accountConfigurationError(quint32 accountId, const QString &errorCode, const QString &errorMessage);
+    // 账户创建后在后台获取到用户信息并写入账户
+    void accountUserInfoUpdated(quint32 accountId, const QString &displayName, const QVariantMap &userInfo);
     
     // 状态变化信号
     void dialogStateChanged(const QString &dialogType, const QString &state, const QVariantMap &info);
@@ -196,61 +300,114 @@ signals:
     
 public slots:
     // 基本账户操作 - DBus方法
-    Q_NOREPLY void dbusInitNewAccount();
-    Q_NOREPLY void dbusInitNewAccountWithConfig(const QString &server, const QString &clientId, const QString &authPath, const QString &tokenPath);
-    Q_NOREPLY void dbusCancelCurrentDialog();
+    Q_NOREPLY void dbusInitNewAccount(const QDBusMessage &message);
+    Q_NOREPLY void dbusInitNewAccountWithConfig(const QString &server, const QString &clientId, const QString &authPath, const QString &tokenPath, const QDBusMessage &message);
+    Q_NOREPLY void dbusCancelCurrentDialog(const QDBusMessage &message);
     
     // 状态查询 - DBus方法  
-    QString dbusGetCurrentDialogState();
-    QVariantMap dbusGetCurrentDialogInfo();
+    QString dbusGetCurrentDialogState(const QDBusMessage &message);
+    QVariantMap dbusGetCurrentDialogInfo(const QDBusMessage &message);
     
     // 配置管理 - DBus方法
-    bool dbusSetOAuth2Config(const QString &server, const QString &clientId, const QString &authPath, const QString &tokenPath);
-    QVariantMap dbusGetOAuth2Config();
-    bool dbusSetAuthMethod(const QString &method);
-    QString dbusGetAuthMethod();
+    bool dbusSetOAuth2Config(const QString &server, const QString &clientId, const QString &authPath, const QString &tokenPath, const QDBusMessage &message);
+    QVariantMap dbusGetOAuth2Config(const QDBusMessage &message);
+    bool dbusSetAuthMethod(const QString &method, const QDBusMessage &message);
+    QString dbusGetAuthMethod(const QDBusMessage &message);
     
     // 信息查询 - DBus方法
-    int dbusGetAccountCount();
-    QString dbusGetPluginVersion();
-    QString dbusGetPluginInfo();
-    bool dbusTestConnection();
-    QString dbusGetLastError();
-    bool dbusClearError();
+    int dbusGetAccountCount(const QDBusMessage &message);
+    QString dbusGetPluginVersion(const QDBusMessage &message);
+    QString dbusGetPluginInfo(const QDBusMessage &message);
+    bool dbusTestConnection(const QDBusMessage &message);
+    QString dbusGetLastError(const QDBusMessage &message);
+    bool dbusClearError(const QDBusMessage &message);
+    QVariantMap dbusGetTokenRateLimiterStats(const QDBusMessage &message);
+    QVariantMap dbusGetCallbackServerStats(const QDBusMessage &message);
+    QVariantMap dbusGetConfigurationSources(const QDBusMessage &message);
+    bool dbusSaveOAuth2Config(const QDBusMessage &message);
+    bool dbusClearRuntimeConfiguration(const QDBusMessage &message);
+    QVariantMap dbusGetProviders();
+    
+    // 角色查询 - 基于账户的 roles/groups 倒排索引
+    bool hasRole(quint32 accountId, const QString &role, const QDBusMessage &message);
+    QList<quint32> accountsWithRole(const QString &role, const QDBusMessage &message);
     
     // 兼容性方法 - 保持向后兼容
-    Q_NOREPLY void initNewAccount();
-    Q_NOREPLY void initNewAccountWithConfig(const QVariantMap &config);
-    Q_NOREPLY void initConfigureAccount(quint32 accountId);
-    Q_NOREPLY void cancelCurrentDialog();
+    Q_NOREPLY void initNewAccount(const QDBusMessage &message);
+    Q_NOREPLY void initNewAccountWithConfig(const QVariantMap &config, const QDBusMessage &message);
+    Q_NOREPLY void initConfigureAccount(quint32 accountId, const QDBusMessage &message);
+    Q_NOREPLY void cancelCurrentDialog(const QDBusMessage &message);
     
     // 账户管理
-    QString getProviderName();
-    void setProviderName(const QString &providerName);
-    QStringList getAccountsList();
-    bool deleteAccount(quint32 accountId);
-    bool enableAccount(quint32 accountId, bool enabled);
-    QVariantMap getAccountDetails(quint32 accountId);
-    bool refreshToken(quint32 accountId);
+    QString getProviderName(const QDBusMessage &message);
+    void setProviderName(const QString &providerName, const QDBusMessage &message);
+    QStringList getAccountsList(const QDBusMessage &message);
+    bool deleteAccount(quint32 accountId, const QDBusMessage &message);
+    bool enableAccount(quint32 accountId, bool enabled, const QDBusMessage &message);
+    QVariantMap getAccountDetails(quint32 accountId, const QDBusMessage &message);
+    bool refreshToken(quint32 accountId, const QDBusMessage &message);
+    Q_NOREPLY void upgradeScopes(quint32 accountId, const QStringList &scopes, const QDBusMessage &message);
     
     // 状态查询
-    QVariantMap getPluginStatus();
+    QVariantMap getPluginStatus(const QDBusMessage &message);
     bool isHeadlessEnvironment();
-    QString getCurrentDialogState();
-    QVariantMap getDialogInfo();
+    QString getCurrentDialogState(const QDBusMessage &message);
+    QVariantMap getDialogInfo(const QDBusMessage &message);
     
     // 配置管理
-    void setOAuth2ServerUrl(const QString &serverUrl);
-    void setOAuth2ClientId(const QString &clientId);
-    void setOAuth2RedirectUri(const QString &redirectUri);
-    void setOAuth2Scope(const QString &scope);
-    QVariantMap getOAuth2Configuration();
+    void setOAuth2ServerUrl(const QString &serverUrl, const QDBusMessage &message);
+    void setOAuth2ClientId(const QString &clientId, const QDBusMessage &message);
+    void setOAuth2RedirectUri(const QString &redirectUri, const QDBusMessage &message);
+    void setOAuth2Scope(const QString &scope, const QDBusMessage &message);
+    QVariantMap getOAuth2Configuration(const QDBusMessage &message);
     
     // 高级功能
-    bool testConnection();
-    QStringList getSupportedAuthMethods();
-    void setAuthMethod(const QString &method);
+    bool testConnection(const QDBusMessage &message);
+    QStringList getSupportedAuthMethods(const QDBusMessage &message);
+    void setAuthMethod(const QString &method, const QDBusMessage &message);
     
 private:
+    // provider 专属对象（/OAuth2Plugin/<provider>）上的调用期间选中该 provider，返回时恢复原来的 provider；
+    // 开始流程的调用（KeepSelected）保持选中。其他 provider 的流程进行中时无法选中：
+    // 调用以 DBus 错误回复（流程调用另发出 accountCreationError），不会作用于其他 provider
+    class ProviderScope
+    {
+    public:
+        enum Mode { Temporary, KeepSelected };
+        ProviderScope(KDEOAuth2PluginDBusAdapter *adapter, const QDBusMessage &message, Mode mode = Temporary);
+        ~ProviderScope();
+        explicit operator bool() const { return m_plugin != nullptr; }
+        KDEOAuth2Plugin *plugin() const { return m_plugin; }
+        KDEOAuth2Plugin *operator->() const { return m_plugin; }
+
+    private:
+        KDEOAuth2Plugin *m_plugin;
+        QString m_previous;   // 返回时恢复的 provider
+    };
+    
+    // 延迟回复：结果在工作线程算出后再发送，期间总线分发不被阻塞
+    template <typename T>
+    static std::function<void(const T &)> delayedReply(const QDBusMessage &message)
+    {
+        message.setDelayedReply(true);
+        QDBusMessage request = message;
+        QDBusConnection bus = QDBusConnection::sessionBus();
+        return [request, bus](const T &value) {
+            bus.send(request.createReply(QVariant::fromValue(value)));
+        };
+    }
+    
+    // 仅在本适配器所属 provider 为当前 provider 时转发信号
+    template <typename... Args>
+    void forwardSignal(KDEOAuth2PluginDBusAdapter *source, void (KDEOAuth2PluginDBusAdapter::*signal)(Args...))
+    {
+        connect(source, signal, this, [this, signal](Args... args) {
+            if (m_plugin->activeProviderId() == m_providerId) {
+                emit (this->*signal)(args...);
+            }
+        });
+    }
+    
     KDEOAuth2Plugin *m_plugin;
+    QString m_providerId;   // 为空表示 /OAuth2Plugin（当前 provider）
 };
\ No newline at end of file
@@ -0,0 +1,549 @@
+#include "loopbackhttpserver.h"
+#include <QDebug>
+#include <QHostAddress>
+#include <QIODevice>
+
+namespace {
+
+constexpr char kBadRequestResponse[] =
+    "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+constexpr char kHeaderTooLargeResponse[] =
+    "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+constexpr char kServiceUnavailableResponse[] =
+    "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+} // namespace
+
+// HttpRequestParser 实现
+HttpRequestParser::HttpRequestParser()
+{
+    // 一次性分配上限大小的缓冲区，后续读取不再重新分配
+    m_buffer.reserve(MaxHeaderSize);
+}
+
+HttpRequestParser::Status HttpRequestParser::feed(QIODevice *device)
+{
+    if (m_status != NeedMoreData) {
+        return m_status;
+    }
+
+    // 上一个请求留下的管线化数据可能已经包含完整的请求头，设备中没有新数据时也要解析
+    qint64 available = device->bytesAvailable();
+    int room = MaxHeaderSize - m_buffer.size();
+    if (available > 0 && room > 0) {
+        int oldSize = m_buffer.size();
+        int toRead = int(qMin<qint64>(available, room));
+        m_buffer.resize(oldSize + toRead);
+        qint64 bytesRead = device->read(m_buffer.data() + oldSize, toRead);
+        if (bytesRead < 0) {
+            m_buffer.resize(oldSize);
+            m_status = Malformed;
+            return m_status;
+        }
+        m_buffer.resize(oldSize + int(bytesRead));
+    }
+
+    m_status = parseLines();
+    if (m_status == NeedMoreData && m_buffer.size() >= MaxHeaderSize) {
+        m_status = TooLarge;
+    }
+    return m_status;
+}
+
+void HttpRequestParser::reset()
+{
+    // 管线化：请求头和 Content-Length 字节的请求体之后的数据属于下一个请求，移到缓冲区开头；
+    // remove() 保留已预留的容量
+    int next = m_buffer.size();
+    if (m_status == Complete) {
+        bool ok = true;
+        qint64 bodyLength = m_contentLength.isEmpty() ? 0 : view(m_contentLength).toLongLong(&ok);
+        if (ok && bodyLength >= 0) {
+            next = int(qMin<qint64>(m_scanOffset + bodyLength, m_buffer.size()));
+        }
+    }
+    m_buffer.remove(0, next);
+    m_scanOffset = 0;
+    m_requestLineDone = false;
+    m_status = NeedMoreData;
+    m_method = Span();
+    m_target = Span();
+    m_version = Span();
+    m_connection = Span();
+    m_contentLength = Span();
+    m_transferEncoding = Span();
+    m_headersBegin = 0;
+    m_headersEnd = 0;
+}
+
+QByteArray HttpRequestParser::path() const
+{
+    const char *data = m_buffer.constData();
+    int length = 0;
+    while (length < m_target.length && data[m_target.offset + length] != '?' && data[m_target.offset + length] != '#') {
+        ++length;
+    }
+    return QByteArray::fromRawData(data + m_target.offset, length);
+}
+
+bool HttpRequestParser::keepAlive() const
+{
+    const char *data = m_buffer.constData();
+    if (m_connection.length == 5 && qstrnicmp(data + m_connection.offset, "close", 5) == 0) {
+        return false;
+    }
+    if (m_connection.length == 10 && qstrnicmp(data + m_connection.offset, "keep-alive", 10) == 0) {
+        return true;
+    }
+    // HTTP/1.1 默认保持连接，HTTP/1.0 默认关闭
+    return m_version.length == 8 && data[m_version.offset + 7] == '1';
+}
+
+QByteArray HttpRequestParser::view(const Span &span) const
+{
+    return QByteArray::fromRawData(m_buffer.constData() + span.offset, span.length);
+}
+
+bool HttpRequestParser::nextHeader(int *cursor, Span *name, Span *value) const
+{
+    if (m_status != Complete) {
+        return false;
+    }
+    int pos = qMax(*cursor, m_headersBegin);
+    while (pos < m_headersEnd) {
+        int lineEnd = m_buffer.indexOf("\r\n", pos);
+        if (lineEnd < 0 || lineEnd > m_headersEnd) {
+            lineEnd = m_headersEnd;
+        }
+        bool valid = splitHeaderLine(pos, lineEnd, name, value);
+        pos = lineEnd + 2;
+        if (valid) {
+            *cursor = pos;
+            return true;
+        }
+    }
+    *cursor = m_headersEnd;
+    return false;
+}
+
+QByteArray HttpRequestParser::bufferedBody() const
+{
+    if (m_status != Complete) {
+        return QByteArray();
+    }
+    return QByteArray::fromRawData(m_buffer.constData() + m_scanOffset, m_buffer.size() - m_scanOffset);
+}
+
+HttpRequestParser::Status HttpRequestParser::parseLines()
+{
+    while (true) {
+        int lineEnd = m_buffer.indexOf("\r\n", m_scanOffset);
+        if (lineEnd < 0) {
+            return NeedMoreData;
+        }
+
+        int lineStart = m_scanOffset;
+        m_scanOffset = lineEnd + 2;
+
+        if (!m_requestLineDone) {
+            // 请求行之前的空行按 RFC 7230 忽略
+            if (lineEnd == lineStart) {
+                continue;
+            }
+            if (!parseRequestLine(lineStart, lineEnd)) {
+                return Malformed;
+            }
+            m_requestLineDone = true;
+            m_headersBegin = m_scanOffset;
+        } else if (lineEnd == lineStart) {
+            // 空行表示请求头结束，之后是请求体
+            m_headersEnd = lineStart;
+            return Complete;
+        } else {
+            parseHeaderLine(lineStart, lineEnd);
+        }
+    }
+}
+
+bool HttpRequestParser::parseRequestLine(int start, int end)
+{
+    int firstSpace = m_buffer.indexOf(' ', start);
+    if (firstSpace < 0 || firstSpace >= end) {
+        return false;
+    }
+    int secondSpace = m_buffer.indexOf(' ', firstSpace + 1);
+    if (secondSpace < 0 || secondSpace >= end) {
+        return false;
+    }
+
+    m_method.offset = start;
+    m_method.length = firstSpace - start;
+    m_target.offset = firstSpace + 1;
+    m_target.length = secondSpace - firstSpace - 1;
+    m_version.offset = secondSpace + 1;
+    m_version.length = end - secondSpace - 1;
+
+    const char *data = m_buffer.constData();
+    if (m_method.isEmpty() || m_target.isEmpty() || data[m_target.offset] != '/') {
+        return false;
+    }
+    if (m_version.length < 8 || qstrncmp(data + m_version.offset, "HTTP/1.", 7) != 0) {
+        return false;
+    }
+    return true;
+}
+
+void HttpRequestParser::parseHeaderLine(int start, int end)
+{
+    Span name;
+    Span value;
+    if (!splitHeaderLine(start, end, &name, &value)) {
+        return; // 忽略无法识别的请求头
+    }
+
+    const char *data = m_buffer.constData() + name.offset;
+    if (name.length == 10 && qstrnicmp(data, "connection", 10) == 0) {
+        m_connection = value;
+    } else if (name.length == 14 && qstrnicmp(data, "content-length", 14) == 0) {
+        m_contentLength = value;
+    } else if (name.length == 17 && qstrnicmp(data, "transfer-encoding", 17) == 0) {
+        m_transferEncoding = value;
+    }
+}
+
+bool HttpRequestParser::splitHeaderLine(int start, int end, Span *name, Span *value) const
+{
+    int colon = m_buffer.indexOf(':', start);
+    if (colon <= start || colon >= end) {
+        return false;
+    }
+
+    const char *data = m_buffer.constData();
+    int valueStart = colon + 1;
+    while (valueStart < end && (data[valueStart] == ' ' || data[valueStart] == '\t')) {
+        ++valueStart;
+    }
+    int valueEnd = end;
+    while (valueEnd > valueStart && (data[valueEnd - 1] == ' ' || data[valueEnd - 1] == '\t')) {
+        --valueEnd;
+    }
+
+    name->offset = start;
+    name->length = colon - start;
+    value->offset = valueStart;
+    value->length = valueEnd - valueStart;
+    return true;
+}
+
+bool HttpRequestParser::findQueryItem(const char *name, Span *value) const
+{
+    const char *data = m_buffer.constData();
+    const int nameLength = int(qstrlen(name));
+    const int end = m_target.offset + m_target.length;
+
+    int pos = m_target.offset;
+    while (pos < end && data[pos] != '?') {
+        ++pos;
+    }
+    ++pos;
+
+    while (pos < end) {
+        int pairEnd = pos;
+        while (pairEnd < end && data[pairEnd] != '&' && data[pairEnd] != '#') {
+            ++pairEnd;
+        }
+        int equals = pos;
+        while (equals < pairEnd && data[equals] != '=') {
+            ++equals;
+        }
+
+        if (equals - pos == nameLength && qstrncmp(data + pos, name, uint(nameLength)) == 0) {
+            if (value) {
+                value->offset = equals < pairEnd ? equals + 1 : pairEnd;
+                value->length = pairEnd - value->offset;
+            }
+            return true;
+        }
+
+        if (pairEnd < end && data[pairEnd] == '#') {
+            break; // 片段部分不属于查询串
+        }
+        pos = pairEnd + 1;
+    }
+    return false;
+}
+
+bool HttpRequestParser::hasQueryItem(const char *name) const
+{
+    return findQueryItem(name, nullptr);
+}
+
+QByteArray HttpRequestParser::queryItemValue(const char *name) const
+{
+    Span value;
+    if (!findQueryItem(name, &value)) {
+        return QByteArray();
+    }
+    return QByteArray::fromPercentEncoding(view(value));
+}
+
+// LoopbackHttpServer 实现
+LoopbackHttpServer::LoopbackHttpServer(QObject *parent)
+    : QTcpServer(parent)
+    , m_ipv6Server(nullptr)
+{
+    m_clock.start();
+}
+
+LoopbackHttpServer::~LoopbackHttpServer()
+{
+    for (auto it = m_connections.begin(); it != m_connections.end(); ++it) {
+        disconnect(it.key(), nullptr, this, nullptr);
+    }
+    qDeleteAll(m_connections);
+    m_connections.clear();
+}
+
+bool LoopbackHttpServer::listenLoopback(const QList<quint16> &ports)
+{
+    stopListening();
+
+    for (quint16 port : ports) {
+        if (!listen(QHostAddress::LocalHost, port)) {
+            qDebug() << "LoopbackHttpServer: cannot listen on 127.0.0.1 port" << port << ":" << errorString();
+            continue;
+        }
+
+        // 浏览器可能把 localhost 解析为 ::1，因此在 IPv6 回环上监听同一端口
+        if (!m_ipv6Server) {
+            m_ipv6Server = new QTcpServer(this);
+            connect(m_ipv6Server, &QTcpServer::newConnection, this, [this]() {
+                while (QTcpSocket *socket = m_ipv6Server->nextPendingConnection()) {
+                    socket->setParent(this);
+                    setupConnection(socket);
+                }
+            });
+        }
+        if (!m_ipv6Server->listen(QHostAddress::LocalHostIPv6, serverPort())) {
+            qDebug() << "LoopbackHttpServer: IPv6 loopback unavailable, listening on IPv4 only:" << m_ipv6Server->errorString();
+        }
+
+        qDebug() << "LoopbackHttpServer: listening on loopback port" << serverPort()
+                 << (m_ipv6Server->isListening() ? "(IPv4 + IPv6)" : "(IPv4)");
+        return true;
+    }
+    return false;
+}
+
+void LoopbackHttpServer::stopListening()
+{
+    close();
+    if (m_ipv6Server) {
+        m_ipv6Server->close();
+    }
+}
+
+bool LoopbackHttpServer::isListeningIPv6() const
+{
+    return m_ipv6Server && m_ipv6Server->isListening();
+}
+
+QVariantMap LoopbackHttpServer::statistics() const
+{
+    QVariantMap stats;
+    stats["listening"] = isListening();
+    stats["listeningIPv6"] = isListeningIPv6();
+    stats["port"] = serverPort();
+    stats["activeConnections"] = m_connections.size();
+    stats["maxConnections"] = m_maxConnections;
+    stats["accepted"] = m_acceptedCount;
+    stats["evicted"] = m_evictedCount;
+    stats["rejected"] = m_rejectedCount;
+    stats["parsed"] = m_parsedCount;
+    stats["malformed"] = m_malformedCount;
+    return stats;
+}
+
+void LoopbackHttpServer::incomingConnection(qintptr socketDescriptor)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        qDebug() << "LoopbackHttpServer: failed to accept connection:" << socket->errorString();
+        delete socket;
+        return;
+    }
+    setupConnection(socket);
+}
+
+void LoopbackHttpServer::requestDataAvailable(QTcpSocket *socket)
+{
+    // 已处理完请求的连接，丢弃多余数据
+    socket->skip(socket->bytesAvailable());
+}
+
+void LoopbackHttpServer::connectionClosing(QTcpSocket *socket)
+{
+    Q_UNUSED(socket);
+}
+
+void LoopbackHttpServer::finishRequest(QTcpSocket *socket, bool keepAlive)
+{
+    Connection *connection = m_connections.value(socket);
+    if (!connection) {
+        return;
+    }
+    if (!keepAlive) {
+        connection->deadline->stop();
+        socket->disconnectFromHost();
+        return;
+    }
+    prepareNextRequest(socket, connection);
+}
+
+void LoopbackHttpServer::startDeadline(QTcpSocket *socket, int ms)
+{
+    if (Connection *connection = m_connections.value(socket)) {
+        connection->deadline->start(ms);
+    }
+}
+
+void LoopbackHttpServer::stopDeadline(QTcpSocket *socket)
+{
+    if (Connection *connection = m_connections.value(socket)) {
+        connection->deadline->stop();
+    }
+}
+
+void LoopbackHttpServer::setupConnection(QTcpSocket *socket)
+{
+    // 连接数达到上限时，驱逐最早建立且尚未完成请求的连接；所有连接都在处理请求时拒绝新连接
+    if (m_connections.size() >= m_maxConnections && !evictOldestConnection()) {
+        qDebug() << "LoopbackHttpServer: connection limit reached and all connections busy, rejecting";
+        ++m_rejectedCount;
+        socket->write(kServiceUnavailableResponse, sizeof(kServiceUnavailableResponse) - 1);
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        // 不读取响应的客户端也不能占住套接字
+        QTimer::singleShot(IdleDeadlineMs, socket, [socket]() { socket->abort(); });
+        socket->disconnectFromHost();
+        return;
+    }
+    ++m_acceptedCount;
+
+    Connection *connection = new Connection;
+    connection->acceptedAt = m_clock.elapsed();
+    connection->deadline = new QTimer(socket);
+    connection->deadline->setSingleShot(true);
+    m_connections.insert(socket, connection);
+
+    // 浏览器预连接或慢速客户端在超时后关闭
+    connect(connection->deadline, &QTimer::timeout, this, [this, socket]() {
+        qDebug() << "LoopbackHttpServer: connection deadline exceeded, evicting";
+        ++m_evictedCount;
+        socket->abort();
+    });
+    connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+        onReadyRead(socket);
+    });
+    connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+        closeConnection(socket);
+    });
+
+    // 尚未发送任何数据的连接使用较短的空闲超时
+    connection->deadline->start(IdleDeadlineMs);
+}
+
+bool LoopbackHttpServer::evictOldestConnection()
+{
+    QTcpSocket *oldest = nullptr;
+    qint64 oldestAcceptedAt = 0;
+    for (auto it = m_connections.constBegin(); it != m_connections.constEnd(); ++it) {
+        if (it.value()->parser.status() != HttpRequestParser::NeedMoreData) {
+            continue; // 正在处理请求的连接不驱逐
+        }
+        if (!oldest || it.value()->acceptedAt < oldestAcceptedAt) {
+            oldest = it.key();
+            oldestAcceptedAt = it.value()->acceptedAt;
+        }
+    }
+
+    if (!oldest) {
+        return false;
+    }
+    qDebug() << "LoopbackHttpServer: connection limit reached, evicting oldest pending connection";
+    ++m_evictedCount;
+    oldest->abort();
+    return true;
+}
+
+void LoopbackHttpServer::onReadyRead(QTcpSocket *socket)
+{
+    Connection *connection = m_connections.value(socket);
+    if (!connection) {
+        socket->skip(socket->bytesAvailable());
+        return;
+    }
+    if (connection->parser.status() != HttpRequestParser::NeedMoreData) {
+        requestDataAvailable(socket);
+        return;
+    }
+
+    bool firstData = connection->parser.bufferedSize() == 0;
+    HttpRequestParser::Status status = connection->parser.feed(socket);
+
+    switch (status) {
+    case HttpRequestParser::NeedMoreData:
+        // 请求被拆分到多个数据包，收到首个数据包后切换为读取截止时间
+        if (firstData) {
+            connection->deadline->start(ReadDeadlineMs);
+        }
+        return;
+    case HttpRequestParser::Complete:
+        connection->deadline->stop();
+        ++m_parsedCount;
+        switch (handleRequest(socket, connection->parser)) {
+        case KeepAlive:
+            prepareNextRequest(socket, connection);
+            break;
+        case CloseConnection:
+            socket->disconnectFromHost();
+            break;
+        case Pending:
+            // 子类完成后调用 finishRequest()；此时 connection 可能已经释放
+            break;
+        }
+        break;
+    case HttpRequestParser::Malformed:
+        qDebug() << "LoopbackHttpServer: malformed request, closing connection";
+        connection->deadline->stop();
+        ++m_malformedCount;
+        socket->write(kBadRequestResponse, sizeof(kBadRequestResponse) - 1);
+        socket->disconnectFromHost();
+        break;
+    case HttpRequestParser::TooLarge:
+        qDebug() << "LoopbackHttpServer: request header too large, closing connection";
+        connection->deadline->stop();
+        ++m_malformedCount;
+        socket->write(kHeaderTooLargeResponse, sizeof(kHeaderTooLargeResponse) - 1);
+        socket->disconnectFromHost();
+        break;
+    }
+}
+
+void LoopbackHttpServer::prepareNextRequest(QTcpSocket *socket, Connection *connection)
+{
+    // keep-alive：复用连接等待下一个请求；解析器中可能已有管线化的下一个请求
+    connection->parser.reset();
+    connection->deadline->start(m_idleTimeoutMs);
+    if (connection->parser.bufferedSize() > 0 || socket->bytesAvailable() > 0) {
+        onReadyRead(socket);
+    }
+}
+
+void LoopbackHttpServer::closeConnection(QTcpSocket *socket)
+{
+    connectionClosing(socket);
+    delete m_connections.take(socket);
+    socket->deleteLater();
+}
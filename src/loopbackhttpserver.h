@@ -0,0 +1,160 @@
+#pragma once
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QVariantMap>
+
+class QIODevice;
+
+// 增量式HTTP请求解析器
+// 直接在套接字的 QByteArray 缓冲区上按偏移量解析请求行和请求头，
+// 支持请求分多次到达，且缓冲区大小有上限。
+class HttpRequestParser
+{
+public:
+    enum Status {
+        NeedMoreData,   // 请求头尚未完整
+        Complete,       // 请求行和请求头已完整
+        Malformed,      // 非法请求
+        TooLarge        // 请求头超过上限
+    };
+
+    // 缓冲区中的一段（偏移量 + 长度），不复制数据
+    struct Span {
+        int offset = 0;
+        int length = 0;
+        bool isEmpty() const { return length == 0; }
+    };
+
+    static constexpr int MaxHeaderSize = 8192;
+
+    HttpRequestParser();
+
+    // 从设备读取可用数据并继续解析
+    Status feed(QIODevice *device);
+    Status status() const { return m_status; }
+    int bufferedSize() const { return m_buffer.size(); }
+    // 为下一个请求复位（keep-alive），保留缓冲区中属于下一个请求的管线化数据
+    void reset();
+
+    // 返回指向内部缓冲区的只读视图（QByteArray::fromRawData，不复制）
+    QByteArray view(const Span &span) const;
+    Span method() const { return m_method; }
+    Span target() const { return m_target; }
+    Span version() const { return m_version; }
+    Span connectionHeader() const { return m_connection; }
+    Span contentLengthHeader() const { return m_contentLength; }
+    Span transferEncodingHeader() const { return m_transferEncoding; }
+    QByteArray path() const;     // 请求目标中查询串之前的部分（视图）
+    bool keepAlive() const;      // 根据 HTTP 版本和 Connection 头判断
+
+    // 依次遍历请求头，cursor 从 0 开始；没有更多请求头时返回 false
+    bool nextHeader(int *cursor, Span *name, Span *value) const;
+    // 与请求头一起读入缓冲区的请求体开头部分（视图）
+    QByteArray bufferedBody() const;
+
+    // 在请求目标的查询串中查找参数，仅对找到的值做百分号解码
+    bool hasQueryItem(const char *name) const;
+    QByteArray queryItemValue(const char *name) const;
+
+private:
+    Status parseLines();
+    bool parseRequestLine(int start, int end);
+    void parseHeaderLine(int start, int end);
+    bool splitHeaderLine(int start, int end, Span *name, Span *value) const;
+    bool findQueryItem(const char *name, Span *value) const;
+
+    QByteArray m_buffer;
+    int m_scanOffset = 0;   // 下一行开始的位置
+    bool m_requestLineDone = false;
+    Status m_status = NeedMoreData;
+
+    Span m_method;
+    Span m_target;
+    Span m_version;
+    Span m_connection;
+    Span m_contentLength;
+    Span m_transferEncoding;
+    int m_headersBegin = 0;   // 第一行请求头的位置
+    int m_headersEnd = 0;     // 结束请求头的空行的位置
+};
+
+// 回环地址上的HTTP/1.1服务器
+// 负责监听（IPv4 + IPv6 同一端口）、连接数上限、空闲/读取截止时间和请求头解析，
+// 子类只处理已解析的请求。回调服务器和令牌代理共用这部分代码。
+class LoopbackHttpServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    static constexpr int DefaultMaxConnections = 16;
+    static constexpr int IdleDeadlineMs = 5000;    // 连接后未发送数据的超时
+    static constexpr int ReadDeadlineMs = 10000;   // 收到首个数据后完成请求头的超时
+
+    explicit LoopbackHttpServer(QObject *parent = nullptr);
+    ~LoopbackHttpServer() override;
+
+    // 在 IPv4 和 IPv6 回环地址上监听同一端口。依次尝试 ports 中的端口，
+    // 0 表示由系统分配的临时端口。IPv6 不可用时仅监听 IPv4。
+    bool listenLoopback(const QList<quint16> &ports);
+    void stopListening();
+    bool isListeningIPv6() const;
+
+    void setMaxConnections(int maxConnections) { m_maxConnections = maxConnections; }
+    // keep-alive 连接等待下一个请求的时间
+    void setIdleTimeout(int ms) { m_idleTimeoutMs = ms; }
+
+    // 监听器计数（accepted / evicted / rejected / parsed / malformed）
+    virtual QVariantMap statistics() const;
+
+protected:
+    enum RequestResult {
+        CloseConnection,   // 响应已写出，关闭连接
+        KeepAlive,         // 响应已写出，等待下一个请求
+        Pending            // 异步处理，完成后调用 finishRequest()
+    };
+
+    void incomingConnection(qintptr socketDescriptor) override;
+
+    // 请求头完整后调用
+    virtual RequestResult handleRequest(QTcpSocket *socket, const HttpRequestParser &parser) = 0;
+    // 请求头之后又收到数据（请求体或多余数据）；默认丢弃
+    virtual void requestDataAvailable(QTcpSocket *socket);
+    // 连接关闭或被驱逐前调用
+    virtual void connectionClosing(QTcpSocket *socket);
+
+    // 结束 Pending 状态的请求
+    void finishRequest(QTcpSocket *socket, bool keepAlive);
+    // 为 Pending 状态的请求设置截止时间，超时后关闭连接
+    void startDeadline(QTcpSocket *socket, int ms);
+    void stopDeadline(QTcpSocket *socket);
+
+private:
+    struct Connection {
+        HttpRequestParser parser;
+        QTimer *deadline = nullptr;   // 空闲/读取截止计时器，随套接字一起释放
+        qint64 acceptedAt = 0;
+    };
+
+    void setupConnection(QTcpSocket *socket);
+    void onReadyRead(QTcpSocket *socket);
+    void prepareNextRequest(QTcpSocket *socket, Connection *connection);
+    bool evictOldestConnection();   // 没有可驱逐的连接时返回 false
+    void closeConnection(QTcpSocket *socket);
+
+    QHash<QTcpSocket *, Connection *> m_connections;
+    QTcpServer *m_ipv6Server;   // 与本服务器使用相同端口的 IPv6 回环监听器
+    QElapsedTimer m_clock;
+    int m_maxConnections = DefaultMaxConnections;
+    int m_idleTimeoutMs = IdleDeadlineMs;
+
+    quint64 m_acceptedCount = 0;
+    quint64 m_evictedCount = 0;
+    quint64 m_rejectedCount = 0;
+    quint64 m_parsedCount = 0;
+    quint64 m_malformedCount = 0;
+};
@@ -0,0 +1,410 @@
+#include "oauth2config.h"
+#include "claimmapper.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QStringList>
+#include <QXmlStreamReader>
+
+namespace {
+
+// 二进制缓存格式标识，解析规则变化时递增版本号
+constexpr quint32 kCacheMagic = 0x4F41324B; // "OA2K"
+constexpr quint16 kCacheVersion = 1;
+
+struct KeyDefault {
+    const char *key;
+    const char *value;
+};
+
+const KeyDefault kDefaults[] = {
+    { "Host", "http://192.168.1.12:9007" },
+    { "ClientId", "10001" },
+    { "AuthPath", "/connect/authorize" },
+    { "TokenPath", "/connect/token" },
+    { "UserInfoPath", "/connect/userinfo" },
+    { "RevocationPath", "/connect/revocation" },
+    { "RedirectUri", "http://localhost:8080/callback" },
+    { "Scope", "openid profile" },
+    { "ScopedTokenGrant", "refresh_token" },
+    { "TokenRateLimit", "2" },
+    { "TokenRateBurst", "5" },
+    { "MaxResponseSize", "2097152" },
+};
+
+struct KeyEnvironment {
+    const char *key;
+    const char *variable;
+};
+
+const KeyEnvironment kEnvironment[] = {
+    { "Host", "OAUTH2_SERVER_URL" },
+    { "ClientId", "OAUTH2_CLIENT_ID" },
+    { "AuthPath", "OAUTH2_AUTH_PATH" },
+    { "TokenPath", "OAUTH2_TOKEN_PATH" },
+    { "UserInfoPath", "OAUTH2_USERINFO_PATH" },
+    { "RevocationPath", "OAUTH2_REVOCATION_PATH" },
+    { "RedirectUri", "OAUTH2_REDIRECT_URI" },
+    { "RedirectPorts", "OAUTH2_REDIRECT_PORTS" },
+    { "Scope", "OAUTH2_SCOPE" },
+    { "ScopedTokenGrant", "OAUTH2_SCOPED_TOKEN_GRANT" },
+    { "TokenRateLimit", "OAUTH2_TOKEN_RATE_LIMIT" },
+    { "TokenRateBurst", "OAUTH2_TOKEN_RATE_BURST" },
+    { "MaxResponseSize", "OAUTH2_MAX_RESPONSE_SIZE" },
+};
+
+QString runtimeSettingsFile()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation)
+        + QStringLiteral("/kde-oauth2-pluginrc");
+}
+
+} // namespace
+
+OAuth2Config::OAuth2Config(const QString &providerFile, QObject *parent)
+    : QObject(parent)
+    , m_providerFile(providerFile)
+    , m_snapshot(std::make_shared<const Snapshot>())
+{
+    connect(&m_watcher, &QFileSystemWatcher::fileChanged, this, &OAuth2Config::onProviderFileChanged);
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged, this, &OAuth2Config::onProviderFileChanged);
+}
+
+void OAuth2Config::load()
+{
+    loadDefaults();
+    loadProviderLayer();
+    loadEnvironmentLayer();
+    loadRuntimeLayer();
+    resolve();
+
+    // 监视文件本身及其目录（软件包升级通常以替换文件的方式更新）
+    if (!m_providerFile.isEmpty()) {
+        QFileInfo info(m_providerFile);
+        if (info.exists() && !m_watcher.files().contains(info.absoluteFilePath())) {
+            m_watcher.addPath(info.absoluteFilePath());
+        }
+        if (info.dir().exists() && !m_watcher.directories().contains(info.absolutePath())) {
+            m_watcher.addPath(info.absolutePath());
+        }
+    }
+}
+
+OAuth2Config::SnapshotPtr OAuth2Config::snapshot() const
+{
+    return std::atomic_load(&m_snapshot);
+}
+
+QString OAuth2Config::value(const QString &key) const
+{
+    return snapshot()->value(key);
+}
+
+OAuth2Config::Layer OAuth2Config::source(const QString &key) const
+{
+    return snapshot()->sources.value(key, DefaultLayer);
+}
+
+QVariantMap OAuth2Config::values() const
+{
+    SnapshotPtr current = snapshot();
+    QVariantMap result;
+    for (auto it = current->values.constBegin(); it != current->values.constEnd(); ++it) {
+        result.insert(it.key(), it.value());
+    }
+    return result;
+}
+
+QVariantMap OAuth2Config::sources() const
+{
+    SnapshotPtr current = snapshot();
+    QVariantMap result;
+    for (auto it = current->sources.constBegin(); it != current->sources.constEnd(); ++it) {
+        result.insert(it.key(), layerName(it.value()));
+    }
+    return result;
+}
+
+void OAuth2Config::setRuntimeOverride(const QString &key, const QString &value)
+{
+    m_layers[RuntimeLayer].insert(key, value);
+
+    QSettings settings(runtimeSettingsFile(), QSettings::IniFormat);
+    settings.beginGroup(runtimeSettingsGroup());
+    settings.setValue(key, value);
+    settings.endGroup();
+
+    resolve();
+}
+
+void OAuth2Config::clearRuntimeOverrides()
+{
+    m_layers[RuntimeLayer].clear();
+
+    QSettings settings(runtimeSettingsFile(), QSettings::IniFormat);
+    settings.remove(runtimeSettingsGroup());
+
+    resolve();
+}
+
+QString OAuth2Config::layerName(Layer layer)
+{
+    switch (layer) {
+    case DefaultLayer: return QStringLiteral("default");
+    case ProviderLayer: return QStringLiteral("provider");
+    case EnvironmentLayer: return QStringLiteral("environment");
+    case RuntimeLayer: return QStringLiteral("runtime");
+    case LayerCount: break;
+    }
+    return QString();
+}
+
+bool OAuth2Config::parseProviderFile(const QString &path, QHash<QString, QString> *settings)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    static const QStringList userAgentPath = { "auth", "oauth2", "user_agent" };
+
+    // 单次遍历：用组名栈跟踪当前所在位置
+    QXmlStreamReader xml(&file);
+    QStringList groups;
+    bool inTemplate = false;
+    while (!xml.atEnd()) {
+        xml.readNext();
+        if (xml.isStartElement()) {
+            if (xml.name() == QLatin1String("template")) {
+                inTemplate = true;
+            } else if (inTemplate && xml.name() == QLatin1String("group")) {
+                groups.append(xml.attributes().value("name").toString());
+            } else if (inTemplate && xml.name() == QLatin1String("setting")) {
+                QString name = xml.attributes().value("name").toString();
+                QString value = xml.readElementText();
+                if (groups == userAgentPath) {
+                    settings->insert(name, value);
+                } else {
+                    settings->insert(groups.join('/') + '/' + name, value);
+                }
+            }
+        } else if (xml.isEndElement()) {
+            if (xml.name() == QLatin1String("template")) {
+                inTemplate = false;
+            } else if (inTemplate && xml.name() == QLatin1String("group") && !groups.isEmpty()) {
+                groups.removeLast();
+            }
+        }
+    }
+
+    if (xml.hasError()) {
+        qDebug() << "OAuth2Config: XML parse error in provider file:" << xml.errorString();
+        return false;
+    }
+    return true;
+}
+
+void OAuth2Config::onProviderFileChanged()
+{
+    qDebug() << "OAuth2Config: provider file changed, reloading" << m_providerFile;
+    load();
+    emit reloaded();
+}
+
+void OAuth2Config::loadDefaults()
+{
+    QHash<QString, QString> &layer = m_layers[DefaultLayer];
+    layer.clear();
+    for (const KeyDefault &entry : kDefaults) {
+        layer.insert(QString::fromLatin1(entry.key), QString::fromLatin1(entry.value));
+    }
+}
+
+void OAuth2Config::loadProviderLayer()
+{
+    QHash<QString, QString> &layer = m_layers[ProviderLayer];
+    layer.clear();
+
+    QFileInfo info(m_providerFile);
+    if (m_providerFile.isEmpty() || !info.exists()) {
+        qDebug() << "OAuth2Config: provider file not found:" << m_providerFile;
+        return;
+    }
+
+    qint64 mtime = info.lastModified().toMSecsSinceEpoch();
+    qint64 size = info.size();
+    if (readCache(mtime, size, &layer)) {
+        qDebug() << "OAuth2Config: loaded provider settings from cache," << layer.size() << "keys";
+        return;
+    }
+
+    if (parseProviderFile(m_providerFile, &layer)) {
+        qDebug() << "OAuth2Config: parsed provider file" << m_providerFile << "," << layer.size() << "keys";
+        writeCache(mtime, size, layer);
+    } else {
+        layer.clear();
+    }
+}
+
+void OAuth2Config::loadEnvironmentLayer()
+{
+    QHash<QString, QString> &layer = m_layers[EnvironmentLayer];
+    layer.clear();
+    for (const KeyEnvironment &entry : kEnvironment) {
+        QString value = qEnvironmentVariable(entry.variable);
+        if (!value.isEmpty()) {
+            layer.insert(QString::fromLatin1(entry.key), value);
+        }
+    }
+}
+
+void OAuth2Config::loadRuntimeLayer()
+{
+    QHash<QString, QString> &layer = m_layers[RuntimeLayer];
+    layer.clear();
+
+    QSettings settings(runtimeSettingsFile(), QSettings::IniFormat);
+    settings.beginGroup(runtimeSettingsGroup());
+    const QStringList keys = settings.childKeys();
+    for (const QString &key : keys) {
+        layer.insert(key, settings.value(key).toString());
+    }
+    settings.endGroup();
+}
+
+void OAuth2Config::resolve()
+{
+    std::shared_ptr<Snapshot> next = compose(QHash<QString, QString>());
+    next->generation = ++m_generation;
+
+    // 发布新快照；持有旧快照的读取方（例如进行中的认证流程）不受影响
+    std::atomic_store(&m_snapshot, SnapshotPtr(std::move(next)));
+}
+
+OAuth2Config::SnapshotPtr OAuth2Config::withOverrides(const QHash<QString, QString> &overrides) const
+{
+    if (overrides.isEmpty()) {
+        return snapshot();
+    }
+    std::shared_ptr<Snapshot> derived = compose(overrides);
+    derived->generation = m_generation;
+    return derived;
+}
+
+std::shared_ptr<OAuth2Config::Snapshot> OAuth2Config::compose(const QHash<QString, QString> &overrides) const
+{
+    auto next = std::make_shared<Snapshot>();
+    for (int layer = DefaultLayer; layer < LayerCount; ++layer) {
+        const QHash<QString, QString> &settings = m_layers[layer];
+        for (auto it = settings.constBegin(); it != settings.constEnd(); ++it) {
+            next->values.insert(it.key(), it.value());
+            next->sources.insert(it.key(), Layer(layer));
+        }
+    }
+    for (auto it = overrides.constBegin(); it != overrides.constEnd(); ++it) {
+        next->values.insert(it.key(), it.value());
+        next->sources.insert(it.key(), RuntimeLayer);
+    }
+
+    next->serverUrl = next->value("Host");
+    next->clientId = next->value("ClientId");
+    next->authPath = next->value("AuthPath");
+    next->tokenPath = next->value("TokenPath");
+    next->userInfoPath = next->value("UserInfoPath");
+    next->revocationPath = next->value("RevocationPath");
+    next->redirectUri = next->value("RedirectUri");
+    next->redirectPorts = next->value("RedirectPorts");
+    next->scope = next->value("Scope");
+    next->scopedTokenGrant = next->value("ScopedTokenGrant");
+    // scopes 组：服务ID -> 该服务所需的 scope；登录时申请全部 scope 的并集
+    QStringList consent = parseScopes(next->scope);
+    for (auto it = next->values.constBegin(); it != next->values.constEnd(); ++it) {
+        if (it.key().startsWith(QLatin1String("scopes/"))) {
+            QStringList scopes = parseScopes(it.value());
+            next->serviceScopes.insert(it.key().mid(7), scopes);
+            consent += scopes;
+        }
+    }
+    consent.sort();
+    consent.removeDuplicates();
+    next->consentScope = consent.join(' ');
+    next->tokenRateLimit = next->value("TokenRateLimit").toDouble();
+    next->tokenRateBurst = next->value("TokenRateBurst").toInt();
+    next->maxResponseSize = next->value("MaxResponseSize").toLongLong();
+    next->claimMapper = std::make_shared<const ClaimMapper>(ClaimMapper::mappingsFromSettings(next->values));
+    return next;
+}
+
+QStringList OAuth2Config::parseScopes(const QString &scope)
+{
+    QStringList scopes = scope.simplified().split(' ', Qt::SkipEmptyParts);
+    scopes.sort();
+    scopes.removeDuplicates();
+    return scopes;
+}
+
+QString OAuth2Config::cacheFile() const
+{
+    QByteArray key = QCryptographicHash::hash(QFileInfo(m_providerFile).absoluteFilePath().toUtf8(),
+                                              QCryptographicHash::Sha1).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+        + QStringLiteral("/kde-oauth2-plugin/") + QString::fromLatin1(key) + QStringLiteral(".config");
+}
+
+QString OAuth2Config::runtimeSettingsGroup() const
+{
+    QString name = QFileInfo(m_providerFile).completeBaseName();
+    return name.isEmpty() ? QStringLiteral("default") : name;
+}
+
+bool OAuth2Config::readCache(qint64 mtime, qint64 size, QHash<QString, QString> *settings) const
+{
+    QFile file(cacheFile());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    qint64 cachedMtime = 0;
+    qint64 cachedSize = 0;
+    in >> magic >> version >> cachedMtime >> cachedSize;
+    if (magic != kCacheMagic || version != kCacheVersion || cachedMtime != mtime || cachedSize != size) {
+        return false;
+    }
+
+    QHash<QString, QString> cached;
+    in >> cached;
+    if (in.status() != QDataStream::Ok) {
+        return false;
+    }
+    *settings = cached;
+    return true;
+}
+
+void OAuth2Config::writeCache(qint64 mtime, qint64 size, const QHash<QString, QString> &settings) const
+{
+    QString path = cacheFile();
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "OAuth2Config: cannot write config cache:" << file.errorString();
+        return;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << kCacheMagic << kCacheVersion << mtime << size << settings;
+    file.commit();
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+#include <memory>
+
+class ClaimMapper;
+
+// 分层配置解析器
+// 优先级：默认值 < provider 文件 < 环境变量 < 运行时覆盖（DBus 显式保存的设置，持久化保存）。
+// provider 文件只在修改后重新解析，解析结果缓存为二进制文件，并在文件变化时自动重新加载。
+// 解析结果以不可变快照发布：写入方（所属线程）构造新快照后原子替换，
+// 读取方在任意线程通过 snapshot() 获取当前快照，无需加锁。
+class OAuth2Config : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Layer {
+        DefaultLayer = 0,
+        ProviderLayer,
+        EnvironmentLayer,
+        RuntimeLayer,
+        LayerCount
+    };
+    Q_ENUM(Layer)
+
+    // 不可变配置快照，发布后不再修改
+    struct Snapshot {
+        QString serverUrl;
+        QString clientId;
+        QString authPath;
+        QString tokenPath;
+        QString userInfoPath;
+        QString revocationPath;   // 令牌吊销端点（RFC 7009），为空表示不支持吊销
+        QString redirectUri;
+        QString redirectPorts;   // 回调监听端口列表，逗号分隔，0 表示系统分配的临时端口；为空时使用 redirectUri 的端口
+        QString scope;
+        QString consentScope;                       // 登录时申请的 scope：Scope 与所有服务 scope 的并集
+        QHash<QString, QStringList> serviceScopes;  // 服务ID -> 该服务令牌的 scope（provider 文件 scopes 组，已排序）
+        QString scopedTokenGrant;                   // 获取服务令牌的方式：refresh_token 或 token-exchange
+        double tokenRateLimit = 0;
+        int tokenRateBurst = 0;
+        qint64 maxResponseSize = 0;        // 令牌/用户信息响应体上限（字节）
+        QHash<QString, QString> values;    // 全部键的最终值
+        QHash<QString, Layer> sources;     // 键 -> 来源配置层
+        std::shared_ptr<const ClaimMapper> claimMapper;   // 由 claims 组编译的声明映射器
+        quint64 generation = 0;            // 每次发布递增
+
+        QString value(const QString &key) const { return values.value(key); }
+    };
+    using SnapshotPtr = std::shared_ptr<const Snapshot>;
+
+    explicit OAuth2Config(const QString &providerFile, QObject *parent = nullptr);
+
+    // 加载全部配置层并开始监视 provider 文件
+    void load();
+
+    // 当前快照（原子读取，可在任意线程调用）
+    SnapshotPtr snapshot() const;
+    QString value(const QString &key) const;
+    Layer source(const QString &key) const;
+    QVariantMap values() const;
+    QVariantMap sources() const;   // 键 -> 配置层名称
+    QString providerFile() const { return m_providerFile; }
+
+    // 运行时覆盖（例如 DBus 设置），写入用户配置文件
+    void setRuntimeOverride(const QString &key, const QString &value);
+    void clearRuntimeOverrides();
+    // 在当前快照之上叠加只对单次流程有效的覆盖（来源记为 runtime），不发布也不持久化
+    SnapshotPtr withOverrides(const QHash<QString, QString> &overrides) const;
+
+    static QString layerName(Layer layer);
+    // 以空白分隔的 scope 列表，排序并去重，可直接用作缓存键
+    static QStringList parseScopes(const QString &scope);
+
+    // 解析 provider 文件中的 <template>；auth/oauth2/user_agent 组内的设置使用设置名作为键，
+    // 其他组使用 "组/.../设置名" 作为键
+    static bool parseProviderFile(const QString &path, QHash<QString, QString> *settings);
+
+signals:
+    void reloaded();
+
+private slots:
+    void onProviderFileChanged();
+
+private:
+    void loadDefaults();
+    void loadProviderLayer();
+    void loadEnvironmentLayer();
+    void loadRuntimeLayer();
+    void resolve();   // 合并各配置层并发布新快照
+    std::shared_ptr<Snapshot> compose(const QHash<QString, QString> &overrides) const;   // 合并各配置层和 overrides
+    bool readCache(qint64 mtime, qint64 size, QHash<QString, QString> *settings) const;
+    void writeCache(qint64 mtime, qint64 size, const QHash<QString, QString> &settings) const;
+    QString cacheFile() const;
+    QString runtimeSettingsGroup() const;
+
+    QString m_providerFile;
+    QFileSystemWatcher m_watcher;
+    QHash<QString, QString> m_layers[LayerCount];
+    SnapshotPtr m_snapshot;   // 只能通过 std::atomic_load / std::atomic_store 访问
+    quint64 m_generation = 0;
+};
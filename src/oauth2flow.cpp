@@ -0,0 +1,281 @@
+#include "oauth2flow.h"
+#include "claimmapper.h"
+#include "jsonresponsereader.h"
+#include "providerregistry.h"
+#include <QDebug>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QObject>
+#include <QPointer>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QUuid>
+
+QString OAuth2Flow::authorizationUrl(const OAuth2Config::Snapshot &config, const QString &redirectUri)
+{
+    QUrl url(config.serverUrl + config.authPath);
+    // 申请所有服务 scope 的并集，之后各服务的令牌都能由 refresh_token 缩小范围得到
+    url.setQuery(authorizationQuery(config, redirectUri,
+                                    config.consentScope.isEmpty() ? QStringLiteral("openid") : config.consentScope));
+    return url.toString();
+}
+
+QString OAuth2Flow::incrementalAuthorizationUrl(const OAuth2Config::Snapshot &config, const QString &redirectUri,
+                                                const QStringList &scopes, const QString &loginHint)
+{
+    QUrl url(config.serverUrl + config.authPath);
+    QUrlQuery query = authorizationQuery(config, redirectUri, scopes.join(' '));
+    query.addQueryItem("include_granted_scopes", "true");
+    if (!loginHint.isEmpty()) {
+        query.addQueryItem("login_hint", loginHint);
+    }
+    url.setQuery(query);
+    return url.toString();
+}
+
+QUrlQuery OAuth2Flow::authorizationQuery(const OAuth2Config::Snapshot &config, const QString &redirectUri,
+                                         const QString &scope)
+{
+    QUrlQuery query;
+    query.addQueryItem("response_type", "code");
+    query.addQueryItem("client_id", config.clientId);
+    query.addQueryItem("redirect_uri", redirectUri);
+    query.addQueryItem("scope", scope);
+    query.addQueryItem("state", QUuid::createUuid().toString(QUuid::WithoutBraces));
+    return query;
+}
+
+QList<quint16> OAuth2Flow::callbackPorts(const OAuth2Config::Snapshot &config)
+{
+    // 需要精确匹配 redirect_uri 的服务器可以配置固定端口列表，按顺序尝试
+    QList<quint16> ports;
+    const QStringList parts = config.redirectPorts.split(',', Qt::SkipEmptyParts);
+    for (const QString &part : parts) {
+        bool ok = false;
+        uint port = part.trimmed().toUInt(&ok);
+        if (ok && port <= 65535) {
+            ports.append(quint16(port));
+        }
+    }
+    if (ports.isEmpty()) {
+        // 多数服务器按字符串精确匹配 redirect_uri，默认只监听其中的端口
+        int port = QUrl(config.redirectUri).port();
+        ports.append(port > 0 ? quint16(port) : quint16(0));
+    }
+    return ports;
+}
+
+QSet<QString> OAuth2Flow::tokenResponseKeys()
+{
+    static const QSet<QString> keys = {
+        "access_token", "refresh_token", "expires_in", "token_type", "scope", "id_token",
+        "issued_token_type", "error", "error_description"
+    };
+    return keys;
+}
+
+void OAuth2Flow::exchangeCode(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                              const QString &code, const QString &redirectUri,
+                              QObject *context, const JsonCallback &callback)
+{
+    QUrlQuery parameters;
+    parameters.addQueryItem("grant_type", "authorization_code");
+    parameters.addQueryItem("client_id", config->clientId);
+    parameters.addQueryItem("code", code);
+    parameters.addQueryItem("redirect_uri", redirectUri);
+
+    // 授权码交换是交互式请求，优先于后台刷新
+    postTokenRequest(provider, config, parameters, tokenResponseKeys() | config->claimMapper->claimKeys(),
+                     TokenRateLimiter::Interactive, context, callback);
+}
+
+void OAuth2Flow::refreshToken(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                              const QString &refreshToken, TokenRateLimiter::Priority priority,
+                              QObject *context, const JsonCallback &callback)
+{
+    QUrlQuery parameters;
+    parameters.addQueryItem("grant_type", "refresh_token");
+    parameters.addQueryItem("refresh_token", refreshToken);
+    parameters.addQueryItem("client_id", config->clientId);
+
+    postTokenRequest(provider, config, parameters, tokenResponseKeys(), priority, context, callback);
+}
+
+void OAuth2Flow::downscopeToken(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                                const QString &refreshToken, const QStringList &scopes,
+                                TokenRateLimiter::Priority priority, QObject *context, const JsonCallback &callback)
+{
+    // RFC 6749 6：刷新时可以申请原授权范围的子集
+    QUrlQuery parameters;
+    parameters.addQueryItem("grant_type", "refresh_token");
+    parameters.addQueryItem("refresh_token", refreshToken);
+    parameters.addQueryItem("client_id", config->clientId);
+    parameters.addQueryItem("scope", scopes.join(' '));
+
+    postTokenRequest(provider, config, parameters, tokenResponseKeys(), priority, context, callback);
+}
+
+void OAuth2Flow::exchangeToken(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                               const QString &subjectToken, const QStringList &scopes,
+                               TokenRateLimiter::Priority priority, QObject *context, const JsonCallback &callback)
+{
+    // RFC 8693：用账户的访问令牌换取范围更小的访问令牌，不涉及 refresh_token
+    QUrlQuery parameters;
+    parameters.addQueryItem("grant_type", "urn:ietf:params:oauth:grant-type:token-exchange");
+    parameters.addQueryItem("client_id", config->clientId);
+    parameters.addQueryItem("subject_token", subjectToken);
+    parameters.addQueryItem("subject_token_type", "urn:ietf:params:oauth:token-type:access_token");
+    parameters.addQueryItem("requested_token_type", "urn:ietf:params:oauth:token-type:access_token");
+    parameters.addQueryItem("scope", scopes.join(' '));
+
+    postTokenRequest(provider, config, parameters, tokenResponseKeys(), priority, context, callback);
+}
+
+void OAuth2Flow::revokeToken(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                             const QString &token, const QString &tokenTypeHint,
+                             TokenRateLimiter::Priority priority, QObject *context, const StatusCallback &callback)
+{
+    QUrlQuery parameters;
+    parameters.addQueryItem("token", token);
+    parameters.addQueryItem("token_type_hint", tokenTypeHint);
+    parameters.addQueryItem("client_id", config->clientId);
+
+    QNetworkRequest request(QUrl(config->serverUrl + config->revocationPath));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+    QByteArray body = parameters.toString(QUrl::FullyEncoded).toUtf8();
+
+    QPointer<QObject> guard(context);
+    provider->tokenRateLimiter()->enqueue(priority, [provider, request, body, guard, callback]() {
+        if (!guard) {
+            return;
+        }
+        QNetworkReply *reply = provider->networkManager()->post(request, body);
+        QObject::connect(reply, &QNetworkReply::finished, guard.data(), [reply, callback]() {
+            reply->deleteLater();
+            int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            qDebug() << "OAuth2Flow:" << reply->url().path() << "status" << status;
+            callback(status, reply->error() != QNetworkReply::NoError ? reply->errorString() : QString());
+        });
+    });
+}
+
+void OAuth2Flow::fetchUserInfo(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                               const QString &accessToken, QObject *context, const JsonCallback &callback)
+{
+    QNetworkRequest request(QUrl(config->serverUrl + config->userInfoPath));
+    request.setRawHeader("Authorization", QString("Bearer %1").arg(accessToken).toUtf8());
+
+    QNetworkReply *reply = provider->networkManager()->get(request);
+    JsonResponseReader::attach(reply, config->maxResponseSize, config->claimMapper->claimKeys());
+    QObject::connect(reply, &QNetworkReply::finished, context, [reply, callback]() {
+        finishReply(reply, callback);
+    });
+}
+
+QVariantMap OAuth2Flow::mapClaims(const OAuth2Config::Snapshot &config, const QJsonObject &source, bool includeIdToken)
+{
+    if (!includeIdToken) {
+        return config.claimMapper->map(source);
+    }
+
+    QJsonObject claimSource = source;
+    QJsonObject idTokenClaims = ClaimMapper::decodeJwtPayload(source.value("id_token").toString());
+    for (auto it = idTokenClaims.constBegin(); it != idTokenClaims.constEnd(); ++it) {
+        claimSource.insert(it.key(), it.value());
+    }
+    return config.claimMapper->map(claimSource);
+}
+
+QVariantMap OAuth2Flow::accountDataFromClaims(const OAuth2Config::Snapshot &config, const QVariantMap &claims,
+                                              QString *displayName)
+{
+    QString userId = claims.value("user_id").toString();
+    QString username = claims.value("username").toString();
+    QString email = claims.value("email").toString();
+    QString portrait = claims.value("portrait").toString();
+
+    // 确定显示名称的优先级
+    if (!username.isEmpty()) {
+        *displayName = username;
+    } else if (!email.isEmpty()) {
+        *displayName = email;
+    } else if (!userId.isEmpty()) {
+        *displayName = "User " + userId;
+    } else {
+        *displayName = "OAuth2 User";
+    }
+
+    QVariantMap data;
+    for (auto it = claims.constBegin(); it != claims.constEnd(); ++it) {
+        bool empty = it.value().type() == QVariant::StringList ? it.value().toStringList().isEmpty()
+                                                               : it.value().toString().isEmpty();
+        if (empty) {
+            continue;
+        }
+        data[it.key()] = it.value();
+    }
+    if (!portrait.isEmpty()) {
+        // 如果是相对路径，转换为完整URL
+        if (portrait.startsWith("/")) {
+            data["portrait_url"] = config.serverUrl + portrait;
+        } else {
+            data["portrait_url"] = portrait;
+        }
+    }
+    return data;
+}
+
+void OAuth2Flow::postTokenRequest(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                                  const QUrlQuery &parameters, const QSet<QString> &wantedKeys,
+                                  TokenRateLimiter::Priority priority, QObject *context, const JsonCallback &callback)
+{
+    QNetworkRequest request(QUrl(config->serverUrl + config->tokenPath));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+    QByteArray body = parameters.toString(QUrl::FullyEncoded).toUtf8();
+    qint64 maxResponseSize = config->maxResponseSize;
+
+    // 排队期间 context 可能已被销毁，此时不再发出请求
+    QPointer<QObject> guard(context);
+    provider->tokenRateLimiter()->enqueue(priority, [provider, request, body, maxResponseSize, wantedKeys, guard, callback]() {
+        if (!guard) {
+            return;
+        }
+        QNetworkReply *reply = provider->networkManager()->post(request, body);
+        JsonResponseReader::attach(reply, maxResponseSize, wantedKeys);
+        QObject::connect(reply, &QNetworkReply::finished, guard.data(), [reply, callback]() {
+            finishReply(reply, callback);
+        });
+    });
+}
+
+void OAuth2Flow::finishReply(QNetworkReply *reply, const JsonCallback &callback)
+{
+    JsonResponseReader *reader = JsonResponseReader::forReply(reply);
+    JsonResponseReader::Result readResult = reader->finish();
+    reply->deleteLater();
+
+    qDebug() << "OAuth2Flow:" << reply->url().path() << "status"
+             << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt()
+             << "size" << reader->bytesRead() << "bytes";
+
+    if (readResult == JsonResponseReader::TooLarge) {
+        callback(QJsonObject(), reader->errorString());
+        return;
+    }
+
+    QJsonObject members = reader->members();
+    if (readResult != JsonResponseReader::Ok || reply->error() != QNetworkReply::NoError) {
+        // 优先使用服务器返回的 OAuth2 错误说明，其次是网络/HTTP错误，最后是解析错误
+        QString reason = members.value("error_description").toString();
+        if (reason.isEmpty()) {
+            reason = members.value("error").toString();
+        }
+        if (reason.isEmpty()) {
+            reason = reply->error() != QNetworkReply::NoError ? reply->errorString() : reader->errorString();
+        }
+        callback(members, reason);
+        return;
+    }
+    callback(members, QString());
+}
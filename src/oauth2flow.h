@@ -0,0 +1,74 @@
+#pragma once
+#include <QJsonObject>
+#include <QList>
+#include <QSet>
+#include <QString>
+#include <QVariantMap>
+#include <functional>
+#include "oauth2config.h"
+#include "tokenratelimiter.h"
+
+class ProviderContext;
+class QNetworkReply;
+class QObject;
+class QUrlQuery;
+
+// 授权码流程和令牌端点（不依赖界面）
+// UI 插件、令牌代理和命令行工具共用：生成认证URL、交换授权码、刷新令牌、获取用户信息和映射声明。
+// 令牌端点请求经 provider 的限流器发出，响应由 JsonResponseReader 流式读取；
+// 回调在 context 所在线程执行，context 销毁后不再回调。
+class OAuth2Flow
+{
+public:
+    // error 为空表示成功；response 为读取器保留的成员（失败时可能包含 error/error_description）
+    using JsonCallback = std::function<void(const QJsonObject &response, const QString &error)>;
+    // status 为 HTTP 状态码，0 表示网络错误
+    using StatusCallback = std::function<void(int status, const QString &error)>;
+
+    static QString authorizationUrl(const OAuth2Config::Snapshot &config, const QString &redirectUri);
+    // 增量授权：只申请 scopes，并要求新令牌包含已授予的 scope（include_granted_scopes）；
+    // loginHint 非空时预填已有账户，用户只需确认新增的授权
+    static QString incrementalAuthorizationUrl(const OAuth2Config::Snapshot &config, const QString &redirectUri,
+                                               const QStringList &scopes, const QString &loginHint);
+    // 回调监听端口，未配置时为 redirect_uri 中的端口（默认 8080）；
+    // 临时端口（0）需要显式配置，只适用于允许任意回环端口的服务器（RFC 8252 第 7.3 节）
+    static QList<quint16> callbackPorts(const OAuth2Config::Snapshot &config);
+    static QSet<QString> tokenResponseKeys();  // 令牌响应中需要保留的成员
+
+    // 交换授权码；令牌响应中映射表用到的声明（例如 uid）也会保留
+    static void exchangeCode(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                             const QString &code, const QString &redirectUri,
+                             QObject *context, const JsonCallback &callback);
+    static void refreshToken(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                             const QString &refreshToken, TokenRateLimiter::Priority priority,
+                             QObject *context, const JsonCallback &callback);
+    // 用 refresh_token 获取只含 scopes 的访问令牌（服务令牌）；响应可能带有轮换后的 refresh_token
+    static void downscopeToken(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                               const QString &refreshToken, const QStringList &scopes,
+                               TokenRateLimiter::Priority priority, QObject *context, const JsonCallback &callback);
+    // 令牌交换（RFC 8693）获取服务令牌，subjectToken 为账户当前的访问令牌
+    static void exchangeToken(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                              const QString &subjectToken, const QStringList &scopes,
+                              TokenRateLimiter::Priority priority, QObject *context, const JsonCallback &callback);
+    // 吊销令牌（RFC 7009）；服务器对已失效的令牌同样返回 200，响应体不读取
+    static void revokeToken(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                            const QString &token, const QString &tokenTypeHint,
+                            TokenRateLimiter::Priority priority, QObject *context, const StatusCallback &callback);
+    // 只保留映射表用到的声明，其余成员（例如很长的组列表）在读取时直接跳过
+    static void fetchUserInfo(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                              const QString &accessToken, QObject *context, const JsonCallback &callback);
+
+    // 映射声明；includeIdToken 时合并 id_token 载荷（同名声明以 id_token 为准）。纯函数，可在任意线程调用
+    static QVariantMap mapClaims(const OAuth2Config::Snapshot &config, const QJsonObject &source, bool includeIdToken);
+    // 声明 -> 账户数据（含 portrait_url），同时确定显示名称
+    static QVariantMap accountDataFromClaims(const OAuth2Config::Snapshot &config, const QVariantMap &claims,
+                                             QString *displayName);
+
+private:
+    static QUrlQuery authorizationQuery(const OAuth2Config::Snapshot &config, const QString &redirectUri,
+                                        const QString &scope);
+    static void postTokenRequest(ProviderContext *provider, const OAuth2Config::SnapshotPtr &config,
+                                 const QUrlQuery &parameters, const QSet<QString> &wantedKeys,
+                                 TokenRateLimiter::Priority priority, QObject *context, const JsonCallback &callback);
+    static void finishReply(QNetworkReply *reply, const JsonCallback &callback);
+};
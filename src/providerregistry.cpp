@@ -0,0 +1,216 @@
+#include "providerregistry.h"
+#include "oauth2config.h"
+#include "tokenratelimiter.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkAccessManager>
+#include <QStandardPaths>
+#include <QXmlStreamReader>
+
+ProviderContext::ProviderContext(const QString &providerId, const QString &providerFile, QObject *parent)
+    : QObject(parent)
+    , m_providerId(providerId)
+    , m_providerFile(providerFile)
+    , m_config(new OAuth2Config(providerFile, this))
+    , m_tokenRateLimiter(new TokenRateLimiter(this))
+    , m_networkManager(nullptr)
+{
+    connect(m_config, &OAuth2Config::reloaded, this, &ProviderContext::applyRateLimit);
+}
+
+QString ProviderContext::dbusObjectPath() const
+{
+    // DBus 路径元素只允许 [A-Za-z0-9_]
+    QString element;
+    element.reserve(m_providerId.size());
+    for (const QChar ch : m_providerId) {
+        element.append(ch.unicode() < 128 && ch.isLetterOrNumber() ? ch : QChar('_'));
+    }
+    return QStringLiteral("/OAuth2Plugin/") + element;
+}
+
+void ProviderContext::load()
+{
+    m_config->load();
+    applyRateLimit();
+}
+
+QNetworkAccessManager *ProviderContext::networkManager()
+{
+    if (!m_networkManager) {
+        m_networkManager = new QNetworkAccessManager(this);
+    }
+    return m_networkManager;
+}
+
+QVariantMap ProviderContext::statistics() const
+{
+    QVariantMap stats;
+    stats["providerId"] = m_providerId;
+    stats["providerFile"] = m_providerFile;
+    stats["displayName"] = m_displayName;
+    stats["dbusObjectPath"] = dbusObjectPath();
+    stats["serverUrl"] = m_config->snapshot()->serverUrl;
+    stats["tokenRateLimiter"] = m_tokenRateLimiter->statistics();
+    stats["tokenCache"] = m_tokenCache.statistics();
+    return stats;
+}
+
+void ProviderContext::applyRateLimit()
+{
+    OAuth2Config::SnapshotPtr config = m_config->snapshot();
+    m_tokenRateLimiter->setRate(config->tokenRateLimit, config->tokenRateBurst);
+}
+
+ProviderRegistry::ProviderRegistry(QObject *parent)
+    : QObject(parent)
+{
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged, this, &ProviderRegistry::onDirectoryChanged);
+}
+
+QStringList ProviderRegistry::providerDirectories()
+{
+    QStringList directories;
+
+    // 与 libaccounts 一致：ACCOUNTS_PROVIDER_DIR 优先
+    QString overrideDir = qEnvironmentVariable("ACCOUNTS_PROVIDER_DIR");
+    if (!overrideDir.isEmpty()) {
+        directories.append(overrideDir);
+    }
+
+    const QStringList dataDirs = QStandardPaths::standardLocations(QStandardPaths::GenericDataLocation);
+    for (const QString &dataDir : dataDirs) {
+        directories.append(dataDir + QStringLiteral("/accounts/providers"));
+        directories.append(dataDir + QStringLiteral("/accounts/providers/kde"));
+    }
+    directories.removeDuplicates();
+    return directories;
+}
+
+bool ProviderRegistry::readProviderHeader(const QString &path, QString *plugin, QString *name)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    QXmlStreamReader xml(&file);
+    while (!xml.atEnd()) {
+        xml.readNext();
+        if (!xml.isStartElement()) {
+            continue;
+        }
+        if (xml.name() == QLatin1String("template")) {
+            break;   // 不需要解析模板部分
+        } else if (xml.name() == QLatin1String("plugin")) {
+            *plugin = xml.readElementText().trimmed();
+        } else if (xml.name() == QLatin1String("name")) {
+            *name = xml.readElementText().trimmed();
+        }
+    }
+    return !xml.hasError() || xml.error() == QXmlStreamReader::PrematureEndOfDocumentError;
+}
+
+void ProviderRegistry::scan()
+{
+    QHash<QString, QString> found;   // providerId -> 文件
+    QHash<QString, QString> names;
+    QStringList order;
+
+    const QStringList directories = providerDirectories();
+    for (const QString &directory : directories) {
+        QDir dir(directory);
+        if (!dir.exists()) {
+            continue;
+        }
+        if (!m_watcher.directories().contains(dir.absolutePath())) {
+            m_watcher.addPath(dir.absolutePath());
+        }
+
+        const QFileInfoList files = dir.entryInfoList(QStringList() << "*.provider", QDir::Files, QDir::Name);
+        for (const QFileInfo &info : files) {
+            // libaccounts 使用文件名（不含扩展名）作为 provider ID
+            QString providerId = info.completeBaseName();
+            if (found.contains(providerId)) {
+                continue;
+            }
+
+            QString plugin;
+            QString name;
+            if (!readProviderHeader(info.absoluteFilePath(), &plugin, &name) || plugin != QLatin1String(PluginName)) {
+                continue;
+            }
+            found.insert(providerId, info.absoluteFilePath());
+            names.insert(providerId, name);
+            order.append(providerId);
+        }
+    }
+
+    // 未安装任何 provider 文件时（例如开发环境），回退到工作目录中的默认 provider
+    if (found.isEmpty()) {
+        QString providerId = QString::fromLatin1(DefaultProviderId);
+        found.insert(providerId, providerId + QStringLiteral(".provider"));
+        order.append(providerId);
+    }
+
+    // 移除已删除的 provider
+    const QStringList known = m_order;
+    for (const QString &providerId : known) {
+        ProviderContext *context = m_providers.value(providerId);
+        if (!found.contains(providerId) || found.value(providerId) != context->providerFile()) {
+            qDebug() << "ProviderRegistry: provider removed" << providerId;
+            m_providers.remove(providerId);
+            m_order.removeAll(providerId);
+            emit providerRemoved(context);
+        }
+    }
+
+    // 添加新的 provider
+    for (const QString &providerId : order) {
+        if (m_providers.contains(providerId)) {
+            continue;
+        }
+        auto *context = new ProviderContext(providerId, found.value(providerId), this);
+        context->setDisplayName(names.value(providerId, providerId));
+        context->load();
+        m_providers.insert(providerId, context);
+        m_order.append(providerId);
+        qDebug() << "ProviderRegistry: provider added" << providerId << context->providerFile();
+        emit providerAdded(context);
+    }
+}
+
+ProviderContext *ProviderRegistry::provider(const QString &providerId) const
+{
+    return m_providers.value(providerId);
+}
+
+ProviderContext *ProviderRegistry::defaultProvider() const
+{
+    if (ProviderContext *context = m_providers.value(QString::fromLatin1(DefaultProviderId))) {
+        return context;
+    }
+    return m_order.isEmpty() ? nullptr : m_providers.value(m_order.first());
+}
+
+QStringList ProviderRegistry::providerIds() const
+{
+    return m_order;
+}
+
+QList<ProviderContext *> ProviderRegistry::providers() const
+{
+    QList<ProviderContext *> result;
+    for (const QString &providerId : m_order) {
+        result.append(m_providers.value(providerId));
+    }
+    return result;
+}
+
+void ProviderRegistry::onDirectoryChanged()
+{
+    qDebug() << "ProviderRegistry: provider directory changed, rescanning";
+    scan();
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+#include "tokencache.h"
+
+class QNetworkAccessManager;
+class OAuth2Config;
+class TokenRateLimiter;
+
+// 单个 provider（租户）的运行时上下文
+// 每个 provider 拥有独立的配置、网络连接池、令牌端点限流器和令牌缓存。
+class ProviderContext : public QObject
+{
+    Q_OBJECT
+
+public:
+    ProviderContext(const QString &providerId, const QString &providerFile, QObject *parent = nullptr);
+
+    QString providerId() const { return m_providerId; }
+    QString providerFile() const { return m_providerFile; }
+    QString displayName() const { return m_displayName; }
+    void setDisplayName(const QString &name) { m_displayName = name; }
+
+    // 该 provider 的 DBus 对象路径，例如 /OAuth2Plugin/gzweibo_oauth2
+    QString dbusObjectPath() const;
+
+    // 加载配置并应用限流参数
+    void load();
+
+    OAuth2Config *config() const { return m_config; }
+    TokenRateLimiter *tokenRateLimiter() const { return m_tokenRateLimiter; }
+    TokenCache &tokenCache() { return m_tokenCache; }
+    const TokenCache &tokenCache() const { return m_tokenCache; }
+    // 延迟创建，见 ProviderContext::networkManager()
+    QNetworkAccessManager *networkManager();
+
+    QVariantMap statistics() const;
+
+private slots:
+    void applyRateLimit();
+
+private:
+    QString m_providerId;
+    QString m_providerFile;
+    QString m_displayName;
+    OAuth2Config *m_config;
+    TokenRateLimiter *m_tokenRateLimiter;
+    QNetworkAccessManager *m_networkManager;
+    TokenCache m_tokenCache;
+};
+
+// provider 注册表
+// 扫描 provider 目录，索引所有 <plugin> 为本插件的 *.provider 文件。
+// 目录发生变化时重新扫描，新增租户只需放入 provider 文件。
+class ProviderRegistry : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr const char *PluginName = "gzweibo_oauth2_plugin";
+    static constexpr const char *DefaultProviderId = "gzweibo-oauth2";
+
+    explicit ProviderRegistry(QObject *parent = nullptr);
+
+    // 扫描所有 provider 目录；同一 provider 以先找到的（用户目录优先）为准
+    void scan();
+
+    ProviderContext *provider(const QString &providerId) const;
+    // 默认 provider：gzweibo-oauth2，不存在时取第一个
+    ProviderContext *defaultProvider() const;
+    QStringList providerIds() const;
+    QList<ProviderContext *> providers() const;
+
+    static QStringList providerDirectories();
+    // 只读取 provider 文件头部（<provider> 到 <template> 之前），返回 <plugin> 和 <name>
+    static bool readProviderHeader(const QString &path, QString *plugin, QString *name);
+
+signals:
+    void providerAdded(ProviderContext *provider);
+    // provider 文件被删除；注册表不再引用上下文对象，由接收者在不再使用时释放
+    // （插件在流程结束后释放；令牌代理保留到退出，进行中的刷新请求仍引用它）
+    void providerRemoved(ProviderContext *provider);
+
+private slots:
+    void onDirectoryChanged();
+
+private:
+    QHash<QString, ProviderContext *> m_providers;
+    QStringList m_order;   // 扫描顺序
+    QFileSystemWatcher m_watcher;
+};
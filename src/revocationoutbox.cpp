@@ -0,0 +1,251 @@
+#include "revocationoutbox.h"
+#include "oauth2config.h"
+#include "oauth2flow.h"
+#include "providerregistry.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+RevocationOutbox::RevocationOutbox(ProviderRegistry *registry, QObject *parent)
+    : QObject(parent)
+    , m_registry(registry)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &RevocationOutbox::sendBatch);
+}
+
+RevocationOutbox::~RevocationOutbox() = default;
+
+QString RevocationOutbox::outboxFile()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+        + QStringLiteral("/kde-oauth2-plugin/revocation-outbox.json");
+}
+
+void RevocationOutbox::load()
+{
+    QFile file(outboxFile());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    const QJsonArray items = QJsonDocument::fromJson(file.readAll()).array();
+    for (const QJsonValue &value : items) {
+        QJsonObject obj = value.toObject();
+        Item item;
+        item.providerId = obj.value("provider").toString();
+        item.token = obj.value("token").toString();
+        item.tokenTypeHint = obj.value("token_type_hint").toString();
+        item.queuedAt = qint64(obj.value("queued_at").toDouble());
+        item.attempts = obj.value("attempts").toInt();
+        if (item.token.isEmpty() || indexOf(item.token) >= 0) {
+            continue;
+        }
+        // 重启后立即尝试一次，之前的退避间隔不再保留
+        m_items.append(item);
+    }
+    qDebug() << "RevocationOutbox:" << m_items.size() << "tokens pending revocation";
+    armTimer();
+}
+
+bool RevocationOutbox::enqueue(const QString &providerId, const QString &token, const QString &tokenTypeHint)
+{
+    if (token.isEmpty()) {
+        return true;
+    }
+    if (indexOf(token) >= 0) {
+        // 插件和账户删除通知可能提交同一令牌
+        return true;
+    }
+
+    Item item;
+    item.providerId = providerId;
+    item.token = token;
+    item.tokenTypeHint = tokenTypeHint;
+    item.queuedAt = QDateTime::currentSecsSinceEpoch();
+    m_items.append(item);
+    ++m_enqueued;
+
+    // 返回前落盘，代理随后退出也不会丢失
+    bool saved = save();
+    armTimer();
+    return saved;
+}
+
+int RevocationOutbox::indexOf(const QString &token) const
+{
+    for (int i = 0; i < m_items.size(); ++i) {
+        if (m_items.at(i).token == token) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void RevocationOutbox::sendBatch()
+{
+    qint64 now = QDateTime::currentSecsSinceEpoch();
+    for (int i = 0; i < m_items.size() && m_inFlight < BatchSize; ) {
+        Item &item = m_items[i];
+        if (item.inFlight || item.nextAttemptAt > now) {
+            ++i;
+            continue;
+        }
+        if (now - item.queuedAt > MaxAgeSecs) {
+            qDebug() << "RevocationOutbox: giving up on a" << item.tokenTypeHint << "of" << item.providerId
+                     << "after" << item.attempts << "attempts";
+            m_items.removeAt(i);
+            m_dirty = true;
+            ++m_dropped;
+            continue;
+        }
+
+        ProviderContext *provider = m_registry->provider(item.providerId);
+        if (!provider) {
+            // provider 文件可能只是暂时不可用（例如正在升级软件包）
+            retryLater(&item, "provider 不存在");
+            ++i;
+            continue;
+        }
+        OAuth2Config::SnapshotPtr config = provider->config()->snapshot();
+        if (config->revocationPath.isEmpty()) {
+            qDebug() << "RevocationOutbox: provider" << item.providerId << "has no revocation endpoint, dropping token";
+            m_items.removeAt(i);
+            m_dirty = true;
+            ++m_dropped;
+            continue;
+        }
+
+        item.inFlight = true;
+        ++item.attempts;
+        ++m_inFlight;
+        QString token = item.token;
+        OAuth2Flow::revokeToken(provider, config, item.token, item.tokenTypeHint, TokenRateLimiter::Background, this,
+                                [this, token](int status, const QString &error) {
+            onRevokeResponse(token, status, error);
+        });
+        ++i;
+    }
+
+    if (m_inFlight == 0 && m_dirty) {
+        save();
+    }
+    armTimer();
+}
+
+void RevocationOutbox::onRevokeResponse(const QString &token, int status, const QString &error)
+{
+    --m_inFlight;
+    int index = indexOf(token);
+    if (index >= 0) {
+        Item &item = m_items[index];
+        item.inFlight = false;
+        if (status == 200) {
+            m_items.removeAt(index);
+            ++m_revoked;
+        } else if (status == 0 || status == 429 || status >= 500) {
+            // 网络错误、限流和服务器错误可以重试（RFC 7009 2.2.1 中的 503）
+            retryLater(&item, error);
+        } else {
+            // 其他 4xx（例如 unsupported_token_type）重试也不会成功
+            qDebug() << "RevocationOutbox: revocation of a" << item.tokenTypeHint << "rejected with status" << status
+                     << error << ", dropping token";
+            m_items.removeAt(index);
+            ++m_dropped;
+        }
+        m_dirty = true;
+    }
+
+    // 一批请求全部结束后写一次文件
+    if (m_inFlight == 0) {
+        if (m_dirty) {
+            save();
+        }
+        armTimer();
+    }
+}
+
+void RevocationOutbox::retryLater(Item *item, const QString &reason)
+{
+    int delay = RetryDelaySecs;
+    for (int i = 1; i < item->attempts && delay < MaxRetryDelaySecs; ++i) {
+        delay *= 2;
+    }
+    delay = qMin(delay, int(MaxRetryDelaySecs));
+    item->nextAttemptAt = QDateTime::currentSecsSinceEpoch() + delay;
+    m_dirty = true;
+    ++m_retried;
+    qDebug() << "RevocationOutbox: revocation for" << item->providerId << "failed:" << reason << ", retrying in" << delay << "s";
+}
+
+bool RevocationOutbox::save()
+{
+    QString path = outboxFile();
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "RevocationOutbox: cannot write" << path << file.errorString();
+        return false;
+    }
+    // 文件中是仍然有效的令牌
+    file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+
+    QJsonArray items;
+    for (const Item &item : qAsConst(m_items)) {
+        QJsonObject obj;
+        obj["provider"] = item.providerId;
+        obj["token"] = item.token;
+        obj["token_type_hint"] = item.tokenTypeHint;
+        obj["queued_at"] = item.queuedAt;
+        obj["attempts"] = item.attempts;
+        items.append(obj);
+    }
+    file.write(QJsonDocument(items).toJson(QJsonDocument::Compact));
+    if (!file.commit()) {
+        qWarning() << "RevocationOutbox: cannot write" << path << file.errorString();
+        return false;
+    }
+    m_dirty = false;
+    return true;
+}
+
+void RevocationOutbox::armTimer()
+{
+    if (m_inFlight >= BatchSize) {
+        // 本批结束后再安排
+        m_timer.stop();
+        return;
+    }
+    qint64 next = -1;
+    for (const Item &item : qAsConst(m_items)) {
+        if (!item.inFlight && (next < 0 || item.nextAttemptAt < next)) {
+            next = item.nextAttemptAt;
+        }
+    }
+    if (next < 0) {
+        m_timer.stop();
+        return;
+    }
+    qint64 wait = (next - QDateTime::currentSecsSinceEpoch()) * 1000;
+    m_timer.start(int(qBound<qint64>(0, wait, qint64(MaxRetryDelaySecs) * 1000)));
+}
+
+QVariantMap RevocationOutbox::statistics() const
+{
+    QVariantMap stats;
+    stats["file"] = outboxFile();
+    stats["pending"] = m_items.size();
+    stats["inFlight"] = m_inFlight;
+    stats["enqueued"] = m_enqueued;
+    stats["revoked"] = m_revoked;
+    stats["retried"] = m_retried;
+    stats["dropped"] = m_dropped;
+    return stats;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <QObject>
+#include <QList>
+#include <QString>
+#include <QTimer>
+#include <QVariantMap>
+
+class ProviderRegistry;
+
+// 令牌吊销发件箱（RFC 7009）
+// 账户删除或停用时，令牌先写入持久化的发件箱（权限 0600），DBus 调用随即返回；
+// 发件箱在后台按批发送吊销请求，失败时按指数退避重试，令牌代理重启后继续发送。
+// 吊销请求经 provider 的限流器以后台优先级发出，不挤占交互式的令牌请求。
+// 吊销是幂等的（服务器对已失效的令牌同样返回 200），崩溃后重发已吊销的令牌没有副作用。
+class RevocationOutbox : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int BatchSize = 8;                      // 每批最多同时发出的请求
+    static constexpr int RetryDelaySecs = 30;                // 首次重试间隔（之后逐次加倍）
+    static constexpr int MaxRetryDelaySecs = 6 * 3600;
+    static constexpr qint64 MaxAgeSecs = 30 * 24 * 3600;     // 排队超过该时间仍未成功则放弃
+
+    explicit RevocationOutbox(ProviderRegistry *registry, QObject *parent = nullptr);
+    ~RevocationOutbox() override;
+
+    // 读取上次未发送完的令牌并安排发送
+    void load();
+    // tokenTypeHint 为 refresh_token 或 access_token；同一令牌只排队一次。写入磁盘后返回
+    bool enqueue(const QString &providerId, const QString &token, const QString &tokenTypeHint);
+    int size() const { return m_items.size(); }
+
+    static QString outboxFile();
+    QVariantMap statistics() const;
+
+private slots:
+    void sendBatch();
+
+private:
+    struct Item {
+        QString providerId;
+        QString token;
+        QString tokenTypeHint;
+        qint64 queuedAt = 0;        // 秒
+        qint64 nextAttemptAt = 0;   // 秒
+        int attempts = 0;
+        bool inFlight = false;      // 不持久化
+    };
+
+    int indexOf(const QString &token) const;
+    void onRevokeResponse(const QString &token, int status, const QString &error);
+    void retryLater(Item *item, const QString &reason);
+    bool save();
+    void armTimer();
+
+    ProviderRegistry *m_registry;
+    QList<Item> m_items;
+    QTimer m_timer;
+    int m_inFlight = 0;
+    bool m_dirty = false;   // 本批结束后写回磁盘
+
+    quint64 m_enqueued = 0;
+    quint64 m_revoked = 0;
+    quint64 m_retried = 0;
+    quint64 m_dropped = 0;
+};
@@ -0,0 +1,151 @@
+#include "roleindex.h"
+#include "stringpool.h"
+#include <QDebug>
+#include <Accounts/Manager>
+#include <algorithm>
+#include <memory>
+
+RoleIndex::RoleIndex(QObject *parent)
+    : QObject(parent)
+    , m_manager(nullptr)
+{
+}
+
+void RoleIndex::setProviders(const QStringList &providerIds)
+{
+    if (providerIds == m_providers) {
+        return;
+    }
+    m_providers = providerIds;
+
+    // provider 集合变化后重新构建
+    m_built = false;
+    m_accounts.clear();
+    m_index.clear();
+}
+
+bool RoleIndex::hasRole(quint32 accountId, const QString &role)
+{
+    ensureBuilt();
+    auto it = m_index.constFind(role);
+    return it != m_index.constEnd() && it->contains(accountId);
+}
+
+QList<quint32> RoleIndex::accountsWithRole(const QString &role, const QString &providerId)
+{
+    ensureBuilt();
+    QList<quint32> result;
+    auto it = m_index.constFind(role);
+    if (it == m_index.constEnd()) {
+        return result;
+    }
+    for (quint32 accountId : *it) {
+        if (providerId.isEmpty() || m_accounts.value(accountId).providerId == providerId) {
+            result.append(accountId);
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+QStringList RoleIndex::roles(quint32 accountId)
+{
+    ensureBuilt();
+    return m_accounts.value(accountId).roles;
+}
+
+QVariantMap RoleIndex::statistics() const
+{
+    QVariantMap stats;
+    stats["built"] = m_built;
+    stats["accounts"] = m_accounts.size();
+    stats["roles"] = m_index.size();
+    return stats;
+}
+
+void RoleIndex::onAccountChanged(Accounts::AccountId id)
+{
+    if (m_built) {
+        indexAccount(id);
+    }
+}
+
+void RoleIndex::onAccountRemoved(Accounts::AccountId id)
+{
+    if (m_built) {
+        removeAccount(id);
+    }
+}
+
+void RoleIndex::ensureBuilt()
+{
+    if (m_built) {
+        return;
+    }
+    m_built = true;
+
+    if (!m_manager) {
+        m_manager = new Accounts::Manager(this);
+        connect(m_manager, &Accounts::Manager::accountCreated, this, &RoleIndex::onAccountChanged);
+        connect(m_manager, &Accounts::Manager::accountUpdated, this, &RoleIndex::onAccountChanged);
+        connect(m_manager, &Accounts::Manager::accountRemoved, this, &RoleIndex::onAccountRemoved);
+    }
+
+    const Accounts::AccountIdList ids = m_manager->accountList();
+    for (Accounts::AccountId id : ids) {
+        indexAccount(id);
+    }
+    qDebug() << "RoleIndex: indexed" << m_accounts.size() << "accounts," << m_index.size() << "roles";
+}
+
+void RoleIndex::indexAccount(quint32 accountId)
+{
+    removeAccount(accountId);
+
+    std::unique_ptr<Accounts::Account> account(m_manager->account(accountId));
+    if (!account || !m_providers.contains(account->providerName())) {
+        return;
+    }
+
+    Entry entry;
+    entry.providerId = StringPool::intern(account->providerName());
+    entry.roles = readRoles(account.get());
+    for (const QString &role : qAsConst(entry.roles)) {
+        m_index[role].insert(accountId);
+    }
+    m_accounts.insert(accountId, entry);
+}
+
+void RoleIndex::removeAccount(quint32 accountId)
+{
+    auto it = m_accounts.find(accountId);
+    if (it == m_accounts.end()) {
+        return;
+    }
+    for (const QString &role : qAsConst(it->roles)) {
+        auto roleIt = m_index.find(role);
+        if (roleIt != m_index.end()) {
+            roleIt->remove(accountId);
+            if (roleIt->isEmpty()) {
+                m_index.erase(roleIt);
+            }
+        }
+    }
+    m_accounts.erase(it);
+}
+
+QStringList RoleIndex::readRoles(Accounts::Account *account)
+{
+    QStringList roles = account->value("roles").toStringList();
+    if (roles.isEmpty()) {
+        // 旧账户只有逗号分隔的 role 字段
+        const QStringList legacy = account->value("role").toString().split(',', Qt::SkipEmptyParts);
+        for (const QString &role : legacy) {
+            roles.append(role.trimmed());
+        }
+    }
+    roles += account->value("groups").toStringList();
+    roles.removeAll(QString());
+    roles.removeDuplicates();
+    return StringPool::intern(roles);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QStringList>
+#include <QVariantMap>
+#include <Accounts/Account>
+
+namespace Accounts {
+class Manager;
+}
+
+// 角色倒排索引：角色/组名 -> 账户ID
+// 从账户设置中的 roles、groups（以及旧的逗号分隔 role）建立，首次查询时构建，
+// 之后跟随账户的创建、更新和删除增量维护，应用做授权检查时无需重新解析声明。
+class RoleIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RoleIndex(QObject *parent = nullptr);
+
+    // 只索引这些 provider 的账户
+    void setProviders(const QStringList &providerIds);
+
+    bool hasRole(quint32 accountId, const QString &role);
+    // providerId 为空时返回所有已索引 provider 的账户
+    QList<quint32> accountsWithRole(const QString &role, const QString &providerId = QString());
+    QStringList roles(quint32 accountId);
+
+    QVariantMap statistics() const;
+
+private slots:
+    void onAccountChanged(Accounts::AccountId id);
+    void onAccountRemoved(Accounts::AccountId id);
+
+private:
+    struct Entry {
+        QString providerId;
+        QStringList roles;      // 已驻留、去重
+    };
+
+    void ensureBuilt();
+    void indexAccount(quint32 accountId);
+    void removeAccount(quint32 accountId);
+    static QStringList readRoles(Accounts::Account *account);
+
+    Accounts::Manager *m_manager;
+    QStringList m_providers;
+    bool m_built = false;
+    QHash<quint32, Entry> m_accounts;
+    QHash<QString, QSet<quint32>> m_index;
+};
@@ -0,0 +1,75 @@
+#include "stringpool.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+
+namespace {
+
+struct Pool {
+    QMutex mutex;
+    QSet<QString> strings;
+    quint64 lookups = 0;
+    quint64 hits = 0;
+    quint64 rejected = 0;
+};
+
+Pool &pool()
+{
+    static Pool instance;
+    return instance;
+}
+
+} // namespace
+
+QString StringPool::intern(const QString &value)
+{
+    if (value.isEmpty()) {
+        return value;
+    }
+
+    Pool &p = pool();
+    QMutexLocker locker(&p.mutex);
+    ++p.lookups;
+
+    auto it = p.strings.constFind(value);
+    if (it != p.strings.constEnd()) {
+        ++p.hits;
+        return *it;
+    }
+    if (p.strings.size() >= MaxEntries) {
+        ++p.rejected;
+        return value;
+    }
+    return *p.strings.insert(value);
+}
+
+QStringList StringPool::intern(const QStringList &values)
+{
+    QStringList result;
+    result.reserve(values.size());
+    for (const QString &value : values) {
+        result.append(intern(value));
+    }
+    return result;
+}
+
+int StringPool::size()
+{
+    Pool &p = pool();
+    QMutexLocker locker(&p.mutex);
+    return p.strings.size();
+}
+
+QVariantMap StringPool::statistics()
+{
+    Pool &p = pool();
+    QMutexLocker locker(&p.mutex);
+
+    QVariantMap stats;
+    stats["entries"] = p.strings.size();
+    stats["maxEntries"] = MaxEntries;
+    stats["lookups"] = p.lookups;
+    stats["hits"] = p.hits;
+    stats["rejected"] = p.rejected;
+    return stats;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+// 进程级字符串驻留池
+// 角色名、组名、签发者、声明键等反复出现的字符串只保留一份（借助 QString 隐式共享），
+// 驻留后的字符串互相比较时也能更快地命中相同的数据指针。线程安全。
+class StringPool
+{
+public:
+    static constexpr int MaxEntries = 65536;   // 超过上限后不再驻留新字符串，直接返回原值
+
+    static QString intern(const QString &value);
+    static QStringList intern(const QStringList &values);
+
+    static int size();
+    static QVariantMap statistics();
+};
@@ -0,0 +1,158 @@
+#include "accountdatabase.h"
+#include "brokerclient.h"
+#include "providerregistry.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <memory>
+
+// kde-oauth2-token：输出账户的有效访问令牌，供脚本调用
+// 快速路径只读一次账户数据库：令牌距过期还有足够时间时直接输出，不访问 DBus 和网络，
+// 也不创建 QCoreApplication。令牌即将过期或过期时间未知时，才向令牌代理请求（代理负责刷新）。
+// --service 请求的服务令牌只保存在代理的内存中，总是走慢速路径。
+
+namespace {
+
+constexpr int DefaultMinValiditySecs = 60;
+
+QTextStream &out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+QTextStream &err()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+// 单引号包裹，内部的单引号写成 '\''
+QString shellQuote(const QString &value)
+{
+    QString quoted = value;
+    quoted.replace('\'', "'\\''");
+    return '\'' + quoted + '\'';
+}
+
+void printToken(const AccountDatabase::TokenRecord &record, const QString &source, bool json, bool exportVars)
+{
+    if (json) {
+        QJsonObject obj;
+        obj["account_id"] = qint64(record.accountId);
+        obj["access_token"] = record.accessToken;
+        obj["expires_at"] = record.expiresAt;
+        obj["server"] = record.server;
+        obj["username"] = record.username;
+        obj["source"] = source;
+        out() << QJsonDocument(obj).toJson(QJsonDocument::Compact) << '\n';
+    } else if (exportVars) {
+        out() << "export OAUTH2_ACCESS_TOKEN=" << shellQuote(record.accessToken) << '\n'
+              << "export OAUTH2_ACCOUNT_ID=" << record.accountId << '\n'
+              << "export OAUTH2_EXPIRES_AT=" << record.expiresAt << '\n'
+              << "export OAUTH2_SERVER=" << shellQuote(record.server) << '\n'
+              << "export OAUTH2_USERNAME=" << shellQuote(record.username) << '\n';
+    } else {
+        out() << record.accessToken << '\n';
+    }
+    out().flush();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QStringList arguments;
+    for (int i = 0; i < argc; ++i) {
+        arguments.append(QString::fromLocal8Bit(argv[i]));
+    }
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Print a valid OAuth2 access token for scripts");
+    QCommandLineOption helpOption({"h", "help"}, "Show this help.");
+    QCommandLineOption accountOption("account", "Account id (default: newest enabled account of the provider).", "id");
+    QCommandLineOption providerOption("provider", "Provider id.", "id", ProviderRegistry::DefaultProviderId);
+    QCommandLineOption minValidityOption("min-validity",
+        "Ask the broker for a fresh token when fewer than this many seconds remain (default: 60).", "secs");
+    QCommandLineOption databaseOption("database", "Accounts database path.", "path");
+    QCommandLineOption jsonOption("json", "Print the token and account details as JSON.");
+    QCommandLineOption exportOption("export", "Print shell export statements.");
+    QCommandLineOption offlineOption("offline", "Never contact the broker; fail if the stored token is not valid.");
+    QCommandLineOption serviceOption("service",
+        "Print a token limited to the scopes of this service (always asks the broker).", "id");
+    parser.addOptions({helpOption, accountOption, providerOption, minValidityOption, databaseOption,
+                       jsonOption, exportOption, offlineOption, serviceOption});
+
+    if (!parser.parse(arguments)) {
+        err() << parser.errorText() << '\n';
+        return 2;
+    }
+    if (parser.isSet(helpOption)) {
+        out() << parser.helpText();
+        return 0;
+    }
+
+    quint32 accountId = parser.value(accountOption).toUInt();
+    QString providerId = parser.value(providerOption);
+    int minValidity = parser.isSet(minValidityOption) ? parser.value(minValidityOption).toInt() : DefaultMinValiditySecs;
+    QString path = parser.isSet(databaseOption) ? parser.value(databaseOption) : AccountDatabase::defaultPath();
+    bool json = parser.isSet(jsonOption);
+    bool exportVars = parser.isSet(exportOption);
+    QString serviceId = parser.value(serviceOption);
+    if (!serviceId.isEmpty() && parser.isSet(offlineOption)) {
+        err() << "--service 需要令牌代理，不能与 --offline 同时使用" << '\n';
+        return 2;
+    }
+
+    AccountDatabase::TokenRecord record;
+    QString error;
+    bool found = AccountDatabase::readToken(path, providerId, accountId, &record, &error);
+    if (found && serviceId.isEmpty() && !record.accessToken.isEmpty() && record.expiresAt > 0
+        && record.expiresAt - QDateTime::currentSecsSinceEpoch() >= minValidity) {
+        printToken(record, "database", json, exportVars);
+        return 0;
+    }
+
+    // 慢速路径：没有账户 ID 就无法向代理请求
+    if (!found && accountId == 0) {
+        err() << error << '\n';
+        return 1;
+    }
+    if (!found) {
+        record.accountId = accountId;
+    }
+
+    if (!parser.isSet(offlineOption)) {
+        // DBus 需要 QCoreApplication，只在慢速路径上创建
+        std::unique_ptr<QCoreApplication> app(new QCoreApplication(argc, argv));
+        QString brokerError;
+        QVariantMap token = serviceId.isEmpty()
+            ? BrokerClient::getTokenBlocking(record.accountId, &brokerError)
+            : BrokerClient::getServiceTokenBlocking(record.accountId, serviceId, &brokerError);
+        if (!token.isEmpty() && !token.value("access_token").toString().isEmpty()) {
+            record.accessToken = token.value("access_token").toString();
+            record.expiresAt = token.value("expires_at").toLongLong();
+            printToken(record, "broker", json, exportVars);
+            return 0;
+        }
+        err() << "令牌代理未返回令牌：" << brokerError << '\n';
+        if (!serviceId.isEmpty()) {
+            // 账户数据库中的令牌不是该服务的令牌
+            return 1;
+        }
+    }
+
+    // 过期时间未知的旧账户：代理不可用时仍输出已保存的令牌（与旧脚本行为一致）
+    if (found && !record.accessToken.isEmpty() && record.expiresAt == 0) {
+        err() << "警告：令牌过期时间未知，输出已保存的令牌" << '\n';
+        err().flush();
+        printToken(record, "database", json, exportVars);
+        return 0;
+    }
+
+    err() << (found ? QString("账户 %1 没有有效的访问令牌").arg(record.accountId) : error) << '\n';
+    return 1;
+}
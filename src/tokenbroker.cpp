@@ -0,0 +1,648 @@
+#include "tokenbroker.h"
+#include "accountwriter.h"
+#include "authproxy.h"
+#include "brokerclient.h"
+#include "flowjournal.h"
+#include "oauth2config.h"
+#include "providerregistry.h"
+#include "revocationoutbox.h"
+#include "roleindex.h"
+#include "tokenrefresher.h"
+#include "tokensnapshot.h"
+#include <QDateTime>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusMetaType>
+#include <QDBusReply>
+#include <QDebug>
+#include <unistd.h>
+#include <Accounts/Manager>
+
+TokenBroker::TokenBroker(QObject *parent)
+    : QObject(parent)
+    , m_registry(new ProviderRegistry(this))
+    , m_roleIndex(new RoleIndex(this))
+    , m_refresher(new TokenRefresher(m_registry, this))
+    , m_revocations(new RevocationOutbox(m_registry, this))
+    , m_journal(new FlowJournal("broker", this))
+    , m_manager(new Accounts::Manager)
+    , m_snapshot(new TokenSnapshotWriter)
+    , m_adaptor(nullptr)
+    , m_proxy(nullptr)
+{
+    qDBusRegisterMetaType<QList<quint32>>();
+
+    m_registry->scan();
+    m_roleIndex->setProviders(m_registry->providerIds());
+    // 首次扫描之后才跟随 provider 目录变化，避免启动时逐个 provider 重建账户索引
+    connect(m_registry, &ProviderRegistry::providerAdded, this, &TokenBroker::onProvidersChanged);
+    connect(m_registry, &ProviderRegistry::providerRemoved, this, &TokenBroker::onProvidersChanged);
+
+    m_refresher->setJournal(m_journal);
+    connect(m_refresher, &TokenRefresher::tokenRefreshed, this, &TokenBroker::onTokenRefreshed);
+    connect(m_refresher, &TokenRefresher::refreshFailed, this, &TokenBroker::onRefreshFailed);
+    connect(m_refresher, &TokenRefresher::scopedTokenRefreshed, this, &TokenBroker::onScopedTokenRefreshed);
+    connect(m_refresher, &TokenRefresher::scopedRefreshFailed, this, &TokenBroker::onScopedRefreshFailed);
+
+    connect(m_manager.get(), &Accounts::Manager::accountCreated, this, &TokenBroker::onAccountChanged);
+    connect(m_manager.get(), &Accounts::Manager::accountUpdated, this, &TokenBroker::onAccountChanged);
+    connect(m_manager.get(), &Accounts::Manager::accountRemoved, this, &TokenBroker::onAccountRemoved);
+
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &TokenBroker::onScheduleTimeout);
+
+    m_adaptor = new TokenBrokerAdaptor(this);
+
+    // 先补写上次中断的令牌轮换，账户索引和刷新计划随后基于最新的令牌建立
+    replayJournal();
+    scanAccounts();
+    // 上次退出时未吊销完的令牌
+    m_revocations->load();
+}
+
+TokenBroker::~TokenBroker() = default;
+
+bool TokenBroker::registerOnBus()
+{
+    QDBusConnection sessionBus = QDBusConnection::sessionBus();
+    if (!sessionBus.registerService(BrokerClient::ServiceName)) {
+        qWarning() << "TokenBroker: cannot register service" << BrokerClient::ServiceName
+                   << sessionBus.lastError().message();
+        return false;
+    }
+    if (!sessionBus.registerObject(BrokerClient::ObjectPath, this)) {
+        qWarning() << "TokenBroker: cannot register object" << BrokerClient::ObjectPath
+                   << sessionBus.lastError().message();
+        sessionBus.unregisterService(BrokerClient::ServiceName);
+        return false;
+    }
+    qDebug() << "TokenBroker: serving" << m_registry->providerIds().size() << "providers,"
+             << m_accountProviders.size() << "accounts," << m_schedule.size() << "scheduled refreshes";
+    return true;
+}
+
+bool TokenBroker::startAuthProxy(quint16 port)
+{
+    if (!m_proxy) {
+        m_proxy = new AuthProxy(this, this);
+    }
+    return m_proxy->start(port);
+}
+
+void TokenBroker::requestToken(quint32 accountId, bool forceRefresh, const TokenCallback &callback)
+{
+    ++m_tokenRequests;
+
+    if (!m_accountProviders.contains(accountId)) {
+        // 刚创建的账户可能还没收到 accountCreated
+        indexAccount(accountId);
+    }
+    QString providerId = m_accountProviders.value(accountId);
+    ProviderContext *provider = m_registry->provider(providerId);
+    if (!provider) {
+        callback(QVariantMap(), "账户不存在或不属于本插件管理的 provider");
+        return;
+    }
+
+    TokenCache::Entry entry;
+    if (!loadEntry(accountId, provider, &entry)) {
+        callback(QVariantMap(), "账户不存在");
+        return;
+    }
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    bool expiring = entry.expiresAt > 0 && now >= entry.expiresAt - qint64(RefreshMarginSecs) * 1000;
+    if (!forceRefresh && !expiring && !entry.accessToken.isEmpty()) {
+        ++m_cacheServed;
+        callback(tokenReply(accountId, providerId, entry.accessToken, entry.expiresAt), QString());
+        return;
+    }
+
+    // 先登记再刷新：刷新可能同步失败并立即回调
+    m_waiting[accountId].append(callback);
+    m_refresher->refresh(accountId, TokenRateLimiter::Interactive);
+}
+
+void TokenBroker::requestServiceToken(quint32 accountId, const QString &serviceId, const TokenCallback &callback)
+{
+    if (!m_accountProviders.contains(accountId)) {
+        indexAccount(accountId);
+    }
+    QString providerId = m_accountProviders.value(accountId);
+    ProviderContext *provider = m_registry->provider(providerId);
+    if (!provider) {
+        callback(QVariantMap(), "账户不存在或不属于本插件管理的 provider");
+        return;
+    }
+
+    OAuth2Config::SnapshotPtr config = provider->config()->snapshot();
+    const QStringList scopes = config->serviceScopes.value(serviceId);
+    if (scopes.isEmpty()) {
+        // 该服务没有单独的 scope，账户令牌即可满足
+        requestToken(accountId, false, callback);
+        return;
+    }
+
+    ++m_tokenRequests;
+    QString scopeKey = scopes.join(' ');
+    TokenCache::Entry entry;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (provider->tokenCache().lookupScoped(accountId, scopeKey, &entry)
+        && !(entry.expiresAt > 0 && now >= entry.expiresAt - qint64(RefreshMarginSecs) * 1000)) {
+        ++m_cacheServed;
+        QVariantMap token = tokenReply(accountId, providerId, entry.accessToken, entry.expiresAt);
+        token["scope"] = scopeKey;
+        callback(token, QString());
+        return;
+    }
+
+    // 同一 (账户, scope) 只发出一个请求，其余请求等待同一结果
+    QPair<quint32, QString> key = qMakePair(accountId, scopeKey);
+    bool pending = m_scopedWaiting.contains(key);
+    m_scopedWaiting[key].append(callback);
+    if (pending) {
+        return;
+    }
+
+    if (config->scopedTokenGrant == QLatin1String("token-exchange")) {
+        // 令牌交换以账户当前的访问令牌为凭据，必要时先刷新账户令牌
+        requestToken(accountId, false, [this, accountId, scopes, scopeKey](const QVariantMap &token, const QString &error) {
+            if (token.isEmpty()) {
+                onScopedRefreshFailed(accountId, scopeKey, error);
+                return;
+            }
+            m_refresher->refreshScoped(accountId, scopes, token.value("access_token").toString(),
+                                       TokenRateLimiter::Interactive);
+        });
+        return;
+    }
+
+    // 账户令牌先读入缓存：refresh_token 轮换后缓存随之更新，随后的 accountUpdated 不会被当作外部修改
+    if (!loadEntry(accountId, provider, &entry)) {
+        onScopedRefreshFailed(accountId, scopeKey, "账户不存在");
+        return;
+    }
+    m_refresher->refreshScoped(accountId, scopes, QString(), TokenRateLimiter::Interactive);
+}
+
+bool TokenBroker::hasRole(quint32 accountId, const QString &role)
+{
+    return m_roleIndex->hasRole(accountId, role);
+}
+
+QList<quint32> TokenBroker::accountsWithRole(const QString &role, const QString &providerId)
+{
+    return m_roleIndex->accountsWithRole(role, providerId);
+}
+
+QStringList TokenBroker::roles(quint32 accountId)
+{
+    return m_roleIndex->roles(accountId);
+}
+
+QStringList TokenBroker::providerIds() const
+{
+    return m_registry->providerIds();
+}
+
+quint32 TokenBroker::defaultAccount(const QString &providerId) const
+{
+    quint32 latest = 0;
+    for (auto it = m_accountProviders.constBegin(); it != m_accountProviders.constEnd(); ++it) {
+        if (it.key() > latest && it.value() == providerId && m_enabledAccounts.contains(it.key())) {
+            latest = it.key();
+        }
+    }
+    return latest;
+}
+
+bool TokenBroker::queueRevocation(const QString &providerId, const QString &accessToken, const QString &refreshToken)
+{
+    // 先吊销 refresh_token：多数服务器会同时吊销由它签发的访问令牌
+    bool queued = m_revocations->enqueue(providerId, refreshToken, "refresh_token");
+    queued = m_revocations->enqueue(providerId, accessToken, "access_token") && queued;
+    return queued;
+}
+
+int TokenBroker::openTokenSnapshot() const
+{
+    return m_snapshot->openReadOnly();
+}
+
+QVariantMap TokenBroker::statistics() const
+{
+    QVariantMap providers;
+    const QList<ProviderContext *> contexts = m_registry->providers();
+    for (ProviderContext *provider : contexts) {
+        providers.insert(provider->providerId(), provider->statistics());
+    }
+
+    QVariantMap stats;
+    stats["providers"] = providers;
+    stats["accounts"] = m_accountProviders.size();
+    stats["scheduledRefreshes"] = m_schedule.size();
+    stats["nextRefreshAt"] = m_schedule.isEmpty() ? qint64(0) : m_schedule.firstKey() / 1000;
+    stats["retryingAccounts"] = m_retryDelaySecs.size();
+    stats["waitingRequests"] = m_waiting.size() + m_scopedWaiting.size();
+    stats["tokenRequests"] = m_tokenRequests;
+    stats["cacheServed"] = m_cacheServed;
+    stats["backgroundRefreshes"] = m_scheduledRefreshes;
+    stats["refresher"] = m_refresher->statistics();
+    stats["roleIndex"] = m_roleIndex->statistics();
+    stats["snapshot"] = m_snapshot->statistics();
+    stats["revocation"] = m_revocations->statistics();
+    stats["journal"] = m_journal->statistics();
+    if (m_proxy) {
+        stats["proxy"] = m_proxy->statistics();
+    }
+    return stats;
+}
+
+void TokenBroker::onAccountChanged(Accounts::AccountId id)
+{
+    indexAccount(id);
+    emit m_adaptor->accountUpdated(id);
+}
+
+void TokenBroker::onAccountRemoved(Accounts::AccountId id)
+{
+    // 账户也可能在系统设置中直接删除，不经过插件。删除通知到达时账户设置已不可读，
+    // 缓存中保存着 indexAccount 读入的最后一次令牌，由这里提交吊销（与插件提交的同一令牌只排队一次）
+    ProviderContext *provider = m_registry->provider(m_accountProviders.value(id));
+    TokenCache::Entry entry;
+    if (provider && provider->tokenCache().lookup(id, &entry)) {
+        queueRevocation(provider->providerId(), entry.accessToken, entry.refreshToken);
+    }
+    forgetAccount(id);
+    emit m_adaptor->accountRemoved(id);
+}
+
+void TokenBroker::onScheduleTimeout()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    while (!m_schedule.isEmpty() && m_schedule.firstKey() <= now) {
+        quint32 accountId = m_schedule.first();
+        m_schedule.erase(m_schedule.begin());
+        m_dueAt.remove(accountId);
+
+        ++m_scheduledRefreshes;
+        m_refresher->refresh(accountId, TokenRateLimiter::Background);
+    }
+    armTimer();
+}
+
+void TokenBroker::onTokenRefreshed(quint32 accountId, const QString &accessToken, qint64 expiresAt)
+{
+    m_retryDelaySecs.remove(accountId);
+    if (expiresAt > 0) {
+        scheduleAt(accountId, expiresAt - qint64(RefreshMarginSecs) * 1000);
+    } else {
+        unschedule(accountId);
+    }
+    publishToken(accountId, accessToken, expiresAt / 1000);
+
+    QString providerId = m_accountProviders.value(accountId);
+    const QList<TokenCallback> callbacks = m_waiting.take(accountId);
+    for (const TokenCallback &callback : callbacks) {
+        callback(tokenReply(accountId, providerId, accessToken, expiresAt), QString());
+    }
+
+    emit m_adaptor->tokenRefreshed(accountId, expiresAt / 1000);
+}
+
+void TokenBroker::onRefreshFailed(quint32 accountId, const QString &error)
+{
+    const QList<TokenCallback> callbacks = m_waiting.take(accountId);
+    for (const TokenCallback &callback : callbacks) {
+        callback(QVariantMap(), error);
+    }
+    emit m_adaptor->tokenRefreshFailed(accountId, error);
+
+    // 仍可刷新的账户按指数退避重试
+    if (!m_accountProviders.contains(accountId)) {
+        return;
+    }
+    std::unique_ptr<Accounts::Account> account(m_manager->account(accountId));
+    if (!account || account->value("refresh_token").toString().isEmpty()) {
+        return;
+    }
+    int delay = m_retryDelaySecs.value(accountId, 0);
+    delay = delay > 0 ? qMin(delay * 2, int(MaxRetryDelaySecs)) : int(RetryDelaySecs);
+    m_retryDelaySecs.insert(accountId, delay);
+    scheduleAt(accountId, QDateTime::currentMSecsSinceEpoch() + qint64(delay) * 1000);
+    qDebug() << "TokenBroker: retrying account" << accountId << "in" << delay << "s";
+}
+
+void TokenBroker::onScopedTokenRefreshed(quint32 accountId, const QString &scopeKey,
+                                         const QString &accessToken, qint64 expiresAt)
+{
+    QString providerId = m_accountProviders.value(accountId);
+    QVariantMap token = tokenReply(accountId, providerId, accessToken, expiresAt);
+    token["scope"] = scopeKey;
+    const QList<TokenCallback> callbacks = m_scopedWaiting.take(qMakePair(accountId, scopeKey));
+    for (const TokenCallback &callback : callbacks) {
+        callback(token, QString());
+    }
+}
+
+void TokenBroker::onScopedRefreshFailed(quint32 accountId, const QString &scopeKey, const QString &error)
+{
+    // 服务令牌按需获取，失败后不安排重试
+    const QList<TokenCallback> callbacks = m_scopedWaiting.take(qMakePair(accountId, scopeKey));
+    for (const TokenCallback &callback : callbacks) {
+        callback(QVariantMap(), error);
+    }
+}
+
+void TokenBroker::onProvidersChanged()
+{
+    m_roleIndex->setProviders(m_registry->providerIds());
+    scanAccounts();
+}
+
+void TokenBroker::scanAccounts()
+{
+    // 退避中的账户由 indexAccount 跳过，清空计划前记下它们的重试时间，扫描后重新安排
+    QHash<quint32, qint64> retries;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (auto it = m_retryDelaySecs.constBegin(); it != m_retryDelaySecs.constEnd(); ++it) {
+        retries.insert(it.key(), m_dueAt.value(it.key(), now));
+    }
+
+    m_accountProviders.clear();
+    m_enabledAccounts.clear();
+    m_schedule.clear();
+    m_dueAt.clear();
+    m_snapshot->clear();
+
+    const Accounts::AccountIdList ids = m_manager->accountList();
+    for (Accounts::AccountId id : ids) {
+        indexAccount(id);
+    }
+
+    for (auto it = retries.constBegin(); it != retries.constEnd(); ++it) {
+        if (!m_enabledAccounts.contains(it.key())) {
+            // 账户已删除、停用或所属 provider 已移除
+            m_retryDelaySecs.remove(it.key());
+        } else if (!m_refresher->isRefreshing(it.key())) {
+            // 刷新进行中时由刷新结果重新安排
+            scheduleAt(it.key(), it.value());
+        }
+    }
+    armTimer();
+}
+
+bool TokenBroker::loadEntry(quint32 accountId, ProviderContext *provider, TokenCache::Entry *entry)
+{
+    if (provider->tokenCache().lookup(accountId, entry)) {
+        return true;
+    }
+    std::unique_ptr<Accounts::Account> account(m_manager->account(accountId));
+    if (!account) {
+        return false;
+    }
+    entry->accessToken = account->value("access_token").toString();
+    entry->refreshToken = account->value("refresh_token").toString();
+    entry->expiresAt = account->value("expires_at").toLongLong() * 1000;
+    provider->tokenCache().insert(accountId, *entry);
+    return true;
+}
+
+void TokenBroker::replayJournal()
+{
+    const QList<FlowJournal::Record> records = m_journal->pending();
+    for (const FlowJournal::Record &record : records) {
+        if (record.type != QLatin1String("rotation")) {
+            continue;
+        }
+        quint32 accountId = record.data.value("account_id").toUInt();
+        std::unique_ptr<Accounts::Account> account(m_manager->account(accountId));
+        if (account && FlowJournal::tokenDigest(account->value("refresh_token").toString())
+                           == record.data.value("replaces").toString()) {
+            qDebug() << "TokenBroker: restoring rotated tokens of account" << accountId << "from journal";
+            QVariantMap values;
+            const char *keys[] = { "access_token", "refresh_token", "expires_in", "expires_at" };
+            for (const char *key : keys) {
+                if (record.data.contains(key)) {
+                    values[key] = record.data.value(key);
+                }
+            }
+            AccountWriter::write(account.get(), values);
+        }
+        m_journal->commit(record.flowId);
+    }
+    m_journal->compact();
+}
+
+void TokenBroker::indexAccount(quint32 accountId)
+{
+    std::unique_ptr<Accounts::Account> account(m_manager->account(accountId));
+    if (!account || !m_registry->provider(account->providerName())) {
+        forgetAccount(accountId);
+        return;
+    }
+
+    QString providerId = account->providerName();
+    m_accountProviders.insert(accountId, providerId);
+    // 账户令牌可能被其他进程修改（例如重新认证），丢弃缓存的令牌和服务令牌，改为账户中的令牌；
+    // 令牌与缓存一致说明是本进程自己写入的（刷新结果），保留缓存。
+    // 每个账户的缓存都保存着已保存的令牌，账户被删除后仍能吊销（见 onAccountRemoved）
+    TokenCache &cache = m_registry->provider(providerId)->tokenCache();
+    TokenCache::Entry cached;
+    TokenCache::Entry stored;
+    stored.accessToken = account->value("access_token").toString();
+    stored.refreshToken = account->value("refresh_token").toString();
+    stored.expiresAt = account->value("expires_at").toLongLong() * 1000;
+    if (!cache.lookup(accountId, &cached)
+        || cached.accessToken != stored.accessToken
+        || cached.refreshToken != stored.refreshToken) {
+        cache.remove(accountId);
+        cache.insert(accountId, stored);
+    }
+    if (account->enabled()) {
+        m_enabledAccounts.insert(accountId);
+        publishToken(accountId, account->value("access_token").toString(), account->value("expires_at").toLongLong());
+    } else {
+        m_enabledAccounts.remove(accountId);
+        m_snapshot->remove(accountId);
+    }
+
+    if (m_refresher->isRefreshing(accountId) || m_retryDelaySecs.contains(accountId)) {
+        // 刷新结果或重试计划会重新安排
+        return;
+    }
+    qint64 expiresAt = account->value("expires_at").toLongLong() * 1000;
+    bool canRefresh = !account->value("refresh_token").toString().isEmpty();
+    if (expiresAt > 0 && canRefresh && account->enabled()) {
+        scheduleAt(accountId, expiresAt - qint64(RefreshMarginSecs) * 1000);
+    } else {
+        unschedule(accountId);
+    }
+}
+
+void TokenBroker::forgetAccount(quint32 accountId)
+{
+    QString providerId = m_accountProviders.take(accountId);
+    m_enabledAccounts.remove(accountId);
+    if (ProviderContext *provider = m_registry->provider(providerId)) {
+        provider->tokenCache().remove(accountId);
+    }
+    unschedule(accountId);
+    m_retryDelaySecs.remove(accountId);
+    m_snapshot->remove(accountId);
+}
+
+void TokenBroker::publishToken(quint32 accountId, const QString &accessToken, qint64 expiresAtSecs)
+{
+    // 空令牌或超长令牌会从快照中移除，客户端回退到 getToken
+    m_snapshot->publish(accountId, accessToken.toUtf8(), expiresAtSecs);
+}
+
+void TokenBroker::scheduleAt(quint32 accountId, qint64 dueMs)
+{
+    unschedule(accountId);
+    m_dueAt.insert(accountId, dueMs);
+    m_schedule.insert(dueMs, accountId);
+    armTimer();
+}
+
+void TokenBroker::unschedule(quint32 accountId)
+{
+    auto it = m_dueAt.find(accountId);
+    if (it == m_dueAt.end()) {
+        return;
+    }
+    m_schedule.remove(it.value(), accountId);
+    m_dueAt.erase(it);
+    armTimer();
+}
+
+void TokenBroker::armTimer()
+{
+    if (m_schedule.isEmpty()) {
+        m_timer.stop();
+        return;
+    }
+    qint64 wait = m_schedule.firstKey() - QDateTime::currentMSecsSinceEpoch();
+    m_timer.start(int(qBound<qint64>(0, wait, MaxTimerIntervalMs)));
+}
+
+QVariantMap TokenBroker::tokenReply(quint32 accountId, const QString &providerId,
+                                    const QString &accessToken, qint64 expiresAt)
+{
+    QVariantMap token;
+    token["account_id"] = accountId;
+    token["provider"] = providerId;
+    token["access_token"] = accessToken;
+    token["expires_at"] = expiresAt / 1000;   // 秒，0 表示未知
+    return token;
+}
+
+// TokenBrokerAdaptor 实现
+TokenBrokerAdaptor::TokenBrokerAdaptor(TokenBroker *parent)
+    : QDBusAbstractAdaptor(parent)
+    , m_broker(parent)
+{
+}
+
+void TokenBrokerAdaptor::replyError(const QDBusMessage &message, QDBusError::ErrorType type, const QString &text)
+{
+    message.setDelayedReply(true);
+    QDBusConnection::sessionBus().send(message.createErrorReply(type, text));
+}
+
+QDBusUnixFileDescriptor TokenBrokerAdaptor::tokenSnapshot(const QDBusMessage &message)
+{
+    // 会话总线按用户隔离，这里再确认一次调用方与代理是同一用户
+    QDBusReply<uint> uid = QDBusConnection::sessionBus().interface()->serviceUid(message.service());
+    if (!uid.isValid() || uid.value() != getuid()) {
+        replyError(message, QDBusError::AccessDenied, "令牌快照只提供给同一用户的进程");
+        return QDBusUnixFileDescriptor();
+    }
+    if (!QDBusUnixFileDescriptor::isSupported()) {
+        replyError(message, QDBusError::NotSupported, "当前 DBus 连接不支持传递文件描述符");
+        return QDBusUnixFileDescriptor();
+    }
+    int fd = m_broker->openTokenSnapshot();
+    if (fd < 0) {
+        replyError(message, QDBusError::Failed, "令牌快照不可用");
+        return QDBusUnixFileDescriptor();
+    }
+    // QDBusUnixFileDescriptor 复制描述符，本地副本随即关闭
+    QDBusUnixFileDescriptor descriptor(fd);
+    close(fd);
+    return descriptor;
+}
+
+QVariantMap TokenBrokerAdaptor::getToken(quint32 accountId, const QDBusMessage &message)
+{
+    // 令牌可能需要先刷新，结果到达后再回复
+    message.setDelayedReply(true);
+    QDBusMessage request = message;
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    m_broker->requestToken(accountId, false, [request, bus](const QVariantMap &token, const QString &error) {
+        if (token.isEmpty()) {
+            bus.send(request.createErrorReply("org.kde.kaccounts.OAuth2Broker.Error.TokenUnavailable", error));
+        } else {
+            bus.send(request.createReply(QVariant(token)));
+        }
+    });
+    return QVariantMap();
+}
+
+QVariantMap TokenBrokerAdaptor::getServiceToken(quint32 accountId, const QString &serviceId, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QDBusMessage request = message;
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    m_broker->requestServiceToken(accountId, serviceId, [request, bus](const QVariantMap &token, const QString &error) {
+        if (token.isEmpty()) {
+            bus.send(request.createErrorReply("org.kde.kaccounts.OAuth2Broker.Error.TokenUnavailable", error));
+        } else {
+            bus.send(request.createReply(QVariant(token)));
+        }
+    });
+    return QVariantMap();
+}
+
+bool TokenBrokerAdaptor::refreshToken(quint32 accountId, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QDBusMessage request = message;
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    m_broker->requestToken(accountId, true, [request, bus](const QVariantMap &token, const QString &) {
+        bus.send(request.createReply(QVariant(!token.isEmpty())));
+    });
+    return false;
+}
+
+bool TokenBrokerAdaptor::queueRevocation(const QString &providerId, const QString &accessToken,
+                                         const QString &refreshToken)
+{
+    return m_broker->queueRevocation(providerId, accessToken, refreshToken);
+}
+
+bool TokenBrokerAdaptor::hasRole(quint32 accountId, const QString &role)
+{
+    return m_broker->hasRole(accountId, role);
+}
+
+QList<quint32> TokenBrokerAdaptor::accountsWithRole(const QString &role, const QString &providerId)
+{
+    return m_broker->accountsWithRole(role, providerId);
+}
+
+QStringList TokenBrokerAdaptor::roles(quint32 accountId)
+{
+    return m_broker->roles(accountId);
+}
+
+QStringList TokenBrokerAdaptor::providers()
+{
+    return m_broker->providerIds();
+}
+
+QVariantMap TokenBrokerAdaptor::statistics()
+{
+    return m_broker->statistics();
+}
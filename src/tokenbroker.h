@@ -0,0 +1,166 @@
+#pragma once
+#include <QObject>
+#include <QDBusAbstractAdaptor>
+#include <QDBusError>
+#include <QDBusMessage>
+#include <QDBusUnixFileDescriptor>
+#include <QHash>
+#include <QList>
+#include <QMultiMap>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+#include <QVariantMap>
+#include <functional>
+#include <memory>
+#include <Accounts/Account>
+#include "tokencache.h"
+
+namespace Accounts {
+class Manager;
+}
+
+class AuthProxy;
+class FlowJournal;
+class ProviderContext;
+class ProviderRegistry;
+class RevocationOutbox;
+class RoleIndex;
+class TokenRefresher;
+class TokenSnapshotWriter;
+class TokenBrokerAdaptor;
+
+// 常驻的令牌代理（kde-oauth2-broker）
+// 不依赖 System Settings 进程：持有所有 provider 的令牌缓存、刷新调度和账户索引，
+// 在令牌过期前通过后台队列刷新，并在 DBus 上向应用提供令牌和角色查询。
+// UI 插件只负责交互式认证，令牌相关的请求都转发到这里。
+class TokenBroker : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int RefreshMarginSecs = 120;      // 在过期前多久刷新
+    static constexpr int RetryDelaySecs = 60;          // 后台刷新失败后的首次重试间隔（之后逐次加倍）
+    static constexpr int MaxRetryDelaySecs = 3600;
+    static constexpr int MaxTimerIntervalMs = 3600 * 1000;   // 休眠唤醒后按墙钟时间重新计算
+
+    // token 为空表示失败，error 为原因
+    using TokenCallback = std::function<void(const QVariantMap &token, const QString &error)>;
+
+    explicit TokenBroker(QObject *parent = nullptr);
+    ~TokenBroker() override;
+
+    // 注册 DBus 服务和 /Broker 对象；服务名已被占用时返回 false
+    bool registerOnBus();
+    // 在回环端口上启动认证反向代理（见 AuthProxy），0 表示由系统分配端口
+    bool startAuthProxy(quint16 port);
+
+    // 返回账户的有效访问令牌（access_token、expires_at、account_id、provider）；
+    // 令牌即将过期或 forceRefresh 时先刷新
+    void requestToken(quint32 accountId, bool forceRefresh, const TokenCallback &callback);
+    // 返回只含服务 scope 的访问令牌（另含 scope）；provider 文件未给该服务定义 scope 时返回账户令牌
+    void requestServiceToken(quint32 accountId, const QString &serviceId, const TokenCallback &callback);
+
+    bool hasRole(quint32 accountId, const QString &role);
+    QList<quint32> accountsWithRole(const QString &role, const QString &providerId);
+    QStringList roles(quint32 accountId);
+    QStringList providerIds() const;
+    ProviderRegistry *registry() const { return m_registry; }
+    // provider 中最近添加的已启用账户，没有时返回 0
+    quint32 defaultAccount(const QString &providerId) const;
+
+    // 把账户令牌放入吊销发件箱（RFC 7009），写入磁盘后返回，吊销在后台完成
+    bool queueRevocation(const QString &providerId, const QString &accessToken, const QString &refreshToken);
+
+    // 共享内存令牌快照的只读描述符（调用方负责关闭），快照不可用时返回 -1
+    int openTokenSnapshot() const;
+
+    QVariantMap statistics() const;
+
+private slots:
+    void onAccountChanged(Accounts::AccountId id);
+    void onAccountRemoved(Accounts::AccountId id);
+    void onScheduleTimeout();
+    void onTokenRefreshed(quint32 accountId, const QString &accessToken, qint64 expiresAt);
+    void onRefreshFailed(quint32 accountId, const QString &error);
+    void onScopedTokenRefreshed(quint32 accountId, const QString &scopeKey, const QString &accessToken, qint64 expiresAt);
+    void onScopedRefreshFailed(quint32 accountId, const QString &scopeKey, const QString &error);
+    void onProvidersChanged();
+
+private:
+    void scanAccounts();
+    // 写回账户之前中断的 refresh_token 轮换
+    void replayJournal();
+    // 读取账户令牌，缓存未命中时从账户数据库读入缓存
+    bool loadEntry(quint32 accountId, ProviderContext *provider, TokenCache::Entry *entry);
+    void indexAccount(quint32 accountId);
+    void forgetAccount(quint32 accountId);
+    void scheduleAt(quint32 accountId, qint64 dueMs);
+    void unschedule(quint32 accountId);
+    void armTimer();
+    void publishToken(quint32 accountId, const QString &accessToken, qint64 expiresAtSecs);
+    static QVariantMap tokenReply(quint32 accountId, const QString &providerId,
+                                  const QString &accessToken, qint64 expiresAt);
+
+    ProviderRegistry *m_registry;
+    RoleIndex *m_roleIndex;
+    TokenRefresher *m_refresher;
+    RevocationOutbox *m_revocations;
+    FlowJournal *m_journal;
+    std::unique_ptr<Accounts::Manager> m_manager;
+    std::unique_ptr<TokenSnapshotWriter> m_snapshot;   // 每次刷新后更新的共享内存快照
+    TokenBrokerAdaptor *m_adaptor;
+    AuthProxy *m_proxy;
+
+    QHash<quint32, QString> m_accountProviders;      // 账户索引：账户ID -> provider
+    QSet<quint32> m_enabledAccounts;
+    QMultiMap<qint64, quint32> m_schedule;           // 刷新时间（毫秒）-> 账户ID
+    QHash<quint32, qint64> m_dueAt;                  // 账户ID -> 刷新时间
+    QHash<quint32, int> m_retryDelaySecs;            // 连续失败的账户当前的重试间隔
+    QHash<quint32, QList<TokenCallback>> m_waiting;  // 等待刷新结果的请求
+    QHash<QPair<quint32, QString>, QList<TokenCallback>> m_scopedWaiting;   // (账户ID, scope) -> 等待服务令牌的请求
+    QTimer m_timer;
+
+    quint64 m_tokenRequests = 0;
+    quint64 m_cacheServed = 0;
+    quint64 m_scheduledRefreshes = 0;
+};
+
+// 需要延迟回复或检查调用方的方法带有末尾的 QDBusMessage 参数（不属于 DBus 签名）：
+// QtDBus 只为注册的对象（TokenBroker）设置 QDBusContext，适配器自己没有调用上下文
+class TokenBrokerAdaptor : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.kaccounts.OAuth2Broker")
+
+public:
+    explicit TokenBrokerAdaptor(TokenBroker *parent);
+
+signals:
+    void tokenRefreshed(quint32 accountId, qlonglong expiresAt);
+    void tokenRefreshFailed(quint32 accountId, const QString &error);
+    // 账户在账户数据库中被修改（例如重新认证、停用）或删除，客户端据此丢弃缓存的令牌
+    void accountUpdated(quint32 accountId);
+    void accountRemoved(quint32 accountId);
+
+public slots:
+    QVariantMap getToken(quint32 accountId, const QDBusMessage &message);
+    QVariantMap getServiceToken(quint32 accountId, const QString &serviceId, const QDBusMessage &message);
+    bool refreshToken(quint32 accountId, const QDBusMessage &message);
+    // 插件删除或停用账户前提交令牌，调用立即返回
+    bool queueRevocation(const QString &providerId, const QString &accessToken, const QString &refreshToken);
+    bool hasRole(quint32 accountId, const QString &role);
+    QList<quint32> accountsWithRole(const QString &role, const QString &providerId);
+    QStringList roles(quint32 accountId);
+    QStringList providers();
+    QVariantMap statistics();
+    // 只交给与代理同一用户的调用方；客户端 mmap 后无需 DBus 即可查询令牌
+    QDBusUnixFileDescriptor tokenSnapshot(const QDBusMessage &message);
+
+private:
+    // 以错误回复调用（返回值随后被 QtDBus 忽略）
+    static void replyError(const QDBusMessage &message, QDBusError::ErrorType type, const QString &text);
+
+    TokenBroker *m_broker;
+};
@@ -0,0 +1,66 @@
+#include "tokencache.h"
+
+bool TokenCache::lookup(quint32 accountId, Entry *entry) const
+{
+    auto it = m_entries.constFind(accountId);
+    if (it == m_entries.constEnd()) {
+        ++m_misses;
+        return false;
+    }
+    ++m_hits;
+    *entry = it.value();
+    return true;
+}
+
+void TokenCache::insert(quint32 accountId, const Entry &entry)
+{
+    m_entries.insert(accountId, entry);
+}
+
+bool TokenCache::lookupScoped(quint32 accountId, const QString &scopeKey, Entry *entry) const
+{
+    auto account = m_scopedEntries.constFind(accountId);
+    if (account == m_scopedEntries.constEnd()) {
+        ++m_misses;
+        return false;
+    }
+    auto it = account->constFind(scopeKey);
+    if (it == account->constEnd()) {
+        ++m_misses;
+        return false;
+    }
+    ++m_hits;
+    *entry = it.value();
+    return true;
+}
+
+void TokenCache::insertScoped(quint32 accountId, const QString &scopeKey, const Entry &entry)
+{
+    m_scopedEntries[accountId].insert(scopeKey, entry);
+}
+
+void TokenCache::remove(quint32 accountId)
+{
+    m_entries.remove(accountId);
+    m_scopedEntries.remove(accountId);
+}
+
+void TokenCache::clear()
+{
+    m_entries.clear();
+    m_scopedEntries.clear();
+}
+
+QVariantMap TokenCache::statistics() const
+{
+    QVariantMap stats;
+    stats["entries"] = m_entries.size();
+    int scoped = 0;
+    for (const QHash<QString, Entry> &entries : m_scopedEntries) {
+        scoped += entries.size();
+    }
+    stats["scopedEntries"] = scoped;
+    stats["hits"] = m_hits;
+    stats["misses"] = m_misses;
+    return stats;
+}
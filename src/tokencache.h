@@ -0,0 +1,38 @@
+#pragma once
+#include <QHash>
+#include <QString>
+#include <QVariantMap>
+
+// 按账户缓存令牌（每个 provider 一个实例）
+// 读穿式缓存：首次从账户数据库读取后保存在内存中，避免重复访问账户数据库。
+// 服务令牌（只含部分 scope）按 (账户, scope 集合) 缓存，只保存在内存中，随账户令牌一起失效。
+class TokenCache
+{
+public:
+    struct Entry {
+        QString accessToken;
+        QString refreshToken;
+        qint64 expiresAt = 0;   // 过期时间（毫秒时间戳），0 表示未知
+
+        bool isExpired(qint64 nowMs) const { return expiresAt > 0 && nowMs >= expiresAt; }
+    };
+
+    // 查找账户的缓存令牌，未命中时返回 false
+    bool lookup(quint32 accountId, Entry *entry) const;
+    void insert(quint32 accountId, const Entry &entry);
+    // scopeKey 为排序后以空格连接的 scope 列表
+    bool lookupScoped(quint32 accountId, const QString &scopeKey, Entry *entry) const;
+    void insertScoped(quint32 accountId, const QString &scopeKey, const Entry &entry);
+    // 同时移除该账户的服务令牌
+    void remove(quint32 accountId);
+    void clear();
+    int size() const { return m_entries.size(); }
+
+    QVariantMap statistics() const;
+
+private:
+    QHash<quint32, Entry> m_entries;
+    QHash<quint32, QHash<QString, Entry>> m_scopedEntries;
+    mutable quint64 m_hits = 0;
+    mutable quint64 m_misses = 0;
+};
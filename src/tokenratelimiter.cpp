@@ -0,0 +1,130 @@
+#include "tokenratelimiter.h"
+#include <QDebug>
+#include <QtMath>
+
+TokenRateLimiter::TokenRateLimiter(QObject *parent)
+    : QObject(parent)
+{
+    m_clock.start();
+    m_lastRefillMs = m_clock.elapsed();
+
+    m_drainTimer.setSingleShot(true);
+    connect(&m_drainTimer, &QTimer::timeout, this, &TokenRateLimiter::drain);
+}
+
+void TokenRateLimiter::setRate(double requestsPerSecond, int burst)
+{
+    refill();
+
+    m_rate = requestsPerSecond > 0 ? requestsPerSecond : 2.0;
+    m_burst = burst > 0 ? burst : 1;
+    m_tokens = qMin(m_tokens, double(m_burst));
+
+    qDebug() << "TokenRateLimiter: rate set to" << m_rate << "req/s, burst" << m_burst;
+    scheduleDrain();
+}
+
+void TokenRateLimiter::enqueue(Priority priority, std::function<void()> request)
+{
+    refill();
+
+    // 令牌不足或前面已有排队请求时，该请求需要等待
+    if (m_tokens < 1.0 || !m_queues[Interactive].empty() || !m_queues[Background].empty()) {
+        ++m_delayed[priority];
+    }
+
+    auto &queue = m_queues[priority];
+    queue.push_back(std::move(request));
+
+    if (int(queue.size()) > m_maxDepth[priority]) {
+        m_maxDepth[priority] = int(queue.size());
+    }
+
+    emit queueDepthChanged(int(m_queues[Interactive].size()), int(m_queues[Background].size()));
+
+    // 在下一个事件循环中执行，避免在调用者栈中直接发起请求
+    if (!m_drainTimer.isActive()) {
+        m_drainTimer.start(0);
+    }
+}
+
+int TokenRateLimiter::queueDepth(Priority priority) const
+{
+    return int(m_queues[priority].size());
+}
+
+QVariantMap TokenRateLimiter::statistics() const
+{
+    QVariantMap stats;
+    stats["rate"] = m_rate;
+    stats["burst"] = m_burst;
+    stats["availableTokens"] = m_tokens;
+    stats["interactiveQueueDepth"] = int(m_queues[Interactive].size());
+    stats["backgroundQueueDepth"] = int(m_queues[Background].size());
+    stats["interactiveMaxQueueDepth"] = m_maxDepth[Interactive];
+    stats["backgroundMaxQueueDepth"] = m_maxDepth[Background];
+    stats["interactiveGranted"] = m_granted[Interactive];
+    stats["backgroundGranted"] = m_granted[Background];
+    stats["interactiveDelayed"] = m_delayed[Interactive];
+    stats["backgroundDelayed"] = m_delayed[Background];
+    return stats;
+}
+
+void TokenRateLimiter::refill()
+{
+    qint64 now = m_clock.elapsed();
+    qint64 elapsed = now - m_lastRefillMs;
+    m_lastRefillMs = now;
+
+    if (elapsed > 0) {
+        m_tokens = qMin(double(m_burst), m_tokens + elapsed * m_rate / 1000.0);
+    }
+}
+
+void TokenRateLimiter::drain()
+{
+    refill();
+
+    bool dispatched = false;
+    while (m_tokens >= 1.0) {
+        // 交互式队列优先
+        Priority lane;
+        if (!m_queues[Interactive].empty()) {
+            lane = Interactive;
+        } else if (!m_queues[Background].empty()) {
+            lane = Background;
+        } else {
+            break;
+        }
+
+        std::function<void()> request = std::move(m_queues[lane].front());
+        m_queues[lane].pop_front();
+        m_tokens -= 1.0;
+        ++m_granted[lane];
+        dispatched = true;
+
+        request();
+    }
+
+    if (dispatched) {
+        emit queueDepthChanged(int(m_queues[Interactive].size()), int(m_queues[Background].size()));
+    }
+
+    // 仍有排队请求时，在下一个令牌可用时再次调度
+    scheduleDrain();
+}
+
+void TokenRateLimiter::scheduleDrain()
+{
+    if (m_queues[Interactive].empty() && m_queues[Background].empty()) {
+        return;
+    }
+
+    int waitMs = 0;
+    if (m_tokens < 1.0) {
+        waitMs = qCeil((1.0 - m_tokens) * 1000.0 / m_rate);
+    }
+
+    qDebug() << "TokenRateLimiter: queue not empty, next drain in" << waitMs << "ms";
+    m_drainTimer.start(waitMs);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVariantMap>
+#include <deque>
+#include <functional>
+
+// 令牌端点限流器（令牌桶算法）
+// 所有访问 /connect/token 的请求（授权码交换、刷新、设备码轮询）都应通过此限流器排队，
+// 交互式登录优先于后台刷新。
+class TokenRateLimiter : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority {
+        Interactive = 0,   // 用户正在等待的请求（例如授权码交换）
+        Background = 1     // 后台请求（例如令牌刷新）
+    };
+    Q_ENUM(Priority)
+
+    explicit TokenRateLimiter(QObject *parent = nullptr);
+
+    // 设置速率（每秒请求数）和突发容量
+    void setRate(double requestsPerSecond, int burst);
+    double rate() const { return m_rate; }
+    int burst() const { return m_burst; }
+
+    // 将请求加入队列，获得令牌后在事件循环中执行
+    void enqueue(Priority priority, std::function<void()> request);
+
+    int queueDepth(Priority priority) const;
+    QVariantMap statistics() const;
+
+signals:
+    void queueDepthChanged(int interactiveDepth, int backgroundDepth);
+
+private slots:
+    void drain();
+
+private:
+    void refill();
+    void scheduleDrain();
+
+    double m_rate = 2.0;
+    int m_burst = 5;
+    double m_tokens = 5.0;
+    QElapsedTimer m_clock;
+    qint64 m_lastRefillMs = 0;
+    QTimer m_drainTimer;
+
+    std::deque<std::function<void()>> m_queues[2];
+
+    // 统计信息
+    quint64 m_granted[2] = {0, 0};
+    quint64 m_delayed[2] = {0, 0};
+    int m_maxDepth[2] = {0, 0};
+};
@@ -0,0 +1,299 @@
+#include "tokenrefresher.h"
+#include "accountwriter.h"
+#include "flowjournal.h"
+#include "oauth2config.h"
+#include "oauth2flow.h"
+#include "providerregistry.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QJsonObject>
+#include <Accounts/Account>
+#include <Accounts/Manager>
+
+TokenRefresher::TokenRefresher(ProviderRegistry *registry, QObject *parent)
+    : QObject(parent)
+    , m_registry(registry)
+{
+}
+
+TokenRefresher::~TokenRefresher() = default;
+
+Accounts::Manager *TokenRefresher::manager()
+{
+    if (!m_manager) {
+        m_manager.reset(new Accounts::Manager);
+    }
+    return m_manager.get();
+}
+
+void TokenRefresher::refresh(quint32 accountId, TokenRateLimiter::Priority priority)
+{
+    if (m_inFlight.contains(accountId)) {
+        ++m_coalesced;
+        return;
+    }
+    m_inFlight.insert(accountId);
+    if (m_grantBusy.contains(accountId)) {
+        m_queuedRefresh.insert(accountId, priority);
+        ++m_queued;
+        return;
+    }
+    startRefresh(accountId, priority);
+}
+
+void TokenRefresher::startRefresh(quint32 accountId, TokenRateLimiter::Priority priority)
+{
+    std::unique_ptr<Accounts::Account> account(manager()->account(accountId));
+    if (!account) {
+        fail(accountId, "账户不存在");
+        return;
+    }
+    ProviderContext *provider = m_registry->provider(account->providerName());
+    if (!provider) {
+        fail(accountId, QString("账户所属 provider 不由本插件管理：%1").arg(account->providerName()));
+        return;
+    }
+    QString refreshToken = account->value("refresh_token").toString();
+    if (refreshToken.isEmpty()) {
+        fail(accountId, "账户没有 refresh_token");
+        return;
+    }
+
+    OAuth2Config::SnapshotPtr config = provider->config()->snapshot();
+
+    qDebug() << "TokenRefresher: refreshing account" << accountId << "provider" << provider->providerId()
+             << (priority == TokenRateLimiter::Interactive ? "(interactive)" : "(background)");
+
+    m_grantBusy.insert(accountId);
+    OAuth2Flow::refreshToken(provider, config, refreshToken, priority, this,
+                             [this, accountId, provider](const QJsonObject &response, const QString &error) {
+        onRefreshResponse(response, error, accountId, provider);
+        releaseGrant(accountId);
+    });
+}
+
+void TokenRefresher::onRefreshResponse(const QJsonObject &response, const QString &error,
+                                       quint32 accountId, ProviderContext *provider)
+{
+    QString accessToken = response.value("access_token").toString();
+    if (!error.isEmpty() || accessToken.isEmpty()) {
+        fail(accountId, QString("令牌刷新失败：%1").arg(error.isEmpty() ? QString("响应中未包含访问令牌") : error));
+        return;
+    }
+
+    std::unique_ptr<Accounts::Account> account(manager()->account(accountId));
+    if (!account) {
+        fail(accountId, "刷新期间账户已被删除");
+        return;
+    }
+
+    TokenCache::Entry entry;
+    entry.accessToken = accessToken;
+    entry.refreshToken = response.value("refresh_token").toString();
+    int expiresIn = response.value("expires_in").toInt();
+    if (expiresIn > 0) {
+        entry.expiresAt = QDateTime::currentMSecsSinceEpoch() + qint64(expiresIn) * 1000;
+    }
+
+    QVariantMap values;
+    values["access_token"] = entry.accessToken;
+    if (!entry.refreshToken.isEmpty()) {
+        // 令牌端点轮换了 refresh_token
+        values["refresh_token"] = entry.refreshToken;
+    } else {
+        entry.refreshToken = account->value("refresh_token").toString();
+    }
+    if (expiresIn > 0) {
+        values["expires_in"] = expiresIn;
+        values["expires_at"] = entry.expiresAt / 1000;
+    }
+    writeRotatedTokens(account.get(), provider, values);
+
+    provider->tokenCache().insert(accountId, entry);
+    m_inFlight.remove(accountId);
+    ++m_succeeded;
+
+    qDebug() << "TokenRefresher: account" << accountId << "refreshed, expires in" << expiresIn << "s";
+    emit tokenRefreshed(accountId, entry.accessToken, entry.expiresAt);
+}
+
+void TokenRefresher::refreshScoped(quint32 accountId, const QStringList &scopes, const QString &subjectToken,
+                                   TokenRateLimiter::Priority priority)
+{
+    QString scopeKey = scopes.join(' ');
+    if (m_scopedInFlight.contains(qMakePair(accountId, scopeKey))) {
+        ++m_coalesced;
+        return;
+    }
+    m_scopedInFlight.insert(qMakePair(accountId, scopeKey));
+    if (m_grantBusy.contains(accountId)) {
+        m_queuedScoped[accountId].append(QueuedScoped{ scopes, subjectToken, priority });
+        ++m_queued;
+        return;
+    }
+    startScoped(accountId, scopes, subjectToken, priority);
+}
+
+void TokenRefresher::startScoped(quint32 accountId, const QStringList &scopes, const QString &subjectToken,
+                                 TokenRateLimiter::Priority priority)
+{
+    QString scopeKey = scopes.join(' ');
+    std::unique_ptr<Accounts::Account> account(manager()->account(accountId));
+    if (!account) {
+        failScoped(accountId, scopeKey, "账户不存在");
+        return;
+    }
+    ProviderContext *provider = m_registry->provider(account->providerName());
+    if (!provider) {
+        failScoped(accountId, scopeKey, QString("账户所属 provider 不由本插件管理：%1").arg(account->providerName()));
+        return;
+    }
+
+    OAuth2Config::SnapshotPtr config = provider->config()->snapshot();
+
+    qDebug() << "TokenRefresher: requesting service token for account" << accountId << "scope" << scopeKey
+             << "via" << config->scopedTokenGrant;
+
+    if (config->scopedTokenGrant == QLatin1String("token-exchange")) {
+        if (subjectToken.isEmpty()) {
+            failScoped(accountId, scopeKey, "令牌交换需要账户的访问令牌");
+            return;
+        }
+        // 令牌交换只使用访问令牌，不占用 refresh_token
+        OAuth2Flow::exchangeToken(provider, config, subjectToken, scopes, priority, this,
+                                  [this, accountId, scopeKey, provider](const QJsonObject &response, const QString &error) {
+            onScopedResponse(response, error, accountId, scopeKey, provider);
+        });
+        return;
+    }
+
+    QString refreshToken = account->value("refresh_token").toString();
+    if (refreshToken.isEmpty()) {
+        failScoped(accountId, scopeKey, "账户没有 refresh_token");
+        return;
+    }
+    m_grantBusy.insert(accountId);
+    OAuth2Flow::downscopeToken(provider, config, refreshToken, scopes, priority, this,
+                               [this, accountId, scopeKey, provider](const QJsonObject &response, const QString &error) {
+        onScopedResponse(response, error, accountId, scopeKey, provider);
+        releaseGrant(accountId);
+    });
+}
+
+void TokenRefresher::releaseGrant(quint32 accountId)
+{
+    m_grantBusy.remove(accountId);
+    // 排队的请求在这里才读取账户中的 refresh_token，用的是刚轮换写回的令牌；
+    // 启动时就失败的请求不占用 refresh_token，继续发出下一个
+    while (!m_grantBusy.contains(accountId)) {
+        auto refresh = m_queuedRefresh.find(accountId);
+        if (refresh != m_queuedRefresh.end()) {
+            TokenRateLimiter::Priority priority = refresh.value();
+            m_queuedRefresh.erase(refresh);
+            startRefresh(accountId, priority);
+            continue;
+        }
+        auto scoped = m_queuedScoped.find(accountId);
+        if (scoped == m_queuedScoped.end()) {
+            break;
+        }
+        QueuedScoped next = scoped.value().takeFirst();
+        if (scoped.value().isEmpty()) {
+            m_queuedScoped.erase(scoped);
+        }
+        startScoped(accountId, next.scopes, next.subjectToken, next.priority);
+    }
+}
+
+void TokenRefresher::onScopedResponse(const QJsonObject &response, const QString &error,
+                                      quint32 accountId, const QString &scopeKey, ProviderContext *provider)
+{
+    QString accessToken = response.value("access_token").toString();
+    if (!error.isEmpty() || accessToken.isEmpty()) {
+        failScoped(accountId, scopeKey, QString("获取服务令牌失败：%1").arg(error.isEmpty() ? QString("响应中未包含访问令牌") : error));
+        return;
+    }
+
+    TokenCache::Entry entry;
+    entry.accessToken = accessToken;
+    int expiresIn = response.value("expires_in").toInt();
+    if (expiresIn > 0) {
+        entry.expiresAt = QDateTime::currentMSecsSinceEpoch() + qint64(expiresIn) * 1000;
+    }
+
+    QString rotated = response.value("refresh_token").toString();
+    if (!rotated.isEmpty()) {
+        // 令牌端点轮换了 refresh_token，旧的已失效，必须写回账户；缓存同步更新，
+        // 令牌代理收到账户变化时据此判断不是其他进程修改的
+        std::unique_ptr<Accounts::Account> account(manager()->account(accountId));
+        if (account) {
+            QVariantMap values;
+            values["refresh_token"] = rotated;
+            writeRotatedTokens(account.get(), provider, values);
+        }
+        TokenCache::Entry accountEntry;
+        if (provider->tokenCache().lookup(accountId, &accountEntry)) {
+            accountEntry.refreshToken = rotated;
+            provider->tokenCache().insert(accountId, accountEntry);
+        }
+    }
+
+    provider->tokenCache().insertScoped(accountId, scopeKey, entry);
+    m_scopedInFlight.remove(qMakePair(accountId, scopeKey));
+    ++m_scopedSucceeded;
+
+    qDebug() << "TokenRefresher: service token for account" << accountId << "scope" << scopeKey
+             << "expires in" << expiresIn << "s";
+    emit scopedTokenRefreshed(accountId, scopeKey, entry.accessToken, entry.expiresAt);
+}
+
+void TokenRefresher::writeRotatedTokens(Accounts::Account *account, ProviderContext *provider, const QVariantMap &values)
+{
+    // 通常只有 access_token 和 expires_at 变化；令牌端点返回相同的 refresh_token 时不算轮换
+    const QVariantMap changed = AccountWriter::changedValues(account, values);
+
+    // 旧的 refresh_token 已失效：写回账户之前退出，新的只能从日志中找回
+    QString flowId;
+    if (m_journal && changed.contains("refresh_token")) {
+        QVariantMap record = changed;
+        record["account_id"] = account->id();
+        record["provider"] = provider->providerId();
+        // 重放时只替换这个令牌，账户之后重新认证得到的令牌不会被覆盖
+        record["replaces"] = FlowJournal::tokenDigest(account->value("refresh_token").toString());
+        flowId = m_journal->begin("rotation", record);
+    }
+    AccountWriter::write(account, changed);
+    if (m_journal) {
+        m_journal->commit(flowId);
+    }
+}
+
+void TokenRefresher::failScoped(quint32 accountId, const QString &scopeKey, const QString &error)
+{
+    m_scopedInFlight.remove(qMakePair(accountId, scopeKey));
+    ++m_scopedFailed;
+    qDebug() << "TokenRefresher: account" << accountId << "scope" << scopeKey << "failed:" << error;
+    emit scopedRefreshFailed(accountId, scopeKey, error);
+}
+
+void TokenRefresher::fail(quint32 accountId, const QString &error)
+{
+    m_inFlight.remove(accountId);
+    ++m_failed;
+    qDebug() << "TokenRefresher: account" << accountId << "refresh failed:" << error;
+    emit refreshFailed(accountId, error);
+}
+
+QVariantMap TokenRefresher::statistics() const
+{
+    QVariantMap stats;
+    stats["inFlight"] = m_inFlight.size();
+    stats["succeeded"] = m_succeeded;
+    stats["failed"] = m_failed;
+    stats["coalesced"] = m_coalesced;
+    stats["queued"] = m_queued;
+    stats["scopedInFlight"] = m_scopedInFlight.size();
+    stats["scopedSucceeded"] = m_scopedSucceeded;
+    stats["scopedFailed"] = m_scopedFailed;
+    return stats;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+#include <memory>
+#include "tokenratelimiter.h"
+
+class FlowJournal;
+class ProviderContext;
+class ProviderRegistry;
+class QJsonObject;
+
+namespace Accounts {
+class Account;
+class Manager;
+}
+
+// 使用 refresh_token 刷新账户令牌
+// 请求经所属 provider 的令牌端点限流器发出（定时刷新走后台队列，不挤占交互式请求），
+// 成功后把新令牌和 expires_at 写回账户设置，并更新该 provider 的令牌缓存。
+// 同一账户同时只有一个刷新请求，重复调用合并到进行中的请求。
+// 服务令牌（只含部分 scope）按 provider 配置由 refresh_token 缩小范围或令牌交换获得，只写入令牌缓存。
+// 同一账户同时只发出一个使用 refresh_token 的授权：令牌端点轮换 refresh_token 时，并发的授权
+// 会拿着已失效的令牌（invalid_grant，或触发重用检测吊销整个令牌族）。其余请求排队，
+// 前一个授权的结果写回账户后再用账户中最新的 refresh_token 发出。
+class TokenRefresher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TokenRefresher(ProviderRegistry *registry, QObject *parent = nullptr);
+    ~TokenRefresher() override;
+
+    void refresh(quint32 accountId, TokenRateLimiter::Priority priority);
+    bool isRefreshing(quint32 accountId) const { return m_inFlight.contains(accountId); }
+    // 轮换后的 refresh_token 在写回账户之前先记入日志（见 FlowJournal），为空时不记录
+    void setJournal(FlowJournal *journal) { m_journal = journal; }
+    // 获取只含 scopes（已排序）的服务令牌；令牌交换时 subjectToken 为账户当前的访问令牌
+    void refreshScoped(quint32 accountId, const QStringList &scopes, const QString &subjectToken,
+                       TokenRateLimiter::Priority priority);
+
+    QVariantMap statistics() const;
+
+signals:
+    // expiresAt 为毫秒时间戳，0 表示令牌端点未返回 expires_in
+    void tokenRefreshed(quint32 accountId, const QString &accessToken, qint64 expiresAt);
+    void refreshFailed(quint32 accountId, const QString &error);
+    // scopeKey 为以空格连接的 scope 列表，expiresAt 同上
+    void scopedTokenRefreshed(quint32 accountId, const QString &scopeKey, const QString &accessToken, qint64 expiresAt);
+    void scopedRefreshFailed(quint32 accountId, const QString &scopeKey, const QString &error);
+
+private:
+    void onRefreshResponse(const QJsonObject &response, const QString &error,
+                           quint32 accountId, ProviderContext *provider);
+    void onScopedResponse(const QJsonObject &response, const QString &error,
+                          quint32 accountId, const QString &scopeKey, ProviderContext *provider);
+    struct QueuedScoped {
+        QStringList scopes;
+        QString subjectToken;
+        TokenRateLimiter::Priority priority;
+    };
+
+    void startRefresh(quint32 accountId, TokenRateLimiter::Priority priority);
+    void startScoped(quint32 accountId, const QStringList &scopes, const QString &subjectToken,
+                     TokenRateLimiter::Priority priority);
+    // 授权结束：依次发出排队的请求，直到其中一个重新占用 refresh_token
+    void releaseGrant(quint32 accountId);
+    void fail(quint32 accountId, const QString &error);
+    void failScoped(quint32 accountId, const QString &scopeKey, const QString &error);
+    // 轮换后的令牌写回账户（先记入日志，写入后提交）
+    void writeRotatedTokens(Accounts::Account *account, ProviderContext *provider, const QVariantMap &values);
+    Accounts::Manager *manager();   // 延迟创建
+
+    ProviderRegistry *m_registry;
+    FlowJournal *m_journal = nullptr;
+    std::unique_ptr<Accounts::Manager> m_manager;
+    QSet<quint32> m_inFlight;
+    QSet<QPair<quint32, QString>> m_scopedInFlight;        // 含排队中的请求
+    QSet<quint32> m_grantBusy;                              // 有使用 refresh_token 的授权进行中的账户
+    QHash<quint32, TokenRateLimiter::Priority> m_queuedRefresh;
+    QHash<quint32, QList<QueuedScoped>> m_queuedScoped;
+
+    quint64 m_succeeded = 0;
+    quint64 m_failed = 0;
+    quint64 m_coalesced = 0;
+    quint64 m_queued = 0;
+    quint64 m_scopedSucceeded = 0;
+    quint64 m_scopedFailed = 0;
+};
@@ -0,0 +1,312 @@
+#include "tokensnapshot.h"
+#include <QDebug>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+size_t TokenSnapshot::mappingSize(quint32 capacity)
+{
+    // 槽位按 SlotSize 对齐，账户ID数组补齐到槽位边界
+    size_t idsSize = (size_t(capacity) * sizeof(quint32) + SlotSize - 1) / SlotSize * SlotSize;
+    size_t headerSize = SlotSize;
+    return headerSize + idsSize + size_t(capacity) * SlotSize;
+}
+
+namespace {
+
+size_t idsOffset()
+{
+    return TokenSnapshot::SlotSize;
+}
+
+size_t slotsOffset(quint32 capacity)
+{
+    return TokenSnapshot::mappingSize(capacity) - size_t(capacity) * TokenSnapshot::SlotSize;
+}
+
+} // namespace
+
+// TokenSnapshotWriter 实现
+TokenSnapshotWriter::TokenSnapshotWriter()
+{
+    create(TokenSnapshot::InitialCapacity);
+}
+
+TokenSnapshotWriter::~TokenSnapshotWriter()
+{
+    release();
+}
+
+bool TokenSnapshotWriter::create(quint32 capacity)
+{
+    int fd = memfd_create("kde-oauth2-tokens", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        qWarning() << "TokenSnapshotWriter: memfd_create failed:" << strerror(errno);
+        return false;
+    }
+    size_t size = TokenSnapshot::mappingSize(capacity);
+    if (ftruncate(fd, off_t(size)) != 0) {
+        qWarning() << "TokenSnapshotWriter: ftruncate failed:" << strerror(errno);
+        close(fd);
+        return false;
+    }
+    // 客户端映射后大小不能再变化，否则读取越界时会收到 SIGBUS
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        qWarning() << "TokenSnapshotWriter: mmap failed:" << strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    // 新文件内容全为 0，只需填写头部
+    auto *header = new (mapping) TokenSnapshot::Header;
+    header->sequence.store(0, std::memory_order_relaxed);
+    header->retired.store(0, std::memory_order_relaxed);
+    header->magic = TokenSnapshot::Magic;
+    header->version = TokenSnapshot::Version;
+    header->capacity = capacity;
+    header->count = 0;
+
+    m_fd = fd;
+    m_header = header;
+    m_size = size;
+    return true;
+}
+
+void TokenSnapshotWriter::release()
+{
+    if (m_header) {
+        munmap(m_header, m_size);
+        m_header = nullptr;
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    m_size = 0;
+}
+
+void TokenSnapshotWriter::beginWrite()
+{
+    m_header->sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void TokenSnapshotWriter::endWrite()
+{
+    m_header->sequence.fetch_add(1, std::memory_order_release);
+}
+
+quint32 *TokenSnapshotWriter::accountIds() const
+{
+    return reinterpret_cast<quint32 *>(reinterpret_cast<char *>(m_header) + idsOffset());
+}
+
+TokenSnapshot::Slot *TokenSnapshotWriter::slots() const
+{
+    return reinterpret_cast<TokenSnapshot::Slot *>(reinterpret_cast<char *>(m_header) + slotsOffset(m_header->capacity));
+}
+
+void TokenSnapshotWriter::writeSlot(int index, quint32 accountId, const QByteArray &token, qint64 expiresAt)
+{
+    TokenSnapshot::Slot &slot = slots()[index];
+    slot.accountId = accountId;
+    slot.tokenLength = quint32(token.size());
+    slot.expiresAt = expiresAt;
+    memcpy(slot.token, token.constData(), size_t(token.size()));
+    accountIds()[index] = accountId;
+}
+
+void TokenSnapshotWriter::publish(quint32 accountId, const QByteArray &token, qint64 expiresAt)
+{
+    if (!m_header) {
+        return;
+    }
+    if (token.isEmpty() || token.size() > TokenSnapshot::MaxTokenLength) {
+        if (!token.isEmpty()) {
+            ++m_oversized;
+        }
+        remove(accountId);
+        return;
+    }
+
+    auto it = m_index.constFind(accountId);
+    if (it == m_index.constEnd() && m_header->count >= m_header->capacity) {
+        // 容量不足：写入两倍大小的新快照，旧快照标记为已取代，客户端据此重新获取描述符
+        TokenSnapshot::Header *oldHeader = m_header;
+        int oldFd = m_fd;
+        size_t oldSize = m_size;
+        quint32 *oldIds = accountIds();
+        TokenSnapshot::Slot *oldSlots = slots();
+        quint32 oldCount = m_header->count;
+
+        if (!create(oldHeader->capacity * 2)) {
+            // 保持旧快照不变，该账户暂时不进入快照
+            return;
+        }
+        for (quint32 i = 0; i < oldCount; ++i) {
+            const TokenSnapshot::Slot &slot = oldSlots[i];
+            writeSlot(int(i), oldIds[i], QByteArray::fromRawData(slot.token, int(slot.tokenLength)), slot.expiresAt);
+        }
+        m_header->count = oldCount;
+
+        oldHeader->retired.store(1, std::memory_order_release);
+        munmap(oldHeader, oldSize);
+        close(oldFd);
+        ++m_replacements;
+        qDebug() << "TokenSnapshotWriter: snapshot grown to" << m_header->capacity << "accounts";
+    }
+
+    beginWrite();
+    int index;
+    if (it != m_index.constEnd()) {
+        index = it.value();
+    } else {
+        index = int(m_header->count);
+        m_index.insert(accountId, index);
+        ++m_header->count;
+    }
+    writeSlot(index, accountId, token, expiresAt);
+    endWrite();
+    ++m_publishes;
+}
+
+void TokenSnapshotWriter::remove(quint32 accountId)
+{
+    auto it = m_index.find(accountId);
+    if (!m_header || it == m_index.end()) {
+        return;
+    }
+    int index = it.value();
+    m_index.erase(it);
+
+    beginWrite();
+    int last = int(m_header->count) - 1;
+    if (index != last) {
+        const TokenSnapshot::Slot &moved = slots()[last];
+        writeSlot(index, moved.accountId, QByteArray::fromRawData(moved.token, int(moved.tokenLength)), moved.expiresAt);
+        m_index.insert(moved.accountId, index);
+    }
+    accountIds()[last] = 0;
+    --m_header->count;
+    endWrite();
+}
+
+void TokenSnapshotWriter::clear()
+{
+    if (!m_header) {
+        return;
+    }
+    beginWrite();
+    m_header->count = 0;
+    endWrite();
+    m_index.clear();
+}
+
+int TokenSnapshotWriter::openReadOnly() const
+{
+    if (m_fd < 0) {
+        return -1;
+    }
+    // 通过 /proc 重新打开同一个 memfd，得到只读的打开文件描述
+    QByteArray path = QByteArray("/proc/self/fd/") + QByteArray::number(m_fd);
+    return open(path.constData(), O_RDONLY | O_CLOEXEC);
+}
+
+QVariantMap TokenSnapshotWriter::statistics() const
+{
+    QVariantMap stats;
+    stats["available"] = isValid();
+    stats["accounts"] = m_index.size();
+    stats["capacity"] = m_header ? m_header->capacity : 0u;
+    stats["publishes"] = m_publishes;
+    stats["replacements"] = m_replacements;
+    stats["oversized"] = m_oversized;
+    return stats;
+}
+
+// TokenSnapshotReader 实现
+TokenSnapshotReader::~TokenSnapshotReader()
+{
+    if (m_header) {
+        munmap(const_cast<TokenSnapshot::Header *>(m_header), m_size);
+    }
+}
+
+bool TokenSnapshotReader::attach(int fd)
+{
+    struct stat info;
+    if (m_header || fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(TokenSnapshot::Header)) {
+        return false;
+    }
+    size_t size = size_t(info.st_size);
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    auto *header = static_cast<const TokenSnapshot::Header *>(mapping);
+    if (header->magic != TokenSnapshot::Magic || header->version != TokenSnapshot::Version
+        || TokenSnapshot::mappingSize(header->capacity) != size) {
+        munmap(mapping, size);
+        return false;
+    }
+    m_header = header;
+    m_size = size;
+    return true;
+}
+
+TokenSnapshotReader::Result TokenSnapshotReader::lookup(quint32 accountId, QByteArray *token, qint64 *expiresAt) const
+{
+    if (!m_header) {
+        return Unavailable;
+    }
+    const char *base = reinterpret_cast<const char *>(m_header);
+    quint32 capacity = m_header->capacity;   // 创建后不再变化
+    const quint32 *ids = reinterpret_cast<const quint32 *>(base + idsOffset());
+    const TokenSnapshot::Slot *slots = reinterpret_cast<const TokenSnapshot::Slot *>(base + slotsOffset(capacity));
+    char buffer[TokenSnapshot::MaxTokenLength];
+
+    for (int attempt = 0; attempt < MaxReadAttempts; ++attempt) {
+        quint32 begin = m_header->sequence.load(std::memory_order_acquire);
+        if (begin & 1) {
+            continue;   // 正在写入
+        }
+        if (m_header->retired.load(std::memory_order_acquire)) {
+            return Retired;
+        }
+
+        // 读取期间数据可能被改写，只使用局部副本，并在序列号确认之后才返回
+        quint32 count = qMin(m_header->count, capacity);
+        int index = -1;
+        for (quint32 i = 0; i < count; ++i) {
+            if (ids[i] == accountId) {
+                index = int(i);
+                break;
+            }
+        }
+        quint32 length = 0;
+        qint64 expires = 0;
+        if (index >= 0) {
+            length = qMin<quint32>(slots[index].tokenLength, TokenSnapshot::MaxTokenLength);
+            expires = slots[index].expiresAt;
+            memcpy(buffer, slots[index].token, length);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_header->sequence.load(std::memory_order_relaxed) != begin) {
+            continue;
+        }
+        if (index < 0) {
+            return NotFound;
+        }
+        *token = QByteArray(buffer, int(length));
+        *expiresAt = expires;
+        return Found;
+    }
+    return Unavailable;
+}
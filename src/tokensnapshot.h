@@ -0,0 +1,111 @@
+#pragma once
+#include <QByteArray>
+#include <QHash>
+#include <QVariantMap>
+#include <atomic>
+
+// 共享内存令牌快照（memfd）
+// 令牌代理把 (账户 -> 令牌, 过期时间) 写入 memfd，通过 DBus 把只读描述符传给本机客户端。
+// 客户端 mmap 后直接读取：查找路径上没有系统调用，也没有 DBus 往返。
+// 并发由序列锁（seqlock）保证：写入期间序列号为奇数，读取前后序列号不同则重试。
+//
+// 布局：Header | 账户ID数组[capacity] | Slot[capacity]
+// 账户ID连续存放，查找时只扫描这一段；槽位紧凑排列，删除时用最后一个槽位填补。
+class TokenSnapshot
+{
+public:
+    static constexpr quint32 Magic = 0x4b4f5453;   // "KOTS"
+    static constexpr quint32 Version = 1;
+    static constexpr int SlotSize = 4096;
+    static constexpr int MaxTokenLength = SlotSize - 16;
+    static constexpr quint32 InitialCapacity = 64;
+
+    struct Header {
+        std::atomic<quint32> sequence;   // 奇数表示正在写入
+        std::atomic<quint32> retired;    // 1 表示已被更大的快照取代，需要重新获取描述符
+        quint32 magic;
+        quint32 version;
+        quint32 capacity;
+        quint32 count;
+        quint32 reserved[2];
+    };
+
+    struct Slot {
+        quint32 accountId;
+        quint32 tokenLength;
+        qint64 expiresAt;                // 秒，0 表示未知
+        char token[MaxTokenLength];
+    };
+
+    static_assert(std::atomic<quint32>::is_always_lock_free, "seqlock needs lock-free atomics in shared memory");
+    static_assert(sizeof(Slot) == SlotSize, "unexpected slot padding");
+
+    static size_t mappingSize(quint32 capacity);
+};
+
+// 快照写入方（令牌代理）
+class TokenSnapshotWriter
+{
+public:
+    TokenSnapshotWriter();
+    ~TokenSnapshotWriter();
+
+    bool isValid() const { return m_header != nullptr; }
+
+    // 超过 MaxTokenLength 的令牌不写入快照，客户端回退到 DBus
+    void publish(quint32 accountId, const QByteArray &token, qint64 expiresAt);
+    void remove(quint32 accountId);
+    void clear();
+
+    // 新打开的只读描述符（调用方负责关闭），客户端无法通过它写入；失败时返回 -1
+    int openReadOnly() const;
+
+    QVariantMap statistics() const;
+
+private:
+    bool create(quint32 capacity);
+    void release();
+    void beginWrite();
+    void endWrite();
+    quint32 *accountIds() const;
+    TokenSnapshot::Slot *slots() const;
+    void writeSlot(int index, quint32 accountId, const QByteArray &token, qint64 expiresAt);
+
+    int m_fd = -1;
+    TokenSnapshot::Header *m_header = nullptr;
+    size_t m_size = 0;
+    QHash<quint32, int> m_index;   // 账户ID -> 槽位
+
+    quint64 m_publishes = 0;
+    quint64 m_replacements = 0;
+    quint64 m_oversized = 0;
+};
+
+// 快照读取方（本机客户端）
+class TokenSnapshotReader
+{
+public:
+    enum Result {
+        Found,
+        NotFound,
+        Retired,        // 快照已被取代，需要重新获取描述符
+        Unavailable     // 未映射或一直处于写入中
+    };
+
+    static constexpr int MaxReadAttempts = 64;
+
+    TokenSnapshotReader() = default;
+    ~TokenSnapshotReader();
+    TokenSnapshotReader(const TokenSnapshotReader &) = delete;
+    TokenSnapshotReader &operator=(const TokenSnapshotReader &) = delete;
+
+    // 映射描述符（只读），之后描述符可以关闭
+    bool attach(int fd);
+    bool isAttached() const { return m_header != nullptr; }
+
+    Result lookup(quint32 accountId, QByteArray *token, qint64 *expiresAt) const;
+
+private:
+    const TokenSnapshot::Header *m_header = nullptr;
+    size_t m_size = 0;
+};
@@ -0,0 +1,264 @@
+// ClaimMapper 单元测试：候选声明优先级、JSON Pointer、多值字段和 provider 设置覆盖
+#include "claimmapper.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTest>
+
+namespace {
+
+ClaimMapper::Mapping findMapping(const QVector<ClaimMapper::Mapping> &mappings, const QString &field)
+{
+    for (const ClaimMapper::Mapping &mapping : mappings) {
+        if (mapping.field == field) {
+            return mapping;
+        }
+    }
+    return ClaimMapper::Mapping();
+}
+
+QString base64Url(const QByteArray &data)
+{
+    return QString::fromLatin1(data.toBase64(QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals));
+}
+
+} // namespace
+
+class ClaimMapperTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void defaultMappings();
+    void candidatePriority();
+    void nullValuesFallThrough();
+    void jsonPointers();
+    void jsonPointerEscapes();
+    void multiValuedFields();
+    void singleValuedArrays();
+    void settingsOverrides();
+    void settingsMultiValuedSuffix();
+    void claimKeys();
+    void decodeJwtPayload();
+    void decodeJwtPayloadErrors_data();
+    void decodeJwtPayloadErrors();
+};
+
+void ClaimMapperTest::defaultMappings()
+{
+    ClaimMapper mapper;
+
+    QJsonObject claims;
+    claims["http://schemas.xmlsoap.org/ws/2005/05/identity/claims/nameidentifier"] = "10086";
+    claims["http://schemas.xmlsoap.org/ws/2005/05/identity/claims/name"] = "zhangsan";
+    claims["mail"] = "zhangsan@example.com";
+    claims["http://schemas.microsoft.com/ws/2008/06/identity/claims/role"] = QJsonArray{ "admin", "user" };
+    claims["groups"] = QJsonArray{ "staff" };
+    claims["picture"] = "/avatar.png";
+    claims["exp"] = 1700003600;
+    claims["unrelated"] = "ignored";
+
+    QVariantMap mapped = mapper.map(claims);
+    QCOMPARE(mapped.value("user_id").toString(), QStringLiteral("10086"));
+    QCOMPARE(mapped.value("username").toString(), QStringLiteral("zhangsan"));
+    QCOMPARE(mapped.value("email").toString(), QStringLiteral("zhangsan@example.com"));
+    QCOMPARE(mapped.value("role").toString(), QStringLiteral("admin,user"));
+    QCOMPARE(mapped.value("roles").toStringList(), QStringList({ "admin", "user" }));
+    QCOMPARE(mapped.value("groups").toStringList(), QStringList({ "staff" }));
+    QCOMPARE(mapped.value("portrait").toString(), QStringLiteral("/avatar.png"));
+    QCOMPARE(mapped.value("exp").toLongLong(), 1700003600LL);
+    QVERIFY(!mapped.contains("unrelated"));
+    QVERIFY(!mapped.contains("iss"));
+}
+
+void ClaimMapperTest::candidatePriority()
+{
+    ClaimMapper mapper({ { "user_id", { "sub", "id", "user_id" } } });
+
+    // JSON 对象按键排序遍历，优先级与遍历顺序无关
+    QJsonObject claims;
+    claims["user_id"] = "third";
+    claims["id"] = "second";
+    QCOMPARE(mapper.map(claims).value("user_id").toString(), QStringLiteral("second"));
+
+    claims["sub"] = "first";
+    QCOMPARE(mapper.map(claims).value("user_id").toString(), QStringLiteral("first"));
+
+    QVERIFY(mapper.map(QJsonObject()).isEmpty());
+}
+
+void ClaimMapperTest::nullValuesFallThrough()
+{
+    ClaimMapper mapper({ { "email", { "email", "mail" } } });
+
+    QJsonObject claims;
+    claims["email"] = QJsonValue::Null;
+    claims["mail"] = "fallback@example.com";
+    QCOMPARE(mapper.map(claims).value("email").toString(), QStringLiteral("fallback@example.com"));
+}
+
+void ClaimMapperTest::jsonPointers()
+{
+    ClaimMapper mapper({
+        { "roles", { "/realm_access/roles" }, ClaimMapper::MultiValued },
+        { "email", { "/emails/1", "/emails/0", "email" } },
+        { "tenant", { "/org/tenant/id" } },
+        { "profile", { "/profile" } },
+    });
+
+    QJsonObject claims;
+    claims["realm_access"] = QJsonObject{ { "roles", QJsonArray{ "reader", "writer" } } };
+    claims["emails"] = QJsonArray{ "only@example.com" };
+    claims["email"] = "top@example.com";
+    claims["org"] = QJsonObject{ { "tenant", "not-an-object" } };
+    claims["profile"] = QJsonObject{ { "nick", "zs" } };
+
+    QVariantMap mapped = mapper.map(claims);
+    QCOMPARE(mapped.value("roles").toStringList(), QStringList({ "reader", "writer" }));
+    // 越界的数组下标不算命中，退回到下一个候选
+    QCOMPARE(mapped.value("email").toString(), QStringLiteral("only@example.com"));
+    QVERIFY(!mapped.contains("tenant"));
+    // 对象值序列化为紧凑 JSON
+    QCOMPARE(mapped.value("profile").toString(), QStringLiteral("{\"nick\":\"zs\"}"));
+}
+
+void ClaimMapperTest::jsonPointerEscapes()
+{
+    ClaimMapper mapper({ { "value", { "/a~1b/c~0d" } } });
+
+    QJsonObject claims;
+    claims["a/b"] = QJsonObject{ { "c~d", "escaped" } };
+    QCOMPARE(mapper.map(claims).value("value").toString(), QStringLiteral("escaped"));
+    QVERIFY(mapper.claimKeys().contains("a/b"));
+}
+
+void ClaimMapperTest::multiValuedFields()
+{
+    ClaimMapper mapper({ { "roles", { "roles" }, ClaimMapper::MultiValued | ClaimMapper::Interned } });
+
+    QJsonObject claims;
+    claims["roles"] = "admin";
+    QCOMPARE(mapper.map(claims).value("roles").toStringList(), QStringList({ "admin" }));
+
+    // 空字符串跳过，非字符串元素转换为字符串
+    claims["roles"] = QJsonArray{ "admin", "", 42, true };
+    QCOMPARE(mapper.map(claims).value("roles").toStringList(), QStringList({ "admin", "42", "true" }));
+
+    claims["roles"] = QJsonArray();
+    QVariant empty = mapper.map(claims).value("roles");
+    QCOMPARE(empty.type(), QVariant::StringList);
+    QVERIFY(empty.toStringList().isEmpty());
+}
+
+void ClaimMapperTest::singleValuedArrays()
+{
+    ClaimMapper mapper({ { "amr", { "amr" } } });
+
+    QJsonObject claims;
+    claims["amr"] = QJsonArray{ "pwd", "otp" };
+    QCOMPARE(mapper.map(claims).value("amr").toString(), QStringLiteral("pwd,otp"));
+}
+
+void ClaimMapperTest::settingsOverrides()
+{
+    QHash<QString, QString> settings;
+    settings.insert("claims/user_id", " /account/id , sub,, ");
+    settings.insert("claims/portrait", QString());
+    settings.insert("claims/department", "dept, /org/department");
+    settings.insert("claims/bad/field", "ignored");
+    settings.insert("claims/", "ignored");
+    settings.insert("Host", "https://sso.example.com");
+
+    QVector<ClaimMapper::Mapping> mappings = ClaimMapper::mappingsFromSettings(settings);
+    QCOMPARE(mappings.size(), ClaimMapper::defaultMappings().size() + 1);
+    QCOMPARE(findMapping(mappings, "user_id").claims, QStringList({ "/account/id", "sub" }));
+    QCOMPARE(findMapping(mappings, "email").claims, findMapping(ClaimMapper::defaultMappings(), "email").claims);
+    QCOMPARE(findMapping(mappings, "department").claims, QStringList({ "dept", "/org/department" }));
+    QVERIFY(!findMapping(mappings, "department").flags);
+
+    ClaimMapper mapper(mappings);
+    QJsonObject claims;
+    claims["sub"] = "subject";
+    claims["account"] = QJsonObject{ { "id", "account-id" } };
+    claims["portrait"] = "/avatar.png";
+    claims["org"] = QJsonObject{ { "department", "R&D" } };
+
+    // 值为空的设置禁用该字段
+    QVariantMap mapped = mapper.map(claims);
+    QCOMPARE(mapped.value("user_id").toString(), QStringLiteral("account-id"));
+    QCOMPARE(mapped.value("department").toString(), QStringLiteral("R&D"));
+    QVERIFY(!mapped.contains("portrait"));
+    QVERIFY(!mapper.fields().contains("bad/field"));
+}
+
+void ClaimMapperTest::settingsMultiValuedSuffix()
+{
+    QHash<QString, QString> settings;
+    settings.insert("claims/teams[]", "/org/teams");
+    settings.insert("claims/email[]", "emails, email");
+
+    QVector<ClaimMapper::Mapping> mappings = ClaimMapper::mappingsFromSettings(settings);
+    ClaimMapper::Mapping teams = findMapping(mappings, "teams");
+    QCOMPARE(teams.claims, QStringList({ "/org/teams" }));
+    QVERIFY(teams.flags & ClaimMapper::MultiValued);
+    QVERIFY(findMapping(mappings, "email").flags & ClaimMapper::MultiValued);
+    // 内置的多值字段不因覆盖候选声明而变成单值
+    QVERIFY(findMapping(ClaimMapper::mappingsFromSettings({ { "claims/groups", "memberOf" } }), "groups").flags
+            & ClaimMapper::MultiValued);
+
+    ClaimMapper mapper(mappings);
+    QJsonObject claims;
+    claims["org"] = QJsonObject{ { "teams", QJsonArray{ "red", "blue" } } };
+    claims["email"] = "zhangsan@example.com";
+    QVariantMap mapped = mapper.map(claims);
+    QCOMPARE(mapped.value("teams").toStringList(), QStringList({ "red", "blue" }));
+    QCOMPARE(mapped.value("email").toStringList(), QStringList({ "zhangsan@example.com" }));
+}
+
+void ClaimMapperTest::claimKeys()
+{
+    ClaimMapper mapper({
+        { "user_id", { "sub", "/account/id" } },
+        { "roles", { "/realm_access/roles", "roles" }, ClaimMapper::MultiValued },
+    });
+
+    QSet<QString> expected = { "sub", "account", "realm_access", "roles" };
+    QCOMPARE(mapper.claimKeys(), expected);
+    QCOMPARE(mapper.fields(), QStringList({ "user_id", "roles" }));
+}
+
+void ClaimMapperTest::decodeJwtPayload()
+{
+    QJsonObject payload;
+    payload["sub"] = "10086";
+    payload["name"] = QStringLiteral("张三");
+    const QByteArray json = QJsonDocument(payload).toJson(QJsonDocument::Compact);
+    const QString jwt = base64Url("{\"alg\":\"none\"}") + '.' + base64Url(json) + QStringLiteral(".signature");
+
+    QJsonObject decoded = ClaimMapper::decodeJwtPayload(jwt);
+    QCOMPARE(decoded.value("sub").toString(), QStringLiteral("10086"));
+    QCOMPARE(decoded.value("name").toString(), QStringLiteral("张三"));
+    QCOMPARE(ClaimMapper().map(decoded).value("user_id").toString(), QStringLiteral("10086"));
+}
+
+void ClaimMapperTest::decodeJwtPayloadErrors_data()
+{
+    QTest::addColumn<QString>("jwt");
+
+    QTest::newRow("empty") << QString();
+    QTest::newRow("two parts") << QStringLiteral("aGVhZGVy.e30");
+    QTest::newRow("empty payload") << QStringLiteral("aGVhZGVy..c2ln");
+    QTest::newRow("not json") << QStringLiteral("aGVhZGVy.bm90IGpzb24.c2ln");
+    QTest::newRow("json array") << QStringLiteral("aGVhZGVy.WzFd.c2ln");
+}
+
+void ClaimMapperTest::decodeJwtPayloadErrors()
+{
+    QFETCH(QString, jwt);
+
+    QVERIFY(ClaimMapper::decodeJwtPayload(jwt).isEmpty());
+}
+
+QTEST_GUILESS_MAIN(ClaimMapperTest)
+
+#include "claimmappertest.moc"
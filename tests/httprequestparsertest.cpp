@@ -0,0 +1,205 @@
+// HttpRequestParser 单元测试：分块到达、请求头上限、非法请求、keep-alive 判断和管线化
+#include "loopbackhttpserver.h"
+#include <QBuffer>
+#include <QTest>
+
+namespace {
+
+// 把一段数据交给解析器，模拟套接字上到达的一次 readyRead
+HttpRequestParser::Status feedBytes(HttpRequestParser &parser, const QByteArray &data)
+{
+    QBuffer device;
+    device.setData(data);
+    device.open(QIODevice::ReadOnly);
+    return parser.feed(&device);
+}
+
+} // namespace
+
+class HttpRequestParserTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void completeRequest();
+    void splitAcrossReads();
+    void leadingEmptyLines();
+    void malformed_data();
+    void malformed();
+    void headerTooLarge();
+    void keepAlive_data();
+    void keepAlive();
+    void headers();
+    void queryItems();
+    void pipelinedRequests();
+};
+
+void HttpRequestParserTest::completeRequest()
+{
+    HttpRequestParser parser;
+    QCOMPARE(feedBytes(parser, "GET /callback?code=abc HTTP/1.1\r\nHost: localhost\r\n\r\n"),
+             HttpRequestParser::Complete);
+    QCOMPARE(parser.status(), HttpRequestParser::Complete);
+    QCOMPARE(parser.view(parser.method()), QByteArray("GET"));
+    QCOMPARE(parser.view(parser.target()), QByteArray("/callback?code=abc"));
+    QCOMPARE(parser.view(parser.version()), QByteArray("HTTP/1.1"));
+    QCOMPARE(parser.path(), QByteArray("/callback"));
+    QVERIFY(parser.bufferedBody().isEmpty());
+
+    // 请求完整后继续 feed 不再读取数据
+    QCOMPARE(feedBytes(parser, "garbage"), HttpRequestParser::Complete);
+    QCOMPARE(parser.path(), QByteArray("/callback"));
+}
+
+void HttpRequestParserTest::splitAcrossReads()
+{
+    const QByteArray request = "POST /token HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc";
+    HttpRequestParser parser;
+    const int headerEnd = request.indexOf("\r\n\r\n") + 4;
+    for (int i = 0; i < headerEnd - 1; ++i) {
+        QCOMPARE(feedBytes(parser, request.mid(i, 1)), HttpRequestParser::NeedMoreData);
+    }
+    QCOMPARE(feedBytes(parser, request.mid(headerEnd - 1)), HttpRequestParser::Complete);
+    QCOMPARE(parser.view(parser.method()), QByteArray("POST"));
+    QCOMPARE(parser.view(parser.contentLengthHeader()), QByteArray("3"));
+    QCOMPARE(parser.bufferedBody(), QByteArray("abc"));
+}
+
+void HttpRequestParserTest::leadingEmptyLines()
+{
+    HttpRequestParser parser;
+    QCOMPARE(feedBytes(parser, "\r\n\r\nGET / HTTP/1.1\r\n\r\n"), HttpRequestParser::Complete);
+    QCOMPARE(parser.path(), QByteArray("/"));
+}
+
+void HttpRequestParserTest::malformed_data()
+{
+    QTest::addColumn<QByteArray>("request");
+
+    QTest::newRow("no target") << QByteArray("GET\r\n\r\n");
+    QTest::newRow("no version") << QByteArray("GET /\r\n\r\n");
+    QTest::newRow("relative target") << QByteArray("GET callback HTTP/1.1\r\n\r\n");
+    QTest::newRow("not http") << QByteArray("GET / FTP/1.0\r\n\r\n");
+    QTest::newRow("short version") << QByteArray("GET / HTTP/1\r\n\r\n");
+}
+
+void HttpRequestParserTest::malformed()
+{
+    QFETCH(QByteArray, request);
+
+    HttpRequestParser parser;
+    QCOMPARE(feedBytes(parser, request), HttpRequestParser::Malformed);
+    QCOMPARE(feedBytes(parser, "GET / HTTP/1.1\r\n\r\n"), HttpRequestParser::Malformed);
+}
+
+void HttpRequestParserTest::headerTooLarge()
+{
+    HttpRequestParser parser;
+    QByteArray request = "GET / HTTP/1.1\r\nX-Padding: ";
+    request.append(QByteArray(HttpRequestParser::MaxHeaderSize, 'a'));
+    QCOMPARE(feedBytes(parser, request), HttpRequestParser::TooLarge);
+    QVERIFY(parser.bufferedSize() <= HttpRequestParser::MaxHeaderSize);
+
+    // 上限正好容纳请求头时仍然可以解析
+    HttpRequestParser exact;
+    QByteArray fits = "GET / HTTP/1.1\r\nX-Padding: ";
+    fits.append(QByteArray(HttpRequestParser::MaxHeaderSize - fits.size() - 4, 'a'));
+    fits.append("\r\n\r\n");
+    QCOMPARE(fits.size(), HttpRequestParser::MaxHeaderSize);
+    QCOMPARE(feedBytes(exact, fits), HttpRequestParser::Complete);
+}
+
+void HttpRequestParserTest::keepAlive_data()
+{
+    QTest::addColumn<QByteArray>("request");
+    QTest::addColumn<bool>("keepAlive");
+
+    QTest::newRow("1.1 default") << QByteArray("GET / HTTP/1.1\r\n\r\n") << true;
+    QTest::newRow("1.1 close") << QByteArray("GET / HTTP/1.1\r\nConnection: Close\r\n\r\n") << false;
+    QTest::newRow("1.0 default") << QByteArray("GET / HTTP/1.0\r\n\r\n") << false;
+    QTest::newRow("1.0 keep-alive") << QByteArray("GET / HTTP/1.0\r\nconnection: Keep-Alive\r\n\r\n") << true;
+}
+
+void HttpRequestParserTest::keepAlive()
+{
+    QFETCH(QByteArray, request);
+    QFETCH(bool, keepAlive);
+
+    HttpRequestParser parser;
+    QCOMPARE(feedBytes(parser, request), HttpRequestParser::Complete);
+    QCOMPARE(parser.keepAlive(), keepAlive);
+}
+
+void HttpRequestParserTest::headers()
+{
+    HttpRequestParser parser;
+    QCOMPARE(feedBytes(parser, "GET / HTTP/1.1\r\n"
+                               "Host: localhost:8080\r\n"
+                               "not a header\r\n"
+                               "Authorization: \t Bearer abc \r\n"
+                               "Transfer-Encoding: chunked\r\n"
+                               "\r\n"),
+             HttpRequestParser::Complete);
+
+    QList<QPair<QByteArray, QByteArray>> headers;
+    int cursor = 0;
+    HttpRequestParser::Span name;
+    HttpRequestParser::Span value;
+    while (parser.nextHeader(&cursor, &name, &value)) {
+        headers.append(qMakePair(QByteArray(parser.view(name)), QByteArray(parser.view(value))));
+    }
+
+    QCOMPARE(headers.size(), 3);
+    QCOMPARE(headers[0].first, QByteArray("Host"));
+    QCOMPARE(headers[0].second, QByteArray("localhost:8080"));
+    QCOMPARE(headers[1].first, QByteArray("Authorization"));
+    QCOMPARE(headers[1].second, QByteArray("Bearer abc"));
+    QCOMPARE(parser.view(parser.transferEncodingHeader()), QByteArray("chunked"));
+    QVERIFY(parser.contentLengthHeader().isEmpty());
+}
+
+void HttpRequestParserTest::queryItems()
+{
+    HttpRequestParser parser;
+    QCOMPARE(feedBytes(parser, "GET /callback?code=a%2Fb%20c&state=&flag&error_description=x#frag=1 HTTP/1.1\r\n\r\n"),
+             HttpRequestParser::Complete);
+
+    QCOMPARE(parser.path(), QByteArray("/callback"));
+    QCOMPARE(parser.queryItemValue("code"), QByteArray("a/b c"));
+    QVERIFY(parser.hasQueryItem("state"));
+    QVERIFY(parser.queryItemValue("state").isEmpty());
+    QVERIFY(parser.hasQueryItem("flag"));
+    QCOMPARE(parser.queryItemValue("error_description"), QByteArray("x"));
+    QVERIFY(!parser.hasQueryItem("frag"));
+    QVERIFY(!parser.hasQueryItem("cod"));
+    QVERIFY(!parser.hasQueryItem("error"));
+}
+
+void HttpRequestParserTest::pipelinedRequests()
+{
+    HttpRequestParser parser;
+    QCOMPARE(feedBytes(parser, "POST /first HTTP/1.1\r\nContent-Length: 4\r\n\r\nabcd"
+                               "GET /second HTTP/1.1\r\n\r\n"
+                               "GET /thi"),
+             HttpRequestParser::Complete);
+    QCOMPARE(parser.path(), QByteArray("/first"));
+    QVERIFY(parser.bufferedBody().startsWith("abcd"));
+
+    // 下一个请求已经在缓冲区中，设备没有新数据时也要解析出来
+    parser.reset();
+    QCOMPARE(feedBytes(parser, QByteArray()), HttpRequestParser::Complete);
+    QCOMPARE(parser.path(), QByteArray("/second"));
+
+    parser.reset();
+    QCOMPARE(parser.bufferedSize(), 8);
+    QCOMPARE(feedBytes(parser, QByteArray()), HttpRequestParser::NeedMoreData);
+    QCOMPARE(feedBytes(parser, "rd HTTP/1.1\r\n\r\n"), HttpRequestParser::Complete);
+    QCOMPARE(parser.path(), QByteArray("/third"));
+
+    parser.reset();
+    QCOMPARE(parser.bufferedSize(), 0);
+}
+
+QTEST_GUILESS_MAIN(HttpRequestParserTest)
+
+#include "httprequestparsertest.moc"
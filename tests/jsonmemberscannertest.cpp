@@ -0,0 +1,134 @@
+// JsonMemberScanner 单元测试：只解析需要的成员、分块输入、转义的键和非法输入
+#include "jsonresponsereader.h"
+#include <QJsonArray>
+#include <QTest>
+
+namespace {
+
+const char kTokenResponse[] =
+    "{\n"
+    "  \"access_token\": \"eyJ.abc\",\n"
+    "  \"id_token_claims\": {\"nested\": [1, 2, {\"s\": \"}]\\\"{\"}], \"x\": null},\n"
+    "  \"expires_in\": 3600 ,\n"
+    "  \"scope\": \"openid profile\",\n"
+    "  \"roles\": [\"admin\", \"user\"]\n"
+    "}\n";
+
+JsonMemberScanner::Status feedAll(JsonMemberScanner &scanner, const QByteArray &data)
+{
+    return scanner.feed(data.constData(), data.size());
+}
+
+} // namespace
+
+class JsonMemberScannerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void wantedMembersOnly();
+    void byteByByte();
+    void emptyObject();
+    void escapedKeys();
+    void malformed_data();
+    void malformed();
+    void incompleteInput();
+    void tooDeep();
+};
+
+void JsonMemberScannerTest::wantedMembersOnly()
+{
+    JsonMemberScanner scanner({ "access_token", "expires_in", "roles", "missing" });
+    QCOMPARE(feedAll(scanner, kTokenResponse), JsonMemberScanner::Complete);
+    QCOMPARE(scanner.finish(), JsonMemberScanner::Complete);
+
+    QJsonObject members = scanner.members();
+    QCOMPARE(members.size(), 3);
+    QCOMPARE(members.value("access_token").toString(), QStringLiteral("eyJ.abc"));
+    QCOMPARE(members.value("expires_in").toInt(), 3600);
+    QCOMPARE(members.value("roles").toArray(), QJsonArray({ "admin", "user" }));
+    QCOMPARE(scanner.skippedMembers(), 2);
+}
+
+void JsonMemberScannerTest::byteByByte()
+{
+    JsonMemberScanner scanner({ "id_token_claims", "scope" });
+    const QByteArray data(kTokenResponse);
+    for (int i = 0; i < data.size(); ++i) {
+        JsonMemberScanner::Status status = scanner.feed(data.constData() + i, 1);
+        QVERIFY2(status == JsonMemberScanner::NeedMoreData || status == JsonMemberScanner::Complete,
+                 qPrintable(QStringLiteral("offset %1").arg(i)));
+    }
+    QCOMPARE(scanner.finish(), JsonMemberScanner::Complete);
+
+    QJsonObject members = scanner.members();
+    QCOMPARE(members.value("scope").toString(), QStringLiteral("openid profile"));
+    QJsonObject nested = members.value("id_token_claims").toObject();
+    QCOMPARE(nested.value("nested").toArray().at(2).toObject().value("s").toString(), QStringLiteral("}]\"{"));
+    QVERIFY(nested.value("x").isNull());
+    QCOMPARE(scanner.skippedMembers(), 3);
+}
+
+void JsonMemberScannerTest::emptyObject()
+{
+    JsonMemberScanner scanner({ "access_token" });
+    QCOMPARE(feedAll(scanner, " \r\n{ }\n"), JsonMemberScanner::Complete);
+    QVERIFY(scanner.members().isEmpty());
+}
+
+void JsonMemberScannerTest::escapedKeys()
+{
+    JsonMemberScanner scanner({ "access_token", "a\"b" });
+    QCOMPARE(feedAll(scanner, "{\"\\u0061ccess_token\": \"x\", \"a\\\"b\": true}"), JsonMemberScanner::Complete);
+    QCOMPARE(scanner.members().value("access_token").toString(), QStringLiteral("x"));
+    QCOMPARE(scanner.members().value("a\"b").toBool(), true);
+}
+
+void JsonMemberScannerTest::malformed_data()
+{
+    QTest::addColumn<QByteArray>("json");
+
+    QTest::newRow("array") << QByteArray("[1, 2]");
+    QTest::newRow("missing colon") << QByteArray("{\"a\" 1}");
+    QTest::newRow("unquoted key") << QByteArray("{a: 1}");
+    QTest::newRow("trailing comma") << QByteArray("{\"a\": 1,}");
+    QTest::newRow("trailing data") << QByteArray("{\"a\": 1} x");
+    QTest::newRow("bad wanted value") << QByteArray("{\"a\": tru}");
+    QTest::newRow("unbalanced") << QByteArray("{\"a\": [1]]}");
+}
+
+void JsonMemberScannerTest::malformed()
+{
+    QFETCH(QByteArray, json);
+
+    JsonMemberScanner scanner({ "a" });
+    QCOMPARE(feedAll(scanner, json), JsonMemberScanner::Malformed);
+    QCOMPARE(feedAll(scanner, "{}"), JsonMemberScanner::Malformed);
+}
+
+void JsonMemberScannerTest::incompleteInput()
+{
+    JsonMemberScanner scanner({ "a" });
+    QCOMPARE(feedAll(scanner, "{\"a\": \"unterminated"), JsonMemberScanner::NeedMoreData);
+    QCOMPARE(scanner.finish(), JsonMemberScanner::Malformed);
+}
+
+void JsonMemberScannerTest::tooDeep()
+{
+    QByteArray json = "{\"skipped\": ";
+    json.append(QByteArray(JsonMemberScanner::MaxDepth + 1, '['));
+
+    JsonMemberScanner scanner;
+    QCOMPARE(feedAll(scanner, json), JsonMemberScanner::TooDeep);
+
+    JsonMemberScanner limit;
+    QByteArray nested = "{\"skipped\": ";
+    nested.append(QByteArray(JsonMemberScanner::MaxDepth, '['));
+    nested.append(QByteArray(JsonMemberScanner::MaxDepth, ']'));
+    nested.append('}');
+    QCOMPARE(feedAll(limit, nested), JsonMemberScanner::Complete);
+}
+
+QTEST_GUILESS_MAIN(JsonMemberScannerTest)
+
+#include "jsonmemberscannertest.moc"
@@ -0,0 +1,281 @@
+// OAuth2Config 单元测试：provider 文件解析、配置层优先级、快照和单次流程覆盖
+#include "claimmapper.h"
+#include "oauth2config.h"
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+
+namespace {
+
+const char *const kEnvironmentVariables[] = {
+    "OAUTH2_SERVER_URL", "OAUTH2_CLIENT_ID", "OAUTH2_AUTH_PATH", "OAUTH2_TOKEN_PATH",
+    "OAUTH2_USERINFO_PATH", "OAUTH2_REVOCATION_PATH", "OAUTH2_REDIRECT_URI", "OAUTH2_REDIRECT_PORTS",
+    "OAUTH2_SCOPE", "OAUTH2_SCOPED_TOKEN_GRANT", "OAUTH2_TOKEN_RATE_LIMIT", "OAUTH2_TOKEN_RATE_BURST",
+    "OAUTH2_MAX_RESPONSE_SIZE",
+};
+
+const char kProvider[] = R"(<?xml version="1.0" encoding="UTF-8"?>
+<provider id="test-oauth2">
+    <name>Test</name>
+    <template>
+        <group name="auth">
+            <setting name="method">oauth2</setting>
+            <group name="oauth2">
+                <group name="user_agent">
+                    <setting name="Host">https://sso.example.com</setting>
+                    <setting name="ClientId">provider-client</setting>
+                    <setting name="Scope">profile openid</setting>
+                    <setting name="TokenRateLimit">4</setting>
+                </group>
+            </group>
+        </group>
+        <group name="claims">
+            <setting name="user_id">/account/id, sub</setting>
+            <setting name="teams[]">/org/teams</setting>
+        </group>
+        <group name="scopes">
+            <setting name="test-email">email openid</setting>
+            <setting name="test-calendar">calendar.read  openid calendar.read</setting>
+        </group>
+    </template>
+</provider>
+)";
+
+bool writeFile(const QString &path, const QByteArray &contents)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    return file.write(contents) == contents.size();
+}
+
+} // namespace
+
+class OAuth2ConfigTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void parseProviderFile();
+    void parseProviderFileErrors();
+    void defaultsWithoutProviderFile();
+    void layerPrecedence();
+    void runtimeOverrides();
+    void serviceScopes();
+    void withOverrides();
+    void claimMapperFromProvider();
+    void reloadChangedProviderFile();
+    void parseScopes_data();
+    void parseScopes();
+
+private:
+    QTemporaryDir m_dir;
+    QString m_providerFile;
+};
+
+void OAuth2ConfigTest::initTestCase()
+{
+    // 运行时覆盖和解析缓存写入测试专用目录，不影响用户配置
+    QStandardPaths::setTestModeEnabled(true);
+    QVERIFY(m_dir.isValid());
+    m_providerFile = m_dir.filePath(QStringLiteral("test-oauth2.provider"));
+}
+
+void OAuth2ConfigTest::init()
+{
+    for (const char *variable : kEnvironmentVariables) {
+        qunsetenv(variable);
+    }
+    QDir(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+         + QStringLiteral("/kde-oauth2-plugin")).removeRecursively();
+    QVERIFY(writeFile(m_providerFile, kProvider));
+}
+
+void OAuth2ConfigTest::cleanup()
+{
+    OAuth2Config config(m_providerFile);
+    config.clearRuntimeOverrides();
+}
+
+void OAuth2ConfigTest::parseProviderFile()
+{
+    QHash<QString, QString> settings;
+    QVERIFY(OAuth2Config::parseProviderFile(m_providerFile, &settings));
+
+    // user_agent 组内用设置名作键，其他组带组路径
+    QCOMPARE(settings.value("Host"), QStringLiteral("https://sso.example.com"));
+    QCOMPARE(settings.value("ClientId"), QStringLiteral("provider-client"));
+    QCOMPARE(settings.value("auth/method"), QStringLiteral("oauth2"));
+    QCOMPARE(settings.value("claims/teams[]"), QStringLiteral("/org/teams"));
+    QCOMPARE(settings.value("scopes/test-email"), QStringLiteral("email openid"));
+    QVERIFY(!settings.contains("name"));
+    QVERIFY(!settings.contains("auth/oauth2/user_agent/Host"));
+}
+
+void OAuth2ConfigTest::parseProviderFileErrors()
+{
+    QHash<QString, QString> settings;
+    QVERIFY(!OAuth2Config::parseProviderFile(m_dir.filePath("missing.provider"), &settings));
+
+    const QString broken = m_dir.filePath(QStringLiteral("broken.provider"));
+    QVERIFY(writeFile(broken, "<provider><template><group name=\"claims\"></template>"));
+    QVERIFY(!OAuth2Config::parseProviderFile(broken, &settings));
+}
+
+void OAuth2ConfigTest::defaultsWithoutProviderFile()
+{
+    OAuth2Config config(m_dir.filePath(QStringLiteral("missing.provider")));
+    config.load();
+
+    OAuth2Config::SnapshotPtr snapshot = config.snapshot();
+    QCOMPARE(snapshot->tokenPath, QStringLiteral("/connect/token"));
+    QCOMPARE(snapshot->scope, QStringLiteral("openid profile"));
+    QCOMPARE(snapshot->maxResponseSize, qint64(2097152));
+    QCOMPARE(config.source("TokenPath"), OAuth2Config::DefaultLayer);
+    QVERIFY(snapshot->claimMapper);
+    QVERIFY(snapshot->generation > 0);
+}
+
+void OAuth2ConfigTest::layerPrecedence()
+{
+    qputenv("OAUTH2_CLIENT_ID", "environment-client");
+    qputenv("OAUTH2_TOKEN_PATH", "/env/token");
+
+    OAuth2Config config(m_providerFile);
+    config.load();
+    config.setRuntimeOverride(QStringLiteral("TokenPath"), QStringLiteral("/runtime/token"));
+
+    OAuth2Config::SnapshotPtr snapshot = config.snapshot();
+    QCOMPARE(snapshot->authPath, QStringLiteral("/connect/authorize"));
+    QCOMPARE(snapshot->serverUrl, QStringLiteral("https://sso.example.com"));
+    QCOMPARE(snapshot->clientId, QStringLiteral("environment-client"));
+    QCOMPARE(snapshot->tokenPath, QStringLiteral("/runtime/token"));
+    QCOMPARE(snapshot->tokenRateLimit, 4.0);
+
+    QCOMPARE(config.source("AuthPath"), OAuth2Config::DefaultLayer);
+    QCOMPARE(config.source("Host"), OAuth2Config::ProviderLayer);
+    QCOMPARE(config.source("ClientId"), OAuth2Config::EnvironmentLayer);
+    QCOMPARE(config.source("TokenPath"), OAuth2Config::RuntimeLayer);
+    QCOMPARE(config.sources().value("ClientId").toString(), QStringLiteral("environment"));
+}
+
+void OAuth2ConfigTest::runtimeOverrides()
+{
+    OAuth2Config config(m_providerFile);
+    config.load();
+    config.setRuntimeOverride(QStringLiteral("ClientId"), QStringLiteral("runtime-client"));
+    const quint64 generation = config.snapshot()->generation;
+
+    // 运行时覆盖持久化保存，新实例加载后仍然生效
+    OAuth2Config reloaded(m_providerFile);
+    reloaded.load();
+    QCOMPARE(reloaded.value("ClientId"), QStringLiteral("runtime-client"));
+    QCOMPARE(reloaded.source("ClientId"), OAuth2Config::RuntimeLayer);
+
+    config.clearRuntimeOverrides();
+    QCOMPARE(config.value("ClientId"), QStringLiteral("provider-client"));
+    QCOMPARE(config.source("ClientId"), OAuth2Config::ProviderLayer);
+    QVERIFY(config.snapshot()->generation > generation);
+}
+
+void OAuth2ConfigTest::serviceScopes()
+{
+    OAuth2Config config(m_providerFile);
+    config.load();
+
+    OAuth2Config::SnapshotPtr snapshot = config.snapshot();
+    QCOMPARE(snapshot->serviceScopes.size(), 2);
+    QCOMPARE(snapshot->serviceScopes.value("test-email"), QStringList({ "email", "openid" }));
+    QCOMPARE(snapshot->serviceScopes.value("test-calendar"), QStringList({ "calendar.read", "openid" }));
+    QCOMPARE(snapshot->consentScope, QStringLiteral("calendar.read email openid profile"));
+}
+
+void OAuth2ConfigTest::withOverrides()
+{
+    OAuth2Config config(m_providerFile);
+    config.load();
+    OAuth2Config::SnapshotPtr base = config.snapshot();
+
+    QVERIFY(config.withOverrides(QHash<QString, QString>()) == base);
+
+    QHash<QString, QString> overrides;
+    overrides.insert(QStringLiteral("RedirectUri"), QStringLiteral("http://127.0.0.1:0/callback"));
+    overrides.insert(QStringLiteral("Scope"), QStringLiteral("openid offline_access"));
+    OAuth2Config::SnapshotPtr derived = config.withOverrides(overrides);
+
+    QVERIFY(derived != base);
+    QCOMPARE(derived->redirectUri, QStringLiteral("http://127.0.0.1:0/callback"));
+    QCOMPARE(derived->sources.value("RedirectUri"), OAuth2Config::RuntimeLayer);
+    QCOMPARE(derived->consentScope, QStringLiteral("calendar.read email offline_access openid"));
+    QCOMPARE(derived->clientId, base->clientId);
+    QCOMPARE(derived->generation, base->generation);
+
+    // 覆盖只对单次流程有效，不发布也不持久化
+    QVERIFY(config.snapshot() == base);
+    QCOMPARE(base->redirectUri, QStringLiteral("http://localhost:8080/callback"));
+    QCOMPARE(config.source("RedirectUri"), OAuth2Config::DefaultLayer);
+}
+
+void OAuth2ConfigTest::claimMapperFromProvider()
+{
+    OAuth2Config config(m_providerFile);
+    config.load();
+
+    QJsonObject claims;
+    claims["sub"] = "subject";
+    claims["account"] = QJsonObject{ { "id", "nested-id" } };
+    claims["org"] = QJsonObject{ { "teams", QJsonArray{ "red", "blue" } } };
+
+    QVariantMap mapped = config.snapshot()->claimMapper->map(claims);
+    QCOMPARE(mapped.value("user_id").toString(), QStringLiteral("nested-id"));
+    QCOMPARE(mapped.value("teams").toStringList(), QStringList({ "red", "blue" }));
+}
+
+void OAuth2ConfigTest::reloadChangedProviderFile()
+{
+    OAuth2Config config(m_providerFile);
+    config.load();
+    QCOMPARE(config.value("ClientId"), QStringLiteral("provider-client"));
+
+    // 第二次加载命中解析缓存
+    config.load();
+    QCOMPARE(config.value("ClientId"), QStringLiteral("provider-client"));
+
+    QByteArray changed(kProvider);
+    changed.replace("provider-client", "changed-provider-client");
+    QVERIFY(writeFile(m_providerFile, changed));
+    config.load();
+    QCOMPARE(config.value("ClientId"), QStringLiteral("changed-provider-client"));
+}
+
+void OAuth2ConfigTest::parseScopes_data()
+{
+    QTest::addColumn<QString>("scope");
+    QTest::addColumn<QStringList>("scopes");
+
+    QTest::newRow("empty") << QString() << QStringList();
+    QTest::newRow("sorted") << QStringLiteral("profile openid") << QStringList({ "openid", "profile" });
+    QTest::newRow("whitespace") << QStringLiteral("  openid \t\n email  ") << QStringList({ "email", "openid" });
+    QTest::newRow("duplicates") << QStringLiteral("openid email openid") << QStringList({ "email", "openid" });
+}
+
+void OAuth2ConfigTest::parseScopes()
+{
+    QFETCH(QString, scope);
+    QFETCH(QStringList, scopes);
+
+    QCOMPARE(OAuth2Config::parseScopes(scope), scopes);
+}
+
+QTEST_GUILESS_MAIN(OAuth2ConfigTest)
+
+#include "oauth2configtest.moc"